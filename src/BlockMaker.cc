@@ -23,6 +23,8 @@
  */
 #include "BlockMaker.h"
 
+#include "prometheus/Registry.h"
+
 ////////////////////////////////// BlockMaker //////////////////////////////////
 BlockMaker::BlockMaker(
     shared_ptr<BlockMakerDefinition> def,
@@ -32,7 +34,11 @@ BlockMaker::BlockMaker(
   , running_(true)
   , kafkaConsumerSolvedShare_(
         kafkaBrokers, def_->solvedShareTopic_.c_str(), 0 /* patition */)
-  , poolDB_(poolDB) {
+  , poolDB_(poolDB)
+  , solvedShareDuration_(prometheus::Registry::Default()->histogram(
+        "blkmaker_solved_share_duration_seconds",
+        "Time to make a block from a solved share and start submitting it",
+        {{"chain", def_->chainType_}})) {
 }
 
 BlockMaker::~BlockMaker() {
@@ -92,6 +98,7 @@ void BlockMaker::consumeSolvedShare(rd_kafka_message_t *rkmessage) {
   }
 
   LOG(INFO) << "received SolvedShare message, len: " << rkmessage->len;
+  prometheus::HistogramTimer timer{*solvedShareDuration_};
   processSolvedShare(rkmessage);
 }
 
@@ -28,6 +28,7 @@
 #include "Kafka.h"
 #include "MySQLConnection.h"
 #include "Stratum.h"
+#include "prometheus/Histogram.h"
 
 #include <vector>
 
@@ -66,6 +67,9 @@ protected:
   KafkaSimpleConsumer kafkaConsumerSolvedShare_;
 
   MysqlConnectInfo poolDB_; // save blocks to table.found_blocks
+  // time to make and submit a block from a solved share, exported by the
+  // default prometheus registry
+  shared_ptr<prometheus::Histogram> solvedShareDuration_;
 
   void runThreadConsumeSolvedShare();
   void consumeSolvedShare(rd_kafka_message_t *rkmessage);
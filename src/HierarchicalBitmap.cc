@@ -0,0 +1,135 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "HierarchicalBitmap.h"
+
+#include <cassert>
+
+const size_t HierarchicalBitmap::npos;
+
+HierarchicalBitmap::HierarchicalBitmap(size_t size)
+  : size_(size)
+  , count_(0) {
+  init();
+}
+
+void HierarchicalBitmap::init() {
+  levels_.clear();
+  count_ = 0;
+
+  // The padding bits after the last valid bit of each level are set, so they
+  // are never found. A word always holds a valid bit thus it is never full
+  // because of the padding alone.
+  size_t bits = size_;
+  do {
+    size_t words = (bits + kWordMask) >> kWordShift;
+    levels_.emplace_back(words > 0 ? words : 1, 0);
+    auto &level = levels_.back();
+    if ((bits & kWordMask) != 0 || bits == 0) {
+      level.back() = kFullWord << (bits & kWordMask);
+    }
+    bits = words;
+  } while (bits > 1);
+}
+
+bool HierarchicalBitmap::set(size_t pos) {
+  assert(pos < size_);
+  if (test(pos)) {
+    return false;
+  }
+  ++count_;
+
+  for (auto &level : levels_) {
+    uint64_t &word = level[pos >> kWordShift];
+    word |= 1ull << (pos & kWordMask);
+    if (word != kFullWord) {
+      break;
+    }
+    pos >>= kWordShift;
+  }
+  return true;
+}
+
+bool HierarchicalBitmap::reset(size_t pos) {
+  assert(pos < size_);
+  if (!test(pos)) {
+    return false;
+  }
+  --count_;
+
+  for (auto &level : levels_) {
+    uint64_t &word = level[pos >> kWordShift];
+    bool wasFull = word == kFullWord;
+    word &= ~(1ull << (pos & kWordMask));
+    if (!wasFull) {
+      break;
+    }
+    pos >>= kWordShift;
+  }
+  return true;
+}
+
+void HierarchicalBitmap::reset() {
+  init();
+}
+
+size_t HierarchicalBitmap::findClearFrom(size_t pos) const {
+  if (pos >= size_) {
+    return npos;
+  }
+
+  // Climb up until a word has a clear bit after the position
+  size_t depth = 0;
+  for (;;) {
+    const auto &level = levels_[depth];
+    size_t index = pos >> kWordShift;
+    if (index >= level.size()) {
+      return npos;
+    }
+    uint64_t clear = ~level[index] & (kFullWord << (pos & kWordMask));
+    if (clear != 0) {
+      pos = (index << kWordShift) | __builtin_ctzll(clear);
+      break;
+    }
+    if (++depth == levels_.size()) {
+      return npos;
+    }
+    // the words of the level below that follow the one just scanned
+    pos = index + 1;
+  }
+
+  // The word pointed by a clear bit is not full, go down to level 0
+  while (depth > 0) {
+    --depth;
+    pos = (pos << kWordShift) | __builtin_ctzll(~levels_[depth][pos]);
+  }
+  return pos;
+}
+
+size_t HierarchicalBitmap::findClear(size_t pos) const {
+  size_t found = findClearFrom(pos);
+  if (found == npos && pos > 0) {
+    found = findClearFrom(0);
+  }
+  return found;
+}
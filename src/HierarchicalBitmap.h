@@ -0,0 +1,74 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/////////////////////////////  HierarchicalBitmap  ////////////////////////////
+// Fixed size bitmap able to find a clear bit in O(log64 n) word operations.
+//
+// Level 0 holds the bits themselves, a bit of level k + 1 is set when the
+// corresponding word of level k is full. A search scans the words with count
+// trailing zeros and only climbs up when the rest of a word is full, then
+// goes straight down to a clear bit. 2^24 bits take 4 levels.
+//
+// Not thread-safe.
+class HierarchicalBitmap {
+public:
+  static const size_t npos = SIZE_MAX;
+
+  explicit HierarchicalBitmap(size_t size);
+
+  size_t size() const { return size_; }
+  // number of set bits
+  size_t count() const { return count_; }
+  bool full() const { return count_ == size_; }
+
+  bool test(size_t pos) const {
+    return (levels_[0][pos >> kWordShift] >> (pos & kWordMask)) & 1;
+  }
+  // Return false if the bit was already in the requested state
+  bool set(size_t pos);
+  bool reset(size_t pos);
+  void reset();
+
+  // The first clear bit at or after pos, npos if there is none
+  size_t findClearFrom(size_t pos) const;
+  // Same as findClearFrom() but wraps around to the beginning
+  size_t findClear(size_t pos) const;
+
+private:
+  static const size_t kWordShift = 6;
+  static const size_t kWordMask = 63;
+  static const uint64_t kFullWord = ~0ull;
+
+  void init();
+
+  size_t size_;
+  size_t count_;
+  // levels_[0] are the bits, the last level is a single word
+  std::vector<std::vector<uint64_t>> levels_;
+};
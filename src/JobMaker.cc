@@ -23,6 +23,7 @@
  */
 #include "JobMaker.h"
 #include "Utils.h"
+#include "prometheus/Registry.h"
 
 ///////////////////////////////////  JobMaker  /////////////////////////////////
 JobMaker::JobMaker(
@@ -36,7 +37,11 @@ JobMaker::JobMaker(
   , kafkaProducer_(
         kafkaBrokers.c_str(),
         handler->def()->jobTopic_.c_str(),
-        RD_KAFKA_PARTITION_UA) {
+        RD_KAFKA_PARTITION_UA)
+  , makeJobDuration_(prometheus::Registry::Default()->histogram(
+        "jobmaker_job_make_duration_seconds",
+        "Time to make a stratum job and produce it to kafka",
+        {{"topic", handler->def()->jobTopic_}})) {
 }
 
 JobMaker::~JobMaker() {
@@ -133,6 +138,7 @@ bool JobMaker::consumeKafkaMsg(
 }
 
 void JobMaker::produceStratumJob() {
+  prometheus::HistogramTimer timer{*makeJobDuration_};
   const string jobMsg = handler_->makeStratumJobMsg();
 
   if (!jobMsg.empty()) {
@@ -29,6 +29,7 @@
 
 #include "Zookeeper.h"
 #include "Utils.h"
+#include "prometheus/Histogram.h"
 
 #include <deque>
 #include <vector>
@@ -89,6 +90,8 @@ struct GbtJobMakerDefinition : public JobMakerDefinition {
   uint32_t maxJobDelay_;
   uint32_t gbtLifeTime_;
   uint32_t emptyGbtLifeTime_;
+  // extra threads decoding the transactions without txid of a template
+  uint32_t gbtDecodeThreads_;
 
   uint32_t auxmergedMiningNotifyPolicy_;
   uint32_t rskmergedMiningNotifyPolicy_;
@@ -159,6 +162,9 @@ protected:
   vector<shared_ptr<thread>> kafkaConsumerWorkers_;
 
   time_t lastJobTime_;
+  // time to make and produce a job, exported by the default prometheus
+  // registry
+  shared_ptr<prometheus::Histogram> makeJobDuration_;
 
 protected:
   bool consumeKafkaMsg(
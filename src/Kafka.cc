@@ -389,12 +389,16 @@ KafkaHighLevelConsumer::KafkaHighLevelConsumer(
   , partition_(partition)
   , conf_(rd_kafka_conf_new())
   , consumer_(nullptr)
+  , queue_(nullptr)
   , topics_(nullptr) {
   rd_kafka_conf_set_log_cb(conf_, kafkaLogger); // set logger
   LOG(INFO) << "consumer librdkafka version: " << rd_kafka_version_str();
 }
 
 KafkaHighLevelConsumer::~KafkaHighLevelConsumer() {
+  if (queue_ != nullptr) {
+    rd_kafka_queue_destroy(queue_);
+  }
   if (consumer_ != nullptr) {
     /* Stop consuming */
     rd_kafka_resp_err_t err = rd_kafka_consumer_close(consumer_);
@@ -503,6 +507,7 @@ bool KafkaHighLevelConsumer::setup() {
 
   /* Redirect rd_kafka_poll() to consumer_poll() */
   rd_kafka_poll_set_consumer(consumer_);
+  queue_ = rd_kafka_queue_get_consumer(consumer_);
 
   /* Create a new list/vector Topic+Partition container */
   int size = 1; // only 1 container
@@ -524,6 +529,15 @@ rd_kafka_message_t *KafkaHighLevelConsumer::consumer(int timeout_ms) {
   return rd_kafka_consumer_poll(consumer_, timeout_ms);
 }
 
+//
+// the high level consumer has no rd_kafka_consume_batch(), whose topic and
+// partition are fixed, batches are read from the consumer queue instead
+//
+ssize_t KafkaHighLevelConsumer::consumeBatch(
+    int timeout_ms, rd_kafka_message_t **messages, size_t size) {
+  return rd_kafka_consume_batch_queue(queue_, timeout_ms, messages, size);
+}
+
 ///////////////////////////////// KafkaProducer
 ///////////////////////////////////
 KafkaProducer::KafkaProducer(
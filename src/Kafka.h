@@ -150,6 +150,7 @@ class KafkaHighLevelConsumer {
 
   rd_kafka_conf_t *conf_;
   rd_kafka_t *consumer_;
+  rd_kafka_queue_t *queue_; // the consumer queue, for batch consuming
   rd_kafka_topic_partition_list_t *topics_;
 
 public:
@@ -167,6 +168,13 @@ public:
   // don't forget to call rd_kafka_message_destroy() after consumer()
   //
   rd_kafka_message_t *consumer(int timeout_ms);
+
+  //
+  // consume up to `size` messages into `messages`, returns the number of
+  // messages or -1 on error. Destroy every returned message.
+  //
+  ssize_t
+  consumeBatch(int timeout_ms, rd_kafka_message_t **messages, size_t size);
 };
 
 ///////////////////////////////// KafkaProducer ////////////////////////////////
@@ -21,6 +21,8 @@
 #include <mysql.h>
 #include <glog/logging.h>
 
+#include <cstring>
+
 MySQLResult::MySQLResult()
   : result(nullptr) {
 }
@@ -272,6 +274,124 @@ bool multiInsert(
   return true;
 }
 
+MySQLStatement::MySQLStatement(MySQLConnection &db)
+  : db_(db)
+  , stmt_(nullptr)
+  , bound_(0) {
+}
+
+MySQLStatement::~MySQLStatement() {
+  close();
+}
+
+void MySQLStatement::close() {
+  if (stmt_) {
+    mysql_stmt_close(stmt_);
+    stmt_ = nullptr;
+  }
+  params_.clear();
+  bound_ = 0;
+}
+
+bool MySQLStatement::prepare(const string &sql) {
+  close();
+
+  if (!db_.conn && !db_.open()) {
+    return false;
+  }
+  stmt_ = mysql_stmt_init(db_.conn);
+  if (!stmt_) {
+    LOG(ERROR) << "init statement failure, error_info: "
+               << mysql_error(db_.conn);
+    return false;
+  }
+  if (mysql_stmt_prepare(stmt_, sql.data(), sql.size()) != 0) {
+    LOG(ERROR) << "prepare statement failure, error_no: "
+               << mysql_stmt_errno(stmt_)
+               << ", error_info: " << mysql_stmt_error(stmt_)
+               << " , sql: " << sql;
+    close();
+    return false;
+  }
+
+  params_.resize(mysql_stmt_param_count(stmt_));
+  return true;
+}
+
+MySQLStatement::Param &MySQLStatement::nextParam() {
+  // the extra parameters are checked by execute()
+  if (bound_ >= params_.size()) {
+    params_.resize(bound_ + 1);
+  }
+  return params_[bound_++];
+}
+
+void MySQLStatement::bindInt(int64_t value) {
+  Param &param = nextParam();
+  param.isString_ = false;
+  param.isUnsigned_ = false;
+  param.integer_ = (uint64_t)value;
+}
+
+void MySQLStatement::bindUint(uint64_t value) {
+  Param &param = nextParam();
+  param.isString_ = false;
+  param.isUnsigned_ = true;
+  param.integer_ = value;
+}
+
+void MySQLStatement::bindString(const string &value) {
+  Param &param = nextParam();
+  param.isString_ = true;
+  param.str_.assign(value);
+  param.length_ = value.size();
+}
+
+bool MySQLStatement::execute() {
+  const size_t bound = bound_;
+  bound_ = 0;
+
+  if (!stmt_) {
+    LOG(ERROR) << "execute statement failure: not prepared";
+    return false;
+  }
+  if (bound != mysql_stmt_param_count(stmt_)) {
+    LOG(ERROR) << "execute statement failure: " << bound
+               << " parameters bound, expected "
+               << mysql_stmt_param_count(stmt_);
+    return false;
+  }
+
+  vector<MYSQL_BIND> binds(bound);
+  memset(binds.data(), 0, sizeof(MYSQL_BIND) * bound);
+  for (size_t i = 0; i < bound; i++) {
+    Param &param = params_[i];
+    if (param.isString_) {
+      binds[i].buffer_type = MYSQL_TYPE_STRING;
+      binds[i].buffer = (void *)param.str_.data();
+      binds[i].buffer_length = param.length_;
+      binds[i].length = &param.length_;
+    } else {
+      binds[i].buffer_type = MYSQL_TYPE_LONGLONG;
+      binds[i].buffer = &param.integer_;
+      binds[i].is_unsigned = param.isUnsigned_;
+    }
+  }
+
+  if (mysql_stmt_bind_param(stmt_, binds.data()) != 0 ||
+      mysql_stmt_execute(stmt_) != 0) {
+    LOG(ERROR) << "execute statement failure, error_no: "
+               << mysql_stmt_errno(stmt_)
+               << ", error_info: " << mysql_stmt_error(stmt_);
+    return false;
+  }
+  return true;
+}
+
+uint64_t MySQLStatement::affectedRows() {
+  return stmt_ ? mysql_stmt_affected_rows(stmt_) : 0;
+}
+
 MySQLExecQueue::MySQLExecQueue(const MysqlConnectInfo &dbInfo)
   : dbInfo_(dbInfo) {
   run();
@@ -40,6 +40,8 @@ extern "C" struct st_mysql;
 typedef struct st_mysql MYSQL;
 extern "C" struct st_mysql_res;
 typedef struct st_mysql_res MYSQL_RES;
+extern "C" struct st_mysql_stmt;
+typedef struct st_mysql_stmt MYSQL_STMT;
 
 /**
  * Simple wrapper for MYSQL_RES
@@ -110,6 +112,8 @@ protected:
 
   struct st_mysql *conn;
 
+  friend class MySQLStatement;
+
 public:
   MySQLConnection(const MysqlConnectInfo &connectInfo);
   ~MySQLConnection();
@@ -142,6 +146,46 @@ bool multiInsert(
     const string &fields,
     const vector<string> &values);
 
+/**
+ * Server side prepared statement of a connection
+ * the parameters are bound in order before every execution, their buffers are
+ * reused by the next executions
+ * it must not outlive the connection, prepare it again after a reconnection
+ */
+class MySQLStatement {
+protected:
+  struct Param {
+    bool isString_ = false;
+    bool isUnsigned_ = false;
+    uint64_t integer_ = 0;
+    string str_;
+    unsigned long length_ = 0;
+  };
+
+  MySQLConnection &db_;
+  struct st_mysql_stmt *stmt_;
+  vector<Param> params_;
+  size_t bound_;
+
+  Param &nextParam();
+
+public:
+  MySQLStatement(MySQLConnection &db);
+  ~MySQLStatement();
+
+  bool prepare(const string &sql);
+  void close();
+  size_t paramCount() const { return params_.size(); }
+
+  void bindInt(int64_t value);
+  void bindUint(uint64_t value);
+  void bindString(const string &value);
+
+  // executes with all the parameters bound since the last execution
+  bool execute();
+  uint64_t affectedRows();
+};
+
 /**
  * Execute SQL statements in order
  */
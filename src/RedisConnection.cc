@@ -282,3 +282,68 @@ RedisResult RedisConnection::execute() {
   redisGetReply(conn_, &reply);
   return RedisResult((redisReply *)reply);
 }
+
+void RedisConnection::prepare(const RedisCommandBuffer &buffer) {
+  redisAppendFormattedCommand(conn_, buffer.data().data(), buffer.size());
+}
+
+/////////////////////////////// RedisCommandBuffer /////////////////////////////
+
+// writes the digits of value before end, returns the first digit
+static char *FormatDecimal(char *end, uint64_t value) {
+  do {
+    *--end = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  return end;
+}
+
+RedisCommandBuffer::RedisCommandBuffer(size_t reserve) {
+  buffer_.reserve(reserve);
+}
+
+void RedisCommandBuffer::appendSize(char type, size_t size) {
+  char str[24];
+  char *end = str + sizeof(str);
+  char *p = end - 2;
+  p[0] = '\r';
+  p[1] = '\n';
+  p = FormatDecimal(p, size);
+  *--p = type;
+  buffer_.append(p, end - p);
+}
+
+void RedisCommandBuffer::command(size_t argc) {
+  appendSize('*', argc);
+  commands_++;
+}
+
+void RedisCommandBuffer::arg(const char *data, size_t size) {
+  appendSize('$', size);
+  buffer_.append(data, size);
+  buffer_.append("\r\n", 2);
+}
+
+void RedisCommandBuffer::argInteger(bool negative, uint64_t absValue) {
+  // the bulk string "$<size>\r\n<digits>\r\n" is written backwards
+  char str[48];
+  char *end = str + sizeof(str);
+  char *p = end - 2;
+  p[0] = '\r';
+  p[1] = '\n';
+  p = FormatDecimal(p, absValue);
+  if (negative) {
+    *--p = '-';
+  }
+  size_t size = end - p - 2;
+  *--p = '\n';
+  *--p = '\r';
+  p = FormatDecimal(p, size);
+  *--p = '$';
+  buffer_.append(p, end - p);
+}
+
+void RedisCommandBuffer::clear() {
+  buffer_.clear();
+  commands_ = 0;
+}
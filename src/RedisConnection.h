@@ -24,7 +24,9 @@
 #ifndef REDIS_CONNECTION_H_
 #define REDIS_CONNECTION_H_
 
+#include <cstring>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <hiredis/hiredis.h>
 
@@ -88,6 +90,44 @@ public:
   }
 };
 
+/////////////////////////////// RedisCommandBuffer /////////////////////////////
+// Commands encoded in the redis protocol (RESP) into one buffer, which is
+// reused between the batches. The integers are formatted in place, no string
+// is allocated for an argument.
+class RedisCommandBuffer {
+  string buffer_;
+  size_t commands_ = 0;
+
+  void appendSize(char type, size_t size);
+  void argInteger(bool negative, uint64_t absValue);
+
+public:
+  RedisCommandBuffer(size_t reserve = 4 * 1024 * 1024);
+
+  // starts a command of argc arguments, the name of the command included
+  void command(size_t argc);
+
+  void arg(const char *data, size_t size);
+  void arg(const char *str) { arg(str, strlen(str)); }
+  void arg(const string &str) { arg(str.data(), str.size()); }
+  template <typename T>
+  typename std::enable_if<
+      std::is_integral<T>::value && std::is_signed<T>::value>::type
+  arg(T value) {
+    argInteger(value < 0, value < 0 ? 0 - (uint64_t)value : (uint64_t)value);
+  }
+  template <typename T>
+  typename std::enable_if<std::is_unsigned<T>::value>::type arg(T value) {
+    argInteger(false, value);
+  }
+
+  const string &data() const { return buffer_; }
+  size_t size() const { return buffer_.size(); }
+  size_t commands() const { return commands_; }
+  bool empty() const { return commands_ == 0; }
+  void clear();
+};
+
 /////////////////////////////// RedisConnection ///////////////////////////////
 class RedisConnection {
 protected:
@@ -113,6 +153,10 @@ public:
   void prepare(initializer_list<const string> args);
   void prepare(const vector<string> &args);
   RedisResult execute();
+
+  // append the commands of the buffer to the pipeline, execute() reads their
+  // replies
+  void prepare(const RedisCommandBuffer &buffer);
 };
 
 #endif
@@ -0,0 +1,286 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "RpcClient.h"
+
+#include "Utils.h"
+
+#include <glog/logging.h>
+
+#include <chrono>
+
+namespace {
+
+size_t WriteResponse(void *contents, size_t size, size_t nmemb, void *userp) {
+  size_t realsize = size * nmemb;
+  static_cast<std::string *>(userp)->append((const char *)contents, realsize);
+  return realsize;
+}
+
+} // namespace
+
+RpcClient::RpcClient(size_t threads, size_t queueCapacity)
+  : queueCapacity_(queueCapacity)
+  , stop_(false) {
+  for (size_t i = 0; i < threads; i++) {
+    executor_.emplace_back([this]() { runExecutor(); });
+  }
+}
+
+RpcClient::~RpcClient() {
+  {
+    std::lock_guard<std::mutex> l{tasksLock_};
+    stop_ = true;
+  }
+  tasksNotEmpty_.notify_all();
+  tasksNotFull_.notify_all();
+  keepConnectedStop_.notify_all();
+
+  if (keepConnectedThread_.joinable()) {
+    keepConnectedThread_.join();
+  }
+  // the queued calls are still made, a found block must be submitted
+  for (auto &thread : executor_) {
+    thread.join();
+  }
+
+  for (auto &itr : idleHandles_) {
+    for (CURL *curl : itr.second) {
+      curl_easy_cleanup(curl);
+    }
+  }
+}
+
+CURL *RpcClient::acquire(const std::string &url) {
+  {
+    std::lock_guard<std::mutex> l{handlesLock_};
+    auto &handles = idleHandles_[url];
+    if (!handles.empty()) {
+      CURL *curl = handles.back();
+      handles.pop_back();
+      return curl;
+    }
+  }
+  return curl_easy_init();
+}
+
+void RpcClient::release(const std::string &url, CURL *curl, bool reusable) {
+  if (!reusable) {
+    curl_easy_cleanup(curl);
+    return;
+  }
+  std::lock_guard<std::mutex> l{handlesLock_};
+  idleHandles_[url].push_back(curl);
+}
+
+size_t RpcClient::idleConnections(const std::string &url) {
+  std::lock_guard<std::mutex> l{handlesLock_};
+  auto itr = idleHandles_.find(url);
+  return itr == idleHandles_.end() ? 0 : itr->second.size();
+}
+
+bool RpcClient::perform(
+    CURL *curl,
+    const RpcNode &node,
+    const std::string &request,
+    std::string &response,
+    long timeoutMs) {
+  // the connection, the DNS cache and the TLS session survive the reset
+  curl_easy_reset(curl);
+
+  struct curl_slist *headers = nullptr;
+  headers = curl_slist_append(headers, "Content-Type: application/json");
+  // RSK doesn't support 'Expect: 100-Continue' in 'HTTP/1.1'.
+  headers = curl_slist_append(headers, "Expect:");
+
+  response.clear();
+  curl_easy_setopt(curl, CURLOPT_URL, node.url_.c_str());
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)request.size());
+  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.data());
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  if (!node.userpwd_.empty()) {
+    curl_easy_setopt(curl, CURLOPT_USERPWD, node.userpwd_.c_str());
+  }
+  curl_easy_setopt(curl, CURLOPT_USE_SSL, CURLUSESSL_TRY);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, getSslVerifyPeer() ? 1L : 0L);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, "curl");
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+  // the executor threads must not get signals for the timeouts
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteResponse);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&response);
+
+  CURLcode status = curl_easy_perform(curl);
+  curl_slist_free_all(headers);
+  if (status != CURLE_OK) {
+    LOG(ERROR) << "unable to request data from: " << node.url_
+               << ", error: " << curl_easy_strerror(status);
+    return false;
+  }
+
+  long code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+  // status code 200 - 208 indicates ok
+  if (code < 200 || code > 208) {
+    LOG(ERROR) << "server responded with code: " << code;
+    return false;
+  }
+  return true;
+}
+
+bool RpcClient::call(
+    const RpcNode &node,
+    const std::string &request,
+    std::string &response,
+    long timeoutMs) {
+  CURL *curl = acquire(node.url_);
+  if (curl == nullptr) {
+    return false;
+  }
+  bool success = perform(curl, node, request, response, timeoutMs);
+  release(node.url_, curl, success);
+  return success;
+}
+
+void RpcClient::dispatch(std::function<void()> task) {
+  {
+    std::unique_lock<std::mutex> l{tasksLock_};
+    tasksNotFull_.wait(l, [this]() {
+      return stop_ || queueCapacity_ == 0 || tasks_.size() < queueCapacity_;
+    });
+    if (stop_) {
+      return;
+    }
+    tasks_.push_back(std::move(task));
+  }
+  tasksNotEmpty_.notify_one();
+}
+
+void RpcClient::runExecutor() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> l{tasksLock_};
+      tasksNotEmpty_.wait(l, [this]() { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return; // stopped
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    tasksNotFull_.notify_one();
+    task();
+  }
+}
+
+void RpcClient::fanOut(
+    const std::vector<RpcNode> &nodes,
+    std::shared_ptr<const std::string> request,
+    size_t tries,
+    prometheus::Histogram *callDuration,
+    prometheus::Histogram *firstSuccessDuration,
+    Callback callback) {
+  struct FanOut {
+    std::chrono::steady_clock::time_point start_;
+    std::atomic<bool> succeeded_;
+  };
+  auto fanOut = std::make_shared<FanOut>();
+  fanOut->start_ = std::chrono::steady_clock::now();
+  fanOut->succeeded_ = false;
+
+  for (size_t i = 0; i < nodes.size(); i++) {
+    dispatch([this,
+              i,
+              node = nodes[i],
+              request,
+              tries,
+              callDuration,
+              firstSuccessDuration,
+              callback,
+              fanOut]() {
+      std::string response;
+      bool success = false;
+      for (size_t t = 0; t < tries && !success; t++) {
+        if (callDuration != nullptr) {
+          prometheus::HistogramTimer timer{*callDuration};
+          success = call(node, *request, response);
+        } else {
+          success = call(node, *request, response);
+        }
+      }
+
+      if (success && !fanOut->succeeded_.exchange(true) &&
+          firstSuccessDuration != nullptr) {
+        firstSuccessDuration->observe(
+            std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - fanOut->start_)
+                .count());
+      }
+      callback(i, success, response);
+    });
+  }
+}
+
+bool RpcClient::preconnect(
+    const RpcNode &node, const std::string &request, size_t connections) {
+  // the handles are all taken before the calls, so every call uses its own
+  // connection
+  std::vector<CURL *> handles;
+  for (size_t i = 0; i < connections; i++) {
+    CURL *curl = acquire(node.url_);
+    if (curl != nullptr) {
+      handles.push_back(curl);
+    }
+  }
+
+  bool success = handles.size() == connections;
+  std::string response;
+  for (CURL *curl : handles) {
+    bool res = perform(curl, node, request, response, kTimeoutMs);
+    release(node.url_, curl, res);
+    success = success && res;
+  }
+  return success;
+}
+
+void RpcClient::keepConnected(
+    const std::vector<RpcNode> &nodes,
+    const std::string &request,
+    size_t connections,
+    uint32_t intervalSeconds) {
+  keepConnectedThread_ = std::thread(
+      [this, nodes, request, connections, intervalSeconds]() {
+        std::unique_lock<std::mutex> l{tasksLock_};
+        while (!keepConnectedStop_.wait_for(
+            l, std::chrono::seconds(intervalSeconds), [this]() {
+              return stop_;
+            })) {
+          l.unlock();
+          for (const auto &node : nodes) {
+            preconnect(node, request, connections);
+          }
+          l.lock();
+        }
+      });
+}
@@ -0,0 +1,135 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#pragma once
+
+#include "prometheus/Histogram.h"
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct RpcNode {
+  std::string url_;
+  std::string userpwd_;
+};
+
+//
+// JSON-RPC calls to the blockchain nodes over kept alive connections. The
+// curl handles of a node are pooled, a handle keeps its connection open after
+// a call so the next call to the node skips the TCP and TLS handshakes.
+//
+// The non blocking calls run on a bounded executor instead of a thread each.
+// Every executor thread runs one call at a time, so a node that does not
+// answer only holds its own threads.
+//
+class RpcClient {
+public:
+  static const long kTimeoutMs = 5000;
+
+  // node is the index of the node in the fan-out
+  using Callback =
+      std::function<void(size_t node, bool success, const std::string &)>;
+
+  // threads run the non blocking calls, at most queueCapacity calls wait for
+  // a thread, dispatching more waits for a free slot. With a queueCapacity of
+  // 0 the queue is unbounded and dispatching never waits.
+  RpcClient(size_t threads, size_t queueCapacity);
+  ~RpcClient();
+  RpcClient(const RpcClient &) = delete;
+  RpcClient &operator=(const RpcClient &) = delete;
+
+  // Same as blockchainNodeRpcCall() on a pooled connection
+  bool call(
+      const RpcNode &node,
+      const std::string &request,
+      std::string &response,
+      long timeoutMs = kTimeoutMs);
+
+  // Runs task on the executor
+  void dispatch(std::function<void()> task);
+
+  // Sends the request to all the nodes at once on the executor, every node is
+  // tried up to tries times. callback is called once per node with its last
+  // response, from the executor. callDuration observes every call and
+  // firstSuccessDuration the time until the first node succeeded, both may be
+  // nullptr.
+  void fanOut(
+      const std::vector<RpcNode> &nodes,
+      std::shared_ptr<const std::string> request,
+      size_t tries,
+      prometheus::Histogram *callDuration,
+      prometheus::Histogram *firstSuccessDuration,
+      Callback callback);
+
+  // Opens connections connections to the node with a cheap request, so the
+  // next calls do not connect. Returns false if a call failed.
+  bool preconnect(
+      const RpcNode &node, const std::string &request, size_t connections);
+
+  // Calls preconnect() for every node every intervalSeconds, the nodes close
+  // the connections idle for too long (30s for bitcoind)
+  void keepConnected(
+      const std::vector<RpcNode> &nodes,
+      const std::string &request,
+      size_t connections,
+      uint32_t intervalSeconds);
+
+  size_t idleConnections(const std::string &url);
+
+private:
+  CURL *acquire(const std::string &url);
+  // a handle that failed is not reused, its connection may be broken
+  void release(const std::string &url, CURL *curl, bool reusable);
+  bool perform(
+      CURL *curl,
+      const RpcNode &node,
+      const std::string &request,
+      std::string &response,
+      long timeoutMs);
+  void runExecutor();
+
+  std::mutex handlesLock_;
+  std::map<std::string, std::vector<CURL *>> idleHandles_;
+
+  const size_t queueCapacity_;
+  std::mutex tasksLock_;
+  std::condition_variable tasksNotEmpty_;
+  std::condition_variable tasksNotFull_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> executor_;
+  bool stop_;
+
+  std::thread keepConnectedThread_;
+  std::condition_variable keepConnectedStop_;
+};
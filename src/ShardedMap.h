@@ -0,0 +1,158 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+///////////////////////////////  ShardedMap  /////////////////////////////////
+// Hash map partitioned into shards, each guarded by its own reader-writer
+// lock. Lookups and inserts only lock the shard of the key, and a walk over
+// the map locks one shard at a time, so a long iteration (a flush, an expiry
+// sweep) only delays the writers of the shard it is visiting.
+//
+// Values are returned by copy, they are expected to be cheap to copy like
+// shared_ptr or integers.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedMap {
+public:
+  explicit ShardedMap(size_t shards = 64)
+    : shardsSize_(shards > 0 ? shards : 1)
+    , shards_(new Shard[shardsSize_])
+    , size_(0) {}
+
+  ShardedMap(const ShardedMap &) = delete;
+  ShardedMap &operator=(const ShardedMap &) = delete;
+
+  size_t shards() const { return shardsSize_; }
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+  // The hash is mixed before picking the shard, the maps in the shards use
+  // its low bits too
+  size_t shardIndex(const Key &key) const {
+    uint64_t h = Hash()(key) * 0x9E3779B97F4A7C15ull;
+    return (h >> 32) % shardsSize_;
+  }
+
+  bool find(const Key &key, Value &value) const {
+    const Shard &shard = shardOf(key);
+    std::shared_lock<std::shared_timed_mutex> l(shard.lock_);
+    auto itr = shard.map_.find(key);
+    if (itr == shard.map_.end()) {
+      return false;
+    }
+    value = itr->second;
+    return true;
+  }
+
+  // Inserts the value if the key is missing. current receives the value in
+  // the map, returns true if it is the inserted one.
+  bool insert(const Key &key, const Value &value, Value &current) {
+    Shard &shard = shardOf(key);
+    std::unique_lock<std::shared_timed_mutex> l(shard.lock_);
+    auto result = shard.map_.emplace(key, value);
+    current = result.first->second;
+    if (result.second) {
+      size_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return result.second;
+  }
+
+  // Calls fn(Value &) under the lock of the shard, the value is default
+  // constructed if the key is missing. The entry is erased if fn returns
+  // false.
+  template <typename Fn>
+  void update(const Key &key, Fn fn) {
+    Shard &shard = shardOf(key);
+    std::unique_lock<std::shared_timed_mutex> l(shard.lock_);
+    auto result = shard.map_.emplace(key, Value());
+    if (result.second) {
+      size_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!fn(result.first->second)) {
+      shard.map_.erase(result.first);
+      size_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Calls fn(const Key &, const Value &) for every entry of a shard under its
+  // read lock
+  template <typename Fn>
+  void forEach(size_t shardIndex, Fn fn) const {
+    const Shard &shard = shards_[shardIndex];
+    std::shared_lock<std::shared_timed_mutex> l(shard.lock_);
+    for (const auto &itr : shard.map_) {
+      fn(itr.first, itr.second);
+    }
+  }
+
+  template <typename Fn>
+  void forEach(Fn fn) const {
+    for (size_t i = 0; i < shardsSize_; i++) {
+      forEach(i, fn);
+    }
+  }
+
+  // Erases the entries of a shard for which pred(const Key &, const Value &)
+  // returns true, returns the number of erased entries
+  template <typename Pred>
+  size_t eraseIf(size_t shardIndex, Pred pred) {
+    Shard &shard = shards_[shardIndex];
+    std::unique_lock<std::shared_timed_mutex> l(shard.lock_);
+    size_t erased = 0;
+    for (auto itr = shard.map_.begin(); itr != shard.map_.end();) {
+      if (pred(itr->first, itr->second)) {
+        itr = shard.map_.erase(itr);
+        erased++;
+      } else {
+        itr++;
+      }
+    }
+    size_.fetch_sub(erased, std::memory_order_relaxed);
+    return erased;
+  }
+
+private:
+  struct Shard {
+    mutable std::shared_timed_mutex lock_;
+    std::unordered_map<Key, Value, Hash> map_;
+  };
+
+  Shard &shardOf(const Key &key) { return shards_[shardIndex(key)]; }
+  const Shard &shardOf(const Key &key) const {
+    return shards_[shardIndex(key)];
+  }
+
+  const size_t shardsSize_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<size_t> size_;
+};
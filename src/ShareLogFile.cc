@@ -0,0 +1,590 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "ShareLogFile.h"
+
+#include <glog/logging.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t kFileMagic = 0x4c535042; // "BPSL"
+static const uint32_t kFileVersion = 2;
+static const uint32_t kBlockMagic = 0x4b424c53; // "SLBK"
+static const uint32_t kIndexMagic = 0x58494c53; // "SLIX"
+
+static bool ReadAt(int fd, void *data, size_t size, uint64_t offset) {
+  char *p = (char *)data;
+  while (size > 0) {
+    ssize_t n = pread(fd, p, size, offset);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+static uint64_t FileSize(int fd) {
+  struct stat buf;
+  if (fstat(fd, &buf) != 0) {
+    return 0;
+  }
+  return buf.st_size;
+}
+
+static bool ReadVarint(const uint8_t *&pos, const uint8_t *end, uint64_t &v) {
+  v = 0;
+  for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+    const uint8_t byte = *pos++;
+    v |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PeekShareLogFields(
+    const uint8_t *data,
+    size_t size,
+    uint32_t timestampField,
+    uint32_t userIdField,
+    int64_t &timestamp,
+    int32_t &userId) {
+  const uint8_t *pos = data;
+  const uint8_t *end = data + size;
+  bool hasTimestamp = false;
+  userId = 0;
+
+  while (pos < end) {
+    uint64_t key = 0, v = 0;
+    if (!ReadVarint(pos, end, key)) {
+      return false;
+    }
+    const uint64_t field = key >> 3;
+    switch (key & 0x7) {
+    case 0: // varint
+      if (!ReadVarint(pos, end, v)) {
+        return false;
+      }
+      // zigzag, both fields are sint
+      if (field == timestampField) {
+        timestamp = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        hasTimestamp = true;
+      } else if (field == userIdField) {
+        userId = (int32_t)((uint32_t)(v >> 1) ^ -(uint32_t)(v & 1));
+      }
+      break;
+    case 1: // 64-bit
+      v = 8;
+      break;
+    case 2: // length-delimited
+      if (!ReadVarint(pos, end, v)) {
+        return false;
+      }
+      break;
+    case 5: // 32-bit
+      v = 4;
+      break;
+    default: // groups are not used by share messages
+      return false;
+    }
+    if ((key & 0x7) != 0) {
+      if (v > (uint64_t)(end - pos)) {
+        return false;
+      }
+      pos += v;
+    }
+  }
+  return hasTimestamp;
+}
+
+static const size_t kIndexEntrySize =
+    sizeof(uint64_t) + sizeof(ShareLogBlockHeader);
+
+///////////////////////////  ShareLogBlockReader  ////////////////////////////
+ShareLogBlockReader::ShareLogBlockReader(const std::string &filePath)
+  : filePath_(filePath)
+  , fd_(-1)
+  , hasIndex_(false)
+  , indexEnd_(0)
+  , dataEnd_(sizeof(ShareLogFileHeader)) {
+}
+
+ShareLogBlockReader::~ShareLogBlockReader() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+ShareLogFormat ShareLogBlockReader::detectFormat(const std::string &filePath) {
+  int fd = ::open(filePath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return ShareLogFormat::UNKNOWN;
+  }
+  ShareLogFileHeader header;
+  bool complete = ReadAt(fd, &header, sizeof(header), 0);
+  ::close(fd);
+
+  if (!complete) {
+    return ShareLogFormat::UNKNOWN;
+  }
+  if (header.magic_ == kFileMagic && header.version_ == kFileVersion) {
+    return ShareLogFormat::BLOCK;
+  }
+  return ShareLogFormat::LEGACY;
+}
+
+bool ShareLogBlockReader::open() {
+  fd_ = ::open(filePath_.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    LOG(ERROR) << "open sharelog fail: " << filePath_;
+    return false;
+  }
+
+  ShareLogFileHeader header;
+  if (!ReadAt(fd_, &header, sizeof(header), 0) || header.magic_ != kFileMagic ||
+      header.version_ != kFileVersion) {
+    LOG(ERROR) << "not a sharelog v2 file: " << filePath_;
+    return false;
+  }
+
+  if (!loadIndex(FileSize(fd_))) {
+    refresh();
+  }
+  return true;
+}
+
+bool ShareLogBlockReader::loadIndex(uint64_t fileSize) {
+  ShareLogIndexTrailer trailer;
+  if (fileSize < sizeof(ShareLogFileHeader) + sizeof(trailer) ||
+      !ReadAt(fd_, &trailer, sizeof(trailer), fileSize - sizeof(trailer)) ||
+      trailer.magic_ != kIndexMagic) {
+    return false;
+  }
+  const uint64_t indexSize = (uint64_t)trailer.blockCount_ * kIndexEntrySize;
+  if (trailer.indexOffset_ < sizeof(ShareLogFileHeader) ||
+      trailer.indexOffset_ + sizeof(uint32_t) + indexSize + sizeof(trailer) !=
+          fileSize) {
+    return false;
+  }
+
+  std::string index;
+  index.resize(indexSize);
+  if (!ReadAt(
+          fd_,
+          (char *)index.data(),
+          indexSize,
+          trailer.indexOffset_ + sizeof(uint32_t))) {
+    return false;
+  }
+
+  blocks_.resize(trailer.blockCount_);
+  for (size_t i = 0; i < blocks_.size(); i++) {
+    const char *entry = index.data() + i * kIndexEntrySize;
+    memcpy(&blocks_[i].offset_, entry, sizeof(uint64_t));
+    memcpy(
+        &blocks_[i].header_,
+        entry + sizeof(uint64_t),
+        sizeof(ShareLogBlockHeader));
+  }
+  hasIndex_ = true;
+  indexEnd_ = fileSize;
+  dataEnd_ = trailer.indexOffset_;
+  return true;
+}
+
+size_t ShareLogBlockReader::refresh() {
+  if (fd_ < 0) {
+    return 0;
+  }
+
+  const uint64_t fileSize = FileSize(fd_);
+  if (hasIndex_) {
+    if (fileSize == indexEnd_) {
+      return 0;
+    }
+    // reopened by a writer, which dropped the index and appends new blocks
+    hasIndex_ = false;
+  }
+  const size_t oldCount = blocks_.size();
+  ShareLogBlockInfo block;
+  while (dataEnd_ + sizeof(ShareLogBlockHeader) <= fileSize &&
+         ReadAt(fd_, &block.header_, sizeof(ShareLogBlockHeader), dataEnd_)) {
+    if (block.header_.magic_ != kBlockMagic) {
+      // the writer has closed the file since
+      if (block.header_.magic_ == kIndexMagic && loadIndex(fileSize)) {
+        return blocks_.size() - oldCount;
+      }
+      LOG(ERROR) << "bad block header at " << dataEnd_ << ": " << filePath_;
+      break;
+    }
+    const uint64_t blockEnd = dataEnd_ + sizeof(ShareLogBlockHeader) +
+        block.header_.compressedSize_;
+    if (blockEnd > fileSize) {
+      break; // still being written
+    }
+    block.offset_ = dataEnd_;
+    blocks_.push_back(block);
+    dataEnd_ = blockEnd;
+  }
+  return blocks_.size() - oldCount;
+}
+
+std::vector<ShareLogBlockInfo> ShareLogBlockReader::findBlocks(
+    uint32_t beginTs,
+    uint32_t endTs,
+    int32_t minUserId,
+    int32_t maxUserId) const {
+  std::vector<ShareLogBlockInfo> result;
+  for (const auto &block : blocks_) {
+    if (block.overlaps(beginTs, endTs, minUserId, maxUserId)) {
+      result.push_back(block);
+    }
+  }
+  return result;
+}
+
+bool ShareLogBlockReader::readBlock(
+    const ShareLogBlockInfo &block, std::string &records) const {
+  const ShareLogBlockHeader &header = block.header_;
+  std::string compressed;
+  compressed.resize(header.compressedSize_);
+  if (!ReadAt(
+          fd_,
+          (char *)compressed.data(),
+          compressed.size(),
+          block.offset_ + sizeof(ShareLogBlockHeader))) {
+    LOG(ERROR) << "read block at " << block.offset_ << " fail: " << filePath_;
+    return false;
+  }
+
+  const uint32_t checksum =
+      crc32(0, (const Bytef *)compressed.data(), compressed.size());
+  if (checksum != header.checksum_) {
+    LOG(ERROR) << "block at " << block.offset_
+               << " has a bad checksum: " << filePath_;
+    return false;
+  }
+
+  records.resize(header.rawSize_);
+  uLongf rawSize = header.rawSize_;
+  if (uncompress(
+          (Bytef *)records.data(),
+          &rawSize,
+          (const Bytef *)compressed.data(),
+          compressed.size()) != Z_OK ||
+      rawSize != header.rawSize_) {
+    LOG(ERROR) << "decompress block at " << block.offset_
+               << " fail: " << filePath_;
+    records.clear();
+    return false;
+  }
+  return true;
+}
+
+bool ShareLogBlockReader::readBlocks(
+    const std::vector<ShareLogBlockInfo> &blocks,
+    size_t threads,
+    const std::function<void(const std::string &records)> &handler) const {
+  bool success = true;
+  std::string records;
+
+  if (threads <= 1) {
+    for (const auto &block : blocks) {
+      if (readBlock(block, records)) {
+        handler(records);
+      } else {
+        success = false;
+      }
+    }
+    return success;
+  }
+
+  // a fixed set of workers decompresses at most `window` blocks ahead of
+  // the handler, the slots are a ring indexed by the block's position
+  threads = std::min<size_t>(
+      {threads,
+       std::max<size_t>(std::thread::hardware_concurrency(), 1),
+       blocks.size()});
+  const size_t window = threads * 2;
+  struct Slot {
+    bool ready = false;
+    bool success = false;
+    std::string records;
+  };
+  std::vector<Slot> slots(window);
+  std::mutex lock;
+  std::condition_variable changed;
+  size_t next = 0; // the next block to decompress
+  size_t handled = 0; // the next block to hand to the handler
+
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> l(lock);
+    for (;;) {
+      changed.wait(l, [&]() {
+        return next >= blocks.size() || next < handled + window;
+      });
+      if (next >= blocks.size()) {
+        return;
+      }
+      const size_t index = next++;
+      l.unlock();
+      std::string output;
+      bool ok = readBlock(blocks[index], output);
+      l.lock();
+      Slot &slot = slots[index % window];
+      slot.success = ok;
+      slot.records.swap(output);
+      slot.ready = true;
+      changed.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (size_t i = 0; i < threads; i++) {
+    workers.emplace_back(worker);
+  }
+
+  while (handled < blocks.size()) {
+    bool ok;
+    {
+      std::unique_lock<std::mutex> l(lock);
+      Slot &slot = slots[handled % window];
+      changed.wait(l, [&]() { return slot.ready; });
+      ok = slot.success;
+      records.swap(slot.records);
+      slot.ready = false;
+      handled++;
+    }
+    changed.notify_all();
+    if (ok) {
+      handler(records);
+    } else {
+      success = false;
+    }
+  }
+
+  for (auto &t : workers) {
+    t.join();
+  }
+  return success;
+}
+
+///////////////////////////  ShareLogBlockWriter  ////////////////////////////
+ShareLogBlockWriter::ShareLogBlockWriter(
+    const std::string &filePath,
+    int compressionLevel,
+    const ShareLogBlockOptions &options)
+  : filePath_(filePath)
+  , compressionLevel_(compressionLevel)
+  , options_(options)
+  , fd_(-1)
+  , fileSize_(0)
+  , pendingHeader_()
+  , pendingSince_(0) {
+}
+
+ShareLogBlockWriter::~ShareLogBlockWriter() {
+  close();
+}
+
+bool ShareLogBlockWriter::open() {
+  struct stat buf;
+  if (stat(filePath_.c_str(), &buf) == 0 && buf.st_size > 0) {
+    ShareLogBlockReader reader(filePath_);
+    if (!reader.open()) {
+      return false;
+    }
+    blocks_ = reader.blocks();
+    fileSize_ = reader.dataEnd();
+
+    // drop the index (or a partially written block) before appending
+    if ((uint64_t)buf.st_size != fileSize_) {
+      if (!reader.hasIndex()) {
+        LOG(WARNING) << "drop " << (buf.st_size - fileSize_)
+                     << " bytes of incomplete block: " << filePath_;
+      }
+      if (truncate(filePath_.c_str(), fileSize_) != 0) {
+        LOG(ERROR) << "truncate sharelog fail: " << filePath_;
+        return false;
+      }
+    }
+
+    fd_ = ::open(filePath_.c_str(), O_WRONLY | O_APPEND);
+    if (fd_ < 0) {
+      LOG(ERROR) << "open sharelog fail: " << filePath_;
+      return false;
+    }
+    return true;
+  }
+
+  fd_ = ::open(filePath_.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (fd_ < 0) {
+    LOG(ERROR) << "create sharelog fail: " << filePath_;
+    return false;
+  }
+  ShareLogFileHeader header;
+  header.magic_ = kFileMagic;
+  header.version_ = kFileVersion;
+  fileSize_ = 0;
+  return writeAll((const char *)&header, sizeof(header));
+}
+
+bool ShareLogBlockWriter::addRecord(
+    const char *message, uint32_t size, uint32_t timestamp, int32_t userId) {
+  if (pending_.empty()) {
+    pendingHeader_.minTimestamp_ = timestamp;
+    pendingHeader_.maxTimestamp_ = timestamp;
+    pendingHeader_.minUserId_ = userId;
+    pendingHeader_.maxUserId_ = userId;
+    pendingHeader_.shareCount_ = 0;
+    pendingSince_ = time(nullptr);
+  } else {
+    pendingHeader_.minTimestamp_ =
+        std::min(pendingHeader_.minTimestamp_, timestamp);
+    pendingHeader_.maxTimestamp_ =
+        std::max(pendingHeader_.maxTimestamp_, timestamp);
+    pendingHeader_.minUserId_ = std::min(pendingHeader_.minUserId_, userId);
+    pendingHeader_.maxUserId_ = std::max(pendingHeader_.maxUserId_, userId);
+  }
+  pendingHeader_.shareCount_++;
+
+  pending_.append((const char *)&size, sizeof(size));
+  pending_.append(message, size);
+
+  if (pending_.size() >= options_.blockSize_) {
+    return writeBlock();
+  }
+  return true;
+}
+
+bool ShareLogBlockWriter::flush(bool force) {
+  if (pending_.empty()) {
+    return true;
+  }
+  if (force || pending_.size() >= options_.blockSize_ ||
+      time(nullptr) >= pendingSince_ + options_.blockInterval_) {
+    return writeBlock();
+  }
+  return true;
+}
+
+bool ShareLogBlockWriter::close() {
+  if (fd_ < 0) {
+    return true;
+  }
+  bool success = flush(true);
+
+  // index: magic, (offset, header) of every block, trailer
+  ShareLogIndexTrailer trailer;
+  trailer.indexOffset_ = fileSize_;
+  trailer.blockCount_ = blocks_.size();
+  trailer.magic_ = kIndexMagic;
+
+  buffer_.clear();
+  buffer_.append((const char *)&kIndexMagic, sizeof(kIndexMagic));
+  for (const auto &block : blocks_) {
+    buffer_.append((const char *)&block.offset_, sizeof(block.offset_));
+    buffer_.append((const char *)&block.header_, sizeof(block.header_));
+  }
+  buffer_.append((const char *)&trailer, sizeof(trailer));
+  success = writeAll(buffer_.data(), buffer_.size()) && success;
+
+  ::close(fd_);
+  fd_ = -1;
+  return success;
+}
+
+bool ShareLogBlockWriter::writeBlock() {
+  ShareLogBlockInfo block;
+  block.offset_ = fileSize_;
+  block.header_ = pendingHeader_;
+  block.header_.magic_ = kBlockMagic;
+  block.header_.rawSize_ = pending_.size();
+  block.header_.reserved_ = 0;
+
+  uLongf compressedSize = compressBound(pending_.size());
+  buffer_.resize(sizeof(ShareLogBlockHeader) + compressedSize);
+  Bytef *payload = (Bytef *)buffer_.data() + sizeof(ShareLogBlockHeader);
+  if (compress2(
+          payload,
+          &compressedSize,
+          (const Bytef *)pending_.data(),
+          pending_.size(),
+          compressionLevel_) != Z_OK) {
+    LOG(ERROR) << "compress block fail: " << filePath_;
+    return false;
+  }
+  block.header_.compressedSize_ = compressedSize;
+  block.header_.checksum_ = crc32(0, payload, compressedSize);
+  memcpy((char *)buffer_.data(), &block.header_, sizeof(ShareLogBlockHeader));
+
+  // header and payload in one write, so readers rarely see half a block
+  if (!writeAll(
+          buffer_.data(), sizeof(ShareLogBlockHeader) + compressedSize)) {
+    // do not leave half a block in front of the next one
+    if (ftruncate(fd_, block.offset_) == 0) {
+      fileSize_ = block.offset_;
+    }
+    return false;
+  }
+  blocks_.push_back(block);
+  pending_.clear();
+  return true;
+}
+
+bool ShareLogBlockWriter::writeAll(const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd_, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG(ERROR) << "write sharelog fail: " << filePath_
+                 << ", errno: " << errno;
+      return false;
+    }
+    data += n;
+    size -= n;
+    fileSize_ += n;
+  }
+  return true;
+}
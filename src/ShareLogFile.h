@@ -0,0 +1,225 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+//
+// Sharelog v2: a seekable container of independently compressed blocks.
+//
+//   file header | block | block | ... | index | trailer
+//
+// Every block holds whole records in the v1 layout (uint32 size + share
+// message), compressed with zlib, behind a header describing its shares.
+// The index, a copy of every block header with its offset, is written when
+// the writer closes the file. A file that is still growing or was not closed
+// cleanly is indexed by walking the block headers instead.
+//
+// All integers are stored in host byte order, like the v1 record sizes.
+//
+
+struct ShareLogFileHeader {
+  uint32_t magic_;
+  uint32_t version_;
+};
+
+struct ShareLogBlockHeader {
+  uint32_t magic_;
+  uint32_t compressedSize_;
+  uint32_t rawSize_;
+  uint32_t shareCount_;
+  uint32_t minTimestamp_;
+  uint32_t maxTimestamp_;
+  int32_t minUserId_;
+  int32_t maxUserId_;
+  uint32_t checksum_; // crc32 of the compressed payload
+  uint32_t reserved_;
+};
+
+struct ShareLogBlockInfo {
+  uint64_t offset_; // where the block header starts
+  ShareLogBlockHeader header_;
+
+  // whether the block may hold shares in [beginTs, endTs) of users in
+  // [minUserId, maxUserId]
+  bool overlaps(
+      uint32_t beginTs,
+      uint32_t endTs,
+      int32_t minUserId,
+      int32_t maxUserId) const {
+    return header_.minTimestamp_ < endTs && header_.maxTimestamp_ >= beginTs &&
+        header_.minUserId_ <= maxUserId && header_.maxUserId_ >= minUserId;
+  }
+};
+
+struct ShareLogIndexTrailer {
+  uint64_t indexOffset_;
+  uint32_t blockCount_;
+  uint32_t magic_;
+};
+
+enum class ShareLogFormat {
+  UNKNOWN, // missing, or too short to tell yet
+  LEGACY, // one gzip (or plain) stream of records
+  BLOCK, // sharelog v2
+};
+
+// Call handler(buf, len) for every complete record of a v1 record stream,
+// returns the number of bytes consumed.
+template <typename Handler>
+size_t ForEachShareRecord(const char *data, size_t size, Handler handler) {
+  size_t pos = 0;
+  while (pos + sizeof(uint32_t) < size) {
+    uint32_t length = *(const uint32_t *)(data + pos);
+    if (size < pos + sizeof(uint32_t) + length) {
+      break;
+    }
+    handler((const uint8_t *)(data + pos + sizeof(uint32_t)), length);
+    pos += sizeof(uint32_t) + length;
+  }
+  return pos;
+}
+
+// Read the timestamp and userid fields (sint64 / sint32) of a serialized
+// share message without parsing it, other fields are skipped. Returns false
+// if the message is malformed or has no timestamp.
+bool PeekShareLogFields(
+    const uint8_t *data,
+    size_t size,
+    uint32_t timestampField,
+    uint32_t userIdField,
+    int64_t &timestamp,
+    int32_t &userId);
+
+template <class SHARE>
+bool PeekShareLogFields(
+    const uint8_t *data, size_t size, int64_t &timestamp, int32_t &userId) {
+  return PeekShareLogFields(
+      data,
+      size,
+      SHARE::kTimestampFieldNumber,
+      SHARE::kUseridFieldNumber,
+      timestamp,
+      userId);
+}
+
+struct ShareLogBlockOptions {
+  bool enabled_ = false; // write new files as sharelog v2
+  uint32_t blockSize_ = 1024 * 1024; // uncompressed bytes per block
+  time_t blockInterval_ = 10; // max seconds a share waits for its block
+};
+
+///////////////////////////  ShareLogBlockReader  ////////////////////////////
+class ShareLogBlockReader {
+public:
+  explicit ShareLogBlockReader(const std::string &filePath);
+  ~ShareLogBlockReader();
+
+  static ShareLogFormat detectFormat(const std::string &filePath);
+
+  bool open();
+  // pick up the blocks appended since the last call, for growing files.
+  // returns the number of new blocks.
+  size_t refresh();
+
+  const std::vector<ShareLogBlockInfo> &blocks() const { return blocks_; }
+  bool hasIndex() const { return hasIndex_; }
+  // the end of the last complete block
+  uint64_t dataEnd() const { return dataEnd_; }
+
+  // the blocks that may hold shares in [beginTs, endTs) of users in
+  // [minUserId, maxUserId], in file order
+  std::vector<ShareLogBlockInfo> findBlocks(
+      uint32_t beginTs,
+      uint32_t endTs,
+      int32_t minUserId = INT32_MIN,
+      int32_t maxUserId = INT32_MAX) const;
+
+  // verify and decompress one block into v1 records, thread-safe
+  bool readBlock(const ShareLogBlockInfo &block, std::string &records) const;
+
+  // decompress blocks on up to `threads` threads, the records are handed
+  // to `handler` in the order of `blocks`. returns false if any block is
+  // corrupted, the others are still handled.
+  bool readBlocks(
+      const std::vector<ShareLogBlockInfo> &blocks,
+      size_t threads,
+      const std::function<void(const std::string &records)> &handler) const;
+
+private:
+  bool loadIndex(uint64_t fileSize);
+
+  const std::string filePath_;
+  int fd_;
+  bool hasIndex_;
+  uint64_t indexEnd_; // the file size when the index was loaded
+  uint64_t dataEnd_;
+  std::vector<ShareLogBlockInfo> blocks_;
+};
+
+///////////////////////////  ShareLogBlockWriter  ////////////////////////////
+// Appends shares of one day to a sharelog v2 file. Opening an existing file
+// drops its index (and any partially written block) and keeps appending,
+// close() writes the index again.
+class ShareLogBlockWriter {
+public:
+  ShareLogBlockWriter(
+      const std::string &filePath,
+      int compressionLevel,
+      const ShareLogBlockOptions &options);
+  ~ShareLogBlockWriter();
+
+  bool open();
+  // append one serialized share, a full block is written at once
+  bool addRecord(
+      const char *message, uint32_t size, uint32_t timestamp, int32_t userId);
+  // write the pending block if it is full, older than the block interval,
+  // or `force` is set
+  bool flush(bool force = false);
+  // write the pending block and the index
+  bool close();
+
+private:
+  bool writeBlock();
+  bool writeAll(const char *data, size_t size);
+
+  const std::string filePath_;
+  const int compressionLevel_;
+  const ShareLogBlockOptions options_;
+  int fd_;
+  uint64_t fileSize_;
+  std::vector<ShareLogBlockInfo> blocks_;
+
+  std::string pending_; // records of the block being built
+  ShareLogBlockHeader pendingHeader_;
+  time_t pendingSince_;
+  std::string buffer_; // header + compressed payload
+};
@@ -24,7 +24,9 @@
 #ifndef SHARELOGPARSER_H_
 #define SHARELOGPARSER_H_
 
+#include "BlockingQueue.h"
 #include "MySQLConnection.h"
+#include "ShareLogFile.h"
 #include "Statistics.h"
 #include "zlibstream/zstr.hpp"
 
@@ -33,6 +35,8 @@
 #include <event2/buffer.h>
 #include <event2/keyvalq_struct.h>
 
+#include <future>
+
 ///////////////////////////////  ShareLogDumper  ///////////////////////////////
 // Interface, used as a pointer type.
 class ShareLogDumper {
@@ -48,19 +52,27 @@ class ShareLogDumperT : public ShareLogDumper {
   string filePath_; // sharelog data file path
   std::set<int32_t> uids_; // if empty dump all user's shares
   bool isDumpAll_;
+  time_t date_; // date_ % 86400 == 0
+  int32_t hour_; // if negative dump all hours
 
   // single user mode
   bool singleUserMode_ = false;
   int32_t singleUserId_ = 0;
 
+  // threads decompressing sharelog v2 blocks
+  uint32_t parseThreads_ = 0;
+
   void parseShareLog(const uint8_t *buf, size_t len);
   void parseShare(const SHARE *share);
+  // sharelog v2, only reads the blocks of the wanted users and hour
+  void dumpBlocks();
 
 public:
   ShareLogDumperT(
       const libconfig::Config &cfg,
       time_t timestamp,
-      const std::set<int32_t> &uids);
+      const std::set<int32_t> &uids,
+      int32_t hour = -1);
   ~ShareLogDumperT();
 
   void dump2stdout();
@@ -98,6 +110,8 @@ class ShareLogParserT : public ShareLogParser {
   // for processGrowingShareLog()
   //
   zstr::ifstream *f_; // file handler
+  std::unique_ptr<ShareLogBlockReader> blockReader_; // for sharelog v2
+  size_t nextBlock_ = 0;
   uint8_t *buf_; // fread buffer
   // 48 * 1000000 = 48,000,000 ~ 48 MB
   static const size_t kMaxElementsNum_ = 1000000; // num of shares
@@ -115,15 +129,29 @@ class ShareLogParserT : public ShareLogParser {
   bool singleUserMode_ = false;
   int32_t singleUserId_ = 0;
 
+  // for processUnchangedShareLog(), 0 means parse on the calling thread
+  uint32_t parseThreads_ = 0;
+  uint32_t aggregateThreads_ = 0;
+
   inline int32_t getHourIdx(uint32_t ts) {
-    // %H	Hour in 24h format (00-23)
-    return atoi(date("%H", ts).c_str());
+    // Hour in 24h format (00-23), it is called for every share
+    return hourOfDay(ts);
   }
 
   void parseShareLog(const uint8_t *buf, size_t len);
   void parseShare(SHARE &share);
   virtual bool filterShare(const SHARE &share) { return true; }
 
+  // the stages of parseShareLog(), shared with the parallel pipeline:
+  // decodeShare() is thread-safe, checkShare() must see shares in file order
+  bool decodeShare(const uint8_t *buf, size_t len, SHARE &share);
+  bool checkShare(SHARE &share);
+  void aggregateShare(SHARE &share);
+
+  // blockReader is nullptr for sharelog v1
+  bool processUnchangedShareLogParallel(const ShareLogBlockReader *blockReader);
+  int64_t processGrowingBlockShareLog();
+
   void generateDailyData(
       shared_ptr<ShareStatsDay<SHARE>> stats,
       const int32_t userId,
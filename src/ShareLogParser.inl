@@ -22,6 +22,8 @@
  THE SOFTWARE.
  */
 
+#include "prometheus/Registry.h"
+
 #include <boost/algorithm/string.hpp>
 #include <set>
 #include <iostream>
@@ -31,9 +33,12 @@ template <class SHARE>
 ShareLogDumperT<SHARE>::ShareLogDumperT(
     const libconfig::Config &cfg,
     time_t timestamp,
-    const std::set<int32_t> &uids)
+    const std::set<int32_t> &uids,
+    int32_t hour)
   : uids_(uids)
-  , isDumpAll_(false) {
+  , isDumpAll_(false)
+  , date_(timestamp - timestamp % 86400)
+  , hour_(hour) {
 
   // single user mode
   cfg.lookupValue("users.single_user_mode", singleUserMode_);
@@ -41,6 +46,7 @@ ShareLogDumperT<SHARE>::ShareLogDumperT(
   if (singleUserMode_) {
     LOG(INFO) << "[Option] Single User Mode Enabled, puid: " << singleUserId_;
   }
+  cfg.lookupValue("sharelog.parse_threads", parseThreads_);
 
   filePath_ = getStatsFilePath(
       cfg.lookup("sharelog.chain_type"),
@@ -57,6 +63,11 @@ ShareLogDumperT<SHARE>::~ShareLogDumperT() {
 
 template <class SHARE>
 void ShareLogDumperT<SHARE>::dump2stdout() {
+  if (ShareLogBlockReader::detectFormat(filePath_) == ShareLogFormat::BLOCK) {
+    dumpBlocks();
+    return;
+  }
+
   try {
     // open file (auto-detecting compression format or non-compression)
     LOG(INFO) << "open file: " << filePath_;
@@ -109,6 +120,40 @@ void ShareLogDumperT<SHARE>::dump2stdout() {
   }
 }
 
+template <class SHARE>
+void ShareLogDumperT<SHARE>::dumpBlocks() {
+  LOG(INFO) << "open file: " << filePath_;
+  ShareLogBlockReader reader(filePath_);
+  if (!reader.open()) {
+    return;
+  }
+
+  uint32_t beginTs = 0;
+  uint32_t endTs = UINT32_MAX;
+  if (hour_ >= 0) {
+    beginTs = date_ + hour_ * 3600;
+    endTs = beginTs + 3600;
+  }
+  // in single user mode the block ranges are about the pool's user id
+  int32_t minUserId = INT32_MIN;
+  int32_t maxUserId = INT32_MAX;
+  if (!isDumpAll_ && !singleUserMode_) {
+    minUserId = *uids_.begin();
+    maxUserId = *uids_.rbegin();
+  }
+
+  auto blocks = reader.findBlocks(beginTs, endTs, minUserId, maxUserId);
+  LOG(INFO) << "sharelog v2, reading " << blocks.size() << " of "
+            << reader.blocks().size() << " blocks";
+
+  reader.readBlocks(blocks, parseThreads_, [this](const string &records) {
+    ForEachShareRecord(
+        records.data(), records.size(), [this](const uint8_t *buf, size_t len) {
+          parseShareLog(buf, len);
+        });
+  });
+}
+
 template <class SHARE>
 void ShareLogDumperT<SHARE>::parseShareLog(const uint8_t *buf, size_t len) {
   SHARE share;
@@ -136,6 +181,10 @@ void ShareLogDumperT<SHARE>::parseShare(const SHARE *share) {
     return;
   }
 
+  if (hour_ >= 0 && hourOfDay(share->timestamp()) != hour_) {
+    return;
+  }
+
   if (isDumpAll_ || uids_.find(share->userid()) != uids_.end()) {
     // print to stdout
     std::cout << share->toString() << std::endl;
@@ -168,6 +217,12 @@ ShareLogParserT<SHARE>::ShareLogParserT(
     LOG(INFO) << "[Option] Single User Mode Enabled, puid: " << singleUserId_;
   }
 
+  cfg.lookupValue("sharelog.parse_threads", parseThreads_);
+  cfg.lookupValue("sharelog.aggregate_threads", aggregateThreads_);
+  if (parseThreads_ > 0 && aggregateThreads_ == 0) {
+    aggregateThreads_ = parseThreads_;
+  }
+
   pthread_rwlock_init(&rwlock_, nullptr);
 
   {
@@ -208,28 +263,43 @@ bool ShareLogParserT<SHARE>::init() {
 template <class SHARE>
 void ShareLogParserT<SHARE>::parseShareLog(const uint8_t *buf, size_t len) {
   SHARE share;
+  if (decodeShare(buf, len, share)) {
+    parseShare(share);
+  }
+}
+
+template <class SHARE>
+void ShareLogParserT<SHARE>::parseShare(SHARE &share) {
+  if (checkShare(share)) {
+    aggregateShare(share);
+  }
+}
+
+template <class SHARE>
+bool ShareLogParserT<SHARE>::decodeShare(
+    const uint8_t *buf, size_t len, SHARE &share) {
   if (!share.ParseFromArray(buf, len)) {
     LOG(INFO) << "parse share from base message failed! ";
-    return;
+    return false;
   }
 
   if (singleUserMode_) {
     if (!share.has_extuserid() || share.userid() != singleUserId_) {
       // Ignore irrelevant shares
-      return;
+      return false;
     }
     // Change the user id for statistical purposes
     share.set_userid(share.extuserid());
   }
 
-  parseShare(share);
+  return true;
 }
 
 template <class SHARE>
-void ShareLogParserT<SHARE>::parseShare(SHARE &share) {
+bool ShareLogParserT<SHARE>::checkShare(SHARE &share) {
   if (!share.isValid()) {
     LOG(ERROR) << "invalid share: " << share.toString();
-    return;
+    return false;
   }
   if (dupShareChecker_ && !dupShareChecker_->addShare(share)) {
     LOG(INFO) << "duplicate share attack: " << share.toString();
@@ -237,9 +307,13 @@ void ShareLogParserT<SHARE>::parseShare(SHARE &share) {
   }
   if (!filterShare(share)) {
     DLOG(INFO) << "filtered share: " << share.toString();
-    return;
+    return false;
   }
+  return true;
+}
 
+template <class SHARE>
+void ShareLogParserT<SHARE>::aggregateShare(SHARE &share) {
   WorkerKey wkey(share.userid(), share.workerhashid());
   WorkerKey ukey(share.userid(), 0);
   WorkerKey pkey(0, 0);
@@ -261,6 +335,32 @@ void ShareLogParserT<SHARE>::parseShare(SHARE &share) {
 
 template <class SHARE>
 bool ShareLogParserT<SHARE>::processUnchangedShareLog() {
+  std::unique_ptr<ShareLogBlockReader> blockReader;
+  if (ShareLogBlockReader::detectFormat(filePath_) == ShareLogFormat::BLOCK) {
+    LOG(INFO) << "open file: " << filePath_;
+    blockReader.reset(new ShareLogBlockReader(filePath_));
+    if (!blockReader->open()) {
+      return false;
+    }
+    LOG(INFO) << "sharelog v2, blocks: " << blockReader->blocks().size();
+  }
+
+  if (parseThreads_ > 0) {
+    return processUnchangedShareLogParallel(blockReader.get());
+  }
+
+  if (blockReader) {
+    return blockReader->readBlocks(
+        blockReader->blocks(), 1, [this](const string &records) {
+          ForEachShareRecord(
+              records.data(),
+              records.size(),
+              [this](const uint8_t *buf, size_t len) {
+                parseShareLog(buf, len);
+              });
+        });
+  }
+
   try {
     // open file
     LOG(INFO) << "open file: " << filePath_;
@@ -321,8 +421,266 @@ bool ShareLogParserT<SHARE>::processUnchangedShareLog() {
   }
 }
 
+//
+// Pipeline version of processUnchangedShareLog():
+//
+//   reader (calling thread) -> N parse threads -> sequencer -> M shard threads
+//
+// The reader cuts the decompressed file into chunks of whole records, the
+// parse threads decode them, and the sequencer takes the decoded chunks back
+// in file order so the duplicate share checker and filterShare() see exactly
+// the same sequence as before. Worker and user stats are sharded by user id,
+// so every stats object is still fed by a single thread in file order and
+// the results are identical to the single thread path. The pool stats and
+// the (rare) shares of user 0, whose keys collide with the pool key, are
+// aggregated by the sequencer itself.
+//
+template <class SHARE>
+bool ShareLogParserT<SHARE>::processUnchangedShareLogParallel(
+    const ShareLogBlockReader *blockReader) {
+  using ShareBatch = vector<SHARE>;
+  using StatsMap =
+      std::unordered_map<WorkerKey, shared_ptr<ShareStatsDay<SHARE>>>;
+
+  struct ParseTask {
+    string records_; // whole records only
+    const ShareLogBlockInfo *block_ = nullptr; // to decompress first (v2)
+    std::promise<ShareBatch> shares_;
+  };
+
+  static const size_t kChunkSize = 4 * 1024 * 1024;
+  static const size_t kShardBatchSize = 4096;
+
+  LOG(INFO) << "open file: " << filePath_ << ", parse threads: "
+            << parseThreads_ << ", aggregate threads: " << aggregateThreads_;
+  std::unique_ptr<zstr::ifstream> f;
+  if (blockReader == nullptr) {
+    try {
+      f.reset(new zstr::ifstream(filePath_, std::ios::binary));
+    } catch (...) {
+      LOG(ERROR) << "open file fail: " << filePath_;
+      return false;
+    }
+    if (!*f) {
+      LOG(ERROR) << "open file fail: " << filePath_;
+      return false;
+    }
+  }
+  std::atomic<bool> blocksIntact(true);
+
+  // the number of decoded chunks held in memory is bounded by these queues
+  BlockingQueue<std::unique_ptr<ParseTask>> parseQueue(parseThreads_);
+  BlockingQueue<std::future<ShareBatch>> orderQueue(parseThreads_ + 2);
+  vector<std::unique_ptr<BlockingQueue<ShareBatch>>> shardQueues;
+  vector<StatsMap> shardStats(aggregateThreads_);
+  for (uint32_t i = 0; i < aggregateThreads_; i++) {
+    shardQueues.emplace_back(new BlockingQueue<ShareBatch>(4));
+  }
+
+  vector<thread> parsers;
+  for (uint32_t i = 0; i < parseThreads_; i++) {
+    parsers.emplace_back([this, &parseQueue, blockReader, &blocksIntact]() {
+      std::unique_ptr<ParseTask> task;
+      while (parseQueue.pop(task)) {
+        if (task->block_ != nullptr &&
+            !blockReader->readBlock(*task->block_, task->records_)) {
+          blocksIntact = false;
+        }
+        ShareBatch shares;
+        const uint8_t *p = (const uint8_t *)task->records_.data();
+        const size_t size = task->records_.size();
+        size_t pos = 0;
+        while (pos + sizeof(uint32_t) <= size) {
+          uint32_t sharelength = *(uint32_t *)(p + pos);
+          shares.emplace_back();
+          if (!decodeShare(
+                  p + pos + sizeof(uint32_t), sharelength, shares.back())) {
+            shares.pop_back();
+          }
+          pos += sizeof(uint32_t) + sharelength;
+        }
+        task->shares_.set_value(std::move(shares));
+      }
+    });
+  }
+
+  thread sequencer([this, &orderQueue, &shardQueues]() {
+    std::future<ShareBatch> future;
+    vector<ShareBatch> batches(shardQueues.size());
+    shared_ptr<ShareStatsDay<SHARE>> poolStats;
+    {
+      pthread_rwlock_rdlock(&rwlock_);
+      poolStats = workersStats_.at(WorkerKey(0, 0));
+      pthread_rwlock_unlock(&rwlock_);
+    }
+
+    while (orderQueue.pop(future)) {
+      ShareBatch shares = future.get();
+      for (auto &share : shares) {
+        if (!checkShare(share)) {
+          continue;
+        }
+        if (share.userid() == 0) {
+          aggregateShare(share);
+          continue;
+        }
+
+        const uint32_t hourIdx = getHourIdx(share.timestamp());
+        poolStats->processShare(hourIdx, share, acceptStale_);
+
+        const size_t shard = (uint32_t)share.userid() % batches.size();
+        batches[shard].push_back(share);
+        if (batches[shard].size() >= kShardBatchSize) {
+          shardQueues[shard]->push(std::move(batches[shard]));
+          batches[shard].clear();
+        }
+      }
+    }
+
+    for (size_t i = 0; i < batches.size(); i++) {
+      if (!batches[i].empty()) {
+        shardQueues[i]->push(std::move(batches[i]));
+      }
+      shardQueues[i]->close();
+    }
+  });
+
+  vector<thread> aggregators;
+  for (uint32_t i = 0; i < aggregateThreads_; i++) {
+    aggregators.emplace_back([this, i, &shardQueues, &shardStats]() {
+      StatsMap &stats = shardStats[i];
+
+      // same creation rules as aggregateShare(), a worker key equal to its
+      // user key ends up sharing the normalized object
+      auto getStats = [this, &stats](const WorkerKey &key, bool normalized) {
+        auto itr = stats.find(key);
+        if (itr != stats.end()) {
+          return itr->second;
+        }
+        shared_ptr<ShareStatsDay<SHARE>> s;
+        pthread_rwlock_rdlock(&rwlock_);
+        auto existing = workersStats_.find(key);
+        if (existing != workersStats_.end()) {
+          s = existing->second;
+        }
+        pthread_rwlock_unlock(&rwlock_);
+        if (!s) {
+          if (normalized) {
+            s = std::make_shared<ShareStatsDayNormalized<SHARE>>();
+          } else {
+            s = std::make_shared<ShareStatsDay<SHARE>>();
+          }
+        }
+        stats[key] = s;
+        return s;
+      };
+
+      ShareBatch shares;
+      while (shardQueues[i]->pop(shares)) {
+        for (auto &share : shares) {
+          WorkerKey wkey(share.userid(), share.workerhashid());
+          WorkerKey ukey(share.userid(), 0);
+          auto workerStats = getStats(wkey, true);
+          auto userStats = getStats(ukey, false);
+
+          const uint32_t hourIdx = getHourIdx(share.timestamp());
+          workerStats->processShare(hourIdx, share, acceptStale_);
+          userStats->processShare(hourIdx, share, acceptStale_);
+        }
+      }
+    });
+  }
+
+  bool success = true;
+  string leftover;
+  try {
+    if (blockReader != nullptr) {
+      for (const auto &block : blockReader->blocks()) {
+        auto task = std::make_unique<ParseTask>();
+        task->block_ = &block;
+        orderQueue.push(task->shares_.get_future());
+        parseQueue.push(std::move(task));
+      }
+    }
+    while (f && f->peek() != EOF) {
+      auto task = std::make_unique<ParseTask>();
+      string &buf = task->records_;
+      buf.resize(leftover.size() + kChunkSize);
+      memcpy((char *)buf.data(), leftover.data(), leftover.size());
+      f->read((char *)buf.data() + leftover.size(), kChunkSize);
+      size_t readNum = f->gcount() + leftover.size();
+
+      size_t currentpos = 0;
+      while (currentpos + sizeof(uint32_t) < readNum) {
+        uint32_t sharelength = *(uint32_t *)(buf.data() + currentpos);
+        if (readNum < currentpos + sizeof(uint32_t) + sharelength) {
+          break;
+        }
+        currentpos = currentpos + sizeof(uint32_t) + sharelength;
+      }
+      leftover.assign(buf.data() + currentpos, readNum - currentpos);
+      buf.resize(currentpos);
+
+      if (!buf.empty()) {
+        orderQueue.push(task->shares_.get_future());
+        parseQueue.push(std::move(task));
+      }
+    }
+
+    if (!leftover.empty()) {
+      LOG(ERROR) << "Sharelog is incomplete, found " << leftover.size()
+                 << " bytes fragment before EOF" << std::endl;
+    }
+  } catch (...) {
+    LOG(ERROR) << "reading file fail with exception: " << filePath_;
+    success = false;
+  }
+
+  parseQueue.close();
+  orderQueue.close();
+  for (auto &t : parsers) {
+    t.join();
+  }
+  sequencer.join();
+  for (auto &t : aggregators) {
+    t.join();
+  }
+
+  // shards own disjoint keys, merging them only publishes the new objects
+  pthread_rwlock_wrlock(&rwlock_);
+  for (const auto &stats : shardStats) {
+    for (const auto &itr : stats) {
+      workersStats_.insert(itr);
+    }
+  }
+  pthread_rwlock_unlock(&rwlock_);
+
+  return success && blocksIntact;
+}
+
 template <class SHARE>
 int64_t ShareLogParserT<SHARE>::processGrowingShareLog() {
+  if (f_ == nullptr && blockReader_ == nullptr) {
+    switch (ShareLogBlockReader::detectFormat(filePath_)) {
+    case ShareLogFormat::BLOCK:
+      blockReader_.reset(new ShareLogBlockReader(filePath_));
+      if (!blockReader_->open()) {
+        blockReader_.reset();
+        return -1;
+      }
+      break;
+    case ShareLogFormat::UNKNOWN:
+      // not created yet, or the v2 file header is not written yet
+      LOG(WARNING) << "open file fail. Filename: " << filePath_;
+      return -1;
+    case ShareLogFormat::LEGACY:
+      break;
+    }
+  }
+  if (blockReader_) {
+    return processGrowingBlockShareLog();
+  }
+
   if (f_ == nullptr) {
     bool fileOpened = true;
     try {
@@ -409,8 +767,35 @@ int64_t ShareLogParserT<SHARE>::processGrowingShareLog() {
   }
 }
 
+template <class SHARE>
+int64_t ShareLogParserT<SHARE>::processGrowingBlockShareLog() {
+  blockReader_->refresh();
+  const auto &blocks = blockReader_->blocks();
+
+  int64_t parsedsharenum = 0;
+  string records;
+  for (; nextBlock_ < blocks.size(); nextBlock_++) {
+    if (!blockReader_->readBlock(blocks[nextBlock_], records)) {
+      continue;
+    }
+    ForEachShareRecord(
+        records.data(),
+        records.size(),
+        [this, &parsedsharenum](const uint8_t *buf, size_t len) {
+          parseShareLog(buf, len);
+          parsedsharenum++;
+        });
+  }
+
+  DLOG(INFO) << "processGrowingShareLog share count: " << parsedsharenum;
+  return parsedsharenum;
+}
+
 template <class SHARE>
 bool ShareLogParserT<SHARE>::isReachEOF() {
+  if (blockReader_) {
+    return nextBlock_ >= blockReader_->blocks().size();
+  }
   if (f_ == nullptr || !*f_) {
     // if error we consider as EOF
     return true;
@@ -981,7 +1366,7 @@ void ShareLogParserServerT<SHARE>::_getShareStats(
       if (hour == 24) {
         statsDay->getShareStatsDay(stats);
       } else if (hour <= 0 && hour >= -23) {
-        const uint32_t hourIdx = atoi(date("%H").c_str()) + hour;
+        const uint32_t hourIdx = hourOfDay(time(nullptr)) + hour;
         statsDay->getShareStatsHour(hourIdx, stats);
       }
     }
@@ -1075,7 +1460,7 @@ void ShareLogParserServerT<SHARE>::getServerStatus(
 
   s.stats.resize(2);
   statsDayPtr->getShareStatsDay(&(s.stats[0]));
-  statsDayPtr->getShareStatsHour(atoi(date("%H").c_str()), &(s.stats[1]));
+  statsDayPtr->getShareStatsHour(hourOfDay(time(nullptr)), &(s.stats[1]));
 }
 
 template <class SHARE>
@@ -1184,6 +1569,12 @@ void ShareLogParserServerT<SHARE>::runThreadShareLogParser() {
 
   static size_t nonShareCounter = 0;
   time_t lastFlushDBTime = 0;
+  auto parseDuration = prometheus::Registry::Default()->histogram(
+      "slparser_share_log_parse_duration_seconds",
+      "Time to parse the new shares of the share log");
+  auto flushDuration = prometheus::Registry::Default()->histogram(
+      "slparser_db_flush_duration_seconds",
+      "Time to flush the share stats to the database");
 
   while (running_) {
     // get ShareLogParserT
@@ -1203,20 +1594,24 @@ void ShareLogParserServerT<SHARE>::runThreadShareLogParser() {
 
     int64_t shareNum = 0;
 
-    while (running_) {
-      shareNum = shareLogParser->processGrowingShareLog();
-      if (shareNum <= 0) {
-        nonShareCounter++;
-        break;
+    {
+      prometheus::HistogramTimer timer{*parseDuration};
+      while (running_) {
+        shareNum = shareLogParser->processGrowingShareLog();
+        if (shareNum <= 0) {
+          nonShareCounter++;
+          break;
+        }
+        nonShareCounter = 0;
+        DLOG(INFO) << "process share: " << shareNum;
       }
-      nonShareCounter = 0;
-      DLOG(INFO) << "process share: " << shareNum;
     }
     // shareNum < 0 means that the file read error. So wait longer.
     std::this_thread::sleep_for(shareNum < 0 ? 5s : 1s);
 
     // flush data to db
     if (time(nullptr) > lastFlushDBTime + kFlushDBInterval_) {
+      prometheus::HistogramTimer timer{*flushDuration};
       shareLogParser->flushToDB(); // will wait util all data flush to DB
       lastFlushDBTime = time(nullptr);
     }
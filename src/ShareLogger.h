@@ -26,13 +26,18 @@
 
 #include "Common.h"
 #include "Kafka.h"
+#include "ShareLogFile.h"
 #include "Utils.h"
 
+#include "prometheus/Collector.h"
+#include "prometheus/Registry.h"
 #include "zlibstream/zstr.hpp"
 
+#include <chrono>
+
 //////////////////////////////  ShareLogWriter  ///////////////////////////////
 // Interface, used as a pointer type.
-class ShareLogWriter {
+class ShareLogWriter : public prometheus::Collector {
 public:
   virtual ~ShareLogWriter(){};
   virtual void stop() = 0;
@@ -51,28 +56,60 @@ private:
   // -1: defaule level, 0: non-compression, 1: best speed, 9: best size.
   int compressionLevel_;
 
+  // sharelog v2 (ShareLogFile.h) for new files
+  ShareLogBlockOptions blockOptions_;
+
   // key:   timestamp - (timestamp % 86400)
   // value: zstr::ofstream *
   std::map<uint32_t, zstr::ofstream *> fileHandlers_;
+  // the same for files in sharelog v2, a day has only one of the two
+  std::map<uint32_t, ShareLogBlockWriter *> blockWriters_;
   std::vector<SHARE> shares_;
 
+  // the day written by the last addRawShare() call
+  uint32_t rawDay_;
+  zstr::ofstream *rawFileHandler_;
+  ShareLogBlockWriter *rawBlockWriter_;
+  // v1 files written since the last flush
+  std::set<zstr::ofstream *> dirtyHandlers_;
+
   const string chainType_;
 
   zstr::ofstream *getFileHandler(uint32_t ts);
+  // returns nullptr if the day is written as v1
+  ShareLogBlockWriter *getBlockWriter(uint32_t ts);
   void tryCloseOldHanders();
 
 public:
   ShareLogWriterBase(
       const char *chainType,
       const string &dataDir,
-      const int compressionLevel = Z_DEFAULT_COMPRESSION);
+      const int compressionLevel = Z_DEFAULT_COMPRESSION,
+      const ShareLogBlockOptions &blockOptions = ShareLogBlockOptions());
   ~ShareLogWriterBase();
 
   void addShare(SHARE &&share);
+  // append a serialized share to its daily file as is, unlike addShare()
+  // nothing is validated or buffered here
+  bool addRawShare(
+      const uint8_t *message,
+      uint32_t size,
+      uint32_t timestamp,
+      int32_t userId);
   size_t countShares();
+  // returns false if any share or pending block failed to be written
   bool flushToDisk();
 };
 
+// Kafka messages of these versions are written to the sharelog as they are,
+// see ShareLogWriterT::consumeShareLog()
+template <class SHARE>
+struct ShareLogRawVersion {
+  static bool match(uint32_t version) {
+    return version == SHARE::CURRENT_VERSION;
+  }
+};
+
 /////////////////////////  ShareLogWriterT /////////////////////////
 // 1. consume topic 'ShareLog'
 // 2. write sharelog to Disk
@@ -83,7 +120,20 @@ class ShareLogWriterT : public ShareLogWriter,
   atomic<bool> running_;
   KafkaHighLevelConsumer hlConsumer_; // consume topic: shareLogTopic
 
+  // false: parse and validate every share before writing it
+  const bool zeroCopy_;
+
+  // stats, read by collectMetrics() in the exporter thread
+  const std::map<string, string> metricLabels_;
+  atomic<uint64_t> sharesWritten_;
+  atomic<uint64_t> sharesInvalid_;
+  std::shared_ptr<prometheus::Histogram> flushDuration_;
+  atomic<uint64_t> flushFailures_;
+  uint64_t lastScrapeShares_;
+  std::chrono::steady_clock::time_point lastScrape_;
+
   void consumeShareLog(rd_kafka_message_t *rkmessage);
+  void flushToDisk();
 
 public:
   ShareLogWriterT(
@@ -92,11 +142,15 @@ public:
       const string &dataDir,
       const string &kafkaGroupID,
       const char *shareLogTopic,
-      const int compressionLevel = Z_DEFAULT_COMPRESSION);
+      const int compressionLevel = Z_DEFAULT_COMPRESSION,
+      const ShareLogBlockOptions &blockOptions = ShareLogBlockOptions(),
+      const bool zeroCopy = true);
   ~ShareLogWriterT();
 
   void stop();
   void run();
+
+  std::vector<std::shared_ptr<prometheus::Metric>> collectMetrics() override;
 };
 
 #include "ShareLogger.inl"
@@ -22,14 +22,25 @@
  THE SOFTWARE.
  */
 
+#include "prometheus/Metric.h"
+
 #include <glog/logging.h>
 
+#include <thread>
+
 ///////////////////////// ShareLogWriterBase /////////////////////////
 template <class SHARE>
 ShareLogWriterBase<SHARE>::ShareLogWriterBase(
-    const char *chainType, const string &dataDir, const int compressionLevel)
+    const char *chainType,
+    const string &dataDir,
+    const int compressionLevel,
+    const ShareLogBlockOptions &blockOptions)
   : dataDir_(dataDir)
   , compressionLevel_(compressionLevel)
+  , blockOptions_(blockOptions)
+  , rawDay_(0)
+  , rawFileHandler_(nullptr)
+  , rawBlockWriter_(nullptr)
   , chainType_(chainType) {
 }
 
@@ -46,6 +57,12 @@ ShareLogWriterBase<SHARE>::~ShareLogWriterBase() {
     delete itr.second;
   }
   fileHandlers_.clear();
+
+  for (auto &itr : blockWriters_) {
+    LOG(INFO) << "close sharelog v2, date: " << date("%F", itr.first);
+    delete itr.second;
+  }
+  blockWriters_.clear();
 }
 
 template <class SHARE>
@@ -78,17 +95,85 @@ zstr::ofstream *ShareLogWriterBase<SHARE>::getFileHandler(uint32_t ts) {
   }
 }
 
+template <class SHARE>
+ShareLogBlockWriter *ShareLogWriterBase<SHARE>::getBlockWriter(uint32_t ts) {
+  auto itr = blockWriters_.find(ts);
+  if (itr != blockWriters_.end()) {
+    return itr->second;
+  }
+  if (fileHandlers_.find(ts) != fileHandlers_.end()) {
+    return nullptr;
+  }
+
+  // an existing file keeps its format, the option only affects new files
+  const string filePath = getStatsFilePath(chainType_.c_str(), dataDir_, ts);
+  const ShareLogFormat format = ShareLogBlockReader::detectFormat(filePath);
+  if (format == ShareLogFormat::LEGACY ||
+      (format == ShareLogFormat::UNKNOWN && !blockOptions_.enabled_)) {
+    return nullptr;
+  }
+
+  LOG(INFO) << "open sharelog v2: " << filePath;
+  auto writer =
+      new ShareLogBlockWriter(filePath, compressionLevel_, blockOptions_);
+  if (!writer->open()) {
+    LOG(FATAL) << "open sharelog v2 fail: " << filePath;
+    delete writer;
+    return nullptr;
+  }
+  blockWriters_[ts] = writer;
+  return writer;
+}
+
 template <class SHARE>
 void ShareLogWriterBase<SHARE>::addShare(SHARE &&share) {
   DLOG(INFO) << share.toString();
 
   if (share.isValid()) {
-    shares_.push_back(share);
+    shares_.push_back(std::move(share));
   } else {
     LOG(ERROR) << "invalid share";
   }
 }
 
+template <class SHARE>
+bool ShareLogWriterBase<SHARE>::addRawShare(
+    const uint8_t *message,
+    uint32_t size,
+    uint32_t timestamp,
+    int32_t userId) {
+  const uint32_t ts = timestamp - (timestamp % 86400);
+
+  try {
+    // shares arrive in time order, so it is nearly always the last day
+    if (rawDay_ != ts ||
+        (rawFileHandler_ == nullptr && rawBlockWriter_ == nullptr)) {
+      rawBlockWriter_ = getBlockWriter(ts);
+      rawFileHandler_ = nullptr;
+      if (rawBlockWriter_ == nullptr) {
+        rawFileHandler_ = getFileHandler(ts);
+        if (rawFileHandler_ == nullptr) {
+          return false;
+        }
+      }
+      rawDay_ = ts;
+    }
+
+    if (rawBlockWriter_ != nullptr) {
+      return rawBlockWriter_->addRecord(
+          (const char *)message, size, timestamp, userId);
+    }
+    dirtyHandlers_.insert(rawFileHandler_);
+    rawFileHandler_->write((const char *)&size, sizeof(uint32_t));
+    rawFileHandler_->write((const char *)message, size);
+    return true;
+
+  } catch (...) {
+    LOG(ERROR) << "write file fail";
+    return false;
+  }
+}
+
 template <class SHARE>
 size_t ShareLogWriterBase<SHARE>::countShares() {
   return shares_.size();
@@ -96,6 +181,9 @@ size_t ShareLogWriterBase<SHARE>::countShares() {
 
 template <class SHARE>
 void ShareLogWriterBase<SHARE>::tryCloseOldHanders() {
+  rawFileHandler_ = nullptr;
+  rawBlockWriter_ = nullptr;
+
   while (fileHandlers_.size() > 3) {
     // Maps (and sets) are sorted, so the first element is the smallest,
     // and the last element is the largest.
@@ -106,33 +194,54 @@ void ShareLogWriterBase<SHARE>::tryCloseOldHanders() {
 
     fileHandlers_.erase(itr);
   }
+
+  while (blockWriters_.size() > 3) {
+    auto itr = blockWriters_.begin();
+
+    LOG(INFO) << "close sharelog v2, date: " << date("%F", itr->first);
+    delete itr->second;
+
+    blockWriters_.erase(itr);
+  }
 }
 
 template <class SHARE>
 bool ShareLogWriterBase<SHARE>::flushToDisk() {
-  if (shares_.empty()) {
-    return true;
-  }
+  bool success = true;
 
   try {
     std::set<zstr::ofstream *> usedHandlers;
+    usedHandlers.swap(dirtyHandlers_);
 
     DLOG(INFO) << "flushToDisk shares count: " << shares_.size();
     for (const auto &share : shares_) {
       const uint32_t ts = share.timestamp() - (share.timestamp() % 86400);
-      zstr::ofstream *f = getFileHandler(ts);
-      if (f == nullptr) {
-        return false;
+      ShareLogBlockWriter *w = getBlockWriter(ts);
+      zstr::ofstream *f = nullptr;
+      if (w == nullptr) {
+        f = getFileHandler(ts);
+        if (f == nullptr) {
+          return false;
+        }
       }
 
-      usedHandlers.insert(f);
-
       string message;
       uint32_t size = 0;
       if (!share.SerializeToBuffer(message, size)) {
         DLOG(INFO) << "base.SerializeToArray failed!" << std::endl;
         continue;
       }
+
+      if (w != nullptr) {
+        if (!w->addRecord(
+                message.data(), size, share.timestamp(), share.userid())) {
+          LOG(ERROR) << "write sharelog v2 record fail, date: "
+                     << date("%F", ts);
+          success = false;
+        }
+        continue;
+      }
+      usedHandlers.insert(f);
       f->write((char *)&size, sizeof(uint32_t));
       f->write((char *)message.data(), size);
     }
@@ -143,11 +252,19 @@ bool ShareLogWriterBase<SHARE>::flushToDisk() {
       DLOG(INFO) << "fflush() file to disk";
       f->flush();
     }
+    // also when shares stop coming, blocks old enough are written anyway
+    for (auto &itr : blockWriters_) {
+      if (!itr.second->flush()) {
+        LOG(ERROR) << "flush sharelog v2 fail, date: "
+                   << date("%F", itr.first);
+        success = false;
+      }
+    }
 
     // should call this after write data
     tryCloseOldHanders();
 
-    return true;
+    return success;
 
   } catch (...) {
     LOG(ERROR) << "write file fail";
@@ -163,10 +280,24 @@ ShareLogWriterT<SHARE>::ShareLogWriterT(
     const string &dataDir,
     const string &kafkaGroupID,
     const char *shareLogTopic,
-    const int compressionLevel)
-  : ShareLogWriterBase<SHARE>(chainType, dataDir, compressionLevel)
+    const int compressionLevel,
+    const ShareLogBlockOptions &blockOptions,
+    const bool zeroCopy)
+  : ShareLogWriterBase<SHARE>(
+        chainType, dataDir, compressionLevel, blockOptions)
   , running_(true)
-  , hlConsumer_(kafkaBrokers, shareLogTopic, 0 /* patition */, kafkaGroupID) {
+  , hlConsumer_(kafkaBrokers, shareLogTopic, 0 /* patition */, kafkaGroupID)
+  , zeroCopy_(zeroCopy)
+  , metricLabels_({{"chain_type", chainType}, {"topic", shareLogTopic}})
+  , sharesWritten_(0)
+  , sharesInvalid_(0)
+  , flushDuration_(prometheus::Registry::Default()->histogram(
+        "sharelogger_flush_duration_seconds",
+        "Time to flush the buffered sharelog data to disk",
+        metricLabels_))
+  , flushFailures_(0)
+  , lastScrapeShares_(0)
+  , lastScrape_(std::chrono::steady_clock::now()) {
 }
 
 template <class SHARE>
@@ -208,37 +339,71 @@ void ShareLogWriterT<SHARE>::consumeShareLog(rd_kafka_message_t *rkmessage) {
     return;
   }
 
-  SHARE share;
+  const uint8_t *payload = (const uint8_t *)rkmessage->payload;
+
+  // the message is the version followed by the serialized share, which is
+  // exactly what a sharelog record holds. Only the timestamp is needed to
+  // pick the file, the share is validated when the sharelog is parsed.
+  if (zeroCopy_ && rkmessage->len > sizeof(uint32_t) &&
+      ShareLogRawVersion<SHARE>::match(*(const uint32_t *)payload)) {
+    const uint8_t *message = payload + sizeof(uint32_t);
+    const uint32_t size = rkmessage->len - sizeof(uint32_t);
+    int64_t timestamp = 0;
+    int32_t userId = 0;
+    if (!PeekShareLogFields<SHARE>(message, size, timestamp, userId) ||
+        timestamp <= 0 || timestamp > UINT32_MAX) {
+      LOG(ERROR) << "invalid share, kafka message size: " << rkmessage->len;
+      sharesInvalid_++;
+      return;
+    }
+    if (this->addRawShare(message, size, timestamp, userId)) {
+      sharesWritten_++;
+    } else {
+      sharesInvalid_++;
+    }
+    return;
+  }
 
-  // if (rkmessage->len < sizeof(uint32_t)) {
-  //   LOG(ERROR) << "invalid share , share size : "<< rkmessage->len ;
-  //   return ;
-  // }
-
-  // uint8_t * payload = reinterpret_cast<uint8_t *> (rkmessage->payload);
-  // uint32_t headlength  = *((uint32_t*)payload);
-
-  // if (rkmessage->len < sizeof(uint32_t) + headlength) {
-  //   LOG(ERROR) << "invalid share , kafka message size : "<< rkmessage->len <<
-  //   " <  complete share size " <<
-  //              headlength + sizeof(uint32_t);
-  //   return;
-  // }
-
-  // if (!share.ParseFromArray((const uint8_t *)(payload + sizeof(uint32_t)),
-  // headlength)) {
-  //   LOG(ERROR) << "parse share from kafka message failed rkmessage->len = "<<
-  //   rkmessage->len ; return;
-  // }
-
-  if (!share.UnserializeWithVersion(
-          (const uint8_t *)(rkmessage->payload), rkmessage->len)) {
+  // older binary versions are converted to the current one
+  SHARE share;
+  if (!share.UnserializeWithVersion(payload, rkmessage->len)) {
     LOG(ERROR) << "parse share from kafka message failed rkmessage->len = "
                << rkmessage->len;
+    sharesInvalid_++;
     return;
   }
 
-  this->addShare(std::move(share));
+  DLOG(INFO) << share.toString();
+
+  if (!share.isValid()) {
+    LOG(ERROR) << "invalid share";
+    sharesInvalid_++;
+    return;
+  }
+
+  string message;
+  uint32_t size = 0;
+  if (!share.SerializeToBuffer(message, size)) {
+    LOG(ERROR) << "share SerializeToBuffer failed";
+    sharesInvalid_++;
+    return;
+  }
+  if (this->addRawShare(
+          (const uint8_t *)message.data(),
+          size,
+          share.timestamp(),
+          share.userid())) {
+    sharesWritten_++;
+  }
+}
+
+template <class SHARE>
+void ShareLogWriterT<SHARE>::flushToDisk() {
+  prometheus::HistogramTimer timer{*flushDuration_};
+  if (!ShareLogWriterBase<SHARE>::flushToDisk()) {
+    LOG(ERROR) << "flush sharelog to disk fail";
+    flushFailures_++;
+  }
 }
 
 template <class SHARE>
@@ -246,6 +411,8 @@ void ShareLogWriterT<SHARE>::run() {
   time_t lastFlushTime = time(nullptr);
   const int32_t kFlushDiskInterval = 2;
   const int32_t kTimeoutMs = 1000;
+  const size_t kBatchSize = 1024;
+  std::vector<rd_kafka_message_t *> messages(kBatchSize);
 
   LOG(INFO) << "setup sharelog consumer...";
 
@@ -258,35 +425,81 @@ void ShareLogWriterT<SHARE>::run() {
 
   while (running_) {
     //
-    // flush data to disk
+    // flush data to disk, also when idle so pending v2 blocks get written
     //
-    if (this->countShares() > 0 &&
-        time(nullptr) > kFlushDiskInterval + lastFlushTime) {
-      this->flushToDisk();
+    if (time(nullptr) > kFlushDiskInterval + lastFlushTime) {
+      flushToDisk();
       lastFlushTime = time(nullptr);
     }
 
     //
-    // consume message
+    // consume messages
     //
-    rd_kafka_message_t *rkmessage;
-    rkmessage = hlConsumer_.consumer(kTimeoutMs);
-
-    // timeout, most of time it's not nullptr and set an error:
-    //          rkmessage->err == RD_KAFKA_RESP_ERR__PARTITION_EOF
-    if (rkmessage == nullptr) {
+    ssize_t count =
+        hlConsumer_.consumeBatch(kTimeoutMs, messages.data(), messages.size());
+    if (count < 0) {
+      LOG(ERROR) << "consume sharelog messages fail: "
+                 << rd_kafka_err2str(rd_kafka_last_error());
+      // the batch call fails at once, wait as long as a poll would do
+      std::this_thread::sleep_for(std::chrono::milliseconds(kTimeoutMs));
       continue;
     }
 
-    DLOG(INFO) << "a new message, size: " << rkmessage->len;
+    DLOG(INFO) << count << " new messages";
 
-    // consume share log
-    consumeShareLog(rkmessage);
-    rd_kafka_message_destroy(rkmessage); /* Return message to rdkafka */
+    for (ssize_t i = 0; i < count; i++) {
+      // consume share log
+      consumeShareLog(messages[i]);
+      rd_kafka_message_destroy(messages[i]); /* Return message to rdkafka */
+    }
   }
 
   // flush left shares
-  if (this->countShares() > 0) {
-    this->flushToDisk();
-  }
+  flushToDisk();
+}
+
+template <class SHARE>
+std::vector<std::shared_ptr<prometheus::Metric>>
+ShareLogWriterT<SHARE>::collectMetrics() {
+  auto scrape = std::chrono::steady_clock::now();
+  double duration =
+      std::chrono::duration<double>(scrape - lastScrape_).count();
+  uint64_t shares = sharesWritten_;
+  double sharesPerSecond =
+      duration > 0 ? (shares - lastScrapeShares_) / duration : 0;
+  lastScrape_ = scrape;
+  lastScrapeShares_ = shares;
+
+  auto labels = [this](const char *status) {
+    auto result = metricLabels_;
+    result["status"] = status;
+    return result;
+  };
+
+  std::vector<std::shared_ptr<prometheus::Metric>> metrics;
+  metrics.push_back(prometheus::CreateMetricValue(
+      "sharelogger_shares_per_second_since_last_scrape",
+      prometheus::Metric::Type::Gauge,
+      "Shares written by sharelogger per second since last scrape",
+      metricLabels_,
+      sharesPerSecond));
+  metrics.push_back(prometheus::CreateMetricValue(
+      "sharelogger_shares_total",
+      prometheus::Metric::Type::Counter,
+      "Shares consumed by sharelogger",
+      labels("written"),
+      shares));
+  metrics.push_back(prometheus::CreateMetricValue(
+      "sharelogger_shares_total",
+      prometheus::Metric::Type::Counter,
+      "Shares consumed by sharelogger",
+      labels("invalid"),
+      sharesInvalid_.load()));
+  metrics.push_back(prometheus::CreateMetricValue(
+      "sharelogger_flush_failures_total",
+      prometheus::Metric::Type::Counter,
+      "Sharelog flushes to disk that failed to write some shares",
+      metricLabels_,
+      flushFailures_.load()));
+  return metrics;
 }
@@ -24,12 +24,16 @@
 #ifndef STATSHTTPD_H_
 #define STATSHTTPD_H_
 
+#include "BlockingQueue.h"
 #include "Common.h"
 #include "Kafka.h"
 #include "MySQLConnection.h"
 #include "RedisConnection.h"
+#include "ShardedMap.h"
 #include "Statistics.h"
 #include "Network.h"
+#include "prometheus/Collector.h"
+#include "prometheus/Histogram.h"
 
 #include <map>
 #include <event2/event.h>
@@ -59,6 +63,36 @@ public:
 
   string rejectDetail15m_;
   string rejectDetail1h_;
+
+  // hash of the values, tells whether the status changed between two flushes
+  uint64_t fingerprint() const {
+    uint64_t h = 0;
+    auto mix = [&h](uint64_t value) {
+      h = (h ^ value) * 0x100000001b3ull;
+      h ^= h >> 32;
+    };
+    mix(accept5m_);
+    mix(accept15m_);
+    mix(stale15m_);
+    mix(reject15m_);
+    mix(accept1h_);
+    mix(stale1h_);
+    mix(reject1h_);
+    mix(acceptCount_);
+    mix(lastShareIP_.addrUint64[0]);
+    mix(lastShareIP_.addrUint64[1]);
+    mix(lastShareTime_);
+    mix(std::hash<string>()(rejectDetail15m_));
+    mix(std::hash<string>()(rejectDetail1h_));
+    return h;
+  }
+};
+
+// the destinations of the status flushes, each has its own dirty tracking
+enum StatsFlushTarget {
+  STATS_FLUSH_REDIS = 0,
+  STATS_FLUSH_DB = 1,
+  STATS_FLUSH_TARGETS = 2
 };
 
 ////////////////////////////////  WorkerShares  ////////////////////////////////
@@ -74,6 +108,13 @@ class WorkerShares {
   IpAddress lastShareIP_;
   uint64_t lastShareTime_ = 0;
 
+  // the status last written to each flush target
+  struct FlushState {
+    uint64_t fingerprint_ = 0;
+    time_t writeTime_ = 0;
+  };
+  FlushState flushed_[STATS_FLUSH_TARGETS];
+
   class AcceptShareWindow : public StatsWindow<uint64_t> {
   public:
     AcceptShareWindow()
@@ -106,11 +147,25 @@ public:
   //  bool unserialize(const ...);
 
   void processShare(SHARE &share, bool acceptStale);
+  // same as processShare() for every share, with a single lock
+  void processShares(const vector<SHARE *> &shares, bool acceptStale);
   WorkerStatus getWorkerStatus();
   void getWorkerStatus(WorkerStatus &status);
   bool isExpired();
+  // Dirty tracking of the flushes: returns true if the status with the
+  // fingerprint has to be written to the target, because it changed since the
+  // last write or because it was written rewriteInterval seconds ago (0 to
+  // always write)
+  bool needFlush(
+      StatsFlushTarget target,
+      uint64_t fingerprint,
+      time_t now,
+      time_t rewriteInterval);
+  // records that the status with the fingerprint was written to the target
+  void setFlushed(StatsFlushTarget target, uint64_t fingerprint, time_t now);
 
 private:
+  void processShareWithoutLock(SHARE &share, bool acceptStale);
   virtual void updateAcceptDiff(uint64_t diff){};
   virtual void updateRejectDiff(SHARE &share) const {};
 };
@@ -128,7 +183,7 @@ private:
 
 ////////////////////////////////  StatsServer  ////////////////////////////////
 // Interface, used as a pointer type.
-class StatsServer {
+class StatsServer : public prometheus::Collector {
 public:
   virtual ~StatsServer(){};
   virtual bool init() = 0;
@@ -138,7 +193,7 @@ public:
 
 ////////////////////////////////  StatsServerT  ////////////////////////////////
 //
-// 1. consume topic 'ShareLog'
+// 1. consume topic 'ShareLog', one thread per partition
 // 2. httpd: API for request alive worker status (realtime)
 // 3. flush worker status to DB
 //
@@ -176,19 +231,22 @@ protected:
     REDIS_INDEX_STALE_1H = 4096
   };
 
+  // the score and the worker id of a member of an index
+  using IndexEntry = std::pair<uint64_t, int64_t>;
+
   struct WorkerIndexBuffer {
     size_t size_ = 0;
 
-    std::vector<string> accept5m_;
-    std::vector<string> accept15m_;
-    std::vector<string> stale15m_;
-    std::vector<string> reject15m_;
-    std::vector<string> accept1h_;
-    std::vector<string> stale1h_;
-    std::vector<string> reject1h_;
-    std::vector<string> acceptCount_;
-    std::vector<string> lastShareIP_;
-    std::vector<string> lastShareTime_;
+    std::vector<IndexEntry> accept5m_;
+    std::vector<IndexEntry> accept15m_;
+    std::vector<IndexEntry> stale15m_;
+    std::vector<IndexEntry> reject15m_;
+    std::vector<IndexEntry> accept1h_;
+    std::vector<IndexEntry> stale1h_;
+    std::vector<IndexEntry> reject1h_;
+    std::vector<IndexEntry> acceptCount_;
+    std::vector<IndexEntry> lastShareIP_;
+    std::vector<IndexEntry> lastShareTime_;
   };
 
   atomic<bool> running_;
@@ -196,19 +254,51 @@ protected:
   atomic<int64_t> totalUserCount_;
   time_t uptime_ = 0;
 
-  pthread_rwlock_t rwlock_; // for workerSet_
-  std::unordered_map<
+  // Sharded so the share consumer, the HTTP API, the expiry and the flushes
+  // only contend on the shard they are touching
+  ShardedMap<
       WorkerKey /* userId + workerId */,
       shared_ptr<WorkerShares<SHARE>>>
       workerSet_;
-  std::unordered_map<int32_t /* userId*/, shared_ptr<WorkerShares<SHARE>>>
-      userSet_;
-  std::unordered_map<int32_t /* userId */, int32_t /* workerNum */>
-      userWorkerCount_;
+  ShardedMap<int32_t /* userId*/, shared_ptr<WorkerShares<SHARE>>> userSet_;
+  ShardedMap<int32_t /* userId */, int32_t /* workerNum */> userWorkerCount_;
   WorkerShares<SHARE> poolWorker_; // worker status for the pool
 
-  KafkaSimpleConsumer kafkaConsumer_; // consume topic: 'ShareLog'
-  thread threadConsume_;
+  // A partition of the topic 'ShareLog' and the thread consuming it
+  struct ShareLogPartition {
+    ShareLogPartition(const string &brokers, const string &topic, int partition)
+      : consumer_(brokers.c_str(), topic.c_str(), partition)
+      , partition_(partition) {}
+
+    KafkaSimpleConsumer consumer_;
+    const int partition_;
+    thread thread_;
+    // the generating time of the last share consumed from the partition
+    atomic<time_t> lastShareTime_{0};
+    atomic<uint64_t> shareCount_{0};
+  };
+  vector<unique_ptr<ShareLogPartition>> shareLogPartitions_;
+  atomic<size_t> initializingPartitions_;
+
+  // The consume threads hand the shares to the process threads by the shard
+  // of their WorkerKey, so every worker is updated by one thread only.
+  // Without process threads the shares are processed by the consume threads.
+  struct ShareQueue {
+    explicit ShareQueue(size_t capacity)
+      : batches_(capacity) {}
+
+    BlockingQueue<vector<SHARE>> batches_;
+    atomic<uint64_t> pushed_{0};
+    atomic<uint64_t> processed_{0};
+    // the batches pushed until all the partitions consumed their history
+    atomic<uint64_t> history_{0};
+  };
+  vector<unique_ptr<ShareQueue>> shareQueues_;
+  // all the partitions consumed their history, isInitializing_ is cleared
+  // after the process threads processed it as well
+  atomic<bool> historyConsumed_;
+  vector<thread> threadsProcess_;
+  thread threadFlush_; // expires and flushes the workers
 
   KafkaSimpleConsumer
       kafkaConsumerCommonEvents_; // consume topic: 'CommonEvents'
@@ -226,16 +316,25 @@ protected:
   RedisConnection *redisCommonEvents_ =
       nullptr; // writing workers' meta infomations
   std::vector<RedisConnection *> redisGroup_; // flush hashrate to this group
+  // the commands pipelined to the connection of the same index
+  std::vector<unique_ptr<RedisCommandBuffer>> redisBuffers_;
   uint32_t redisConcurrency_ = 1; // how many threads are writing to Redis at
                                   // the same time
   string redisKeyPrefix_;
   int redisKeyExpire_ = 0;
   uint32_t redisPublishPolicy_ = 0; // @see statshttpd.cfg
   uint32_t redisIndexPolicy_ = 0; // @see statshttpd.cfg
+  time_t redisRewriteInterval_ = 600; // @see statshttpd.cfg
 
   time_t kFlushDBInterval_ = 20;
+  time_t dbRewriteInterval_ = 300; // @see statshttpd.cfg
   atomic<bool> isInserting_; // flag mark if we are flushing db
   atomic<bool> isUpdateRedis_; // flag mark if we are flushing redis
+  // exported by the default prometheus registry
+  shared_ptr<prometheus::Histogram> dbFlushDuration_;
+  shared_ptr<prometheus::Histogram> redisFlushDuration_;
+  atomic<uint64_t> dbFlushRows_; // rows written by the DB flushes
+  atomic<uint64_t> dbUnchangedRows_; // rows skipped by the DB flushes
 
   atomic<time_t>
       lastShareTime_; // the generating time of the last consumed share
@@ -247,6 +346,7 @@ protected:
 
   shared_ptr<DuplicateShareChecker<SHARE>>
       dupShareChecker_; // Used to detect duplicate share attacks.
+  std::mutex dupShareCheckerLock_; // shared by the consume threads
 
   bool acceptStale_ = false; // Whether stale shares are accepted
 
@@ -264,8 +364,12 @@ public:
   atomic<uint64_t> responseBytes_;
 
 protected:
-  void runThreadConsume();
-  void consumeShareLog(rd_kafka_message_t *rkmessage);
+  void runThreadConsume(ShareLogPartition *partition);
+  // Returns false if the message is not a share to process
+  bool consumeShareLog(rd_kafka_message_t *rkmessage, SHARE &share);
+  void dispatchShares(vector<vector<SHARE>> &batches);
+  void runThreadProcess(size_t index);
+  void runThreadFlush();
 
   void runThreadConsumeCommonEvents();
   void consumeCommonEvents(rd_kafka_message_t *rkmessage);
@@ -286,7 +390,24 @@ protected:
       const string &value);
 
   void _processShare(WorkerKey &key, SHARE &share);
+  int32_t getUserWorkerCount(const int32_t userId) const;
+  // Copies the entries of the shards threadStep, threadStep + threadNum, ...
+  // so they can be flushed without holding any lock
+  void collectWorkers(
+      uint32_t threadStep,
+      uint32_t threadNum,
+      vector<std::pair<WorkerKey, shared_ptr<WorkerShares<SHARE>>>> &workers);
+  void collectUsers(
+      uint32_t threadStep,
+      uint32_t threadNum,
+      vector<std::pair<int32_t, shared_ptr<WorkerShares<SHARE>>>> &users);
   void processShare(SHARE &share);
+  // Updates the worker and the user of the share, but not the pool. Returns
+  // false if the share is ignored.
+  bool processWorkerShare(SHARE &share);
+  // the history shares are processed when the process threads are done with
+  // the batches pushed until the partitions consumed their history
+  bool isHistoryProcessed() const;
   virtual bool filterShare(const SHARE &share) { return true; }
   void getWorkerStatusBatch(
       const vector<WorkerKey> &keys, vector<WorkerStatus> &workerStatus);
@@ -294,15 +415,27 @@ protected:
 
   void flushWorkersAndUsersToDB();
   void _flushWorkersAndUsersToDBThread();
+  // a row of table.mining_workers, the user rows have the worker id 0
+  struct WorkerRow {
+    int64_t workerId_;
+    int32_t userId_;
+    WorkerStatus status_;
+  };
+  static const size_t kWorkerRowFields = 17;
+  // Upserts the rows with a prepared statement of the same number of rows,
+  // the statement is prepared again if its number of rows is different
+  bool insertWorkerRows(
+      MySQLStatement &statement,
+      const vector<WorkerRow> &rows,
+      const string &nowStr);
 
   void flushWorkersAndUsersToRedis();
   void _flushWorkersAndUsersToRedisThread();
   void _flushWorkersAndUsersToRedisThread(uint32_t threadStep);
   bool checkRedis(uint32_t threadStep);
-  // Tasks are evenly distributed to each thread.
-  // For example, 6 items are assigned to two threads.
-  // The first thread is responsible for the first 3,
-  // and the second thread is responsible for the next 3.
+  // Shards are distributed to the threads in turn.
+  // For example, with 64 shards and two threads, the first thread is
+  // responsible for the shards 0, 2, 4... and the second one for the others.
   void flushWorkersToRedis(uint32_t threadStep);
   void flushUsersToRedis(uint32_t threadStep);
   void addIndexToBuffer(
@@ -310,13 +443,23 @@ protected:
       const int64_t workerId,
       const WorkerStatus &status);
   void flushIndexToRedis(
-      RedisConnection *redis,
+      uint32_t threadStep,
       std::unordered_map<int32_t /*userId*/, WorkerIndexBuffer>
           &indexBufferMap);
   void flushIndexToRedis(
-      RedisConnection *redis, WorkerIndexBuffer &buffer, const int32_t userId);
-  void flushIndexToRedis(
-      RedisConnection *redis, const std::vector<string> &commandVector);
+      uint32_t threadStep, WorkerIndexBuffer &buffer, const int32_t userId);
+  // the statuses written by the commands in a Redis buffer, with their
+  // fingerprints
+  using RedisFlushed = vector<std::pair<WorkerShares<SHARE> *, uint64_t>>;
+  // Sends the commands buffered for the connection when there are enough of
+  // them for a round trip, or when force is true. The statuses in flushed are
+  // marked as flushed at now only if all the commands succeeded, flushed is
+  // cleared together with the buffer.
+  void pipelineToRedis(
+      uint32_t threadStep,
+      bool force,
+      RedisFlushed *flushed = nullptr,
+      time_t now = 0);
 
   void removeExpiredWorkers();
   bool setupThreadConsume();
@@ -336,6 +479,10 @@ public:
   void stop();
   void run();
 
+  // The consuming lag of the share partitions, the process threads and the
+  // rows of the DB flushes
+  std::vector<std::shared_ptr<prometheus::Metric>> collectMetrics() override;
+
   ServerStatus getServerStatus();
 
   static void httpdServerStatus(struct evhttp_request *req, void *arg);
@@ -22,6 +22,8 @@
  THE SOFTWARE.
  */
 
+#include "prometheus/Metric.h"
+#include "prometheus/Registry.h"
 #include "utilities_js.hpp"
 
 #include <boost/algorithm/string.hpp>
@@ -42,6 +44,24 @@ WorkerShares<SHARE>::WorkerShares(const int64_t workerId, const int32_t userId)
 template <class SHARE>
 void WorkerShares<SHARE>::processShare(SHARE &share, bool acceptStale) {
   ScopeLock sl(lock_);
+  processShareWithoutLock(share, acceptStale);
+}
+
+template <class SHARE>
+void WorkerShares<SHARE>::processShares(
+    const vector<SHARE *> &shares, bool acceptStale) {
+  if (shares.empty()) {
+    return;
+  }
+  ScopeLock sl(lock_);
+  for (SHARE *share : shares) {
+    processShareWithoutLock(*share, acceptStale);
+  }
+}
+
+template <class SHARE>
+void WorkerShares<SHARE>::processShareWithoutLock(
+    SHARE &share, bool acceptStale) {
   const time_t now = time(nullptr);
   if (now > share.timestamp() + STATS_SLIDING_WINDOW_SECONDS) {
     return;
@@ -123,6 +143,26 @@ bool WorkerShares<SHARE>::isExpired() {
       (uint32_t)time(nullptr);
 }
 
+template <class SHARE>
+bool WorkerShares<SHARE>::needFlush(
+    StatsFlushTarget target,
+    uint64_t fingerprint,
+    time_t now,
+    time_t rewriteInterval) {
+  ScopeLock sl(lock_);
+  const FlushState &state = flushed_[target];
+  return rewriteInterval == 0 || fingerprint != state.fingerprint_ ||
+      now >= state.writeTime_ + rewriteInterval;
+}
+
+template <class SHARE>
+void WorkerShares<SHARE>::setFlushed(
+    StatsFlushTarget target, uint64_t fingerprint, time_t now) {
+  ScopeLock sl(lock_);
+  flushed_[target].fingerprint_ = fingerprint;
+  flushed_[target].writeTime_ = now;
+}
+
 template <class SHARE>
 void WorkerSharesNormalized<SHARE>::updateAcceptDiff(uint64_t diff) {
   if (diff > 0) {
@@ -147,16 +187,22 @@ StatsServerT<SHARE>::StatsServerT(
   , totalUserCount_(0)
   , uptime_(time(nullptr))
   , poolWorker_(0u /* worker id */, 0 /* user id */)
-  , kafkaConsumer_(
-        cfg.lookup("kafka.brokers").c_str(),
-        cfg.lookup("statshttpd.share_topic").c_str(),
-        0 /* patition */)
+  , initializingPartitions_(0)
+  , historyConsumed_(false)
   , kafkaConsumerCommonEvents_(
         cfg.lookup("kafka.brokers").c_str(),
         cfg.lookup("statshttpd.common_events_topic").c_str(),
         0 /* patition */)
   , isInserting_(false)
   , isUpdateRedis_(false)
+  , dbFlushDuration_(prometheus::Registry::Default()->histogram(
+        "statshttpd_db_flush_duration_seconds",
+        "Time to flush the workers and users to the database"))
+  , redisFlushDuration_(prometheus::Registry::Default()->histogram(
+        "statshttpd_redis_flush_duration_seconds",
+        "Time to flush the workers and users to redis"))
+  , dbFlushRows_(0)
+  , dbUnchangedRows_(0)
   , lastShareTime_(0)
   , isInitializing_(true)
   , lastFlushTime_(0)
@@ -173,11 +219,33 @@ StatsServerT<SHARE>::StatsServerT(
   cfg.lookupValue("statshttpd.flush_db_interval", flushInterval);
   kFlushDBInterval_ = flushInterval;
 
+  int dbRewriteInterval = dbRewriteInterval_;
+  cfg.lookupValue("statshttpd.db_rewrite_interval", dbRewriteInterval);
+  dbRewriteInterval_ = dbRewriteInterval;
+
   cfg.lookupValue("statshttpd.file_last_flush_time", fileLastFlushTime_);
   cfg.lookupValue("statshttpd.accept_stale", acceptStale_);
   cfg.lookupValue("statshttpd.update_worker_name", updateWorkerName_);
   cfg.lookupValue("statshttpd.expected_online_workers", expectedOnlineWorkers);
 
+  // the partitions 0 ~ share_partitions-1 of the share topic are consumed
+  int sharePartitions = 1;
+  cfg.lookupValue("statshttpd.share_partitions", sharePartitions);
+  const string brokers = cfg.lookup("kafka.brokers").c_str();
+  const string shareTopic = cfg.lookup("statshttpd.share_topic").c_str();
+  for (int i = 0; i < std::max(sharePartitions, 1); i++) {
+    shareLogPartitions_.push_back(
+        std::make_unique<ShareLogPartition>(brokers, shareTopic, i));
+  }
+
+  // the queues hold batches of shares
+  const size_t kShareQueueCapacity = 64;
+  int processThreads = 0;
+  cfg.lookupValue("statshttpd.process_threads", processThreads);
+  for (int i = 0; i < processThreads; i++) {
+    shareQueues_.push_back(std::make_unique<ShareQueue>(kShareQueueCapacity));
+  }
+
   cfg.lookupValue("users.single_user_mode", singleUserMode_);
   cfg.lookupValue("users.single_user_puid", singleUserId_);
   if (singleUserMode_) {
@@ -219,6 +287,14 @@ StatsServerT<SHARE>::StatsServerT(
     cfg.lookupValue("redis.index_policy", redisIndexPolicy_);
     cfg.lookupValue("redis.concurrency", redisConcurrency_);
 
+    int rewriteInterval = redisRewriteInterval_;
+    cfg.lookupValue("redis.rewrite_interval", rewriteInterval);
+    redisRewriteInterval_ = rewriteInterval;
+    // the unchanged keys must be rewritten before they expire
+    if (redisKeyExpire_ > 0 && redisRewriteInterval_ > redisKeyExpire_ / 2) {
+      redisRewriteInterval_ = redisKeyExpire_ / 2;
+    }
+
     if (updateWorkerName_) {
       redisCommonEvents_ = new RedisConnection(redisInfo);
     }
@@ -226,18 +302,31 @@ StatsServerT<SHARE>::StatsServerT(
     for (uint32_t i = 0; i < redisConcurrency_; i++) {
       RedisConnection *redis = new RedisConnection(redisInfo);
       redisGroup_.push_back(redis);
+      redisBuffers_.push_back(std::make_unique<RedisCommandBuffer>());
     }
   }
-
-  pthread_rwlock_init(&rwlock_, nullptr);
 }
 
 template <class SHARE>
 StatsServerT<SHARE>::~StatsServerT() {
   stop();
 
-  if (threadConsume_.joinable())
-    threadConsume_.join();
+  for (auto &partition : shareLogPartitions_) {
+    if (partition->thread_.joinable())
+      partition->thread_.join();
+  }
+
+  // nothing is pushed after the consume threads exited
+  for (auto &queue : shareQueues_) {
+    queue->batches_.close();
+  }
+  for (auto &thread : threadsProcess_) {
+    if (thread.joinable())
+      thread.join();
+  }
+
+  if (threadFlush_.joinable())
+    threadFlush_.join();
 
   if (threadConsumeCommonEvents_.joinable())
     threadConsumeCommonEvents_.join();
@@ -268,8 +357,6 @@ StatsServerT<SHARE>::~StatsServerT() {
     }
     redisGroup_.pop_back();
   }
-
-  pthread_rwlock_destroy(&rwlock_);
 }
 
 template <class SHARE>
@@ -352,63 +439,99 @@ void StatsServerT<SHARE>::stop() {
 
 template <class SHARE>
 void StatsServerT<SHARE>::processShare(SHARE &share) {
+  if (processWorkerShare(share)) {
+    poolWorker_.processShare(share, acceptStale_);
+  }
+}
+
+template <class SHARE>
+bool StatsServerT<SHARE>::processWorkerShare(SHARE &share) {
   const time_t now = time(nullptr);
 
   lastShareTime_ = share.timestamp();
 
   // ignore too old shares
   if (now > share.timestamp() + STATS_SLIDING_WINDOW_SECONDS) {
-    return;
+    return false;
   }
   if (!filterShare(share)) {
     DLOG(INFO) << "filtered share: " << share.toString();
-    return;
+    return false;
   }
 
   WorkerKey key(share.userid(), share.workerhashid());
   _processShare(key, share);
-  poolWorker_.processShare(share, acceptStale_);
+  return true;
 }
 
 template <class SHARE>
 void StatsServerT<SHARE>::_processShare(WorkerKey &key, SHARE &share) {
   const int32_t userId = key.userId_;
 
-  pthread_rwlock_rdlock(&rwlock_);
-  auto workerItr = workerSet_.find(key);
-  auto userItr = userSet_.find(userId);
-  pthread_rwlock_unlock(&rwlock_);
+  shared_ptr<WorkerShares<SHARE>> workerShare, userShare;
 
-  shared_ptr<WorkerShares<SHARE>> workerShare = nullptr, userShare = nullptr;
-
-  if (workerItr != workerSet_.end()) {
-    workerItr->second->processShare(share, acceptStale_);
-  } else {
-    workerShare = make_shared<WorkerSharesNormalized<SHARE>>(
+  if (!workerSet_.find(key, workerShare)) {
+    auto newWorker = make_shared<WorkerSharesNormalized<SHARE>>(
         share.workerhashid(), share.userid());
-    workerShare->processShare(share, acceptStale_);
+    if (workerSet_.insert(key, newWorker, workerShare)) {
+      totalWorkerCount_++;
+      userWorkerCount_.update(userId, [](int32_t &count) {
+        count++;
+        return true;
+      });
+    }
   }
+  workerShare->processShare(share, acceptStale_);
 
-  if (userItr != userSet_.end()) {
-    userItr->second->processShare(share, acceptStale_);
-  } else {
-    userShare =
+  if (!userSet_.find(userId, userShare)) {
+    auto newUser =
         make_shared<WorkerShares<SHARE>>(share.workerhashid(), share.userid());
-    userShare->processShare(share, acceptStale_);
-  }
-
-  if (workerShare != nullptr || userShare != nullptr) {
-    pthread_rwlock_wrlock(&rwlock_); // write lock
-    if (workerShare != nullptr) {
-      workerSet_[key] = workerShare;
-      totalWorkerCount_++;
-      userWorkerCount_[key.userId_]++;
-    }
-    if (userShare != nullptr) {
-      userSet_[userId] = userShare;
+    if (userSet_.insert(userId, newUser, userShare)) {
       totalUserCount_++;
     }
-    pthread_rwlock_unlock(&rwlock_);
+  }
+  userShare->processShare(share, acceptStale_);
+}
+
+template <class SHARE>
+int32_t StatsServerT<SHARE>::getUserWorkerCount(const int32_t userId) const {
+  int32_t count = 0;
+  userWorkerCount_.find(userId, count);
+  return count;
+}
+
+template <class SHARE>
+void StatsServerT<SHARE>::collectWorkers(
+    uint32_t threadStep,
+    uint32_t threadNum,
+    vector<std::pair<WorkerKey, shared_ptr<WorkerShares<SHARE>>>> &workers) {
+  // every thread takes its own shards, they are read locked one by one
+  for (size_t shard = threadStep; shard < workerSet_.shards();
+       shard += threadNum) {
+    workerSet_.forEach(
+        shard,
+        [&workers](
+            const WorkerKey &key,
+            const shared_ptr<WorkerShares<SHARE>> &workerShare) {
+          workers.emplace_back(key, workerShare);
+        });
+  }
+}
+
+template <class SHARE>
+void StatsServerT<SHARE>::collectUsers(
+    uint32_t threadStep,
+    uint32_t threadNum,
+    vector<std::pair<int32_t, shared_ptr<WorkerShares<SHARE>>>> &users) {
+  for (size_t shard = threadStep; shard < userSet_.shards();
+       shard += threadNum) {
+    userSet_.forEach(
+        shard,
+        [&users](
+            const int32_t userId,
+            const shared_ptr<WorkerShares<SHARE>> &userShare) {
+          users.emplace_back(userId, userShare);
+        });
   }
 }
 
@@ -428,6 +551,7 @@ void StatsServerT<SHARE>::flushWorkersAndUsersToRedis() {
 
 template <class SHARE>
 void StatsServerT<SHARE>::_flushWorkersAndUsersToRedisThread() {
+  prometheus::HistogramTimer timer{*redisFlushDuration_};
   std::vector<std::thread> threadPool;
 
   assert(redisGroup_.size() == redisConcurrency_);
@@ -442,10 +566,8 @@ void StatsServerT<SHARE>::_flushWorkersAndUsersToRedisThread() {
     }
   }
 
-  pthread_rwlock_rdlock(&rwlock_);
   LOG(INFO) << "flush to redis... done, " << workerSet_.size() << " workers, "
             << userSet_.size() << " users";
-  pthread_rwlock_unlock(&rwlock_);
 
   isUpdateRedis_ = false;
 }
@@ -483,218 +605,151 @@ bool StatsServerT<SHARE>::checkRedis(uint32_t threadStep) {
 
 template <class SHARE>
 void StatsServerT<SHARE>::flushWorkersToRedis(uint32_t threadStep) {
-  RedisConnection *redis = redisGroup_[threadStep];
+  RedisCommandBuffer &commands = *redisBuffers_[threadStep];
   size_t workerCounter = 0;
+  size_t unchangedCounter = 0;
   std::unordered_map<int32_t /*userId*/, WorkerIndexBuffer> indexBufferMap;
+  RedisFlushed flushed;
 
-  pthread_rwlock_rdlock(&rwlock_); // read lock
-  LOG(INFO) << "redis (thread " << threadStep << "): flush workers, rd locked";
+  vector<std::pair<WorkerKey, shared_ptr<WorkerShares<SHARE>>>> workers;
+  collectWorkers(threadStep, redisConcurrency_, workers);
+  LOG(INFO) << "redis (thread " << threadStep << "): flush workers, "
+            << workers.size() << " collected";
 
-  size_t stepSize = workerSet_.size() / redisConcurrency_;
-  if (workerSet_.size() % redisConcurrency_ != 0) {
-    // +1 to avoid missing the last few items.
-    // Example: 5 / 2 = 2. Each thread handles 2 items and the fifth was
-    // missing.
-    stepSize++;
-  }
-
-  size_t offsetBegin = stepSize * threadStep;
-
-  auto itr = workerSet_.begin();
-
-  // move to the beginning position
-  for (size_t i = 0; i < offsetBegin && itr != workerSet_.end(); i++, itr++)
-    ;
+  // flush the changed workes status of the shards
+  const time_t now = time(nullptr);
+  for (const auto &worker : workers) {
+    const int32_t userId = worker.first.userId_;
+    const int64_t workerId = worker.first.workerId_;
+    const shared_ptr<WorkerShares<SHARE>> &workerShare = worker.second;
+    const WorkerStatus status = workerShare->getWorkerStatus();
 
-  // flush all workes status in a stepSize
-  for (size_t i = 0; i < stepSize && itr != workerSet_.end(); i++, itr++) {
+    const uint64_t fingerprint = status.fingerprint();
+    if (!workerShare->needFlush(
+            STATS_FLUSH_REDIS, fingerprint, now, redisRewriteInterval_)) {
+      unchangedCounter++;
+      continue;
+    }
+    flushed.emplace_back(workerShare.get(), fingerprint);
     workerCounter++;
 
-    const int32_t userId = itr->first.userId_;
-    const int64_t workerId = itr->first.workerId_;
-    shared_ptr<WorkerShares<SHARE>> workerShare = itr->second;
-    const WorkerStatus status = workerShare->getWorkerStatus();
-
     string key = getRedisKeyMiningWorker(userId, workerId);
 
     // update info
-    redis->prepare({"HMSET",
-                    key,
-                    "accept_5m",
-                    std::to_string(status.accept5m_),
-                    "accept_15m",
-                    std::to_string(status.accept15m_),
-                    "stale_15m",
-                    std::to_string(status.stale15m_),
-                    "reject_15m",
-                    std::to_string(status.reject15m_),
-                    "reject_detail_15m",
-                    status.rejectDetail15m_,
-                    "accept_1h",
-                    std::to_string(status.accept1h_),
-                    "stale_1h",
-                    std::to_string(status.stale1h_),
-                    "reject_1h",
-                    std::to_string(status.reject1h_),
-                    "reject_detail_1h",
-                    status.rejectDetail1h_,
-                    "accept_count",
-                    std::to_string(status.acceptCount_),
-                    "last_share_ip",
-                    status.lastShareIP_.toString(),
-                    "last_share_time",
-                    std::to_string(status.lastShareTime_),
-                    "updated_at",
-                    std::to_string(time(nullptr))});
+    commands.command(2 + 13 * 2);
+    commands.arg("HMSET");
+    commands.arg(key);
+    commands.arg("accept_5m");
+    commands.arg(status.accept5m_);
+    commands.arg("accept_15m");
+    commands.arg(status.accept15m_);
+    commands.arg("stale_15m");
+    commands.arg(status.stale15m_);
+    commands.arg("reject_15m");
+    commands.arg(status.reject15m_);
+    commands.arg("reject_detail_15m");
+    commands.arg(status.rejectDetail15m_);
+    commands.arg("accept_1h");
+    commands.arg(status.accept1h_);
+    commands.arg("stale_1h");
+    commands.arg(status.stale1h_);
+    commands.arg("reject_1h");
+    commands.arg(status.reject1h_);
+    commands.arg("reject_detail_1h");
+    commands.arg(status.rejectDetail1h_);
+    commands.arg("accept_count");
+    commands.arg(status.acceptCount_);
+    commands.arg("last_share_ip");
+    commands.arg(status.lastShareIP_.toString());
+    commands.arg("last_share_time");
+    commands.arg(status.lastShareTime_);
+    commands.arg("updated_at");
+    commands.arg(now);
     // set key expire
     if (redisKeyExpire_ > 0) {
-      redis->prepare({"EXPIRE", key, std::to_string(redisKeyExpire_)});
+      commands.command(3);
+      commands.arg("EXPIRE");
+      commands.arg(key);
+      commands.arg(redisKeyExpire_);
     }
     // publish notification
     if (redisPublishPolicy_ & REDIS_PUBLISH_WORKER_UPDATE) {
-      redis->prepare({"PUBLISH", key, "1"});
+      commands.command(3);
+      commands.arg("PUBLISH");
+      commands.arg(key);
+      commands.arg("1");
     }
 
     // add index to buffer
     if (redisIndexPolicy_ != REDIS_INDEX_NONE) {
       addIndexToBuffer(indexBufferMap[userId], workerId, status);
     }
-  }
 
-  pthread_rwlock_unlock(&rwlock_); // unlock
-  LOG(INFO) << "redis (thread " << threadStep << "): flush workers, rd unlock";
+    pipelineToRedis(threadStep, false, &flushed, now);
+  }
+  pipelineToRedis(threadStep, true, &flushed, now);
 
   if (workerCounter == 0) {
-    LOG(INFO) << "redis (thread " << threadStep << "): no active workers";
+    LOG(INFO) << "redis (thread " << threadStep << "): no changed workers";
     return;
   }
 
-  for (size_t i = 0; i < workerCounter; i++) {
-    // update info
-    {
-      RedisResult r = redis->execute();
-      if (r.type() != REDIS_REPLY_STATUS || r.str() != "OK") {
-        LOG(INFO) << "redis (thread " << threadStep << ") HMSET failed, "
-                  << "item index: " << i << ", "
-                  << "reply type: " << r.type() << ", "
-                  << "reply str: " << r.str();
-      }
-    }
-    // set key expire
-    if (redisKeyExpire_ > 0) {
-      RedisResult r = redis->execute();
-      if (r.type() != REDIS_REPLY_INTEGER || r.integer() != 1) {
-        LOG(INFO) << "redis (thread " << threadStep << ") EXPIRE failed, "
-                  << "item index: " << i << ", "
-                  << "reply type: " << r.type() << ", "
-                  << "reply integer: " << r.integer() << ","
-                  << "reply str: " << r.str();
-      }
-    }
-    // notification
-    if (redisPublishPolicy_ & REDIS_PUBLISH_WORKER_UPDATE) {
-      RedisResult r = redis->execute();
-      if (r.type() != REDIS_REPLY_INTEGER) {
-        LOG(INFO) << "redis (thread " << threadStep << ") PUBLISH failed, "
-                  << "item index: " << i << ", "
-                  << "reply type: " << r.type() << ", "
-                  << "reply str: " << r.str();
-      }
-    }
-  }
-
   // flush indexes
   if (redisIndexPolicy_ != REDIS_INDEX_NONE) {
-    flushIndexToRedis(redis, indexBufferMap);
+    flushIndexToRedis(threadStep, indexBufferMap);
   }
 
   LOG(INFO) << "flush workers to redis (thread " << threadStep
-            << ") done, workers: " << workerCounter;
+            << ") done, workers: " << workerCounter
+            << ", unchanged: " << unchangedCounter;
   return;
 }
 
 template <class SHARE>
 void StatsServerT<SHARE>::flushIndexToRedis(
-    RedisConnection *redis,
+    uint32_t threadStep,
     std::unordered_map<int32_t /*userId*/, WorkerIndexBuffer> &indexBufferMap) {
 
   for (auto itr = indexBufferMap.begin(); itr != indexBufferMap.end(); itr++) {
-    flushIndexToRedis(redis, itr->second, itr->first);
+    flushIndexToRedis(threadStep, itr->second, itr->first);
   }
+  pipelineToRedis(threadStep, true);
 }
 
 template <class SHARE>
 void StatsServerT<SHARE>::flushIndexToRedis(
-    RedisConnection *redis, WorkerIndexBuffer &buffer, const int32_t userId) {
-  // accept_5m
-  if (redisIndexPolicy_ & REDIS_INDEX_ACCEPT_5M) {
-    buffer.accept5m_.insert(
-        buffer.accept5m_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "accept_5m")});
-    flushIndexToRedis(redis, buffer.accept5m_);
-  }
-  // accept_15m
-  if (redisIndexPolicy_ & REDIS_INDEX_ACCEPT_15M) {
-    buffer.accept15m_.insert(
-        buffer.accept15m_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "accept_15m")});
-    flushIndexToRedis(redis, buffer.accept15m_);
-  }
-  // stale_15m
-  if (redisIndexPolicy_ & REDIS_INDEX_STALE_15M) {
-    buffer.stale15m_.insert(
-        buffer.stale15m_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "stale_15m")});
-    flushIndexToRedis(redis, buffer.stale15m_);
-  }
-  // reject_15m
-  if (redisIndexPolicy_ & REDIS_INDEX_REJECT_15M) {
-    buffer.reject15m_.insert(
-        buffer.reject15m_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "reject_15m")});
-    flushIndexToRedis(redis, buffer.reject15m_);
-  }
-  // accept_1h
-  if (redisIndexPolicy_ & REDIS_INDEX_ACCEPT_1H) {
-    buffer.accept1h_.insert(
-        buffer.accept1h_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "accept_1h")});
-    flushIndexToRedis(redis, buffer.accept1h_);
-  }
-  // stale_1h
-  if (redisIndexPolicy_ & REDIS_INDEX_STALE_1H) {
-    buffer.stale1h_.insert(
-        buffer.stale1h_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "stale_1h")});
-    flushIndexToRedis(redis, buffer.stale1h_);
-  }
-  // reject_1h
-  if (redisIndexPolicy_ & REDIS_INDEX_REJECT_1H) {
-    buffer.reject1h_.insert(
-        buffer.reject1h_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "reject_1h")});
-    flushIndexToRedis(redis, buffer.reject1h_);
-  }
-  // accept_count
-  if (redisIndexPolicy_ & REDIS_INDEX_ACCEPT_COUNT) {
-    buffer.acceptCount_.insert(
-        buffer.acceptCount_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "accept_count")});
-    flushIndexToRedis(redis, buffer.acceptCount_);
-  }
-  // last_share_ip
-  if (redisIndexPolicy_ & REDIS_INDEX_LAST_SHARE_IP) {
-    buffer.lastShareIP_.insert(
-        buffer.lastShareIP_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "last_share_ip")});
-    flushIndexToRedis(redis, buffer.lastShareIP_);
-  }
-  // last_share_time
-  if (redisIndexPolicy_ & REDIS_INDEX_LAST_SHARE_TIME) {
-    buffer.lastShareTime_.insert(
-        buffer.lastShareTime_.begin(),
-        {"ZADD", getRedisKeyIndex(userId, "last_share_time")});
-    flushIndexToRedis(redis, buffer.lastShareTime_);
+    uint32_t threadStep, WorkerIndexBuffer &buffer, const int32_t userId) {
+  const struct {
+    RedisIndexPolicy policy_;
+    const char *name_;
+    const std::vector<IndexEntry> &entries_;
+  } indexes[] = {
+      {REDIS_INDEX_ACCEPT_5M, "accept_5m", buffer.accept5m_},
+      {REDIS_INDEX_ACCEPT_15M, "accept_15m", buffer.accept15m_},
+      {REDIS_INDEX_STALE_15M, "stale_15m", buffer.stale15m_},
+      {REDIS_INDEX_REJECT_15M, "reject_15m", buffer.reject15m_},
+      {REDIS_INDEX_ACCEPT_1H, "accept_1h", buffer.accept1h_},
+      {REDIS_INDEX_STALE_1H, "stale_1h", buffer.stale1h_},
+      {REDIS_INDEX_REJECT_1H, "reject_1h", buffer.reject1h_},
+      {REDIS_INDEX_ACCEPT_COUNT, "accept_count", buffer.acceptCount_},
+      {REDIS_INDEX_LAST_SHARE_IP, "last_share_ip", buffer.lastShareIP_},
+      {REDIS_INDEX_LAST_SHARE_TIME, "last_share_time", buffer.lastShareTime_},
+  };
+
+  RedisCommandBuffer &commands = *redisBuffers_[threadStep];
+  for (const auto &index : indexes) {
+    if (!(redisIndexPolicy_ & index.policy_) || index.entries_.empty()) {
+      continue;
+    }
+    // ZADD key score member [score member ...]
+    commands.command(2 + index.entries_.size() * 2);
+    commands.arg("ZADD");
+    commands.arg(getRedisKeyIndex(userId, index.name_));
+    for (const auto &entry : index.entries_) {
+      commands.arg(entry.first);
+      commands.arg(entry.second);
+    }
+    pipelineToRedis(threadStep, false);
   }
 }
 
@@ -705,175 +760,182 @@ void StatsServerT<SHARE>::addIndexToBuffer(
     const WorkerStatus &status) {
   // accept_5m
   if (redisIndexPolicy_ & REDIS_INDEX_ACCEPT_5M) {
-    buffer.accept5m_.push_back(std::to_string(status.accept5m_));
-    buffer.accept5m_.push_back(std::to_string(workerId));
+    buffer.accept5m_.emplace_back(status.accept5m_, workerId);
   }
   // accept_15m
   if (redisIndexPolicy_ & REDIS_INDEX_ACCEPT_15M) {
-    buffer.accept15m_.push_back(std::to_string(status.accept15m_));
-    buffer.accept15m_.push_back(std::to_string(workerId));
+    buffer.accept15m_.emplace_back(status.accept15m_, workerId);
   }
   // stale_15m
   if (redisIndexPolicy_ & REDIS_INDEX_STALE_15M) {
-    buffer.stale15m_.push_back(std::to_string(status.stale15m_));
-    buffer.stale15m_.push_back(std::to_string(workerId));
+    buffer.stale15m_.emplace_back(status.stale15m_, workerId);
   }
   // reject_15m
   if (redisIndexPolicy_ & REDIS_INDEX_REJECT_15M) {
-    buffer.reject15m_.push_back(std::to_string(status.reject15m_));
-    buffer.reject15m_.push_back(std::to_string(workerId));
+    buffer.reject15m_.emplace_back(status.reject15m_, workerId);
   }
   // accept_1h
   if (redisIndexPolicy_ & REDIS_INDEX_ACCEPT_1H) {
-    buffer.accept1h_.push_back(std::to_string(status.accept1h_));
-    buffer.accept1h_.push_back(std::to_string(workerId));
+    buffer.accept1h_.emplace_back(status.accept1h_, workerId);
   }
   // stale_1h
   if (redisIndexPolicy_ & REDIS_INDEX_STALE_1H) {
-    buffer.stale1h_.push_back(std::to_string(status.stale1h_));
-    buffer.stale1h_.push_back(std::to_string(workerId));
+    buffer.stale1h_.emplace_back(status.stale1h_, workerId);
   }
   // reject_1h
   if (redisIndexPolicy_ & REDIS_INDEX_REJECT_1H) {
-    buffer.reject1h_.push_back(std::to_string(status.reject1h_));
-    buffer.reject1h_.push_back(std::to_string(workerId));
+    buffer.reject1h_.emplace_back(status.reject1h_, workerId);
   }
   // accept_count
   if (redisIndexPolicy_ & REDIS_INDEX_ACCEPT_COUNT) {
-    buffer.acceptCount_.push_back(std::to_string(status.acceptCount_));
-    buffer.acceptCount_.push_back(std::to_string(workerId));
+    buffer.acceptCount_.emplace_back(status.acceptCount_, workerId);
   }
   // last_share_ip
   if (redisIndexPolicy_ & REDIS_INDEX_LAST_SHARE_IP) {
-    buffer.lastShareIP_.push_back(
-        std::to_string(status.lastShareIP_.addrUint64[1]));
-    buffer.lastShareIP_.push_back(std::to_string(workerId));
+    buffer.lastShareIP_.emplace_back(
+        status.lastShareIP_.addrUint64[1], workerId);
   }
   // last_share_time
   if (redisIndexPolicy_ & REDIS_INDEX_LAST_SHARE_TIME) {
-    buffer.lastShareTime_.push_back(std::to_string(status.lastShareTime_));
-    buffer.lastShareTime_.push_back(std::to_string(workerId));
+    buffer.lastShareTime_.emplace_back(status.lastShareTime_, workerId);
   }
 
   buffer.size_++;
 }
 
 template <class SHARE>
-void StatsServerT<SHARE>::flushIndexToRedis(
-    RedisConnection *redis, const std::vector<string> &commandVector) {
-  redis->prepare(commandVector);
-  RedisResult r = redis->execute();
-  if (r.type() != REDIS_REPLY_INTEGER) {
-    LOG(INFO) << "redis ZADD failed, "
-              << "item key: " << commandVector[1] << ", "
-              << "reply type: " << r.type() << ", "
-              << "reply str: " << r.str();
+void StatsServerT<SHARE>::pipelineToRedis(
+    uint32_t threadStep, bool force, RedisFlushed *flushed, time_t now) {
+  // thousands of commands per round trip, bounded by the size of the buffer
+  const size_t kPipelineCommands = 4096;
+  const size_t kPipelineBytes = 4 * 1024 * 1024;
+
+  RedisCommandBuffer &commands = *redisBuffers_[threadStep];
+  if (commands.empty() ||
+      (!force && commands.commands() < kPipelineCommands &&
+       commands.size() < kPipelineBytes)) {
+    return;
   }
-}
 
-template <class SHARE>
-void StatsServerT<SHARE>::flushUsersToRedis(uint32_t threadStep) {
   RedisConnection *redis = redisGroup_[threadStep];
-  size_t userCounter = 0;
-
-  pthread_rwlock_rdlock(&rwlock_); // read lock
-  LOG(INFO) << "redis (thread " << threadStep << "): flush users, rd locked";
+  redis->prepare(commands);
+
+  size_t failures = 0;
+  for (size_t i = 0; i < commands.commands(); i++) {
+    RedisResult r = redis->execute();
+    if (r.empty() || r.type() == REDIS_REPLY_ERROR) {
+      if (failures++ == 0) {
+        LOG(INFO) << "redis (thread " << threadStep << ") command failed, "
+                  << "item index: " << i << ", "
+                  << "reply type: " << r.type() << ", "
+                  << "reply str: " << r.str();
+      }
+    }
+  }
+  if (failures > 0) {
+    LOG(WARNING) << "redis (thread " << threadStep << "): " << failures
+                 << " of " << commands.commands() << " commands failed";
+  }
 
-  size_t stepSize = userSet_.size() / redisConcurrency_;
-  if (userSet_.size() % redisConcurrency_ != 0) {
-    // +1 to avoid missing the last few items.
-    // Example: 5 / 2 = 2. Each thread handles 2 items and the fifth was
-    // missing.
-    stepSize++;
+  if (flushed != nullptr) {
+    // a failed batch is written again by the next flush
+    if (failures == 0) {
+      for (const auto &itr : *flushed) {
+        itr.first->setFlushed(STATS_FLUSH_REDIS, itr.second, now);
+      }
+    }
+    flushed->clear();
   }
+  commands.clear();
+}
 
-  size_t offsetBegin = stepSize * threadStep;
+template <class SHARE>
+void StatsServerT<SHARE>::flushUsersToRedis(uint32_t threadStep) {
+  RedisCommandBuffer &commands = *redisBuffers_[threadStep];
+  size_t userCounter = 0;
+  size_t unchangedCounter = 0;
+  RedisFlushed flushed;
 
-  auto itr = userSet_.begin();
+  vector<std::pair<int32_t, shared_ptr<WorkerShares<SHARE>>>> users;
+  collectUsers(threadStep, redisConcurrency_, users);
+  LOG(INFO) << "redis (thread " << threadStep << "): flush users, "
+            << users.size() << " collected";
 
-  // move to the beginning position
-  for (size_t i = 0; i < offsetBegin && itr != userSet_.end(); i++, itr++)
-    ;
+  // flush the changed users status of the shards
+  const time_t now = time(nullptr);
+  for (const auto &user : users) {
+    const int32_t userId = user.first;
+    const shared_ptr<WorkerShares<SHARE>> &workerShare = user.second;
+    const WorkerStatus status = workerShare->getWorkerStatus();
+    const int32_t workerCount = getUserWorkerCount(userId);
 
-  // flush all users status in a stepSize
-  for (size_t i = 0; i < stepSize && itr != userSet_.end(); i++, itr++) {
+    const uint64_t fingerprint =
+        status.fingerprint() ^ ((uint64_t)workerCount * 0x9E3779B97F4A7C15ull);
+    if (!workerShare->needFlush(
+            STATS_FLUSH_REDIS, fingerprint, now, redisRewriteInterval_)) {
+      unchangedCounter++;
+      continue;
+    }
+    flushed.emplace_back(workerShare.get(), fingerprint);
     userCounter++;
 
-    const int32_t userId = itr->first;
-    shared_ptr<WorkerShares<SHARE>> workerShare = itr->second;
-    const WorkerStatus status = workerShare->getWorkerStatus();
-    const int32_t workerCount = userWorkerCount_[userId];
-
     string key = getRedisKeyMiningWorker(userId);
 
     // update info
-    redis->prepare({"HMSET",           key,
-                    "worker_count",    std::to_string(workerCount),
-                    "accept_5m",       std::to_string(status.accept5m_),
-                    "accept_15m",      std::to_string(status.accept15m_),
-                    "stale_15m",       std::to_string(status.stale15m_),
-                    "reject_15m",      std::to_string(status.reject15m_),
-                    "accept_1h",       std::to_string(status.accept1h_),
-                    "stale_1h",        std::to_string(status.stale1h_),
-                    "reject_1h",       std::to_string(status.reject1h_),
-                    "accept_count",    std::to_string(status.acceptCount_),
-                    "last_share_ip",   status.lastShareIP_.toString(),
-                    "last_share_time", std::to_string(status.lastShareTime_),
-                    "updated_at",      std::to_string(time(nullptr))});
+    commands.command(2 + 12 * 2);
+    commands.arg("HMSET");
+    commands.arg(key);
+    commands.arg("worker_count");
+    commands.arg(workerCount);
+    commands.arg("accept_5m");
+    commands.arg(status.accept5m_);
+    commands.arg("accept_15m");
+    commands.arg(status.accept15m_);
+    commands.arg("stale_15m");
+    commands.arg(status.stale15m_);
+    commands.arg("reject_15m");
+    commands.arg(status.reject15m_);
+    commands.arg("accept_1h");
+    commands.arg(status.accept1h_);
+    commands.arg("stale_1h");
+    commands.arg(status.stale1h_);
+    commands.arg("reject_1h");
+    commands.arg(status.reject1h_);
+    commands.arg("accept_count");
+    commands.arg(status.acceptCount_);
+    commands.arg("last_share_ip");
+    commands.arg(status.lastShareIP_.toString());
+    commands.arg("last_share_time");
+    commands.arg(status.lastShareTime_);
+    commands.arg("updated_at");
+    commands.arg(now);
     // set key expire
     if (redisKeyExpire_ > 0) {
-      redis->prepare({"EXPIRE", key, std::to_string(redisKeyExpire_)});
+      commands.command(3);
+      commands.arg("EXPIRE");
+      commands.arg(key);
+      commands.arg(redisKeyExpire_);
     }
     // publish notification
     if (redisPublishPolicy_ & REDIS_PUBLISH_USER_UPDATE) {
-      redis->prepare({"PUBLISH", key, std::to_string(workerCount)});
+      commands.command(3);
+      commands.arg("PUBLISH");
+      commands.arg(key);
+      commands.arg(workerCount);
     }
-  }
 
-  pthread_rwlock_unlock(&rwlock_); // unlock
-  LOG(INFO) << "redis (thread " << threadStep << "): flush users, rd unlock";
+    pipelineToRedis(threadStep, false, &flushed, now);
+  }
+  pipelineToRedis(threadStep, true, &flushed, now);
 
   if (userCounter == 0) {
-    LOG(INFO) << "redis (thread " << threadStep << "): no active users";
+    LOG(INFO) << "redis (thread " << threadStep << "): no changed users";
     return;
   }
 
-  for (size_t i = 0; i < userCounter; i++) {
-    // update info
-    {
-      RedisResult r = redis->execute();
-      if (r.type() != REDIS_REPLY_STATUS || r.str() != "OK") {
-        LOG(INFO) << "redis (thread " << threadStep << ") HMSET failed, "
-                  << "item index: " << i << ", "
-                  << "reply type: " << r.type() << ", "
-                  << "reply str: " << r.str();
-      }
-    }
-    // set key expire
-    if (redisKeyExpire_ > 0) {
-      RedisResult r = redis->execute();
-      if (r.type() != REDIS_REPLY_INTEGER || r.integer() != 1) {
-        LOG(INFO) << "redis (thread " << threadStep << ") EXPIRE failed, "
-                  << "item index: " << i << ", "
-                  << "reply type: " << r.type() << ", "
-                  << "reply integer: " << r.integer() << ","
-                  << "reply str: " << r.str();
-      }
-    }
-    // publish notification
-    if (redisPublishPolicy_ & REDIS_PUBLISH_USER_UPDATE) {
-      RedisResult r = redis->execute();
-      if (r.type() != REDIS_REPLY_INTEGER) {
-        LOG(INFO) << "redis (thread " << threadStep << ") PUBLISH failed, "
-                  << "item index: " << i << ", "
-                  << "reply type: " << r.type() << ", "
-                  << "reply str: " << r.str();
-      }
-    }
-  }
-
   LOG(INFO) << "flush users to redis (thread " << threadStep
-            << ") done, users: " << userCounter;
+            << ") done, users: " << userCounter
+            << ", unchanged: " << unchangedCounter;
   return;
 }
 
@@ -893,153 +955,104 @@ void StatsServerT<SHARE>::flushWorkersAndUsersToDB() {
 
 template <class SHARE>
 void StatsServerT<SHARE>::_flushWorkersAndUsersToDBThread() {
-  //
-  // merge two table items
-  // table.`mining_workers` unique index: `puid` + `worker_id`
-  //
-  const string mergeSQL = R"(
-    INSERT INTO `mining_workers`
-    SELECT * FROM `mining_workers_tmp`
-    ON DUPLICATE KEY UPDATE
-      `mining_workers`.`accept_5m` = `mining_workers_tmp`.`accept_5m`,
-      `mining_workers`.`accept_15m` = `mining_workers_tmp`.`accept_15m`,
-      `mining_workers`.`stale_15m` = `mining_workers_tmp`.`stale_15m`,
-      `mining_workers`.`reject_15m` = `mining_workers_tmp`.`reject_15m`,
-      `mining_workers`.`reject_detail_15m` = `mining_workers_tmp`.`reject_detail_15m`,
-      `mining_workers`.`accept_1h` = `mining_workers_tmp`.`accept_1h`,
-      `mining_workers`.`stale_1h` = `mining_workers_tmp`.`stale_1h`,
-      `mining_workers`.`reject_1h` = `mining_workers_tmp`.`reject_1h`,
-      `mining_workers`.`reject_detail_1h` = `mining_workers_tmp`.`reject_detail_1h`,
-      `mining_workers`.`accept_count` = `mining_workers_tmp`.`accept_count`,
-      `mining_workers`.`last_share_ip` = `mining_workers_tmp`.`last_share_ip`,
-      `mining_workers`.`last_share_time` = `mining_workers_tmp`.`last_share_time`,
-      `mining_workers`.`updated_at` = `mining_workers_tmp`.`updated_at`
-  )";
-  // fields for table.mining_workers
-  const string fields =
-      "`worker_id`, `puid`, `group_id`, `accept_5m`, "
-      "`accept_15m`, `stale_15m`, `reject_15m`, `reject_detail_15m`, "
-      "`accept_1h`, `stale_1h`, `reject_1h`, reject_detail_1h, "
-      "`accept_count`, `last_share_ip`, "
-      "`last_share_time`, `created_at`, `updated_at`";
-  // values for multi-insert sql
-  vector<string> values;
-  size_t workerCounter = 0;
-  size_t userCounter = 0;
+  prometheus::HistogramTimer timer{*dbFlushDuration_};
+
+  // rows per execution of the prepared statement
+  const size_t kRowsPerStatement = 1000;
+
+  vector<std::pair<WorkerKey, shared_ptr<WorkerShares<SHARE>>>> workers;
+  vector<std::pair<int32_t, shared_ptr<WorkerShares<SHARE>>>> users;
+  // the changed rows waiting for a statement execution
+  vector<WorkerRow> rows;
+  // marked as flushed after the commit, so a failed flush is written again
+  vector<std::pair<WorkerShares<SHARE> *, uint64_t>> flushed;
+  MySQLStatement statement(*poolDB_);
+  const time_t now = time(nullptr);
+  const string nowStr = date("%F %T", now);
+  size_t unchangedCounter = 0;
+  bool inTransaction = false;
+
+  // only the workers changed since the last flush are written
+  auto addRow = [&](int64_t workerId,
+                    int32_t userId,
+                    WorkerShares<SHARE> &workerShare) {
+    WorkerRow row{workerId, userId, workerShare.getWorkerStatus()};
+    const uint64_t fingerprint = row.status_.fingerprint();
+    if (!workerShare.needFlush(
+            STATS_FLUSH_DB, fingerprint, now, dbRewriteInterval_)) {
+      unchangedCounter++;
+      return true;
+    }
+    flushed.emplace_back(&workerShare, fingerprint);
+    rows.push_back(std::move(row));
+    if (rows.size() < kRowsPerStatement) {
+      return true;
+    }
+    bool result = insertWorkerRows(statement, rows, nowStr);
+    rows.clear();
+    return result;
+  };
 
   if (!poolDB_->ping()) {
     LOG(ERROR) << "can't connect to pool DB";
     goto finish;
   }
 
-  pthread_rwlock_rdlock(&rwlock_); // read lock
-  LOG(INFO) << "flush DB: rd locked";
-
-  // get all workes status
-  for (auto itr = workerSet_.begin(); itr != workerSet_.end(); itr++) {
-    workerCounter++;
-
-    const int32_t userId = itr->first.userId_;
-    const int64_t workerId = itr->first.workerId_;
-    shared_ptr<WorkerShares<SHARE>> workerShare = itr->second;
-    const WorkerStatus status = workerShare->getWorkerStatus();
-
-    const string nowStr = date("%F %T", time(nullptr));
-
-    values.push_back(Strings::Format(
-        "%d,%d,%d,%u,"
-        "%u,%u,%u,'%s'," // accept_15m, stale_15m, reject_15m, reject_detail_15m
-        "%u,%u,%u,'%s'," // accept_1h,  stale_1h,  reject_1h,  reject_detail_1h
-        "%d,\"%s\","
-        "\"%s\",\"%s\",\"%s\"",
-        workerId,
-        userId,
-        -1 * userId, /* default group id */
-        status.accept5m_,
-        status.accept15m_,
-        status.stale15m_,
-        status.reject15m_,
-        status.rejectDetail15m_,
-        status.accept1h_,
-        status.stale1h_,
-        status.reject1h_,
-        status.rejectDetail1h_,
-        status.acceptCount_,
-        status.lastShareIP_.toString(),
-        date("%F %T", status.lastShareTime_),
-        nowStr,
-        nowStr));
-  }
-
-  // get all users status
-  for (auto itr = userSet_.begin(); itr != userSet_.end(); itr++) {
-    userCounter++;
-
-    const int32_t userId = itr->first;
-    const int64_t workerId = 0;
-    shared_ptr<WorkerShares<SHARE>> workerShare = itr->second;
-    const WorkerStatus status = workerShare->getWorkerStatus();
-
-    const string nowStr = date("%F %T", time(nullptr));
-
-    values.push_back(Strings::Format(
-        "%d,%d,%d,%u,"
-        "%u,%u,%u,'%s'," // accept_15m, stale_15m, reject_15m, reject_detail_15m
-        "%u,%u,%u,'%s'," // accept_1h,  stale_1h,  reject_1h,  reject_detail_1h
-        "%d,\"%s\","
-        "\"%s\",\"%s\",\"%s\"",
-        workerId,
-        userId,
-        -1 * userId, /* default group id */
-        status.accept5m_,
-        status.accept15m_,
-        status.stale15m_,
-        status.reject15m_,
-        status.rejectDetail15m_,
-        status.accept1h_,
-        status.stale1h_,
-        status.reject1h_,
-        status.rejectDetail1h_,
-        status.acceptCount_,
-        status.lastShareIP_.toString(),
-        date("%F %T", status.lastShareTime_),
-        nowStr,
-        nowStr));
-  }
-
-  pthread_rwlock_unlock(&rwlock_);
-  LOG(INFO) << "flush DB: rd unlock";
+  collectWorkers(0, 1, workers);
+  collectUsers(0, 1, users);
+  LOG(INFO) << "flush DB: " << workers.size() << " workers and "
+            << users.size() << " users collected";
 
-  if (values.size() == 0) {
+  if (workers.empty() && users.empty()) {
     LOG(INFO) << "flush to DB: no active workers";
     goto finish;
   }
 
-  if (!poolDB_->execute(
-          "DROP TEMPORARY TABLE IF EXISTS `mining_workers_tmp`;")) {
-    LOG(ERROR) << "DROP TEMPORARY TABLE `mining_workers_tmp` failure";
-    goto finish;
-  }
-  if (!poolDB_->execute("CREATE TEMPORARY TABLE `mining_workers_tmp` like "
-                        "`mining_workers`;")) {
-    LOG(ERROR) << "CREATE TEMPORARY TABLE `mining_workers_tmp` failure";
+  // one commit for all the batches
+  if (!poolDB_->execute("START TRANSACTION")) {
+    LOG(ERROR) << "start transaction failure";
     // something went wrong with the current mysql connection, try to reconnect.
     poolDB_->reconnect();
     goto finish;
   }
+  inTransaction = true;
 
-  if (!multiInsert(*poolDB_, "mining_workers_tmp", fields, values)) {
-    LOG(ERROR) << "mul-insert table.mining_workers_tmp failure";
+  // the changed workers status
+  for (const auto &worker : workers) {
+    if (!addRow(
+            worker.first.workerId_, worker.first.userId_, *worker.second)) {
+      LOG(ERROR) << "upsert table.mining_workers failure";
+      goto finish;
+    }
+  }
+
+  // the changed users status
+  for (const auto &user : users) {
+    if (!addRow(0 /* worker id */, user.first, *user.second)) {
+      LOG(ERROR) << "upsert table.mining_workers failure";
+      goto finish;
+    }
+  }
+
+  if (!rows.empty() && !insertWorkerRows(statement, rows, nowStr)) {
+    LOG(ERROR) << "upsert table.mining_workers failure";
     goto finish;
   }
 
-  // merge items
-  if (!poolDB_->update(mergeSQL)) {
-    LOG(ERROR) << "merge mining_workers failure";
+  if (!poolDB_->execute("COMMIT")) {
+    LOG(ERROR) << "commit table.mining_workers failure";
     goto finish;
   }
-  LOG(INFO) << "flush to DB... done, workers: " << workerCounter
-            << ", users: " << userCounter;
+  inTransaction = false;
+
+  for (const auto &itr : flushed) {
+    itr.first->setFlushed(STATS_FLUSH_DB, itr.second, now);
+  }
+  dbFlushRows_ += flushed.size();
+  dbUnchangedRows_ += unchangedCounter;
+  LOG(INFO) << "flush to DB... done, workers: " << workers.size()
+            << ", users: " << users.size() << ", rows: " << flushed.size()
+            << ", unchanged: " << unchangedCounter;
 
   lastFlushTime_ = time(nullptr);
   // save flush timestamp to file, for monitor system
@@ -1047,52 +1060,113 @@ void StatsServerT<SHARE>::_flushWorkersAndUsersToDBThread() {
     writeTime2File(fileLastFlushTime_.c_str(), lastFlushTime_);
 
 finish:
+  if (inTransaction) {
+    poolDB_->execute("ROLLBACK");
+  }
   isInserting_ = false;
 }
 
 template <class SHARE>
-void StatsServerT<SHARE>::removeExpiredWorkers() {
-  size_t expiredWorkerCount = 0;
-  size_t expiredUserCount = 0;
-
-  pthread_rwlock_wrlock(&rwlock_); // write lock
-
-  // delete all expired workers
-  for (auto itr = workerSet_.begin(); itr != workerSet_.end();) {
-    const int32_t userId = itr->first.userId_;
-    shared_ptr<WorkerShares<SHARE>> workerShare = itr->second;
-
-    if (workerShare->isExpired()) {
-      itr = workerSet_.erase(itr);
-
-      expiredWorkerCount++;
-      totalWorkerCount_--;
-      userWorkerCount_[userId]--;
-
-      if (userWorkerCount_[userId] <= 0) {
-        userWorkerCount_.erase(userId);
-      }
-    } else {
-      itr++;
+bool StatsServerT<SHARE>::insertWorkerRows(
+    MySQLStatement &statement,
+    const vector<WorkerRow> &rows,
+    const string &nowStr) {
+  if (statement.paramCount() != rows.size() * kWorkerRowFields) {
+    //
+    // table.`mining_workers` unique index: `puid` + `worker_id`
+    //
+    string sql =
+        "INSERT INTO `mining_workers`("
+        "`worker_id`, `puid`, `group_id`, `accept_5m`, "
+        "`accept_15m`, `stale_15m`, `reject_15m`, `reject_detail_15m`, "
+        "`accept_1h`, `stale_1h`, `reject_1h`, `reject_detail_1h`, "
+        "`accept_count`, `last_share_ip`, "
+        "`last_share_time`, `created_at`, `updated_at`) VALUES ";
+    for (size_t i = 0; i < rows.size(); i++) {
+      sql += (i == 0) ? "(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)"
+                      : ",(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)";
+    }
+    sql += R"(
+      ON DUPLICATE KEY UPDATE
+        `accept_5m` = VALUES(`accept_5m`),
+        `accept_15m` = VALUES(`accept_15m`),
+        `stale_15m` = VALUES(`stale_15m`),
+        `reject_15m` = VALUES(`reject_15m`),
+        `reject_detail_15m` = VALUES(`reject_detail_15m`),
+        `accept_1h` = VALUES(`accept_1h`),
+        `stale_1h` = VALUES(`stale_1h`),
+        `reject_1h` = VALUES(`reject_1h`),
+        `reject_detail_1h` = VALUES(`reject_detail_1h`),
+        `accept_count` = VALUES(`accept_count`),
+        `last_share_ip` = VALUES(`last_share_ip`),
+        `last_share_time` = VALUES(`last_share_time`),
+        `updated_at` = VALUES(`updated_at`)
+    )";
+    if (!statement.prepare(sql)) {
+      return false;
     }
   }
 
-  // delete all expired users
-  for (auto itr = userSet_.begin(); itr != userSet_.end();) {
-    shared_ptr<WorkerShares<SHARE>> workerShare = itr->second;
+  for (const auto &row : rows) {
+    const WorkerStatus &status = row.status_;
+    statement.bindInt(row.workerId_);
+    statement.bindInt(row.userId_);
+    statement.bindInt(-1 * row.userId_); /* default group id */
+    statement.bindUint(status.accept5m_);
+    statement.bindUint(status.accept15m_);
+    statement.bindUint(status.stale15m_);
+    statement.bindUint(status.reject15m_);
+    statement.bindString(status.rejectDetail15m_);
+    statement.bindUint(status.accept1h_);
+    statement.bindUint(status.stale1h_);
+    statement.bindUint(status.reject1h_);
+    statement.bindString(status.rejectDetail1h_);
+    statement.bindUint(status.acceptCount_);
+    statement.bindString(status.lastShareIP_.toString());
+    statement.bindString(date("%F %T", status.lastShareTime_));
+    statement.bindString(nowStr);
+    statement.bindString(nowStr);
+  }
+  return statement.execute();
+}
 
-    if (workerShare->isExpired()) {
-      itr = userSet_.erase(itr);
+template <class SHARE>
+void StatsServerT<SHARE>::removeExpiredWorkers() {
+  size_t expiredWorkerCount = 0;
+  size_t expiredUserCount = 0;
 
-      expiredUserCount++;
-      totalUserCount_--;
-    } else {
-      itr++;
-    }
+  // the shards are write locked one by one, shares of the other shards are
+  // processed meanwhile
+  for (size_t shard = 0; shard < workerSet_.shards(); shard++) {
+    expiredWorkerCount += workerSet_.eraseIf(
+        shard,
+        [this](
+            const WorkerKey &key,
+            const shared_ptr<WorkerShares<SHARE>> &workerShare) {
+          if (!workerShare->isExpired()) {
+            return false;
+          }
+          totalWorkerCount_--;
+          userWorkerCount_.update(
+              key.userId_, [](int32_t &count) { return --count > 0; });
+          return true;
+        });
+  }
+
+  for (size_t shard = 0; shard < userSet_.shards(); shard++) {
+    expiredUserCount += userSet_.eraseIf(
+        shard,
+        [this](
+            const int32_t userId,
+            const shared_ptr<WorkerShares<SHARE>> &userShare) {
+          if (!userShare->isExpired()) {
+            return false;
+          }
+          totalUserCount_--;
+          return true;
+        });
   }
 
-  pthread_rwlock_unlock(&rwlock_);
-
   LOG(INFO) << "removed expired workers: " << expiredWorkerCount
             << ", users: " << expiredUserCount;
 }
@@ -1106,27 +1180,15 @@ void StatsServerT<SHARE>::getWorkerStatusBatch(
   ptrs.resize(keys.size());
 
   // find all shared pointer
-  pthread_rwlock_rdlock(&rwlock_);
   for (size_t i = 0; i < keys.size(); i++) {
     if (keys[i].workerId_ == 0) {
       // find user
-      auto itr = userSet_.find(keys[i].userId_);
-      if (itr == userSet_.end()) {
-        ptrs[i] = nullptr;
-      } else {
-        ptrs[i] = itr->second;
-      }
+      userSet_.find(keys[i].userId_, ptrs[i]);
     } else {
       // find worker
-      auto itr = workerSet_.find(keys[i]);
-      if (itr == workerSet_.end()) {
-        ptrs[i] = nullptr;
-      } else {
-        ptrs[i] = itr->second;
-      }
+      workerSet_.find(keys[i], ptrs[i]);
     }
   }
-  pthread_rwlock_unlock(&rwlock_);
 
   // foreach get worker status
   for (size_t i = 0; i < ptrs.size(); i++) {
@@ -1165,7 +1227,8 @@ WorkerStatus StatsServerT<SHARE>::mergeWorkerStatus(
 }
 
 template <class SHARE>
-void StatsServerT<SHARE>::consumeShareLog(rd_kafka_message_t *rkmessage) {
+bool StatsServerT<SHARE>::consumeShareLog(
+    rd_kafka_message_t *rkmessage, SHARE &share) {
   // check error
   if (rkmessage->err) {
     if (rkmessage->err == RD_KAFKA_RESP_ERR__PARTITION_EOF) {
@@ -1176,7 +1239,7 @@ void StatsServerT<SHARE>::consumeShareLog(rd_kafka_message_t *rkmessage) {
       //      << "[" << rkmessage->partition << "] "
       //      << " message queue at offset " << rkmessage->offset;
       // acturlly
-      return;
+      return false;
     }
 
     LOG(ERROR) << "consume error for topic "
@@ -1188,22 +1251,20 @@ void StatsServerT<SHARE>::consumeShareLog(rd_kafka_message_t *rkmessage) {
         rkmessage->err == RD_KAFKA_RESP_ERR__UNKNOWN_TOPIC) {
       LOG(FATAL) << "consume fatal";
     }
-    return;
+    return false;
   }
 
-  SHARE share;
-
   if (!share.UnserializeWithVersion(
           (const uint8_t *)(rkmessage->payload), rkmessage->len)) {
     LOG(ERROR) << "parse share from kafka message failed rkmessage->len = "
                << rkmessage->len;
-    return;
+    return false;
   }
 
   if (singleUserMode_) {
     if (!share.has_extuserid() || share.userid() != singleUserId_) {
       // Ignore irrelevant shares
-      return;
+      return false;
     }
     // Change the user id for statistical purposes
     share.set_userid(share.extuserid());
@@ -1211,28 +1272,44 @@ void StatsServerT<SHARE>::consumeShareLog(rd_kafka_message_t *rkmessage) {
 
   if (!share.isValid()) {
     LOG(ERROR) << "invalid share: " << share.toString();
-    return;
+    return false;
   }
 
-  if (dupShareChecker_ && !dupShareChecker_->addShare(share)) {
-    LOG(INFO) << "duplicate share attack: " << share.toString();
-    share.set_status(StratumStatus::DUPLICATE_SHARE);
+  if (dupShareChecker_) {
+    std::lock_guard<std::mutex> l(dupShareCheckerLock_);
+    if (!dupShareChecker_->addShare(share)) {
+      LOG(INFO) << "duplicate share attack: " << share.toString();
+      share.set_status(StratumStatus::DUPLICATE_SHARE);
+    }
   }
 
-  processShare(share);
+  return true;
+}
+
+template <class SHARE>
+void StatsServerT<SHARE>::dispatchShares(vector<vector<SHARE>> &batches) {
+  for (size_t i = 0; i < batches.size(); i++) {
+    if (!batches[i].empty()) {
+      shareQueues_[i]->batches_.push(std::move(batches[i]));
+      shareQueues_[i]->pushed_++;
+      batches[i].clear();
+    }
+  }
 }
 
 template <class SHARE>
 bool StatsServerT<SHARE>::setupThreadConsume() {
-  // kafkaConsumer_
+  // shareLogPartitions_
   {
     //
     // assume we have 100,000 online workers and every share per 10 seconds,
     // so in 60 mins there will be 100000/10*3600 = 36,000,000 shares.
     // data size will be 36,000,000 * sizeof(SHARE) = 1,728,000,000 Bytes
     // (Not accurate because ProtoBuf has the variable length).
+    // The shares are spread over the partitions.
     //
-    const int32_t kConsumeLatestN = expectedOnlineWorkers * 3600 / 10;
+    const int32_t kConsumeLatestN =
+        expectedOnlineWorkers * 3600 / 10 / shareLogPartitions_.size();
 
     map<string, string> consumerOptions;
     // fetch.wait.max.ms:
@@ -1240,18 +1317,33 @@ bool StatsServerT<SHARE>::setupThreadConsume() {
     // fetch.min.bytes.
     consumerOptions["fetch.wait.max.ms"] = "200";
 
-    if (kafkaConsumer_.setup(
-            RD_KAFKA_OFFSET_TAIL(kConsumeLatestN), &consumerOptions) == false) {
-      LOG(INFO) << "setup consumer fail";
-      return false;
+    for (auto &partition : shareLogPartitions_) {
+      if (partition->consumer_.setup(
+              RD_KAFKA_OFFSET_TAIL(kConsumeLatestN), &consumerOptions) ==
+          false) {
+        LOG(INFO) << "setup consumer of partition " << partition->partition_
+                  << " fail";
+        return false;
+      }
+
+      if (!partition->consumer_.checkAlive()) {
+        LOG(ERROR) << "kafka brokers is not alive";
+        return false;
+      }
     }
 
-    if (!kafkaConsumer_.checkAlive()) {
-      LOG(ERROR) << "kafka brokers is not alive";
-      return false;
+    for (size_t i = 0; i < shareQueues_.size(); i++) {
+      threadsProcess_.emplace_back(
+          &StatsServerT<SHARE>::runThreadProcess, this, i);
     }
 
-    threadConsume_ = std::thread(&StatsServerT<SHARE>::runThreadConsume, this);
+    initializingPartitions_ = shareLogPartitions_.size();
+    for (auto &partition : shareLogPartitions_) {
+      partition->thread_ = std::thread(
+          &StatsServerT<SHARE>::runThreadConsume, this, partition.get());
+    }
+
+    threadFlush_ = std::thread(&StatsServerT<SHARE>::runThreadFlush, this);
   }
 
   // kafkaConsumerCommonEvents_
@@ -1284,64 +1376,149 @@ bool StatsServerT<SHARE>::setupThreadConsume() {
 }
 
 template <class SHARE>
-void StatsServerT<SHARE>::runThreadConsume() {
-  LOG(INFO) << "start sharelog consume thread";
-  time_t lastCleanTime = time(nullptr);
-  time_t lastFlushDBTime =
-      0; // Set to 0 to log lastShareTime_ of the first share
+void StatsServerT<SHARE>::runThreadConsume(ShareLogPartition *partition) {
+  LOG(INFO) << "start sharelog consume thread, partition "
+            << partition->partition_;
+  time_t lastMessageTime = time(nullptr);
+  time_t lastLogTime = 0; // Set to 0 to log lastShareTime_ of the first share
+  bool initializing = true;
 
-  const time_t kExpiredCleanInterval = 60 * 30;
   const int32_t kTimeoutMs = 1000; // consumer timeout
+  // the shares are handed to the process threads in batches, a batch is
+  // dispatched when it is full, when the partition is idle or every 100ms
+  const size_t kBatchSize = 1000;
+  const auto kDispatchInterval = std::chrono::milliseconds(100);
+  vector<vector<SHARE>> batches(shareQueues_.size());
+  auto lastDispatchTime = std::chrono::steady_clock::now();
 
-  // consuming history shares
   while (running_) {
     rd_kafka_message_t *rkmessage;
-    rkmessage = kafkaConsumer_.consumer(kTimeoutMs);
+    rkmessage = partition->consumer_.consumer(kTimeoutMs);
+    bool idle = (rkmessage == nullptr);
 
     if (rkmessage != nullptr) {
       // record the latest time that got a non-empty message
-      lastCleanTime = time(nullptr);
-
-      // consume share log (lastShareTime_ will be updated)
-      consumeShareLog(rkmessage);
+      lastMessageTime = time(nullptr);
+
+      SHARE share;
+      if (consumeShareLog(rkmessage, share)) {
+        partition->lastShareTime_ = share.timestamp();
+        partition->shareCount_++;
+
+        if (batches.empty()) {
+          processShare(share);
+        } else {
+          WorkerKey key(share.userid(), share.workerhashid());
+          auto &batch = batches[workerSet_.shardIndex(key) % batches.size()];
+          batch.push_back(std::move(share));
+          idle = (batch.size() >= kBatchSize);
+        }
+      } else {
+        // the end of the partition or an error
+        idle = true;
+      }
       rd_kafka_message_destroy(rkmessage); /* Return message to rdkafka */
     }
 
-    if (lastFlushDBTime + kFlushDBInterval_ < time(nullptr)) {
-      LOG(INFO) << "consuming history shares: "
-                << date("%F %T", lastShareTime_);
-      lastFlushDBTime = time(nullptr);
+    if (!batches.empty()) {
+      auto now = std::chrono::steady_clock::now();
+      if (idle || now - lastDispatchTime >= kDispatchInterval) {
+        dispatchShares(batches);
+        lastDispatchTime = now;
+      }
+    }
+
+    if (!initializing) {
+      continue;
+    }
+
+    if (lastLogTime + kFlushDBInterval_ < time(nullptr)) {
+      LOG(INFO) << "consuming history shares of partition "
+                << partition->partition_ << ": "
+                << date("%F %T", partition->lastShareTime_);
+      lastLogTime = time(nullptr);
     }
 
     // don't flush database while consuming history shares.
     // otherwise, users' hashrate will be updated to 0 when statshttpd
     // restarted.
 
-    // the initialization state ends after consuming a share that generated in
-    // the last minute.
-    if (lastShareTime_ + 60 >= time(nullptr)) {
-      isInitializing_ = false;
-      break;
+    // the initialization state of a partition ends after consuming a share
+    // that generated in the last minute, or after no shares in 5 minutes.
+    // The server is initialized when all the partitions are.
+    if (partition->lastShareTime_ + 60 >= time(nullptr) ||
+        (rkmessage == nullptr && lastMessageTime + 300 < time(nullptr))) {
+      initializing = false;
+      // the history of the partition is handed to the process threads before
+      // it is counted as consumed
+      dispatchShares(batches);
+      lastDispatchTime = std::chrono::steady_clock::now();
+      if (--initializingPartitions_ == 0) {
+        LOG(INFO) << "history shares consumed";
+        for (auto &queue : shareQueues_) {
+          queue->history_ = queue->pushed_.load();
+        }
+        historyConsumed_ = true;
+      }
     }
+  }
+  dispatchShares(batches);
+  LOG(INFO) << "stop sharelog consume thread, partition "
+            << partition->partition_;
 
-    // the initialization state ends after no shares in 5 minutes
-    // LastCleanTime is used here because it records the latest time that got a
-    // non-empty message
-    if (rkmessage == nullptr && lastCleanTime + 300 < time(nullptr)) {
-      isInitializing_ = false;
-      break;
+  stop(); // if thread exit, we must call server to stop
+}
+
+template <class SHARE>
+void StatsServerT<SHARE>::runThreadProcess(size_t index) {
+  LOG(INFO) << "start share process thread " << index;
+
+  ShareQueue &queue = *shareQueues_[index];
+  vector<SHARE> shares;
+  vector<SHARE *> poolShares;
+  while (queue.batches_.pop(shares)) {
+    // the pool is updated by all the process threads, it is locked once per
+    // batch rather than once per share
+    poolShares.clear();
+    for (auto &share : shares) {
+      if (processWorkerShare(share)) {
+        poolShares.push_back(&share);
+      }
     }
+    poolWorker_.processShares(poolShares, acceptStale_);
+    queue.processed_++;
   }
 
-  // consuming recent shares
+  LOG(INFO) << "stop share process thread " << index;
+}
+
+template <class SHARE>
+bool StatsServerT<SHARE>::isHistoryProcessed() const {
+  for (const auto &queue : shareQueues_) {
+    if (queue->processed_ < queue->history_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class SHARE>
+void StatsServerT<SHARE>::runThreadFlush() {
+  time_t lastCleanTime = time(nullptr);
+  time_t lastFlushDBTime = 0;
+
+  const time_t kExpiredCleanInterval = 60 * 30;
+
   while (running_) {
-    rd_kafka_message_t *rkmessage;
-    rkmessage = kafkaConsumer_.consumer(kTimeoutMs);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
 
-    if (rkmessage != nullptr) {
-      // consume share log (lastShareTime_ will be updated)
-      consumeShareLog(rkmessage);
-      rd_kafka_message_destroy(rkmessage); /* Return message to rdkafka */
+    if (isInitializing_) {
+      if (!historyConsumed_ || !isHistoryProcessed()) {
+        lastCleanTime = time(nullptr);
+        continue;
+      }
+      LOG(INFO) << "history shares processed";
+      isInitializing_ = false;
     }
 
     //
@@ -1357,8 +1534,8 @@ void StatsServerT<SHARE>::runThreadConsume() {
     //
     if (lastFlushDBTime + kFlushDBInterval_ < time(nullptr)) {
       // will use thread to flush data to DB.
-      // it's very fast because we use insert statement with multiple values
-      // and merge table when flush data to DB.
+      // only the changed worker and user rows are written, upserted by a
+      // prepared statement within one transaction.
       if (poolDB_ != nullptr) {
         flushWorkersAndUsersToDB();
       }
@@ -1368,9 +1545,6 @@ void StatsServerT<SHARE>::runThreadConsume() {
       lastFlushDBTime = time(nullptr);
     }
   }
-  LOG(INFO) << "stop sharelog consume thread";
-
-  stop(); // if thread exit, we must call server to stop
 }
 
 template <class SHARE>
@@ -1860,9 +2034,8 @@ void StatsServerT<SHARE>::getWorkerStatus(
     // extra infomations
     string extraInfo;
     if (!isMerge && keys[i].workerId_ == 0) { // all workers of this user
-      pthread_rwlock_rdlock(&rwlock_);
-      extraInfo = Strings::Format(",\"workers\":%d", userWorkerCount_[userId]);
-      pthread_rwlock_unlock(&rwlock_);
+      extraInfo =
+          Strings::Format(",\"workers\":%d", getUserWorkerCount(userId));
     }
 
     Strings::EvBufferAdd(
@@ -1955,6 +2128,62 @@ void StatsServerT<SHARE>::runHttpd() {
   event_base_dispatch(base_);
 }
 
+template <class SHARE>
+std::vector<std::shared_ptr<prometheus::Metric>>
+StatsServerT<SHARE>::collectMetrics() {
+  std::vector<std::shared_ptr<prometheus::Metric>> metrics;
+  const time_t now = time(nullptr);
+
+  for (auto &partition : shareLogPartitions_) {
+    std::map<std::string, std::string> labels{
+        {"partition", std::to_string(partition->partition_)}};
+    time_t lastShareTime = partition->lastShareTime_;
+    if (lastShareTime > 0) {
+      metrics.push_back(prometheus::CreateMetricValue(
+          "statshttpd_share_lag_seconds",
+          prometheus::Metric::Type::Gauge,
+          "Wall clock minus the generating time of the last consumed share",
+          labels,
+          now - lastShareTime));
+    }
+  }
+  for (auto &partition : shareLogPartitions_) {
+    metrics.push_back(prometheus::CreateMetricValue(
+        "statshttpd_shares_total",
+        prometheus::Metric::Type::Counter,
+        "Shares consumed by statshttpd",
+        {{"partition", std::to_string(partition->partition_)}},
+        partition->shareCount_.load()));
+  }
+  for (size_t i = 0; i < shareQueues_.size(); i++) {
+    metrics.push_back(prometheus::CreateMetricValue(
+        "statshttpd_share_queue_batches",
+        prometheus::Metric::Type::Gauge,
+        "Batches of shares waiting for a process thread",
+        {{"thread", std::to_string(i)}},
+        shareQueues_[i]->batches_.size()));
+  }
+  metrics.push_back(prometheus::CreateMetricValue(
+      "statshttpd_db_flush_rows_total",
+      prometheus::Metric::Type::Counter,
+      "Rows of table.mining_workers considered by the DB flushes",
+      {{"status", "written"}},
+      dbFlushRows_.load()));
+  metrics.push_back(prometheus::CreateMetricValue(
+      "statshttpd_db_flush_rows_total",
+      prometheus::Metric::Type::Counter,
+      "Rows of table.mining_workers considered by the DB flushes",
+      {{"status", "unchanged"}},
+      dbUnchangedRows_.load()));
+  metrics.push_back(prometheus::CreateMetricValue(
+      "statshttpd_initializing",
+      prometheus::Metric::Type::Gauge,
+      "Whether statshttpd is still consuming the history shares",
+      {},
+      isInitializing_ ? 1 : 0));
+  return metrics;
+}
+
 template <class SHARE>
 void StatsServerT<SHARE>::run() {
   if (setupThreadConsume() == false) {
@@ -247,19 +247,94 @@ struct LocalShare {
     }
     return false;
   }
+
+  bool operator==(const LocalShare &r) const {
+    return exNonce2_ == r.exNonce2_ && nonce_ == r.nonce_ && time_ == r.time_ &&
+        versionMask_ == r.versionMask_;
+  }
+};
+
+// Open addressing (linear probing) hash set of the shares submitted to a job.
+// Each slot has a one byte tag (7 bits of the hash plus an occupied bit) that
+// is checked before the share itself, so most probes never touch the shares.
+// Memory is only allocated when the table grows.
+class LocalShareSet {
+public:
+  // Returns false if the share is already in the set
+  bool insert(const LocalShare &share) {
+    if ((size_ + 1) * 4 > tags_.size() * 3) {
+      rehash(tags_.empty() ? kMinCapacity : tags_.size() * 2);
+    }
+
+    uint64_t h = hash(share);
+    uint8_t tag = makeTag(h);
+    size_t mask = tags_.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      if (tags_[i] == kEmpty) {
+        tags_[i] = tag;
+        shares_[i] = share;
+        ++size_;
+        return true;
+      }
+      if (tags_[i] == tag && shares_[i] == share) {
+        return false;
+      }
+    }
+  }
+
+  size_t size() const { return size_; }
+
+private:
+  static const size_t kMinCapacity = 16;
+  static const uint8_t kEmpty = 0;
+
+  static uint64_t hash(const LocalShare &share) {
+    uint64_t nonceTime = (uint64_t)share.nonce_ << 32 | share.time_;
+    uint64_t h = share.exNonce2_ ^ (nonceTime * 0x9E3779B97F4A7C15ULL) ^
+        ((uint64_t)share.versionMask_ * 0xC2B2AE3D27D4EB4FULL);
+    // splitmix64 finalizer
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+  }
+
+  static uint8_t makeTag(uint64_t h) { return 0x80 | (h >> 57); }
+
+  void rehash(size_t capacity) {
+    std::vector<uint8_t> tags(capacity); // all kEmpty
+    std::vector<LocalShare> shares(capacity, LocalShare(0, 0, 0));
+    size_t mask = capacity - 1;
+    for (size_t j = 0; j < tags_.size(); ++j) {
+      if (tags_[j] == kEmpty) {
+        continue;
+      }
+      size_t i = hash(shares_[j]) & mask;
+      while (tags[i] != kEmpty) {
+        i = (i + 1) & mask;
+      }
+      tags[i] = tags_[j];
+      shares[i] = shares_[j];
+    }
+    tags_.swap(tags);
+    shares_.swap(shares);
+  }
+
+  std::vector<uint8_t> tags_;
+  std::vector<LocalShare> shares_;
+  size_t size_ = 0;
 };
 
 struct LocalJob {
   size_t chainId_;
   uint64_t jobId_;
-  std::set<LocalShare> submitShares_;
+  LocalShareSet submitShares_;
 
   LocalJob(size_t chainId, uint64_t jobId)
     : chainId_(chainId)
     , jobId_(jobId) {}
 
   bool addLocalShare(const LocalShare &localShare) {
-    return submitShares_.insert(localShare).second;
+    return submitShares_.insert(localShare);
   }
 };
 
@@ -31,6 +31,9 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <array>
+
 using namespace std;
 
 #define NULL_DISPATCHER_LOG \
@@ -94,6 +97,11 @@ void StratumMessageMinerDispatcher::handleRequest(
   miner_->handleRequest(idStr, method, jparams, jroot);
 }
 
+bool StratumMessageMinerDispatcher::handleSubmit(
+    const string &idStr, const StratumRequest &request) {
+  return miner_->handleSubmit(idStr, request);
+}
+
 void StratumMessageMinerDispatcher::handleExMessage(const string &exMessage) {
   LOG(ERROR) << "Agent message shall not reach here";
 }
@@ -132,6 +140,10 @@ void StratumMessageMinerDispatcher::removeLocalJob(LocalJob &localJob) {
   miner_->removeLocalJob(localJob);
 }
 
+uint64_t StratumMessageMinerDispatcher::getTotalDiff() const {
+  return miner_->getCurDiff();
+}
+
 struct StratumMessageExSessionSpecific {
   boost::endian::little_uint8_buf_t magic;
   boost::endian::little_uint8_buf_t command;
@@ -147,6 +159,13 @@ struct StratumMessageExMiningSetDiff {
   boost::endian::little_uint16_buf_t count;
 };
 
+// floor(log2(diff)), the difficulties are powers of 2
+static uint8_t DiffExp(uint64_t diff) {
+  return diff != 0 ? 63 - __builtin_clzll(diff) : 0;
+}
+
+const uint16_t StratumMessageAgentDispatcher::kNoMiner;
+
 StratumMessageAgentDispatcher::StratumMessageAgentDispatcher(
     IStratumSession &session, const DiffController &diffController)
   : session_(session)
@@ -155,8 +174,8 @@ StratumMessageAgentDispatcher::StratumMessageAgentDispatcher(
 }
 
 StratumMessageAgentDispatcher::~StratumMessageAgentDispatcher() {
-  while (!miners_.empty()) {
-    unregisterWorker(miners_.begin()->first);
+  while (!sessionIds_.empty()) {
+    unregisterWorker(sessionIds_.back());
   }
 }
 
@@ -191,14 +210,16 @@ void StratumMessageAgentDispatcher::handleExMessage(const string &exMessage) {
 }
 
 void StratumMessageAgentDispatcher::setMinDiff(uint64_t minDiff) {
-  for (auto &p : miners_) {
-    p.second->setMinDiff(minDiff);
+  for (size_t i = 0; i < miners_.size(); i++) {
+    miners_[i]->setMinDiff(minDiff);
+    curDiffs_[i] = miners_[i]->getCurDiff();
   }
 }
 
 void StratumMessageAgentDispatcher::resetCurDiff(uint64_t curDiff) {
-  for (auto &p : miners_) {
-    p.second->resetCurDiff(curDiff);
+  for (size_t i = 0; i < miners_.size(); i++) {
+    miners_[i]->resetCurDiff(curDiff);
+    curDiffs_[i] = miners_[i]->getCurDiff();
   }
 }
 
@@ -209,58 +230,75 @@ void StratumMessageAgentDispatcher::addLocalJob(LocalJob &localJob) {
     curDiff_ = agentDiff;
   }
 
-  map<uint8_t, vector<uint16_t>> newDiffs;
-  for (auto &p : miners_) {
-    uint64_t curDiff = p.second->getCurDiff();
-    uint8_t oldDiff = curDiff ? log2(curDiff) : 0;
-    uint8_t newDiff = log2(p.second->addLocalJob(localJob));
-    if (newDiff != oldDiff) {
-      newDiffs[newDiff].push_back(p.first);
+  // Collect the sub-workers whose difficulty changed and count them by
+  // difficulty, then group their session ids with a counting sort
+  std::array<uint16_t, 64> diffCounts{};
+  changedMiners_.clear();
+  for (size_t i = 0; i < miners_.size(); i++) {
+    curDiffs_[i] = miners_[i]->addLocalJob(localJob);
+    uint8_t diffExp = DiffExp(curDiffs_[i]);
+    if (diffExp != diffExps_[i]) {
+      diffExps_[i] = diffExp;
+      diffCounts[diffExp]++;
+      changedMiners_.push_back(i);
     }
   }
 
-  if (!newDiffs.empty()) {
-    //
-    // CMD_MINING_SET_DIFF:
-    // | magic_number(1) | cmd(1) | len (2) | diff_2_exp(1) | count(2) |
-    // session_id (2) ... |
-    //
-    //
-    // max session id count is 32,764, each message's max length is UINT16_MAX.
-    //     65535 -1-1-2-1-2 = 65,528
-    //     65,528 / 2 = 32,764
-    //
-    string data;
-    getSetDiffCommand(newDiffs, data);
-    session_.sendData(data);
+  if (!changedMiners_.empty()) {
+    std::array<uint16_t, 64> offsets;
+    uint16_t offset = 0;
+    for (size_t diffExp = 0; diffExp < diffCounts.size(); diffExp++) {
+      offsets[diffExp] = offset;
+      offset += diffCounts[diffExp];
+    }
+    setDiffSessionIds_.resize(changedMiners_.size());
+    for (auto i : changedMiners_) {
+      setDiffSessionIds_[offsets[diffExps_[i]]++] = sessionIds_[i];
+    }
+
+    setDiffMessage_.clear();
+    offset = 0;
+    for (size_t diffExp = 0; diffExp < diffCounts.size(); diffExp++) {
+      if (diffCounts[diffExp] > 0) {
+        appendSetDiffCommand(
+            diffExp,
+            setDiffSessionIds_.data() + offset,
+            diffCounts[diffExp],
+            setDiffMessage_);
+        offset += diffCounts[diffExp];
+      }
+    }
+    session_.sendData(setDiffMessage_);
   }
 }
 
 void StratumMessageAgentDispatcher::removeLocalJob(LocalJob &localJob) {
-  for (auto &p : miners_) {
-    p.second->removeLocalJob(localJob);
+  for (auto &miner : miners_) {
+    miner->removeLocalJob(localJob);
+  }
+}
+
+uint64_t StratumMessageAgentDispatcher::getTotalDiff() const {
+  uint64_t totalDiff = 0;
+  for (auto diff : curDiffs_) {
+    totalDiff += diff;
   }
+  return totalDiff;
 }
 
 void StratumMessageAgentDispatcher::beforeSwitchChain() {
   // remove worker from the old chain
-  for (auto &itr : miners_) {
-    auto &miner = itr.second;
-    if (miner) {
-      session_.removeWorker(
-          miner->clientAgent(), miner->workerName(), miner->workerId());
-    }
+  for (auto &miner : miners_) {
+    session_.removeWorker(
+        miner->clientAgent(), miner->workerName(), miner->workerId());
   }
 }
 
 void StratumMessageAgentDispatcher::afterSwitchChain() {
   // add worker to the new chain
-  for (auto &itr : miners_) {
-    auto &miner = itr.second;
-    if (miner) {
-      session_.addWorker(
-          miner->clientAgent(), miner->workerName(), miner->workerId());
-    }
+  for (auto &miner : miners_) {
+    session_.addWorker(
+        miner->clientAgent(), miner->workerName(), miner->workerId());
   }
 }
 
@@ -324,10 +362,18 @@ void StratumMessageAgentDispatcher::handleExMessage_SessionSpecific(
   // | magic_number(1) | cmd(1) | len (2) | ... | session_id(2) | ...
   //
   auto sessionId = session_.decodeSessionId(exMessage);
-  auto iter = miners_.find(sessionId);
-  if (iter != miners_.end()) {
-    iter->second->handleExMessage(exMessage);
+  auto miner = findMiner(sessionId);
+  if (miner != nullptr) {
+    miner->handleExMessage(exMessage);
+  }
+}
+
+StratumMiner *
+StratumMessageAgentDispatcher::findMiner(uint32_t sessionId) const {
+  if (sessionId >= minerIndex_.size() || minerIndex_[sessionId] == kNoMiner) {
+    return nullptr;
   }
+  return miners_[minerIndex_[sessionId]].get();
 }
 
 void StratumMessageAgentDispatcher::registerWorker(
@@ -338,23 +384,66 @@ void StratumMessageAgentDispatcher::registerWorker(
   DLOG(INFO) << "[agent] clientAgent: " << clientAgent
              << ", workerName: " << workerName << ", workerId: " << workerId
              << ", session id:" << sessionId;
-  miners_.emplace(
-      sessionId, session_.createMiner(clientAgent, workerName, workerId));
+  if (sessionId > StratumMessageEx::AGENT_MAX_SESSION_ID) {
+    LOG(WARNING) << "[agent] ignore worker " << workerName
+                 << " with invalid session id " << sessionId;
+    return;
+  }
+
+  auto miner = session_.createMiner(clientAgent, workerName, workerId);
+  // the first registration of a session id wins
+  if (miner && findMiner(sessionId) == nullptr) {
+    if (sessionId >= minerIndex_.size()) {
+      minerIndex_.resize(sessionId + 1, kNoMiner);
+    }
+    minerIndex_[sessionId] = miners_.size();
+    sessionIds_.push_back(sessionId);
+    curDiffs_.push_back(miner->getCurDiff());
+    diffExps_.push_back(DiffExp(miner->getCurDiff()));
+    miners_.push_back(move(miner));
+  }
   session_.addWorker(clientAgent, workerName, workerId);
 }
 
 void StratumMessageAgentDispatcher::unregisterWorker(uint32_t sessionId) {
-  auto &miner = miners_[sessionId];
-  if (miner) {
-    session_.removeWorker(
-        miner->clientAgent(), miner->workerName(), miner->workerId());
+  auto miner = findMiner(sessionId);
+  if (miner == nullptr) {
+    return;
+  }
+  session_.removeWorker(
+      miner->clientAgent(), miner->workerName(), miner->workerId());
+
+  // move the last sub-worker into the hole
+  size_t index = minerIndex_[sessionId];
+  size_t last = miners_.size() - 1;
+  if (index != last) {
+    sessionIds_[index] = sessionIds_[last];
+    miners_[index] = move(miners_[last]);
+    curDiffs_[index] = curDiffs_[last];
+    diffExps_[index] = diffExps_[last];
+    minerIndex_[sessionIds_[index]] = index;
   }
-  miners_.erase(sessionId);
+  sessionIds_.pop_back();
+  miners_.pop_back();
+  curDiffs_.pop_back();
+  diffExps_.pop_back();
+  minerIndex_[sessionId] = kNoMiner;
 }
 
 void StratumMessageAgentDispatcher::getSetDiffCommand(
     std::map<uint8_t, std::vector<uint16_t>> &diffSessionIds,
     std::string &exMessage) {
+  exMessage.clear();
+  for (auto &p : diffSessionIds) {
+    appendSetDiffCommand(p.first, p.second.data(), p.second.size(), exMessage);
+  }
+}
+
+void StratumMessageAgentDispatcher::appendSetDiffCommand(
+    uint8_t diffExp,
+    const uint16_t *sessionIds,
+    size_t count,
+    std::string &exMessage) {
   //
   // CMD_MINING_SET_DIFF:
   // | magic_number(1) | cmd(1) | len (2) | diff_2_exp(1) | count(2) |
@@ -366,44 +455,34 @@ void StratumMessageAgentDispatcher::getSetDiffCommand(
   //     65,528 / 2 = 32,764
   //
   static const size_t kMaxCount = 32764;
-  exMessage.clear();
 
-  for (auto &p : diffSessionIds) {
-    auto iter = p.second.begin();
-    auto iend = p.second.end();
-    while (iter != iend) {
-      size_t count = distance(iter, iend);
-      if (count > kMaxCount)
-        count = kMaxCount;
-
-      string buf;
-      uint16_t len = 1 + 1 + 2 + 1 + 2 + count * 2;
-      buf.resize(len);
-      auto start = &buf.front();
-      auto header = reinterpret_cast<StratumMessageExMiningSetDiff *>(start);
-
-      // cmd
-      header->magic = StratumMessageEx::CMD_MAGIC_NUMBER;
-      header->command = static_cast<uint8_t>(StratumCommandEx::MINING_SET_DIFF);
-
-      // len
-      header->length = len;
-
-      // diff, 2 exp
-      header->diffExp = p.first;
-
-      // count
-      header->count = count;
-      auto p = reinterpret_cast<boost::endian::little_uint16_buf_t *>(
-          start + 1 + 1 + 2 + 1 + 2);
-
-      // session ids
-      for (size_t j = 0; j < count; j++) {
-        *(p++) = *(iter++);
-      }
+  while (count > 0) {
+    size_t n = std::min(count, kMaxCount);
+    uint16_t len = 1 + 1 + 2 + 1 + 2 + n * 2;
+    size_t start = exMessage.size();
+    exMessage.resize(start + len);
+    auto header =
+        reinterpret_cast<StratumMessageExMiningSetDiff *>(&exMessage[start]);
 
-      exMessage.append(buf);
+    // cmd
+    header->magic = StratumMessageEx::CMD_MAGIC_NUMBER;
+    header->command = static_cast<uint8_t>(StratumCommandEx::MINING_SET_DIFF);
 
-    } /* /while */
-  } /* /for */
+    // len
+    header->length = len;
+
+    // diff, 2 exp
+    header->diffExp = diffExp;
+
+    // count
+    header->count = n;
+    auto p = reinterpret_cast<boost::endian::little_uint16_buf_t *>(
+        &exMessage[start + 1 + 1 + 2 + 1 + 2]);
+
+    // session ids
+    for (size_t j = 0; j < n; j++) {
+      *(p++) = *(sessionIds++);
+    }
+    count -= n;
+  }
 }
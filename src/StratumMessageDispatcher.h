@@ -25,6 +25,7 @@
 #ifndef STRATUM_MESSAGE_DISPATCHER_H
 #define STRATUM_MESSAGE_DISPATCHER_H
 
+#include "StratumRequest.h"
 #include "utilities_js.hpp"
 
 #include <cstdint>
@@ -48,6 +49,12 @@ public:
       const std::string &method,
       const JsonNode &jparams,
       const JsonNode &jroot) = 0;
+  // Handle a mining.submit with scalar params without JsonNode, returns false
+  // if it must be handled by handleRequest() instead
+  virtual bool
+  handleSubmit(const std::string &idStr, const StratumRequest &request) {
+    return false;
+  }
   virtual void handleExMessage(const std::string &exMessage) = 0;
   virtual void responseShareAccepted(const std::string &idStr) = 0;
   virtual void
@@ -57,6 +64,8 @@ public:
   virtual void resetCurDiff(uint64_t curDiff) = 0;
   virtual void addLocalJob(LocalJob &localJob) = 0;
   virtual void removeLocalJob(LocalJob &localJob) = 0;
+  // Sum of the current difficulties of the miners, it follows their hashrate
+  virtual uint64_t getTotalDiff() const { return 0; }
 
   // Some states (such as agent workers) may need to be updated after
   // switching chain
@@ -92,6 +101,8 @@ public:
       const std::string &method,
       const JsonNode &jparams,
       const JsonNode &jroot) override;
+  bool handleSubmit(
+      const std::string &idStr, const StratumRequest &request) override;
   void handleExMessage(const std::string &exMessage) override;
   void responseShareAccepted(const std::string &idStr) override;
   void responseShareAcceptedWithStatus(
@@ -101,6 +112,7 @@ public:
   void resetCurDiff(uint64_t curDiff) override;
   void addLocalJob(LocalJob &localJob) override;
   void removeLocalJob(LocalJob &localJob) override;
+  uint64_t getTotalDiff() const override;
 
 protected:
   IStratumSession &session_;
@@ -127,6 +139,7 @@ public:
   void resetCurDiff(uint64_t curDiff) override;
   void addLocalJob(LocalJob &localJob) override;
   void removeLocalJob(LocalJob &localJob) override;
+  uint64_t getTotalDiff() const override;
 
   void beforeSwitchChain() override;
   void afterSwitchChain() override;
@@ -147,12 +160,37 @@ public:
   static void getSetDiffCommand(
       std::map<uint8_t, std::vector<uint16_t>> &diffSessionIds,
       std::string &exMessage);
+  // Append the CMD_MINING_SET_DIFF messages setting the difficulty 2^diffExp
+  // to the sessions, split as needed
+  static void appendSetDiffCommand(
+      uint8_t diffExp,
+      const uint16_t *sessionIds,
+      size_t count,
+      std::string &exMessage);
 
 protected:
+  static const uint16_t kNoMiner = UINT16_MAX;
+
+  StratumMiner *findMiner(uint32_t sessionId) const;
+
   IStratumSession &session_;
   std::unique_ptr<DiffController> diffController_;
   uint64_t curDiff_;
-  std::map<uint16_t, std::unique_ptr<StratumMiner>> miners_;
+
+  // The sub-workers are stored densely in registration order, as a structure
+  // of arrays, so a job broadcast is a linear pass over them. minerIndex_
+  // maps a session id to the position of its sub-worker, or kNoMiner.
+  std::vector<uint16_t> minerIndex_;
+  std::vector<uint16_t> sessionIds_;
+  std::vector<std::unique_ptr<StratumMiner>> miners_;
+  std::vector<uint64_t> curDiffs_;
+  // log2 of the difficulty last sent to the agent for the sub-worker
+  std::vector<uint8_t> diffExps_;
+
+  // Scratch buffers of addLocalJob(), kept to reuse their memory
+  std::vector<uint16_t> changedMiners_;
+  std::vector<uint16_t> setDiffSessionIds_;
+  std::string setDiffMessage_;
 };
 
 #endif // #ifndef STRATUM_MESSAGE_DISPATCHER_H
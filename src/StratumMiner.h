@@ -25,11 +25,13 @@
 #define STRATUM_MINER_H_
 
 #include "Statistics.h"
+#include "StratumRequest.h"
 #include "utilities_js.hpp"
 
 #include <cstdint>
-#include <map>
 #include <memory>
+#include <utility>
+#include <vector>
 
 class DiffController;
 struct LocalJob;
@@ -58,6 +60,12 @@ public:
       const std::string &method,
       const JsonNode &jparams,
       const JsonNode &jroot) = 0;
+  // mining.submit with scalar params, returns false if the miner only handles
+  // it in handleRequest()
+  virtual bool
+  handleSubmit(const std::string &idStr, const StratumRequest &request) {
+    return false;
+  }
   virtual void handleExMessage(
       const std::string &exMessage){}; // No agent support by default
   void setMinDiff(uint64_t minDiff);
@@ -91,6 +99,53 @@ protected:
   shared_ptr<bool> alive_;
 };
 
+// The difficulties of the local jobs of a miner, with the lookups of a map.
+// A session only keeps a few local jobs, added at the back and removed from
+// the front, so a vector searched from the newest job is faster and does not
+// allocate once its capacity is reached.
+template <typename JobDiffType>
+class LocalJobDiffs {
+  using Entry = std::pair<const LocalJob *, JobDiffType>;
+
+public:
+  using iterator = typename std::vector<Entry>::iterator;
+
+  iterator begin() { return diffs_.begin(); }
+  iterator end() { return diffs_.end(); }
+  size_t size() const { return diffs_.size(); }
+
+  iterator find(const LocalJob *localJob) {
+    for (auto itr = diffs_.end(); itr != diffs_.begin();) {
+      if ((--itr)->first == localJob) {
+        return itr;
+      }
+    }
+    return diffs_.end();
+  }
+
+  JobDiffType &operator[](const LocalJob *localJob) {
+    auto itr = find(localJob);
+    if (itr != diffs_.end()) {
+      return itr->second;
+    }
+    diffs_.emplace_back(localJob, JobDiffType());
+    return diffs_.back().second;
+  }
+
+  // the oldest job is usually removed, it is searched from the front
+  void erase(const LocalJob *localJob) {
+    for (auto itr = diffs_.begin(); itr != diffs_.end(); ++itr) {
+      if (itr->first == localJob) {
+        diffs_.erase(itr);
+        return;
+      }
+    }
+  }
+
+private:
+  std::vector<Entry> diffs_;
+};
+
 template <typename StratumTraits>
 class StratumMinerBase : public StratumMiner {
   using SessionType = typename StratumTraits::SessionType;
@@ -126,7 +181,7 @@ public:
   }
 
 protected:
-  std::map<const LocalJob *, JobDiffType> jobDiffs_;
+  LocalJobDiffs<JobDiffType> jobDiffs_;
 };
 
 #endif // #define STRATUM_MINER_H_
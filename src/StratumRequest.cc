@@ -0,0 +1,281 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2016] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "StratumRequest.h"
+
+#include <cstring>
+
+using JsonType = Utilities::JS::type;
+
+namespace {
+
+// the closing brackets of the nested values are tracked in a bit stack
+const size_t kMaxDepth = 64;
+
+const char *SkipSpaces(const char *p, const char *end) {
+  while (p != end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+    ++p;
+  }
+  return p;
+}
+
+// p is after the opening quote, returns the closing quote or end
+const char *SkipString(const char *p, const char *end) {
+  while (p != end) {
+    if (*p == '"') {
+      return p;
+    }
+    if (*p == '\\' && ++p == end) {
+      return end;
+    }
+    ++p;
+  }
+  return end;
+}
+
+const char *SkipDigits(const char *p, const char *end) {
+  while (p != end && *p >= '0' && *p <= '9') {
+    ++p;
+  }
+  return p;
+}
+
+bool HasLiteral(const char *p, const char *end, const char *literal) {
+  size_t size = strlen(literal);
+  return (size_t)(end - p) >= size && memcmp(p, literal, size) == 0;
+}
+
+bool IsKey(const char *begin, const char *end, const char *key) {
+  size_t size = strlen(key);
+  return (size_t)(end - begin) == size && memcmp(begin, key, size) == 0;
+}
+
+} // namespace
+
+bool StratumRequest::Value::equals(const char *str, size_t size) const {
+  return this->size() == size && memcmp(begin_, str, size) == 0;
+}
+
+bool StratumRequest::isMethod(const char *method) const {
+  return method_.type_ == JsonType::Str &&
+      method_.equals(method, strlen(method));
+}
+
+void StratumRequest::getIdStr(std::string &out) const {
+  if (id_.type_ == JsonType::Int) {
+    out.assign(id_.begin_, id_.end_);
+  } else if (id_.type_ == JsonType::Str) {
+    out.assign(1, '"');
+    out.append(id_.begin_, id_.end_);
+    out.push_back('"');
+  } else {
+    out.assign("null");
+  }
+}
+
+// p is at the first character of the value, returns the end of the value or
+// nullptr if it is malformed. Objects and arrays are only checked for
+// balanced brackets.
+const char *StratumRequest::skipValue(
+    const char *p, const char *end, Value *value) const {
+  if (p == end) {
+    return nullptr;
+  }
+  value->begin_ = p;
+
+  if (*p == '"') {
+    const char *close = SkipString(p + 1, end);
+    if (close == end) {
+      return nullptr;
+    }
+    value->type_ = JsonType::Str;
+    value->begin_ = p + 1;
+    value->end_ = close;
+    return close + 1;
+  }
+
+  if (*p == '{' || *p == '[') {
+    value->type_ = (*p == '{') ? JsonType::Obj : JsonType::Array;
+    uint64_t isObj = 0; // bit i is set if the value at depth i is an object
+    size_t depth = 0;
+    for (; p != end; ++p) {
+      if (*p == '"') {
+        p = SkipString(p + 1, end);
+        if (p == end) {
+          return nullptr;
+        }
+      } else if (*p == '{' || *p == '[') {
+        if (depth == kMaxDepth) {
+          return nullptr;
+        }
+        isObj = (isObj & ~(1ull << depth)) | ((uint64_t)(*p == '{') << depth);
+        ++depth;
+      } else if (*p == '}' || *p == ']') {
+        --depth;
+        if (((isObj >> depth) & 1) != (*p == '}')) {
+          return nullptr;
+        }
+        if (depth == 0) {
+          value->end_ = p + 1;
+          return p + 1;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  if (HasLiteral(p, end, "true") || HasLiteral(p, end, "false")) {
+    value->type_ = JsonType::Bool;
+    value->end_ = p + (*p == 't' ? 4 : 5);
+    return value->end_;
+  }
+  if (HasLiteral(p, end, "null")) {
+    value->type_ = JsonType::Null;
+    value->end_ = p + 4;
+    return value->end_;
+  }
+
+  // number
+  const char *digits = (*p == '-') ? p + 1 : p;
+  const char *q = SkipDigits(digits, end);
+  if (q == digits) {
+    return nullptr;
+  }
+  value->type_ = JsonType::Int;
+  if (q != end && *q == '.') {
+    value->type_ = JsonType::Real;
+    q = SkipDigits(q + 1, end);
+  }
+  if (q != end && (*q == 'e' || *q == 'E')) {
+    value->type_ = JsonType::Real;
+    ++q;
+    if (q != end && (*q == '+' || *q == '-')) {
+      ++q;
+    }
+    q = SkipDigits(q, end);
+  }
+  value->end_ = q;
+  return q;
+}
+
+// p is at the opening bracket of the array
+const char *StratumRequest::skipParams(const char *p, const char *end) {
+  scalarParams_ = true;
+  paramsSize_ = 0;
+
+  p = SkipSpaces(p + 1, end);
+  if (p != end && *p == ']') {
+    return p + 1;
+  }
+  for (;;) {
+    Value value;
+    p = skipValue(p, end, &value);
+    if (p == nullptr) {
+      return nullptr;
+    }
+    if (value.type_ == JsonType::Obj || value.type_ == JsonType::Array ||
+        paramsSize_ == kMaxParams) {
+      scalarParams_ = false;
+    } else {
+      params_[paramsSize_++] = value;
+    }
+
+    p = SkipSpaces(p, end);
+    if (p == end) {
+      return nullptr;
+    }
+    if (*p == ']') {
+      return p + 1;
+    }
+    if (*p != ',') {
+      return nullptr;
+    }
+    p = SkipSpaces(p + 1, end);
+  }
+}
+
+bool StratumRequest::scan(const char *begin, const char *end) {
+  id_ = Value();
+  method_ = Value();
+  scalarParams_ = false;
+  paramsSize_ = 0;
+
+  const char *p = SkipSpaces(begin, end);
+  if (p == end || *p != '{') {
+    return false;
+  }
+  p = SkipSpaces(p + 1, end);
+  if (p != end && *p == '}') {
+    return SkipSpaces(p + 1, end) == end;
+  }
+
+  for (;;) {
+    if (p == end || *p != '"') {
+      return false;
+    }
+    const char *keyBegin = p + 1;
+    const char *keyEnd = SkipString(keyBegin, end);
+    if (keyEnd == end) {
+      return false;
+    }
+    p = SkipSpaces(keyEnd + 1, end);
+    if (p == end || *p != ':') {
+      return false;
+    }
+    p = SkipSpaces(p + 1, end);
+
+    if (IsKey(keyBegin, keyEnd, "params")) {
+      if (p != end && *p == '[') {
+        p = skipParams(p, end);
+      } else {
+        Value value;
+        p = skipValue(p, end, &value);
+        scalarParams_ = false;
+        paramsSize_ = 0;
+      }
+    } else {
+      Value value;
+      p = skipValue(p, end, &value);
+      if (IsKey(keyBegin, keyEnd, "id")) {
+        id_ = value;
+      } else if (IsKey(keyBegin, keyEnd, "method")) {
+        method_ = value;
+      }
+    }
+    if (p == nullptr) {
+      return false;
+    }
+
+    p = SkipSpaces(p, end);
+    if (p == end) {
+      return false;
+    }
+    if (*p == '}') {
+      return SkipSpaces(p + 1, end) == end;
+    }
+    if (*p != ',') {
+      return false;
+    }
+    p = SkipSpaces(p + 1, end);
+  }
+}
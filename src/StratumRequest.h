@@ -0,0 +1,89 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2016] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#pragma once
+
+#include "utilities_js.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+//
+// A stratum request line scanned in place, without any allocation. Only the
+// members "id", "method" and "params" of the top level object are located,
+// the values point into the scanned line which must outlive the request.
+//
+// The scalar elements of an array "params" are recorded as well, so frequent
+// requests like mining.submit can be handled without building a JsonNode.
+// Requests with other shapes are handled by the JsonNode path.
+//
+class StratumRequest {
+public:
+  // A scalar JSON value, strings are kept escaped and without the quotes
+  // like JsonNode::str()
+  struct Value {
+    Utilities::JS::type type_ = Utilities::JS::type::Undefined;
+    const char *begin_ = "";
+    const char *end_ = "";
+
+    size_t size() const { return end_ - begin_; }
+    std::string str() const { return std::string(begin_, end_); }
+    bool equals(const char *str, size_t size) const;
+
+    // Same conversions as JsonNode, the value is always followed by a JSON
+    // delimiter in the line so it stops the parsing
+    uint32_t uint32() const { return strtoul(begin_, nullptr, 10); }
+    uint32_t uint32_hex() const { return strtoul(begin_, nullptr, 16); }
+    uint64_t uint64() const { return strtoull(begin_, nullptr, 10); }
+    uint64_t uint64_hex() const { return strtoull(begin_, nullptr, 16); }
+  };
+
+  static const size_t kMaxParams = 16;
+
+  // Returns false if the line is not a JSON object
+  bool scan(const char *begin, const char *end);
+
+  const Value &id() const { return id_; }
+  const Value &method() const { return method_; }
+  bool isMethod(const char *method) const;
+  // "params" is an array of scalars, at most kMaxParams of them
+  bool hasScalarParams() const { return scalarParams_; }
+  size_t paramsSize() const { return paramsSize_; }
+  const Value &param(size_t i) const { return params_[i]; }
+
+  // The id in the format of the responses: the number, the quoted string or
+  // null. Assigned to out to reuse its buffer.
+  void getIdStr(std::string &out) const;
+
+private:
+  const char *skipValue(const char *p, const char *end, Value *value) const;
+  const char *skipParams(const char *p, const char *end);
+
+  Value id_;
+  Value method_;
+  bool scalarParams_ = false;
+  size_t paramsSize_ = 0;
+  std::array<Value, kMaxParams> params_;
+};
@@ -34,10 +34,14 @@
 
 #include <netinet/tcp.h>
 
+#include <algorithm>
+#include <limits>
+
 using namespace std;
 
 static const uint32_t MIN_SHARE_WORKER_QUEUE_SIZE = 256;
 static const uint32_t MIN_SHARE_WORKER_THREADS = 1;
+static const uint32_t MIN_NETWORK_THREADS = 1;
 
 #ifndef WORK_WITH_STRATUM_SWITCHER
 
@@ -46,25 +50,16 @@ static const uint32_t MIN_SHARE_WORKER_THREADS = 1;
 template <uint8_t IBITS>
 SessionIDManagerT<IBITS>::SessionIDManagerT(const uint8_t serverId)
   : serverId_(serverId)
-  , count_(0)
+  , sessionIds_(kSessionIdMask + 1)
   , allocIdx_(0)
   , allocInterval_(0) {
   static_assert(IBITS <= 24, "IBITS cannot large than 24");
-  sessionIds_.reset();
 }
 
 template <uint8_t IBITS>
 bool SessionIDManagerT<IBITS>::ifFull() {
   ScopeLock sl(lock_);
-  return _ifFull();
-}
-
-template <uint8_t IBITS>
-bool SessionIDManagerT<IBITS>::_ifFull() {
-  if (count_ > kSessionIdMask) {
-    return true;
-  }
-  return false;
+  return sessionIds_.full();
 }
 
 template <uint8_t IBITS>
@@ -73,33 +68,45 @@ void SessionIDManagerT<IBITS>::setAllocInterval(uint32_t interval) {
 }
 
 template <uint8_t IBITS>
-bool SessionIDManagerT<IBITS>::allocSessionId(uint32_t *sessionID) {
-  ScopeLock sl(lock_);
-
-  if (_ifFull())
+bool SessionIDManagerT<IBITS>::_allocSessionId(uint32_t *sessionID) {
+  // find an empty bit, from allocIdx_ and rolling back to the beginning
+  size_t idx = sessionIds_.findClear(allocIdx_);
+  if (idx == HierarchicalBitmap::npos) {
     return false;
-
-  // find an empty bit
-  while (sessionIds_.test(allocIdx_) == true) {
-    allocIdx_ = (allocIdx_ + 1) & kSessionIdMask;
   }
 
   // set to true
-  sessionIds_.set(allocIdx_, true);
-  count_++;
+  sessionIds_.set(idx);
 
-  *sessionID = (((uint32_t)serverId_ << IBITS) | allocIdx_);
-  allocIdx_ = (allocIdx_ + allocInterval_) & kSessionIdMask;
+  *sessionID = (((uint32_t)serverId_ << IBITS) | (uint32_t)idx);
+  allocIdx_ = ((uint32_t)idx + allocInterval_) & kSessionIdMask;
   return true;
 }
 
+template <uint8_t IBITS>
+bool SessionIDManagerT<IBITS>::allocSessionId(uint32_t *sessionID) {
+  ScopeLock sl(lock_);
+  return _allocSessionId(sessionID);
+}
+
+template <uint8_t IBITS>
+size_t
+SessionIDManagerT<IBITS>::allocSessionIds(uint32_t *sessionIDs, size_t count) {
+  ScopeLock sl(lock_);
+
+  size_t allocated = 0;
+  while (allocated < count && _allocSessionId(sessionIDs + allocated)) {
+    allocated++;
+  }
+  return allocated;
+}
+
 template <uint8_t IBITS>
 void SessionIDManagerT<IBITS>::freeSessionId(uint32_t sessionId) {
   ScopeLock sl(lock_);
 
   const uint32_t idx = (sessionId & kSessionIdMask);
-  sessionIds_.set(idx, false);
-  count_--;
+  sessionIds_.reset(idx);
 }
 
 // Class template instantiation
@@ -129,6 +136,7 @@ JobRepository::JobRepository(
   , lastJobSendTime_(0)
   , lastJobId_(0)
   , lastJobHeight_(0)
+  , lastCleanJobNotifyDuration_(0)
   , niceHashForced_(niceHashForced)
   , niceHashMinDiff_(niceHashMinDiff) {
   assert(kMiningNotifyInterval_ < kMaxJobsLifeTime_);
@@ -171,6 +179,7 @@ void JobRepository::setMiningNotifyInterval(time_t miningNotifyInterval) {
 }
 
 shared_ptr<StratumJobEx> JobRepository::getStratumJobEx(const uint64_t jobId) {
+  std::shared_lock<std::shared_timed_mutex> l{exJobsLock_};
   auto itr = exJobs_.find(jobId);
   if (itr != exJobs_.end()) {
     return itr->second;
@@ -179,13 +188,20 @@ shared_ptr<StratumJobEx> JobRepository::getStratumJobEx(const uint64_t jobId) {
 }
 
 shared_ptr<StratumJobEx> JobRepository::getLatestStratumJobEx() {
+  std::shared_lock<std::shared_timed_mutex> l{exJobsLock_};
   if (exJobs_.size()) {
     return exJobs_.rbegin()->second;
   }
+  l.unlock();
   LOG(WARNING) << "getLatestStratumJobEx fail";
   return nullptr;
 }
 
+void JobRepository::addStratumJobEx(shared_ptr<StratumJobEx> exJob) {
+  std::unique_lock<std::shared_timed_mutex> l{exJobsLock_};
+  exJobs_[exJob->sjob_->jobId_] = std::move(exJob);
+}
+
 void JobRepository::stop() {
   if (!running_) {
     return;
@@ -321,6 +337,7 @@ JobRepository::createStratumJobEx(shared_ptr<StratumJob> sjob, bool isClean) {
 }
 
 void JobRepository::markAllJobsAsStale(uint64_t height) {
+  std::shared_lock<std::shared_timed_mutex> l{exJobsLock_};
   for (auto it : exJobs_) {
     auto &exjob = it.second;
     if (exjob->sjob_ && exjob->sjob_->height() <= height) {
@@ -340,7 +357,14 @@ void JobRepository::checkAndSendMiningNotify() {
 
 void JobRepository::sendMiningNotify(shared_ptr<StratumJobEx> exJob) {
   // send job to all clients
-  server_->sendMiningNotifyToAll(exJob);
+  server_->sendMiningNotifyToAll(exJob, [this, exJob]() {
+    if (exJob->isClean_) {
+      lastCleanJobNotifyDuration_ =
+          std::chrono::duration<double>(
+              std::chrono::steady_clock::now() - exJob->receivedTime_)
+              .count();
+    }
+  });
   lastJobSendTime_ = time(nullptr);
 
   // write last mining notify time to file
@@ -368,6 +392,7 @@ void JobRepository::tryCleanExpiredJobs() {
               << ", time: " << date("%F %T", jobTime);
 
     // remove expired job
+    std::unique_lock<std::shared_timed_mutex> l{exJobsLock_};
     exJobs_.erase(itr);
   }
 }
@@ -378,7 +403,8 @@ StratumJobEx::StratumJobEx(
   : state_(0)
   , chainId_(chainId)
   , isClean_(isClean)
-  , sjob_(sjob) {
+  , sjob_(sjob)
+  , receivedTime_(std::chrono::steady_clock::now()) {
   assert(sjob);
 }
 
@@ -398,6 +424,28 @@ bool StratumJobEx::isStale() {
 ///////////////////////////////////// StratumServer
 //////////////////////////////////////
 
+thread_local StratumServer::Reactor *StratumServer::currentReactor_ = nullptr;
+thread_local StratumServer::Reactor *StratumServer::originReactor_ = nullptr;
+
+StratumServer::Reactor::~Reactor() {
+  // Destroy connections before event base
+  pendingNotify_.reset();
+  connections_.clear();
+
+  if (notifyTimer_ != nullptr) {
+    event_free(notifyTimer_);
+  }
+  if (disconnectTimer_ != nullptr) {
+    event_free(disconnectTimer_);
+  }
+  if (listener_ != nullptr) {
+    evconnlistener_free(listener_);
+  }
+  if (base_ != nullptr) {
+    event_base_free(base_);
+  }
+}
+
 SSL_CTX *StratumServer::getSSLCTX(const libconfig::Config &config) {
   return get_server_SSL_CTX(
       config.lookup("sserver.tls_cert_file").c_str(),
@@ -406,11 +454,11 @@ SSL_CTX *StratumServer::getSSLCTX(const libconfig::Config &config) {
 
 StratumServer::StratumServer()
   : enableTLS_(false)
-  , base_(nullptr)
-  , listener_(nullptr)
   , tcpReadTimeout_(600)
   , shutdownGracePeriod_(3600)
-  , disconnectTimer_(nullptr)
+  , notifyBatchSize_(1000)
+  , drainingReactors_(0)
+  , sessionIdSlabSize_(0)
   , acceptStale_(true)
   , isEnableSimulator_(false)
   , isSubmitInvalidBlock_(false)
@@ -424,8 +472,23 @@ StratumServer::StratumServer()
 }
 
 StratumServer::~StratumServer() {
+  for (auto &reactor : reactors_) {
+    if (reactor->thread_.joinable()) {
+      reactor->thread_.join();
+    }
+  }
+
   // Destroy connections before event base
-  connections_.clear();
+  for (auto &reactor : reactors_) {
+    reactor->connections_.clear();
+#ifndef WORK_WITH_STRATUM_SWITCHER
+    // Return the ids left in the reactor's slab to the manager
+    for (uint32_t sessionId : reactor->sessionIds_) {
+      sessionIDManager_->freeSessionId(sessionId);
+    }
+    reactor->sessionIds_.clear();
+#endif
+  }
 
   if (statsExporter_) {
     if (statsExporter_) {
@@ -436,16 +499,8 @@ StratumServer::~StratumServer() {
     statsExporter_.reset();
   }
 
-  if (disconnectTimer_ != nullptr) {
-    event_free(disconnectTimer_);
-  }
+  reactors_.clear();
 
-  if (listener_ != nullptr) {
-    evconnlistener_free(listener_);
-  }
-  if (base_ != nullptr) {
-    event_base_free(base_);
-  }
   if (userInfo_ != nullptr) {
     delete userInfo_;
   }
@@ -732,6 +787,76 @@ bool StratumServer::setup(const libconfig::Config &config) {
   config.lookupValue("sserver.proxy_protocol", proxyProtocol_);
   LOG_IF(INFO, proxyProtocol_) << "PROXY protocol support enabled";
 
+  // ------------------- TCP Listen -------------------
+  // Create the reactors before starting any thread that may dispatch tasks to
+  // them. Connections will not be accepted until run() is called.
+
+  // Enable multithreading and flag BEV_OPT_THREADSAFE.
+  // Without it, bufferevent_socket_new() will return NULL with flag
+  // BEV_OPT_THREADSAFE.
+  evthread_use_pthreads();
+
+  memset(&sin_, 0, sizeof(sin_));
+  sin_.sin_family = AF_INET;
+  sin_.sin_port = htons(listenPort);
+  sin_.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (listenIP.empty() ||
+      inet_pton(AF_INET, listenIP.c_str(), &sin_.sin_addr) == 0) {
+    LOG(ERROR) << "invalid ip: " << listenIP;
+    return false;
+  }
+
+  config.lookupValue("sserver.shutdown_grace_period", shutdownGracePeriod_);
+
+  uint32_t notifyBatchSize = notifyBatchSize_;
+  config.lookupValue("sserver.notify_batch_size", notifyBatchSize);
+  notifyBatchSize_ = std::max(notifyBatchSize, 1u);
+
+  // Every network thread has its own event base and listener
+  uint32_t networkThreads = 1;
+  config.lookupValue("sserver.network_threads", networkThreads);
+  networkThreads = std::max(networkThreads, MIN_NETWORK_THREADS);
+  LOG_IF(INFO, networkThreads > 1)
+      << "[Option] " << networkThreads << " network threads";
+
+#ifndef WORK_WITH_STRATUM_SWITCHER
+  uint32_t sessionIdSlabSize = 0;
+  config.lookupValue("sserver.session_id_slab", sessionIdSlabSize);
+  sessionIdSlabSize_ = sessionIdSlabSize;
+  LOG_IF(INFO, sessionIdSlabSize_ > 0)
+      << "[Option] session ids reserved by " << sessionIdSlabSize_
+      << " for each network thread";
+#endif
+
+  for (size_t chainId = 0; chainId < chains_.size(); ++chainId) {
+    verifyDurations_.push_back(std::make_unique<prometheus::Histogram>());
+    broadcastDurations_.emplace_back();
+    for (auto &histogram : broadcastDurations_.back()) {
+      histogram = std::make_unique<prometheus::Histogram>();
+    }
+    notifyDurations_.emplace_back();
+    for (auto &histogram : notifyDurations_.back()) {
+      histogram = std::make_unique<prometheus::Histogram>();
+    }
+    produceDurations_.emplace_back();
+    for (auto &histogram : produceDurations_.back()) {
+      histogram = std::make_unique<prometheus::Histogram>();
+    }
+  }
+
+  for (size_t i = 0; i < networkThreads; ++i) {
+    auto reactor = std::make_unique<Reactor>();
+    reactor->server_ = this;
+    reactor->id_ = i;
+    reactor->shareStats_.resize(chains_.size());
+    reactor->cancelledNotifies_.resize(chains_.size());
+    if (!setupReactor(*reactor)) {
+      LOG(ERROR) << "cannot create listener: " << listenIP << ":" << listenPort;
+      return false;
+    }
+    reactors_.push_back(std::move(reactor));
+  }
+
   // ------------------- user info -------------------
   // It should at below of addChainVars() or sserver may crashed
   // because of IndexOutOfBoundsException in chains_.
@@ -838,47 +963,6 @@ bool StratumServer::setup(const libconfig::Config &config) {
     }
   }
 
-  // ------------------- TCP Listen -------------------
-
-  // Enable multithreading and flag BEV_OPT_THREADSAFE.
-  // Without it, bufferevent_socket_new() will return NULL with flag
-  // BEV_OPT_THREADSAFE.
-  evthread_use_pthreads();
-
-  base_ = event_base_new();
-  if (!base_) {
-    LOG(ERROR) << "server: cannot create base";
-    return false;
-  }
-
-  memset(&sin_, 0, sizeof(sin_));
-  sin_.sin_family = AF_INET;
-  sin_.sin_port = htons(listenPort);
-  sin_.sin_addr.s_addr = htonl(INADDR_ANY);
-  if (listenIP.empty() ||
-      inet_pton(AF_INET, listenIP.c_str(), &sin_.sin_addr) == 0) {
-    LOG(ERROR) << "invalid ip: " << listenIP;
-    return false;
-  }
-
-  listener_ = evconnlistener_new_bind(
-      base_,
-      StratumServer::listenerCallback,
-      (void *)this,
-      LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE_PORT,
-      -1,
-      (struct sockaddr *)&sin_,
-      sizeof(sin_));
-  if (!listener_) {
-    LOG(ERROR) << "cannot create listener: " << listenIP << ":" << listenPort;
-    return false;
-  }
-
-  // initialize but don't activate the graceful shutdown disconnect timer event
-  config.lookupValue("sserver.shutdown_grace_period", shutdownGracePeriod_);
-  disconnectTimer_ = event_new(
-      base_, -1, EV_PERSIST, &StratumServer::disconnectCallback, this);
-
   // check if TLS enabled
   config.lookupValue("sserver.enable_tls", enableTLS_);
   if (enableTLS_) {
@@ -906,7 +990,7 @@ bool StratumServer::setup(const libconfig::Config &config) {
     if (!statsExporter_->registerCollector(statsCollector_)) {
       LOG(WARNING) << "Failed to register stratum server statistics collector";
     }
-    if (!statsExporter_->run(base_)) {
+    if (!statsExporter_->run(reactors_.front()->base_)) {
       LOG(WARNING) << "Failed to run stratum server statistics exporter";
     }
   }
@@ -918,23 +1002,87 @@ bool StratumServer::setup(const libconfig::Config &config) {
 
   uint32_t shareWorkerThreads = 0;
   config.lookupValue("sserver.share_worker_threads", shareWorkerThreads);
-  shareWorker_->start(std::max(shareWorkerThreads, MIN_SHARE_WORKER_THREADS));
+  std::vector<int> shareWorkerCpus;
+  if (config.exists("sserver.share_worker_cpus")) {
+    const Setting &cpus = config.lookup("sserver.share_worker_cpus");
+    for (int i = 0; i < cpus.getLength(); i++) {
+      shareWorkerCpus.push_back(cpus[i]);
+    }
+  }
+  shareWorker_->start(
+      std::max(shareWorkerThreads, MIN_SHARE_WORKER_THREADS), shareWorkerCpus);
 
   // ------------------- Derived Class Setup -------------------
   return setupInternal(config);
 }
 
+bool StratumServer::setupReactor(Reactor &reactor) {
+  reactor.base_ = event_base_new();
+  if (!reactor.base_) {
+    LOG(ERROR) << "server: cannot create base";
+    return false;
+  }
+
+  // All listeners are bound to the same address with SO_REUSEPORT, the kernel
+  // distributes incoming connections between them.
+  reactor.listener_ = evconnlistener_new_bind(
+      reactor.base_,
+      StratumServer::listenerCallback,
+      (void *)&reactor,
+      LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE_PORT,
+      -1,
+      (struct sockaddr *)&sin_,
+      sizeof(sin_));
+  if (!reactor.listener_) {
+    return false;
+  }
+
+  // initialize but don't activate the graceful shutdown disconnect timer event
+  reactor.disconnectTimer_ = event_new(
+      reactor.base_,
+      -1,
+      EV_PERSIST,
+      &StratumServer::disconnectCallback,
+      &reactor);
+  reactor.notifyTimer_ =
+      evtimer_new(reactor.base_, &StratumServer::notifyTimerCallback, &reactor);
+  return true;
+}
+
 void StratumServer::run() {
   LOG(INFO) << "stratum server running";
-  if (base_ != NULL) {
-    //    event_base_loop(base_, EVLOOP_NONBLOCK);
-    event_base_dispatch(base_);
+  if (reactors_.empty()) {
+    return;
+  }
+
+  for (size_t i = 1; i < reactors_.size(); ++i) {
+    Reactor *reactor = reactors_[i].get();
+    reactor->thread_ = std::thread([reactor]() {
+      LOG(INFO) << "network thread " << reactor->id_ << " running";
+      currentReactor_ = reactor;
+      // The loop of a secondary reactor may be empty after its listener was
+      // disabled, keep it running until stop() is called.
+      event_base_loop(reactor->base_, EVLOOP_NO_EXIT_ON_EMPTY);
+      currentReactor_ = nullptr;
+    });
+  }
+
+  currentReactor_ = reactors_.front().get();
+  event_base_dispatch(reactors_.front()->base_);
+  currentReactor_ = nullptr;
+
+  for (auto &reactor : reactors_) {
+    if (reactor->thread_.joinable()) {
+      reactor->thread_.join();
+    }
   }
 }
 
 void StratumServer::stop() {
   LOG(INFO) << "stop stratum server";
-  event_base_loopexit(base_, NULL);
+  for (auto &reactor : reactors_) {
+    event_base_loopexit(reactor->base_, NULL);
+  }
   for (ChainVars &chain : chains_) {
     chain.jobRepository_->stop();
   }
@@ -945,17 +1093,29 @@ void StratumServer::stop() {
 void StratumServer::stopGracefully() {
   LOG(INFO) << "stop stratum server gracefully";
 
-  // Stop listening & trigger gracefully disconnecting timer
-  evconnlistener_disable(listener_);
-  if (connections_.empty()) {
-    dispatch([this]() { stop(); });
-  } else {
-    timeval timeout;
-    timeout.tv_sec = shutdownGracePeriod_ / connections_.size();
-    timeout.tv_usec =
-        (shutdownGracePeriod_ - timeout.tv_sec * connections_.size()) *
-        1000000 / connections_.size();
-    event_add(disconnectTimer_, &timeout);
+  drainingReactors_ = reactors_.size();
+  for (auto &reactor : reactors_) {
+    dispatch(*reactor, [this, reactor = reactor.get()]() {
+      // Stop listening & trigger gracefully disconnecting timer
+      evconnlistener_disable(reactor->listener_);
+      auto &connections = reactor->connections_;
+      if (connections.empty()) {
+        reactorDrained();
+      } else {
+        timeval timeout;
+        timeout.tv_sec = shutdownGracePeriod_ / connections.size();
+        timeout.tv_usec =
+            (shutdownGracePeriod_ - timeout.tv_sec * connections.size()) *
+            1000000 / connections.size();
+        event_add(reactor->disconnectTimer_, &timeout);
+      }
+    });
+  }
+}
+
+void StratumServer::reactorDrained() {
+  if (--drainingReactors_ == 0) {
+    dispatch(*reactors_.front(), [this]() { stop(); });
   }
 }
 
@@ -963,9 +1123,14 @@ namespace {
 
 class StratumServerTask {
 public:
-  StratumServerTask(event_base *base, std::function<void()> task)
+  StratumServerTask(
+      event_base *base,
+      std::function<void()> task,
+      prometheus::Histogram &delays)
     : task_{move(task)}
-    , event_{event_new(base, -1, 0, &StratumServerTask::execute, this)} {
+    , event_{event_new(base, -1, 0, &StratumServerTask::execute, this)}
+    , delays_{delays}
+    , dispatched_{std::chrono::steady_clock::now()} {
     event_add(event_, nullptr);
     event_active(event_, EV_TIMEOUT, 0);
   }
@@ -976,22 +1141,31 @@ public:
 
 private:
   ~StratumServerTask() {
+    delays_.observe(std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - dispatched_)
+                        .count());
     task_();
     event_free(event_);
   }
 
   std::function<void()> task_;
   struct event *event_;
+  prometheus::Histogram &delays_;
+  std::chrono::steady_clock::time_point dispatched_;
 };
 
 } // namespace
 
 void StratumServer::dispatch(std::function<void()> task) {
+  dispatch(currentReactor(), move(task));
+}
+
+void StratumServer::dispatch(Reactor &reactor, std::function<void()> task) {
   if (!task) {
     return;
   }
 
-  new StratumServerTask{base_, move(task)};
+  new StratumServerTask{reactor.base_, move(task), dispatchDelays_};
 }
 
 void StratumServer::dispatchSafely(
@@ -1007,34 +1181,122 @@ void StratumServer::dispatchSafely(
   });
 }
 
-void StratumServer::dispatchToShareWorker(std::function<void()> work) {
-  shareWorker_->dispatch(std::move(work));
+StratumServer::Reactor &StratumServer::currentReactor() {
+  if (currentReactor_ != nullptr) {
+    return *currentReactor_;
+  }
+  return originReactor_ != nullptr ? *originReactor_ : *reactors_.front();
 }
 
-size_t StratumServer::switchChain(string userName, size_t newChainId) {
-  size_t onlineSessions = 0;
-  for (auto &itr : connections_) {
-    if (itr->getUserName() == userName) {
-      onlineSessions++;
-      if (itr->getChainId() != newChainId) {
-        itr->switchChain(newChainId);
-      }
-    }
+void StratumServer::runInReactor(Reactor &reactor, std::function<void()> task) {
+  if (currentReactor_ == &reactor) {
+    task();
+  } else {
+    dispatch(reactor, move(task));
   }
-  return onlineSessions;
 }
 
-size_t StratumServer::autoRegCallback(const string &userName) {
-  size_t sessions = 0;
-  for (auto &itr : connections_) {
-    if (itr->autoRegCallback(userName)) {
-      sessions++;
-    }
+void StratumServer::forEachReactor(
+    std::function<size_t(Reactor &)> fn, std::function<void(size_t)> done) {
+  struct Progress {
+    std::atomic<size_t> pending;
+    std::atomic<size_t> result;
+  };
+  auto progress = std::make_shared<Progress>();
+  progress->pending = reactors_.size();
+  progress->result = 0;
+
+  for (auto &reactor : reactors_) {
+    runInReactor(
+        *reactor, [this, reactor = reactor.get(), fn, done, progress]() {
+          progress->result += fn(*reactor);
+          if (--progress->pending == 0 && done) {
+            runInReactor(*reactors_.front(), [done, progress]() {
+              done(progress->result);
+            });
+          }
+        });
   }
-  return sessions;
 }
 
-void StratumServer::sendMiningNotifyToAll(shared_ptr<StratumJobEx> exJobPtr) {
+void StratumServer::switchChain(
+    string userName,
+    size_t newChainId,
+    std::function<void(size_t)> done) {
+  forEachReactor(
+      [userName, newChainId](Reactor &reactor) {
+        size_t onlineSessions = 0;
+        for (auto &itr : reactor.connections_) {
+          if (itr->getUserName() == userName) {
+            onlineSessions++;
+            if (itr->getChainId() != newChainId) {
+              itr->switchChain(newChainId);
+            }
+          }
+        }
+        return onlineSessions;
+      },
+      move(done));
+}
+
+void StratumServer::autoRegCallback(
+    const string &userName, std::function<void(size_t)> done) {
+  forEachReactor(
+      [userName](Reactor &reactor) {
+        size_t sessions = 0;
+        for (auto &itr : reactor.connections_) {
+          if (itr->autoRegCallback(userName)) {
+            sessions++;
+          }
+        }
+        return sessions;
+      },
+      move(done));
+}
+
+void StratumServer::sendMiningNotifyToAll(
+    shared_ptr<StratumJobEx> exJobPtr, std::function<void()> done) {
+  // Each reactor notifies its own sessions, the reactor of the caller
+  // (normally the first one) is notified without a round trip.
+  auto start = std::chrono::steady_clock::now();
+  forEachReactor(
+      [this, exJobPtr](Reactor &reactor) {
+        sendMiningNotifyToReactor(reactor, exJobPtr);
+        return 0;
+      },
+      [this, exJobPtr, start, done = move(done)](size_t) {
+        broadcastDurations_[exJobPtr->chainId_][exJobPtr->isClean_]->observe(
+            std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+        if (done) {
+          done();
+        }
+      });
+}
+
+void StratumServer::sendMiningNotifyToReactor(
+    Reactor &reactor, shared_ptr<StratumJobEx> exJobPtr) {
+  // The previous broadcast holds pointers to the sessions, it must be done
+  // before any dead session is freed. If it is for the same chain, its job is
+  // superseded and the sessions not notified yet only get the new one.
+  // Otherwise the sessions of the other chain still need its job.
+  if (reactor.pendingNotify_) {
+    size_t chainId = reactor.pendingNotify_->exJob_->chainId_;
+    if (chainId == exJobPtr->chainId_) {
+      evtimer_del(reactor.notifyTimer_);
+      reactor.pendingNotify_.reset();
+      std::lock_guard<std::mutex> l{reactor.lock_};
+      ++reactor.cancelledNotifies_[chainId];
+    } else {
+      finishPendingNotify(reactor);
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::pair<uint64_t /* diff */, StratumSession *>> sessions;
+  sessions.reserve(reactor.connections_.size());
+
   //
   // http://www.sgi.com/tech/stl/Map.html
   //
@@ -1044,25 +1306,121 @@ void StratumServer::sendMiningNotifyToAll(shared_ptr<StratumJobEx> exJobPtr) {
   // of course, for iterators that actually point to the element that is
   // being erased.
   //
-  auto itr = connections_.begin();
-  while (itr != connections_.end()) {
+  auto &connections = reactor.connections_;
+  auto itr = connections.begin();
+  while (itr != connections.end()) {
     auto &conn = *itr;
     if (conn->isDead()) {
 #ifndef WORK_WITH_STRATUM_SWITCHER
       sessionIDManager_->freeSessionId(conn->getSessionId());
 #endif
-      itr = connections_.erase(itr);
+      std::lock_guard<std::mutex> l{reactor.lock_};
+      itr = connections.erase(itr);
     } else {
       if (conn->getChainId() == exJobPtr->chainId_) {
-        conn->sendMiningNotify(exJobPtr);
+        sessions.emplace_back(conn->getDispatcher().getTotalDiff(), conn.get());
       }
       ++itr;
     }
   }
+
+  // The difficulty follows the hashrate, the sessions with more hashrate waste
+  // more work on the stale job so they are notified first.
+  std::stable_sort(
+      sessions.begin(), sessions.end(), [](const auto &a, const auto &b) {
+        return a.first > b.first;
+      });
+
+  auto pending = std::make_unique<Reactor::PendingNotify>();
+  pending->exJob_ = exJobPtr;
+  pending->sessions_.reserve(sessions.size());
+  for (auto &p : sessions) {
+    pending->sessions_.push_back(p.second);
+  }
+  pending->start_ = start;
+  reactor.pendingNotify_ = std::move(pending);
+
+  // A clean job makes all the work in progress stale, send it at once. The
+  // others are spread over several loop iterations so that the shares coming
+  // in meanwhile are not delayed.
+  notifyPendingSessions(
+      reactor,
+      exJobPtr->isClean_ ? std::numeric_limits<size_t>::max()
+                         : notifyBatchSize_);
+}
+
+void StratumServer::notifyPendingSessions(
+    Reactor &reactor, size_t maxSessions) {
+  auto &pending = *reactor.pendingNotify_;
+  auto &exJob = pending.exJob_;
+  size_t end = pending.next_ +
+      std::min(maxSessions, pending.sessions_.size() - pending.next_);
+  for (; pending.next_ < end; ++pending.next_) {
+    auto session = pending.sessions_[pending.next_];
+    // the session may be closed or switched to another chain meanwhile
+    if (!session->isDead() && session->getChainId() == exJob->chainId_) {
+      session->sendMiningNotify(exJob);
+    }
+  }
+
+  if (pending.next_ < pending.sessions_.size()) {
+    // The timer fires after the pending network events are handled
+    timeval timeout = {0, 0};
+    evtimer_add(reactor.notifyTimer_, &timeout);
+    return;
+  }
+
+  notifyDurations_[exJob->chainId_][exJob->isClean_]->observe(
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - pending.start_)
+          .count());
+  reactor.pendingNotify_.reset();
+}
+
+StratumServer::ShareVerifyTimer::~ShareVerifyTimer() {
+  server_.observeVerifyDuration(
+      chainId_,
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start_)
+          .count());
+}
+
+void StratumServer::observeVerifyDuration(size_t chainId, double seconds) {
+  verifyDurations_[chainId]->observe(seconds);
+}
+
+void StratumServer::finishPendingNotify(Reactor &reactor) {
+  if (reactor.pendingNotify_) {
+    evtimer_del(reactor.notifyTimer_);
+    notifyPendingSessions(reactor, std::numeric_limits<size_t>::max());
+  }
+}
+
+#ifndef WORK_WITH_STRATUM_SWITCHER
+bool StratumServer::allocSessionId(Reactor &reactor, uint32_t *sessionID) {
+  if (sessionIdSlabSize_ == 0) {
+    return sessionIDManager_->allocSessionId(sessionID);
+  }
+
+  // Reserve a slab of ids so the manager is only locked once per slab
+  auto &ids = reactor.sessionIds_;
+  if (ids.empty()) {
+    ids.resize(sessionIdSlabSize_);
+    ids.resize(sessionIDManager_->allocSessionIds(ids.data(), ids.size()));
+    if (ids.empty()) {
+      return false;
+    }
+    std::reverse(ids.begin(), ids.end());
+  }
+  *sessionID = ids.back();
+  ids.pop_back();
+  return true;
 }
+#endif
 
-void StratumServer::addConnection(unique_ptr<StratumSession> connection) {
-  connections_.insert(move(connection));
+void StratumServer::addConnection(
+    Reactor &reactor, unique_ptr<StratumSession> connection) {
+  std::lock_guard<std::mutex> l{reactor.lock_};
+  reactor.connections_.insert(move(connection));
 }
 
 void StratumServer::removeConnection(StratumSession &connection) {
@@ -1079,14 +1437,15 @@ void StratumServer::listenerCallback(
     struct sockaddr *saddr,
     int socklen,
     void *data) {
-  StratumServer *server = static_cast<StratumServer *>(data);
-  struct event_base *base = (struct event_base *)server->base_;
+  auto reactor = static_cast<Reactor *>(data);
+  StratumServer *server = reactor->server_;
+  struct event_base *base = reactor->base_;
   struct bufferevent *bev;
   uint32_t sessionID = 0u;
 
 #ifndef WORK_WITH_STRATUM_SWITCHER
   // can't alloc session Id
-  if (server->sessionIDManager_->allocSessionId(&sessionID) == false) {
+  if (server->allocSessionId(*reactor, &sessionID) == false) {
     close(fd);
     return;
   }
@@ -1145,24 +1504,36 @@ void StratumServer::listenerCallback(
   // By default, a newly created bufferevent has writing enabled.
   bufferevent_enable(bev, EV_READ | EV_WRITE);
 
-  server->addConnection(move(conn));
+  server->addConnection(*reactor, move(conn));
 }
 
 void StratumServer::disconnectCallback(int, short, void *context) {
-  auto server = static_cast<StratumServer *>(context);
-  if (server->connections_.empty()) {
-    server->stop();
+  auto reactor = static_cast<Reactor *>(context);
+  reactor->server_->finishPendingNotify(*reactor);
+  auto &connections = reactor->connections_;
+  if (connections.empty()) {
+    event_del(reactor->disconnectTimer_);
+    reactor->server_->reactorDrained();
   } else {
-    auto iter = server->connections_.begin();
-    auto iend = server->connections_.end();
+    std::lock_guard<std::mutex> l{reactor->lock_};
+    auto iter = connections.begin();
+    auto iend = connections.end();
     StratumSession::State state;
     do {
       state = (*iter)->getState();
-      iter = server->connections_.erase(iter);
+      iter = connections.erase(iter);
     } while (state < StratumSession::AUTHENTICATED && iter != iend);
   }
 }
 
+void StratumServer::notifyTimerCallback(int, short, void *context) {
+  auto reactor = static_cast<Reactor *>(context);
+  if (reactor->pendingNotify_) {
+    reactor->server_->notifyPendingSessions(
+        *reactor, reactor->server_->notifyBatchSize_);
+  }
+}
+
 void StratumServer::readCallback(struct bufferevent *bev, void *connection) {
   auto conn = static_cast<StratumSession *>(connection);
   conn->readBuf(bufferevent_get_input(bev));
@@ -1199,13 +1570,21 @@ void StratumServer::eventCallback(
   conn->getServer().removeConnection(*conn);
 }
 
+void StratumServer::reportShare(size_t chainId, int32_t status) {
+  auto &reactor = currentReactor();
+  std::lock_guard<std::mutex> l{reactor.lock_};
+  ++reactor.shareStats_[chainId][status];
+}
+
 void StratumServer::sendShare2Kafka(
     size_t chainId, const char *data, size_t len) {
+  prometheus::HistogramTimer timer{*produceDurations_[chainId][0]};
   chains_[chainId].kafkaProducerShareLog_->produce(data, len);
 }
 
 void StratumServer::sendSolvedShare2Kafka(
     size_t chainId, const char *data, size_t len) {
+  prometheus::HistogramTimer timer{*produceDurations_[chainId][1]};
   chains_[chainId].kafkaProducerSolvedShare_->produce(data, len);
 }
 
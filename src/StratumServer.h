@@ -33,12 +33,15 @@
 
 #include "prometheus/Exporter.h"
 #include "prometheus/Collector.h"
+#include "prometheus/Histogram.h"
 #include "prometheus/Metric.h"
 
 #include "WorkerPool.h"
+#include "HierarchicalBitmap.h"
 
-#include <bitset>
+#include <array>
 #include <regex>
+#include <shared_mutex>
 
 #include <openssl/ssl.h>
 #include <event2/bufferevent.h>
@@ -75,11 +78,17 @@ public:
   // mining space for workers and there is no DoS risk.
   virtual void setAllocInterval(uint32_t interval) = 0;
   virtual bool allocSessionId(uint32_t *sessionID) = 0;
+  // Allocate up to count ids in one go, in the same order as successive calls
+  // of allocSessionId(). Return the number of ids allocated.
+  virtual size_t allocSessionIds(uint32_t *sessionIDs, size_t count) = 0;
   virtual void freeSessionId(uint32_t sessionId) = 0;
 };
 
 // thread-safe
 // template IBITS: index bits
+//
+// The used ids are kept in a hierarchical bitmap, so finding the next free id
+// does not depend on how many ids are used.
 template <uint8_t IBITS>
 class SessionIDManagerT : public SessionIDManager {
   //
@@ -95,14 +104,13 @@ class SessionIDManagerT : public SessionIDManager {
       (1 << IBITS) - 1; // example: 0x00FFFFFF;
 
   uint8_t serverId_;
-  std::bitset<kSessionIdMask + 1> sessionIds_;
+  HierarchicalBitmap sessionIds_;
 
-  uint32_t count_; // how many ids are used now
   uint32_t allocIdx_;
   uint32_t allocInterval_;
   mutex lock_;
 
-  bool _ifFull();
+  bool _allocSessionId(uint32_t *sessionID);
 
 public:
   SessionIDManagerT(const uint8_t serverId);
@@ -110,6 +118,7 @@ public:
   bool ifFull() override;
   void setAllocInterval(uint32_t interval) override;
   bool allocSessionId(uint32_t *sessionID) override;
+  size_t allocSessionIds(uint32_t *sessionIDs, size_t count) override;
   void freeSessionId(uint32_t sessionId) override;
 };
 
@@ -120,7 +129,11 @@ class JobRepository {
 protected:
   atomic<bool> running_;
   size_t chainId_;
+  // Written by the first network thread only, read by all network threads.
+  // Writers must hold exJobsLock_ exclusively, readers from other threads must
+  // hold it shared.
   std::map<uint64_t /* jobId */, shared_ptr<StratumJobEx>> exJobs_;
+  mutable std::shared_timed_mutex exJobsLock_;
 
   KafkaSimpleConsumer kafkaConsumer_; // consume topic: 'StratumJob'
   StratumServer *server_; // call server to send new job
@@ -133,6 +146,8 @@ protected:
   time_t lastJobSendTime_;
   uint64_t lastJobId_;
   uint64_t lastJobHeight_;
+  // seconds from receiving the last clean job to notifying the last session
+  double lastCleanJobNotifyDuration_;
 
   thread threadConsume_;
   friend class StratumServerStats;
@@ -147,6 +162,9 @@ private:
   void tryCleanExpiredJobs();
   void checkAndSendMiningNotify();
 
+protected:
+  void addStratumJobEx(shared_ptr<StratumJobEx> exJob);
+
 public:
   JobRepository(
       size_t chainId,
@@ -207,6 +225,7 @@ public:
   size_t chainId_;
   bool isClean_;
   shared_ptr<StratumJob> sjob_;
+  std::chrono::steady_clock::time_point receivedTime_;
 
 public:
   StratumJobEx(size_t chainId, shared_ptr<StratumJob> sjob, bool isClean);
@@ -219,16 +238,73 @@ public:
 ///////////////////////////////////// StratumServer
 //////////////////////////////////////
 class StratumServer {
+public:
+  //
+  // A network thread of the server. Every reactor owns an event base, a
+  // listener (all listeners are bound with SO_REUSEPORT so the kernel balances
+  // new connections between them) and the sessions accepted by it. A session is
+  // only touched by the thread of its own reactor.
+  //
+  // The first reactor runs in the thread calling run(), it also hosts the job
+  // repositories and the statistics exporter.
+  //
+  struct Reactor {
+    StratumServer *server_ = nullptr;
+    size_t id_ = 0;
+    struct event_base *base_ = nullptr;
+    struct evconnlistener *listener_ = nullptr;
+    struct event *disconnectTimer_ = nullptr;
+    std::set<unique_ptr<StratumSession>> connections_;
+    // share counters of each chain since last scrape
+    std::vector<std::map<int32_t, size_t>> shareStats_;
+    // job broadcasts of each chain superseded before all sessions got them
+    std::vector<uint64_t> cancelledNotifies_;
+    // guards modifications of connections_, shareStats_ and cancelledNotifies_,
+    // the owner thread can read them without lock
+    std::mutex lock_;
+
+    // A job broadcast in progress, sessions are notified in batches with
+    // network events processed in between. Dead sessions must not be freed
+    // before it is finished.
+    struct PendingNotify {
+      shared_ptr<StratumJobEx> exJob_;
+      std::vector<StratumSession *> sessions_;
+      size_t next_ = 0;
+      std::chrono::steady_clock::time_point start_;
+    };
+    unique_ptr<PendingNotify> pendingNotify_;
+    struct event *notifyTimer_ = nullptr;
+    std::thread thread_;
+
+#ifndef WORK_WITH_STRATUM_SWITCHER
+    // Session ids reserved for the connections accepted by this reactor when
+    // session_id_slab is set, the next one is at the back. Only touched by
+    // the owner thread.
+    std::vector<uint32_t> sessionIds_;
+#endif
+
+    ~Reactor();
+  };
+
+private:
   // NetIO
   bool enableTLS_;
   SSL_CTX *sslCTX_;
   struct sockaddr_in sin_;
-  struct event_base *base_;
-  struct evconnlistener *listener_;
-  std::set<unique_ptr<StratumSession>> connections_;
+  std::vector<unique_ptr<Reactor>> reactors_;
   uint32_t tcpReadTimeout_; // seconds
   uint32_t shutdownGracePeriod_;
-  struct event *disconnectTimer_;
+  // sessions notified per event loop iteration when broadcasting non clean jobs
+  size_t notifyBatchSize_;
+  // reactors still draining sessions during a graceful shutdown
+  std::atomic<size_t> drainingReactors_;
+  // session ids a reactor reserves at once, 0: no reservation
+  size_t sessionIdSlabSize_;
+
+  // the reactor of the current thread, nullptr for non-network threads
+  static thread_local Reactor *currentReactor_;
+  // the reactor that dispatched the work running in a share worker thread
+  static thread_local Reactor *originReactor_;
 
 public:
   struct ChainVars {
@@ -240,7 +316,6 @@ public:
     KafkaProducer *kafkaProducerCommonEvents_;
 
     JobRepository *jobRepository_;
-    std::map<int32_t, size_t> shareStats_;
 
     int32_t singleUserId_;
   };
@@ -283,6 +358,26 @@ public:
 
   unique_ptr<WorkerPool> shareWorker_;
 
+  // Latencies of the share path, observed by any thread without a lock:
+  // share verifications by the share worker of each chain
+  std::vector<unique_ptr<prometheus::Histogram>> verifyDurations_;
+  // job broadcasts until every reactor has started them, indexed by
+  // [chainId][isClean]
+  std::vector<std::array<unique_ptr<prometheus::Histogram>, 2>>
+      broadcastDurations_;
+  // job notifications of the sessions of a reactor, indexed by
+  // [chainId][isClean]
+  std::vector<std::array<unique_ptr<prometheus::Histogram>, 2>>
+      notifyDurations_;
+  // shares produced to kafka, indexed by [chainId][isSolvedShare]
+  std::vector<std::array<unique_ptr<prometheus::Histogram>, 2>>
+      produceDurations_;
+  // request lines handled by the network threads, indexed by whether the
+  // request is a mining.submit
+  std::array<prometheus::Histogram, 2> requestDurations_;
+  // time from dispatching a task to a reactor until it runs
+  prometheus::Histogram dispatchDelays_;
+
 protected:
   SSL_CTX *getSSLCTX(const libconfig::Config &config);
 
@@ -292,6 +387,28 @@ protected:
   virtual bool setupInternal(const libconfig::Config &config) { return true; };
   void initZookeeper(const libconfig::Config &config);
 
+  bool setupReactor(Reactor &reactor);
+  // Available to setupInternal(), the reactors are created before it
+  const std::vector<unique_ptr<Reactor>> &reactors() const {
+    return reactors_;
+  }
+  // The reactor of the calling thread, the reactor that dispatched the work
+  // if the caller is a share worker, or the first reactor otherwise.
+  Reactor &currentReactor();
+  // Run the task immediately if we are in the thread of the reactor, otherwise
+  // dispatch it to the reactor.
+  void runInReactor(Reactor &reactor, std::function<void()> task);
+  // Run fn in every reactor and call done with the sum of the results in the
+  // first reactor.
+  void forEachReactor(
+      std::function<size_t(Reactor &)> fn, std::function<void(size_t)> done);
+  void sendMiningNotifyToReactor(
+      Reactor &reactor, shared_ptr<StratumJobEx> exJobPtr);
+  void notifyPendingSessions(Reactor &reactor, size_t maxSessions);
+  void finishPendingNotify(Reactor &reactor);
+  void reactorDrained();
+  void observeVerifyDuration(size_t chainId, double seconds);
+
 public:
   virtual ~StratumServer();
 
@@ -300,12 +417,34 @@ public:
   void stop();
   void stopGracefully();
 
-  // Dispatch the task to the libevent loop
+  // Dispatch the task to the libevent loop of the calling thread's reactor
   void dispatch(std::function<void()> task);
+  // Dispatch the task to the libevent loop of a specified reactor
+  void dispatch(Reactor &reactor, std::function<void()> task);
   // Dispatch the task with alive check
   void dispatchSafely(std::function<void()> task, std::weak_ptr<bool> alive);
-  // Dispatch the work to the share worker
-  void dispatchToShareWorker(std::function<void()> work);
+  // Created at the beginning of a share verification work dispatched to the
+  // share worker, records the time spent as the verification duration of the
+  // chain when the work returns
+  struct ShareVerifyTimer {
+    StratumServer &server_;
+    size_t chainId_;
+    std::chrono::steady_clock::time_point start_ =
+        std::chrono::steady_clock::now();
+
+    ~ShareVerifyTimer();
+  };
+  // Dispatch the work to the share worker, tasks dispatched by the work will
+  // go back to the reactor of the caller
+  template <typename Work>
+  void dispatchToShareWorker(Work &&work) {
+    shareWorker_->dispatch([reactor = &currentReactor(),
+                            work = std::forward<Work>(work)]() mutable {
+      originReactor_ = reactor;
+      work();
+      originReactor_ = nullptr;
+    });
+  }
 
   shared_ptr<Zookeeper> getZookeeper(const libconfig::Config &config) {
     initZookeeper(config);
@@ -314,15 +453,27 @@ public:
 
   const uint32_t tcpReadTimeout() { return tcpReadTimeout_; }
   const string &chainName(size_t chainId) { return chains_[chainId].name_; }
-  size_t /* online sessions */
-  switchChain(string userName, size_t newChainId);
-  size_t /* auto reg sessions */
-  autoRegCallback(const string &userName);
-
-  void sendMiningNotifyToAll(shared_ptr<StratumJobEx> exJobPtr);
+  // The callbacks are called in the first reactor after all reactors are done
+  void switchChain(
+      string userName,
+      size_t newChainId,
+      std::function<void(size_t /* online sessions */)> done);
+  void autoRegCallback(
+      const string &userName,
+      std::function<void(size_t /* auto reg sessions */)> done);
+
+  // done is called in the first reactor after every reactor has started the
+  // broadcast, clean jobs are already sent to all sessions by then
+  void sendMiningNotifyToAll(
+      shared_ptr<StratumJobEx> exJobPtr, std::function<void()> done = nullptr);
 
-  void addConnection(unique_ptr<StratumSession> connection);
+#ifndef WORK_WITH_STRATUM_SWITCHER
+  // Called by the thread of the reactor accepting the connection
+  bool allocSessionId(Reactor &reactor, uint32_t *sessionID);
+#endif
+  void addConnection(Reactor &reactor, unique_ptr<StratumSession> connection);
   void removeConnection(StratumSession &connection);
+  void reportShare(size_t chainId, int32_t status);
 
   static void listenerCallback(
       struct evconnlistener *listener,
@@ -331,6 +482,7 @@ public:
       int socklen,
       void *server);
   static void disconnectCallback(evutil_socket_t, short, void *context);
+  static void notifyTimerCallback(evutil_socket_t, short, void *context);
   static void readCallback(struct bufferevent *, void *connection);
   static void eventCallback(struct bufferevent *, short, void *connection);
 
@@ -64,6 +64,7 @@ StratumServerStats::StratumServerStats(StratumServer &server)
       {},
       [this]() { return server_.serverId_; }));
 
+  // the series of a metric are exported together
   for (auto &chain : server_.chains_) {
     metrics_.push_back(prometheus::CreateMetricFn(
         "sserver_idle_since_last_job_broadcast_seconds",
@@ -73,6 +74,8 @@ StratumServerStats::StratumServerStats(StratumServer &server)
         [&chain]() {
           return time(nullptr) - chain.jobRepository_->lastJobSendTime_;
         }));
+  }
+  for (auto &chain : server_.chains_) {
     metrics_.push_back(prometheus::CreateMetricFn(
         "sserver_last_job_broadcast_height",
         prometheus::Metric::Type::Gauge,
@@ -80,6 +83,16 @@ StratumServerStats::StratumServerStats(StratumServer &server)
         {{"chain", chain.name_}},
         [&chain]() { return chain.jobRepository_->lastJobHeight_; }));
   }
+  for (auto &chain : server_.chains_) {
+    metrics_.push_back(prometheus::CreateMetricFn(
+        "sserver_last_clean_job_notify_duration_seconds",
+        prometheus::Metric::Type::Gauge,
+        "Time from receiving the last clean job to notifying all sessions",
+        {{"chain", chain.name_}},
+        [&chain]() {
+          return chain.jobRepository_->lastCleanJobNotifyDuration_;
+        }));
+  }
 }
 
 std::vector<std::shared_ptr<prometheus::Metric>>
@@ -91,8 +104,26 @@ StratumServerStats::collectMetrics() {
   lastScrape_ = scrape;
 
   std::vector<std::shared_ptr<prometheus::Metric>> metrics = metrics_;
-  for (auto &chain : server_.chains_) {
-    for (auto p : chain.shareStats_) {
+  std::vector<std::map<int32_t, size_t>> shareStats(server_.chains_.size());
+  std::map<std::pair<size_t, StratumSession::State>, size_t> sessions_;
+  std::vector<uint64_t> cancelledNotifies(server_.chains_.size());
+  for (auto &reactor : server_.reactors_) {
+    std::lock_guard<std::mutex> l{reactor->lock_};
+    for (size_t chainId = 0; chainId < shareStats.size(); ++chainId) {
+      for (auto p : reactor->shareStats_[chainId]) {
+        shareStats[chainId][p.first] += p.second;
+      }
+      reactor->shareStats_[chainId].clear();
+      cancelledNotifies[chainId] += reactor->cancelledNotifies_[chainId];
+    }
+    for (auto &session : reactor->connections_) {
+      ++sessions_[{session->getChainId(), session->getState()}];
+    }
+  }
+
+  for (size_t chainId = 0; chainId < shareStats.size(); ++chainId) {
+    auto &chain = server_.chains_[chainId];
+    for (auto p : shareStats[chainId]) {
       metrics.push_back(prometheus::CreateMetricValue(
           "sserver_shares_per_second_since_last_scrape",
           prometheus::Metric::Type::Gauge,
@@ -100,13 +131,67 @@ StratumServerStats::collectMetrics() {
           {{"chain", chain.name_}, {"status", FormatStratumStatus(p.first)}},
           static_cast<double>(p.second) / duration));
     }
-    chain.shareStats_.clear();
   }
 
-  std::map<std::pair<size_t, StratumSession::State>, size_t> sessions_;
-  for (auto &session : server_.connections_) {
-    ++sessions_[{session->getChainId(), session->getState()}];
+  for (size_t chainId = 0; chainId < server_.chains_.size(); ++chainId) {
+    for (size_t clean = 0; clean < 2; ++clean) {
+      metrics.push_back(prometheus::CreateMetricHistogram(
+          "sserver_job_notify_duration_seconds",
+          "Time for a network thread to notify its sessions about a job",
+          {{"chain", server_.chains_[chainId].name_},
+           {"clean", clean ? "true" : "false"}},
+          server_.notifyDurations_[chainId][clean]->collect()));
+    }
   }
+  for (size_t chainId = 0; chainId < cancelledNotifies.size(); ++chainId) {
+    metrics.push_back(prometheus::CreateMetricValue(
+        "sserver_job_notify_cancelled_total",
+        prometheus::Metric::Type::Counter,
+        "Job notifications superseded by a newer job before all sessions got "
+        "them",
+        {{"chain", server_.chains_[chainId].name_}},
+        cancelledNotifies[chainId]));
+  }
+  for (size_t chainId = 0; chainId < server_.chains_.size(); ++chainId) {
+    for (size_t clean = 0; clean < 2; ++clean) {
+      metrics.push_back(prometheus::CreateMetricHistogram(
+          "sserver_job_broadcast_duration_seconds",
+          "Time for all network threads to start notifying about a job",
+          {{"chain", server_.chains_[chainId].name_},
+           {"clean", clean ? "true" : "false"}},
+          server_.broadcastDurations_[chainId][clean]->collect()));
+    }
+  }
+  for (size_t chainId = 0; chainId < server_.chains_.size(); ++chainId) {
+    metrics.push_back(prometheus::CreateMetricHistogram(
+        "sserver_share_verify_duration_seconds",
+        "Time for the share worker to verify a share",
+        {{"chain", server_.chains_[chainId].name_}},
+        server_.verifyDurations_[chainId]->collect()));
+  }
+  for (size_t chainId = 0; chainId < server_.chains_.size(); ++chainId) {
+    for (size_t solved = 0; solved < 2; ++solved) {
+      metrics.push_back(prometheus::CreateMetricHistogram(
+          "sserver_kafka_produce_duration_seconds",
+          "Time to produce a share message to kafka",
+          {{"chain", server_.chains_[chainId].name_},
+           {"topic", solved ? "solved_share" : "share_log"}},
+          server_.produceDurations_[chainId][solved]->collect()));
+    }
+  }
+  for (size_t submit = 0; submit < 2; ++submit) {
+    metrics.push_back(prometheus::CreateMetricHistogram(
+        "sserver_request_duration_seconds",
+        "Time for a network thread to read and handle a request line",
+        {{"method", submit ? "mining.submit" : "other"}},
+        server_.requestDurations_[submit].collect()));
+  }
+  metrics.push_back(prometheus::CreateMetricHistogram(
+      "sserver_dispatch_delay_seconds",
+      "Time from dispatching a task to a network thread until it runs",
+      {},
+      server_.dispatchDelays_.collect()));
+
   for (auto &s : sessions_) {
     metrics.push_back(prometheus::CreateMetricValue(
         "sserver_sessions_total",
@@ -117,5 +202,44 @@ StratumServerStats::collectMetrics() {
         s.second));
   }
 
+  if (server_.shareWorker_) {
+    auto stats = server_.shareWorker_->getStats();
+    metrics.push_back(prometheus::CreateMetricValue(
+        "sserver_share_worker_queue_depth",
+        prometheus::Metric::Type::Gauge,
+        "The number of works waiting in the share worker queue",
+        {},
+        stats.queueDepth));
+    metrics.push_back(prometheus::CreateMetricValue(
+        "sserver_share_worker_dispatched_total",
+        prometheus::Metric::Type::Counter,
+        "The number of works dispatched to the share worker",
+        {},
+        stats.dispatched));
+    metrics.push_back(prometheus::CreateMetricValue(
+        "sserver_share_worker_completed_total",
+        prometheus::Metric::Type::Counter,
+        "The number of works completed by the share worker",
+        {},
+        stats.completed));
+    metrics.push_back(prometheus::CreateMetricValue(
+        "sserver_share_worker_queue_full_total",
+        prometheus::Metric::Type::Counter,
+        "The number of dispatches blocked by a full share worker queue",
+        {},
+        stats.queueFull));
+    metrics.push_back(prometheus::CreateMetricValue(
+        "sserver_share_worker_queue_wait_seconds_total",
+        prometheus::Metric::Type::Counter,
+        "Total time works spent in the share worker queue in seconds",
+        {},
+        stats.queueWaitSeconds));
+    metrics.push_back(prometheus::CreateMetricHistogram(
+        "sserver_share_worker_queue_wait_seconds",
+        "Time a work spent in the share worker queue",
+        {},
+        std::move(stats.queueWait)));
+  }
+
   return metrics;
 }
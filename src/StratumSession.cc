@@ -183,9 +183,12 @@ bool StratumSession::handleMessage() {
   //
   // handle stratum message
   //
-  string line;
-  if (tryReadLine(line)) {
-    handleLine(line);
+  if (tryReadLine(line_)) {
+    auto start = std::chrono::steady_clock::now();
+    handleLine(line_);
+    server_.requestDurations_[request_.isMethod("mining.submit")].observe(
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count());
     return true;
   }
 
@@ -218,6 +221,16 @@ void StratumSession::handleLine(const std::string &line) {
     return;
   }
 
+  // Shares are submitted straight from the scanned line if the miner can,
+  // any other request goes through JsonNode
+  if (request_.scan(line.data(), line.data() + line.size()) &&
+      request_.isMethod("mining.submit") && request_.hasScalarParams()) {
+    request_.getIdStr(idStr_);
+    if (dispatcher_->handleSubmit(idStr_, request_)) {
+      return;
+    }
+  }
+
   JsonNode jnode;
   if (!JsonNode::parse(line.data(), line.data() + line.size(), jnode)) {
     LOG(ERROR) << "decode line fail, not a json string. string value: \""
@@ -565,6 +578,22 @@ void StratumSession::sendData(const char *data, size_t len) {
   DLOG(INFO) << "send(" << len << ") to " << worker_.fullName_ << " : " << data;
 }
 
+void StratumSession::sendSharedData(std::shared_ptr<const std::string> data) {
+  // The reference is released by libevent once the data has been written
+  auto ref = new std::shared_ptr<const std::string>(std::move(data));
+  int res = evbuffer_add_reference(
+      bufferevent_get_output(bev_),
+      (*ref)->data(),
+      (*ref)->size(),
+      [](const void *, size_t, void *extra) {
+        delete static_cast<std::shared_ptr<const std::string> *>(extra);
+      },
+      ref);
+  if (res != 0) {
+    delete ref;
+  }
+}
+
 void StratumSession::readBuf(struct evbuffer *buf) {
   // moves all data from src to the end of dst
   evbuffer_add_buffer(buffer_, buf);
@@ -679,7 +708,7 @@ void StratumSession::responseAuthorizeSuccess(const std::string &idStr) {
 
 void StratumSession::reportShare(
     size_t chainId, int32_t status, uint64_t shareDiff) {
-  ++server_.chains_[chainId].shareStats_[status];
+  server_.reportShare(chainId, status);
 }
 
 bool StratumSession::acceptStale() const {
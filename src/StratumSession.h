@@ -26,6 +26,7 @@
 #define STRATUM_SESSION_H_
 
 #include "StratumMessageDispatcher.h"
+#include "StratumRequest.h"
 #include "Stratum.h"
 #include "utilities_js.hpp"
 
@@ -151,6 +152,11 @@ protected:
 
   std::unique_ptr<ProxyStrategy> proxyStrategy_;
 
+  // Buffers reused by every received line
+  std::string line_;
+  std::string idStr_;
+  StratumRequest request_;
+
   void setup();
   void setReadTimeout(int32_t readTimeout);
 
@@ -222,6 +228,9 @@ public:
   void sendData(const std::string &str) override {
     sendData(str.data(), str.size());
   }
+  // Send a buffer shared by many sessions, it is referenced by the output
+  // buffer instead of being copied
+  void sendSharedData(std::shared_ptr<const std::string> data);
   void readBuf(struct evbuffer *buf);
 
   // Please keep them in here and be virtual or you have to refactor
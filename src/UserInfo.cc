@@ -274,25 +274,26 @@ void UserInfo::handleSwitchChainEvent(const string &userName) {
     return;
   }
 
-  server_->dispatch([this, userName, currentChainId, newChainId]() {
-    size_t onlineSessions = server_->switchChain(userName, newChainId);
-
-    if (onlineSessions == 0) {
-      LOG(INFO) << "No workers of user " << userName
-                << " online, subsequent switching request will be ignored";
-      // clear cache
-      std::unique_lock<std::shared_timed_mutex> l{nameChainlock_};
-      auto itr = nameChains_.find(userName);
-      if (itr != nameChains_.end()) {
-        nameChains_.erase(itr);
-      }
-    }
+  server_->switchChain(
+      userName,
+      newChainId,
+      [this, userName, currentChainId, newChainId](size_t onlineSessions) {
+        if (onlineSessions == 0) {
+          LOG(INFO) << "No workers of user " << userName
+                    << " online, subsequent switching request will be ignored";
+          // clear cache
+          std::unique_lock<std::shared_timed_mutex> l{nameChainlock_};
+          auto itr = nameChains_.find(userName);
+          if (itr != nameChains_.end()) {
+            nameChains_.erase(itr);
+          }
+        }
 
-    LOG(INFO) << "User '" << userName << "' (" << onlineSessions
-              << " miners) switched chain: "
-              << server_->chainName(currentChainId) << " -> "
-              << server_->chainName(newChainId);
-  });
+        LOG(INFO) << "User '" << userName << "' (" << onlineSessions
+                  << " miners) switched chain: "
+                  << server_->chainName(currentChainId) << " -> "
+                  << server_->chainName(newChainId);
+      });
 }
 
 bool UserInfo::getChainId(const string &userName, size_t &chainId) {
@@ -640,9 +641,7 @@ void UserInfo::handleAutoRegEvent(
     userInfo->autoRegPendingUsers_.erase(userName);
   }
 
-  userInfo->server_->dispatch([userInfo, userName]() {
-    size_t sessions = userInfo->server_->autoRegCallback(userName);
-
+  userInfo->server_->autoRegCallback(userName, [userName](size_t sessions) {
     LOG(INFO) << "Auto Reg: User '" << userName << "' (" << sessions
               << " miners online) registered";
   });
@@ -85,6 +85,18 @@ bool Hex2Bin(const char *in, size_t size, vector<char> &out) {
   return true;
 }
 
+bool Hex2Bin(const char *in, size_t size, char *out) {
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    int h = _hex2bin_char(in[i]);
+    int l = _hex2bin_char(in[i + 1]);
+    if (h < 0 || l < 0) {
+      return false;
+    }
+    *out++ = (h << 4) | l;
+  }
+  return true;
+}
+
 bool Hex2Bin(const char *in, vector<char> &out) {
   out.clear();
   out.reserve(strlen(in) / 2);
@@ -199,6 +211,10 @@ void setSslVerifyPeer(bool verifyPeer) {
   sslVerifyPeer = verifyPeer;
 }
 
+bool getSslVerifyPeer() {
+  return sslVerifyPeer;
+}
+
 bool httpGET(const char *url, string &response, long timeoutMs) {
   return httpPOST(url, nullptr, nullptr, response, timeoutMs, nullptr);
 }
@@ -46,6 +46,8 @@ using libconfig::Setting;
 bool Hex2BinReverse(const char *in, size_t size, vector<char> &out);
 bool Hex2Bin(const char *in, size_t size, vector<char> &out);
 bool Hex2Bin(const char *in, vector<char> &out);
+// Writes size / 2 bytes to out, no "0x" prefix or spaces are allowed
+bool Hex2Bin(const char *in, size_t size, char *out);
 void Bin2Hex(const uint8_t *in, size_t len, string &str);
 void Bin2Hex(const vector<uint8_t> &in, string &str);
 void Bin2Hex(const vector<char> &in, string &str);
@@ -79,6 +81,7 @@ bool s_send(zmq::socket_t &socket, const std::string &string);
 bool s_sendmore(zmq::socket_t &socket, const std::string &string);
 
 void setSslVerifyPeer(bool verifyPeer);
+bool getSslVerifyPeer();
 bool httpGET(const char *url, string &response, long timeoutMs);
 bool httpGET(
     const char *url, const char *userpwd, string &response, long timeoutMs);
@@ -115,6 +118,11 @@ string date(const char *format, const time_t timestamp);
 inline string date(const char *format) {
   return date(format, time(nullptr));
 }
+// Same as atoi(date("%H", timestamp)) without formatting, date() is in UTC
+// so every day has 24 hours of 3600 seconds
+inline int32_t hourOfDay(const time_t timestamp) {
+  return (int32_t)(timestamp % 86400 / 3600);
+}
 time_t str2time(const char *str, const char *format);
 inline time_t str2time(const char *str) {
   return str2time(str, "%F %T");
@@ -24,30 +24,70 @@
 
 #include "WorkerPool.h"
 
+#include <glog/logging.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+static size_t RoundUpPowerOfTwo(size_t n) {
+  size_t result = 2;
+  while (result < n) {
+    result <<= 1;
+  }
+  return result;
+}
+
 WorkerPool::WorkerPool(size_t queueCapacity)
-  : works_{queueCapacity}
+  : slots_{new Slot[RoundUpPowerOfTwo(queueCapacity)]}
+  , mask_{RoundUpPowerOfTwo(queueCapacity) - 1}
+  , enqueuePos_{0}
+  , dequeuePos_{0}
+  , size_{0}
+  , sleepers_{0}
+  , fullWaiters_{0}
+  , dispatched_{0}
+  , completed_{0}
+  , queueFull_{0}
+  , queueWaitNanos_{0}
   , stop_{false} {
+  for (size_t i = 0; i <= mask_; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
 }
 
 WorkerPool::~WorkerPool() {
   stop();
 }
 
-void WorkerPool::start(size_t numOfWorkers) {
+void WorkerPool::start(size_t numOfWorkers, const std::vector<int> &cpus) {
   for (size_t i = 0; i < numOfWorkers; ++i) {
     workers_.emplace_back([this]() { runWorker(); });
+
+    if (!cpus.empty()) {
+      int cpu = cpus[i % cpus.size()];
+      cpu_set_t cpuSet;
+      CPU_ZERO(&cpuSet);
+      CPU_SET(cpu, &cpuSet);
+      int res = pthread_setaffinity_np(
+          workers_.back().native_handle(), sizeof(cpu_set_t), &cpuSet);
+      LOG_IF(WARNING, res != 0)
+          << "cannot pin share worker " << i << " to cpu " << cpu;
+    }
   }
 }
 
 void WorkerPool::stop() {
   {
-    std::unique_lock<std::mutex> l{worksMutex_};
+    std::lock_guard<std::mutex> l{sleepMutex_};
     if (!stop_) {
       stop_ = true;
       worksNotEmpty_.notify_all();
-      worksNotFull_.notify_all();
     }
   }
+  {
+    std::lock_guard<std::mutex> l{fullMutex_};
+    worksNotFull_.notify_all();
+  }
 
   for (auto &worker : workers_) {
     if (worker.joinable())
@@ -55,31 +95,177 @@ void WorkerPool::stop() {
   }
 }
 
-void WorkerPool::dispatch(std::function<void()> work) {
+void WorkerPool::dispatch(WorkerTask work) {
   if (!work) {
     return;
   }
 
-  std::unique_lock<std::mutex> l{worksMutex_};
-  worksNotFull_.wait(l, [this]() { return !works_.full() || stop_; });
-  if (!stop_) {
-    works_.push_back(std::move(work));
-    worksNotEmpty_.notify_one();
+  if (!tryPush(work)) {
+    // The queue is full, wait for the workers to catch up
+    ++queueFull_;
+    if (!waitForFreeSlot(work)) {
+      return;
+    }
+  }
+
+  ++dispatched_;
+  // size_ (incremented by tryPush) and sleepers_ are sequentially consistent,
+  // either we see a sleeping worker here or the worker sees the new work
+  // before going to sleep.
+  if (sleepers_.load() > 0) {
+    wakeWorker();
   }
 }
 
-void WorkerPool::runWorker() {
+WorkerPool::Stats WorkerPool::getStats() const {
+  Stats stats;
+  stats.queueDepth = size_.load(std::memory_order_relaxed);
+  stats.dispatched = dispatched_.load(std::memory_order_relaxed);
+  stats.completed = completed_.load(std::memory_order_relaxed);
+  stats.queueFull = queueFull_.load(std::memory_order_relaxed);
+  stats.queueWaitSeconds =
+      queueWaitNanos_.load(std::memory_order_relaxed) / 1e9;
+  stats.queueWait = queueWaits_.collect();
+  return stats;
+}
+
+bool WorkerPool::tryPush(WorkerTask &work) {
+  Slot *slot;
+  size_t pos = enqueuePos_.load(std::memory_order_relaxed);
   while (true) {
-    std::unique_lock<std::mutex> l{worksMutex_};
-    worksNotEmpty_.wait(l, [this]() { return !works_.empty() || stop_; });
+    slot = &slots_[pos & mask_];
+    size_t seq = slot->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (enqueuePos_.compare_exchange_weak(
+              pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false; // full
+    } else {
+      pos = enqueuePos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->enqueued = Clock::now();
+  slot->work = std::move(work);
+  // counted before it is published, so a worker popping it never decrements
+  // size_ below zero
+  size_.fetch_add(1);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool WorkerPool::waitForFreeSlot(WorkerTask &work) {
+  // A batch is drained quickly, so spin a little first
+  for (size_t spins = 0; spins < kSpinsBeforeSleep; ++spins) {
     if (stop_) {
-      break;
+      return false;
+    }
+    std::this_thread::yield();
+    if (tryPush(work)) {
+      return true;
+    }
+  }
+
+  // Then sleep rather than taking the core of the network thread under a
+  // sustained overload. The fences pair with the one of runWorker(): either
+  // the worker sees this waiter or tryPush() sees the slots it freed.
+  std::unique_lock<std::mutex> l{fullMutex_};
+  fullWaiters_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool pushed = false;
+  worksNotFull_.wait(l, [this, &work, &pushed]() {
+    pushed = tryPush(work);
+    return pushed || stop_;
+  });
+  fullWaiters_.fetch_sub(1);
+  return pushed;
+}
+
+bool WorkerPool::tryPop(WorkerTask &work, Clock::time_point &enqueued) {
+  Slot *slot;
+  size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+  while (true) {
+    slot = &slots_[pos & mask_];
+    size_t seq = slot->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (dequeuePos_.compare_exchange_weak(
+              pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false; // empty
     } else {
-      auto work = std::move(works_.front());
-      works_.pop_front();
-      worksNotFull_.notify_one();
-      l.unlock();
-      work();
+      pos = dequeuePos_.load(std::memory_order_relaxed);
     }
   }
-}
\ No newline at end of file
+
+  work = std::move(slot->work);
+  enqueued = slot->enqueued;
+  slot->sequence.store(pos + mask_ + 1, std::memory_order_release);
+  return true;
+}
+
+void WorkerPool::wakeWorker() {
+  std::lock_guard<std::mutex> l{sleepMutex_};
+  worksNotEmpty_.notify_one();
+}
+
+void WorkerPool::runWorker() {
+  WorkerTask batch[kMaxBatchSize];
+  size_t spins = 0;
+
+  while (!stop_) {
+    // Drain a batch of works
+    size_t n = 0;
+    uint64_t waitNanos = 0;
+    Clock::time_point enqueued;
+    while (n < kMaxBatchSize && tryPop(batch[n], enqueued)) {
+      auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      Clock::now() - enqueued)
+                      .count();
+      waitNanos += wait;
+      queueWaits_.observe(wait / 1e9);
+      ++n;
+    }
+
+    if (n > 0) {
+      spins = 0;
+      size_.fetch_sub(n);
+      queueWaitNanos_.fetch_add(waitNanos, std::memory_order_relaxed);
+
+      // Wake the producers waiting for the slots just freed
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (fullWaiters_.load() > 0) {
+        std::lock_guard<std::mutex> l{fullMutex_};
+        worksNotFull_.notify_all();
+      }
+
+      // Let another worker share the rest of the queue
+      if (size_.load() > 0 && sleepers_.load() > 0) {
+        wakeWorker();
+      }
+
+      for (size_t i = 0; i < n; ++i) {
+        batch[i]();
+        batch[i].reset();
+      }
+      completed_.fetch_add(n, std::memory_order_relaxed);
+      continue;
+    }
+
+    if (++spins < kSpinsBeforeSleep) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> l{sleepMutex_};
+    sleepers_.fetch_add(1);
+    worksNotEmpty_.wait(l, [this]() { return size_.load() > 0 || stop_; });
+    sleepers_.fetch_sub(1);
+    spins = 0;
+  }
+}
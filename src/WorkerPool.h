@@ -24,32 +24,197 @@
 
 #pragma once
 
-#include <boost/circular_buffer.hpp>
+#include "prometheus/Histogram.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+//
+// A move-only void() callable with small buffer optimization. Callables not
+// larger than kInlineSize are stored in place, so dispatching a share check
+// with a big capture list does not allocate.
+//
+class WorkerTask {
+public:
+  static constexpr size_t kInlineSize = 512;
+
+  WorkerTask() = default;
+
+  template <
+      typename F,
+      typename = std::enable_if_t<
+          !std::is_same<std::decay_t<F>, WorkerTask>::value>>
+  WorkerTask(F &&f) {
+    using T = std::decay_t<F>;
+    emplace<T>(
+        std::forward<F>(f),
+        std::integral_constant<
+            bool,
+            sizeof(T) <= kInlineSize &&
+                alignof(T) <= alignof(std::max_align_t)>{});
+  }
+
+  WorkerTask(WorkerTask &&other) { moveFrom(other); }
+  WorkerTask &operator=(WorkerTask &&other) {
+    if (this != &other) {
+      reset();
+      moveFrom(other);
+    }
+    return *this;
+  }
+  WorkerTask(const WorkerTask &) = delete;
+  WorkerTask &operator=(const WorkerTask &) = delete;
+  ~WorkerTask() { reset(); }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+  void operator()() { ops_->invoke(&storage_); }
+
+  void reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+private:
+  struct Ops {
+    void (*invoke)(void *);
+    // move constructs dst from src, then destroys src
+    void (*relocate)(void *dst, void *src);
+    void (*destroy)(void *);
+  };
+
+  template <typename T>
+  struct InlineOps {
+    static void invoke(void *p) { (*static_cast<T *>(p))(); }
+    static void relocate(void *dst, void *src) {
+      new (dst) T(std::move(*static_cast<T *>(src)));
+      static_cast<T *>(src)->~T();
+    }
+    static void destroy(void *p) { static_cast<T *>(p)->~T(); }
+    static const Ops ops;
+  };
+
+  template <typename T>
+  struct HeapOps {
+    static void invoke(void *p) { (**static_cast<T **>(p))(); }
+    static void relocate(void *dst, void *src) {
+      *static_cast<T **>(dst) = *static_cast<T **>(src);
+    }
+    static void destroy(void *p) { delete *static_cast<T **>(p); }
+    static const Ops ops;
+  };
+
+  template <typename T, typename F>
+  void emplace(F &&f, std::true_type /* inline */) {
+    new (&storage_) T(std::forward<F>(f));
+    ops_ = &InlineOps<T>::ops;
+  }
+
+  template <typename T, typename F>
+  void emplace(F &&f, std::false_type /* inline */) {
+    *reinterpret_cast<T **>(&storage_) = new T(std::forward<F>(f));
+    ops_ = &HeapOps<T>::ops;
+  }
+
+  void moveFrom(WorkerTask &other) {
+    if (other.ops_ != nullptr) {
+      other.ops_->relocate(&storage_, &other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  const Ops *ops_ = nullptr;
+  std::aligned_storage_t<kInlineSize, alignof(std::max_align_t)> storage_;
+};
+
+template <typename T>
+const WorkerTask::Ops WorkerTask::InlineOps<T>::ops = {
+    &InlineOps<T>::invoke, &InlineOps<T>::relocate, &InlineOps<T>::destroy};
+
+template <typename T>
+const WorkerTask::Ops WorkerTask::HeapOps<T>::ops = {
+    &HeapOps<T>::invoke, &HeapOps<T>::relocate, &HeapOps<T>::destroy};
+
+//
+// Share worker pool backed by a bounded lock-free MPMC ring buffer
+// (Dmitry Vyukov's algorithm). Producers (the network threads) never take a
+// lock unless a worker is sleeping, workers drain the ring in batches and only
+// sleep on a condition variable when the ring stays empty. A producer finding
+// the ring full spins briefly, then sleeps until a worker frees a slot.
+//
 class WorkerPool {
 public:
+  struct Stats {
+    size_t queueDepth;
+    uint64_t dispatched; // works accepted by dispatch()
+    uint64_t completed; // works executed
+    uint64_t queueFull; // dispatches that had to wait for a free slot
+    double queueWaitSeconds; // sum of the time works spent in the queue
+    prometheus::HistogramSnapshot queueWait; // the time of each work
+  };
+
   explicit WorkerPool(size_t queueCapacity);
   WorkerPool(const WorkerPool &&) = delete;
   ~WorkerPool();
 
-  void start(size_t numOfWorkers);
+  // Worker i is pinned to cpus[i % cpus.size()] if cpus is not empty
+  void start(size_t numOfWorkers, const std::vector<int> &cpus = {});
   void stop();
-  void dispatch(std::function<void()> work);
+  void dispatch(WorkerTask work);
+
+  size_t capacity() const { return mask_ + 1; }
+  Stats getStats() const;
 
 private:
+  static const size_t kMaxBatchSize = 16;
+  static const size_t kSpinsBeforeSleep = 64;
+
+  using Clock = std::chrono::steady_clock;
+
+  struct Slot {
+    std::atomic<size_t> sequence;
+    Clock::time_point enqueued;
+    WorkerTask work;
+  };
+
+  bool tryPush(WorkerTask &work);
+  // returns false if the pool stopped before the work could be pushed
+  bool waitForFreeSlot(WorkerTask &work);
+  bool tryPop(WorkerTask &work, Clock::time_point &enqueued);
+  void wakeWorker();
   void runWorker();
 
-  boost::circular_buffer<std::function<void()>> works_;
-  std::mutex worksMutex_;
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+
+  alignas(64) std::atomic<size_t> enqueuePos_;
+  alignas(64) std::atomic<size_t> dequeuePos_;
+  alignas(64) std::atomic<size_t> size_;
+  std::atomic<size_t> sleepers_;
+  std::atomic<size_t> fullWaiters_; // producers sleeping on a full ring
+
+  std::atomic<uint64_t> dispatched_;
+  std::atomic<uint64_t> completed_;
+  std::atomic<uint64_t> queueFull_;
+  std::atomic<uint64_t> queueWaitNanos_;
+  prometheus::Histogram queueWaits_;
+
+  std::mutex sleepMutex_;
   std::condition_variable worksNotEmpty_;
+  std::mutex fullMutex_;
   std::condition_variable worksNotFull_;
   std::vector<std::thread> workers_;
-  bool stop_;
+  std::atomic<bool> stop_;
 };
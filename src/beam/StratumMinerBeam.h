@@ -40,6 +40,8 @@ public:
       const std::string &method,
       const JsonNode &jparams,
       const JsonNode &jroot) override;
+  bool handleCheckedShare(
+      const std::string &idStr, size_t chainId, const ShareBeam &share);
 
 private:
   void handleRequest_Submit(const string &idStr, const JsonNode &jroot);
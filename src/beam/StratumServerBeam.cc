@@ -88,7 +88,7 @@ void JobRepositoryBeam::broadcastStratumJob(shared_ptr<StratumJob> sjob) {
   }
 
   // insert new job
-  exJobs_[sjobBeam->jobId_] = exJob;
+  addStratumJobEx(exJob);
 
   // send job
   if (isClean) {
@@ -127,12 +127,12 @@ bool ServerBeam::setupInternal(const libconfig::Config &config) {
 
 void ServerBeam::checkAndUpdateShare(
     size_t chainId,
-    ShareBeam &share,
+    ShareBeam share,
     shared_ptr<StratumJobEx> exjob,
-    const string &output,
-    const std::set<uint64_t> &jobDiffs,
+    string output,
+    std::set<uint64_t> jobDiffs,
     const string &workFullName,
-    uint256 &computedShareHash) {
+    std::function<void(const ShareBeam &share)> returnFn) {
   auto sjob = static_pointer_cast<StratumJobBeam>(exjob->sjob_);
 
   DLOG(INFO) << "checking share nonce: " << hex << share.nonce()
@@ -140,17 +140,47 @@ void ServerBeam::checkAndUpdateShare(
 
   if (exjob->isStale()) {
     share.set_status(StratumStatus::STALE_SHARE);
+    returnFn(share);
     return;
   }
 
   if (noncePrefixCheck_ && (share.nonce() >> 40) != share.sessionid()) {
     share.set_status(StratumStatus::WRONG_NONCE_PREFIX);
+    returnFn(share);
     return;
   }
 
+  dispatchToShareWorker([this,
+                         chainId,
+                         share = std::move(share),
+                         sjob,
+                         output = std::move(output),
+                         jobDiffs = std::move(jobDiffs),
+                         workFullName,
+                         returnFn = std::move(returnFn)]() mutable {
+    ShareVerifyTimer timer{*this, chainId};
+    uint256 blockHash;
+    verifyShare(share, *sjob, output, jobDiffs, workFullName, blockHash);
+    if (StratumStatus::isSolved(share.status())) {
+      sendSolvedShare2Kafka(
+          chainId, share, sjob->input_, output, workFullName, blockHash);
+    }
+    dispatch([share = std::move(share), returnFn = std::move(returnFn)]() {
+      returnFn(share);
+    });
+  });
+}
+
+void ServerBeam::verifyShare(
+    ShareBeam &share,
+    const StratumJobBeam &sjob,
+    const string &output,
+    const std::set<uint64_t> &jobDiffs,
+    const string &workFullName,
+    uint256 &computedShareHash) {
   beam::Difficulty::Raw shareHash;
   bool isValidSulution = Beam_ComputeHash(
-      sjob->input_,
+      sjob.input_,
       share.nonce(),
       output,
       shareHash,
@@ -216,7 +246,7 @@ void ServerBeam::sendSolvedShare2Kafka(
     const ShareBeam &share,
     const string &input,
     const string &output,
-    const StratumWorker &worker,
+    const string &workFullName,
     const uint256 &blockHash) {
   string msg = Strings::Format(
       "{\"nonce\":\"%016x"
@@ -230,9 +260,9 @@ void ServerBeam::sendSolvedShare2Kafka(
       output,
       share.height(),
       share.blockbits(),
-      worker.userId(chainId),
-      worker.workerHashId_,
-      filterWorkerName(worker.fullName_),
+      share.userid(),
+      share.workerhashid(),
+      filterWorkerName(workFullName),
       blockHash.ToString(),
       "BEAM");
   ServerBase::sendSolvedShare2Kafka(chainId, msg.data(), msg.size());
@@ -37,20 +37,22 @@ class ServerBeam : public ServerBase<JobRepositoryBeam> {
 
 public:
   bool setupInternal(const libconfig::Config &config) override;
+  // The equihash solution is verified by the share worker, returnFn is called
+  // with the checked share in the reactor of the caller
   void checkAndUpdateShare(
       size_t chainId,
-      ShareBeam &share,
+      ShareBeam share,
       shared_ptr<StratumJobEx> exjob,
-      const string &output,
-      const std::set<uint64_t> &jobDiffs,
+      string output,
+      std::set<uint64_t> jobDiffs,
       const string &workFullName,
-      uint256 &computedShareHash);
+      std::function<void(const ShareBeam &share)> returnFn);
   void sendSolvedShare2Kafka(
       size_t chainId,
       const ShareBeam &share,
       const string &input,
       const string &output,
-      const StratumWorker &worker,
+      const string &workFullName,
       const uint256 &blockHash);
 
   JobRepository *createJobRepository(
@@ -69,6 +71,15 @@ public:
 
   bool noncePrefixCheck() { return noncePrefixCheck_; }
   uint32_t beamHash2ForkHeight() { return beamHash2ForkHeight_; }
+
+protected:
+  void verifyShare(
+      ShareBeam &share,
+      const StratumJobBeam &sjob,
+      const string &output,
+      const std::set<uint64_t> &jobDiffs,
+      const string &workFullName,
+      uint256 &computedShareHash);
 };
 
 class JobRepositoryBeam : public JobRepositoryBase<ServerBeam> {
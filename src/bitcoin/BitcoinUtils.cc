@@ -43,10 +43,49 @@ std::string EncodeHexBlockHeader(const CBlockHeader &blkHeader) {
   return HexStr(ssBlkHeader.begin(), ssBlkHeader.end());
 }
 
+std::string EncodeHexBlockTxs(const BlockTxs &vtxs) {
+  CDataStream ssTxs(SER_NETWORK, PROTOCOL_VERSION);
+  WriteCompactSize(ssTxs, vtxs.size() + 1); // with the coinbase
+  for (const auto &tx : vtxs) {
+    ssTxs << *tx;
+  }
+  return HexStr(ssTxs.begin(), ssTxs.end());
+}
+
+std::string EncodeHexBlock(
+    const CBlockHeader &header,
+    const std::vector<char> &coinbaseTxBin,
+    const std::string &blockTxsHex) {
+  // hex digits of the transaction count, see WriteCompactSize()
+  size_t countSize = 2;
+  if (blockTxsHex.compare(0, 2, "fd") == 0) {
+    countSize = 6;
+  } else if (blockTxsHex.compare(0, 2, "fe") == 0) {
+    countSize = 10;
+  } else if (blockTxsHex.compare(0, 2, "ff") == 0) {
+    countSize = 18;
+  }
+
+  std::string coinbaseHex;
+  Bin2Hex(coinbaseTxBin, coinbaseHex);
+
+  std::string blockHex = EncodeHexBlockHeader(header);
+  blockHex.reserve(blockHex.size() + coinbaseHex.size() + blockTxsHex.size());
+  blockHex.append(blockTxsHex, 0, countSize);
+  blockHex.append(coinbaseHex);
+  blockHex.append(blockTxsHex, countSize, std::string::npos);
+  return blockHex;
+}
+
 uint256 ComputeCoinbaseMerkleRoot(
     const std::vector<char> &coinbaseBin, const vector<uint256> &merkleBranch) {
+  return ComputeCoinbaseMerkleRoot(
+      Hash(coinbaseBin.begin(), coinbaseBin.end()), merkleBranch);
+}
 
-  uint256 hashMerkleRoot = Hash(coinbaseBin.begin(), coinbaseBin.end());
+uint256 ComputeCoinbaseMerkleRoot(
+    const uint256 &coinbaseHash, const vector<uint256> &merkleBranch) {
+  uint256 hashMerkleRoot = coinbaseHash;
   for (const uint256 &step : merkleBranch) {
     hashMerkleRoot = Hash(
         BEGIN(hashMerkleRoot), END(hashMerkleRoot), BEGIN(step), END(step));
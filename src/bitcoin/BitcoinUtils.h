@@ -125,10 +125,28 @@ std::vector<uint256> BlockMerkleBranch(const CBlock &block, uint32_t position);
 uint256 ComputeCoinbaseMerkleRoot(
     const std::vector<char> &coinbaseBin,
     const std::vector<uint256> &merkleBranch);
+uint256 ComputeCoinbaseMerkleRoot(
+    const uint256 &coinbaseHash, const std::vector<uint256> &merkleBranch);
 
 std::string EncodeHexBlock(const CBlock &block);
 std::string EncodeHexBlockHeader(const CBlockHeader &blkHeader);
 
+#ifdef CHAIN_TYPE_ZEC
+using BlockTxs = std::vector<std::shared_ptr<const CTransaction>>;
+#else
+using BlockTxs = std::vector<CTransactionRef>;
+#endif
+// The hex of the transactions of a block following the coinbase, preceded by
+// the transaction count including the coinbase
+std::string EncodeHexBlockTxs(const BlockTxs &vtxs);
+// Same as EncodeHexBlock() of the block made of the header, the coinbase and
+// the transactions of blockTxsHex from EncodeHexBlockTxs(), without
+// serializing the transactions again
+std::string EncodeHexBlock(
+    const CBlockHeader &header,
+    const std::vector<char> &coinbaseTxBin,
+    const std::string &blockTxsHex);
+
 int64_t GetBlockReward(int nHeight, const Consensus::Params &consensusParams);
 
 bool checkBitcoinRPC(
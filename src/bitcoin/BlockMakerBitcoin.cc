@@ -26,6 +26,7 @@
 #include "StratumBitcoin.h"
 
 #include "BitcoinUtils.h"
+#include "prometheus/Registry.h"
 
 #include "rsk/RskSolvedShareData.h"
 
@@ -67,7 +68,10 @@ BlockMakerBitcoin::BlockMakerBitcoin(
   , kafkaConsumerRskSolvedShare_(
         kafkaBrokers, def()->rskSolvedShareTopic_.c_str(), 0 /* patition */)
 #endif
-{
+  , rpcClient_(kRpcThreads, kRpcQueueCapacity)
+  , submitRpcClient_(
+        std::max<size_t>(def()->nodes.size(), 1) * kRpcConnectionsPerNode,
+        0 /* unbounded */) {
 }
 
 BlockMakerBitcoin::~BlockMakerBitcoin() {
@@ -90,6 +94,20 @@ bool BlockMakerBitcoin::init() {
   if (!checkBitcoinds())
     return false;
 
+  // the connections to the nodes are opened before a block is found
+  const string request =
+      "{\"jsonrpc\":\"1.0\",\"id\":\"1\",\"method\":\"getnetworkinfo\","
+      "\"params\":[]}";
+  for (const auto &itr : def()->nodes) {
+    rpcNodes_.push_back(RpcNode{itr.rpcAddr_, itr.rpcUserPwd_});
+    if (!submitRpcClient_.preconnect(
+            rpcNodes_.back(), request, kRpcConnectionsPerNode)) {
+      LOG(WARNING) << "cannot preconnect to: " << itr.rpcAddr_;
+    }
+  }
+  submitRpcClient_.keepConnected(
+      rpcNodes_, request, kRpcConnectionsPerNode, kRpcKeepConnectedInterval);
+
   if (!BlockMaker::init()) {
     return false;
   }
@@ -240,17 +258,23 @@ void BlockMakerBitcoin::addRawgbt(const char *str, size_t len) {
 #endif
   }
 
+  auto txsHex = std::make_shared<const string>(EncodeHexBlockTxs(*vtxs));
+
   LOG(INFO) << "insert rawgbt: " << gbtHash.ToString()
-            << ", txs: " << vtxs->size();
-  insertRawGbt(gbtHash, vtxs);
+            << ", txs: " << vtxs->size()
+            << ", txs bytes: " << txsHex->size() / 2;
+  insertRawGbt(gbtHash, vtxs, txsHex);
 }
 
 void BlockMakerBitcoin::insertRawGbt(
-    const uint256 &gbtHash, shared_ptr<vector<CTransactionRef>> vtxs) {
+    const uint256 &gbtHash,
+    shared_ptr<vector<CTransactionRef>> vtxs,
+    shared_ptr<const string> txsHex) {
   ScopeLock ls(rawGbtLock_);
 
   // insert rawgbt
   rawGbtMap_[gbtHash] = vtxs;
+  rawGbtTxsHexMap_[gbtHash] = txsHex;
   rawGbtQ_.push_back(gbtHash);
 
   // remove rawgbt if need
@@ -258,6 +282,7 @@ void BlockMakerBitcoin::insertRawGbt(
     const uint256 h = *rawGbtQ_.begin();
 
     rawGbtMap_.erase(h); // delete from map
+    rawGbtTxsHexMap_.erase(h);
     rawGbtQ_.pop_front(); // delete from Q
   }
 }
@@ -543,8 +568,7 @@ void BlockMakerBitcoin::submitNamecoinBlockNonBlocking(
     const string &bitcoinBlockHash,
     const string &rpcAddress,
     const string &rpcUserpass) {
-  // use thread to submit
-  std::thread t(std::bind(
+  rpcClient_.dispatch(std::bind(
       &BlockMakerBitcoin::_submitNamecoinBlockThread,
       this,
       auxBlockHash,
@@ -552,7 +576,6 @@ void BlockMakerBitcoin::submitNamecoinBlockNonBlocking(
       bitcoinBlockHash,
       rpcAddress,
       rpcUserpass));
-  t.detach();
 }
 
 void BlockMakerBitcoin::_submitNamecoinBlockThread(
@@ -593,8 +616,8 @@ void BlockMakerBitcoin::_submitNamecoinBlockThread(
     // try N times
     string response;
     for (size_t i = 0; i < 3; i++) {
-      bool res = blockchainNodeRpcCall(
-          rpcAddress.c_str(), rpcUserpass.c_str(), request.c_str(), response);
+      bool res =
+          rpcClient_.call(RpcNode{rpcAddress, rpcUserpass}, request, response);
 
       // success
       if (res == true) {
@@ -660,9 +683,11 @@ void BlockMakerBitcoin::processSolvedShare(rd_kafka_message_t *rkmessage) {
     foundBlock.headerData_.get(blkHeader);
   }
 
-  // get gbtHash and rawgbt (vtxs)
+  // get gbtHash and rawgbt (serialized txs)
   uint256 gbtHash;
-  shared_ptr<vector<CTransactionRef>> vtxs;
+  // a block with the coinbase only for the light version
+  shared_ptr<const string> txsHex =
+      std::make_shared<const string>(EncodeHexBlockTxs(BlockTxs()));
   {
     ScopeLock sl(jobIdMapLock_);
     if (jobId2GbtHash_.find(foundBlock.jobId_) != jobId2GbtHash_.end()) {
@@ -684,49 +709,35 @@ void BlockMakerBitcoin::processSolvedShare(rd_kafka_message_t *rkmessage) {
 #endif // CHAIN_TYPE_BCH
   {
     ScopeLock ls(rawGbtLock_);
-    if (rawGbtMap_.find(gbtHash) == rawGbtMap_.end()) {
+    const auto iter = rawGbtTxsHexMap_.find(gbtHash);
+    if (iter == rawGbtTxsHexMap_.end()) {
       LOG(ERROR) << "can't find this gbthash in rawGbtMap_: "
                  << gbtHash.ToString();
       return;
     }
-    vtxs = rawGbtMap_[gbtHash];
-    assert(vtxs.get() != nullptr);
+    txsHex = iter->second;
+    assert(txsHex.get() != nullptr);
   }
 
-  //
-  // build new block
-  //
-  CBlock newblk(blkHeader);
-
-  // put coinbase tx
-  {
-    CSerializeData sdata;
-    sdata.insert(sdata.end(), coinbaseTxBin.begin(), coinbaseTxBin.end());
+  // coinbase tx
 #ifdef CHAIN_TYPE_ZEC
-    newblk.vtx.push_back(CTransaction());
+  CTransaction coinbaseTx;
 #else
-    newblk.vtx.push_back(MakeTransactionRef());
+  CTransactionRef coinbaseTx = MakeTransactionRef();
 #endif
+  {
+    CSerializeData sdata;
+    sdata.insert(sdata.end(), coinbaseTxBin.begin(), coinbaseTxBin.end());
     CDataStream c(sdata, SER_NETWORK, PROTOCOL_VERSION);
-    c >> newblk.vtx[newblk.vtx.size() - 1];
-  }
-
-  // put other txs
-  if (vtxs && vtxs->size()) {
-#ifdef CHAIN_TYPE_ZEC
-    for (size_t i = 0; i < vtxs->size(); ++i) {
-      newblk.vtx.push_back(*vtxs->at(i));
-    }
-#else
-    newblk.vtx.insert(newblk.vtx.end(), vtxs->begin(), vtxs->end());
-#endif
+    c >> coinbaseTx;
   }
 
-  // submit to bitcoind
-  const string blockHex = EncodeHexBlock(newblk);
+  // submit to bitcoind, the header and the coinbase are spliced in front of
+  // the txs serialized when the rawgbt was received
+  const string blockHex = EncodeHexBlock(blkHeader, coinbaseTxBin, *txsHex);
 #if defined(CHAIN_TYPE_BCH) || defined(CHAIN_TYPE_BSV)
   if (lightVersion) {
-    LOG(INFO) << "submit block light: " << newblk.GetHash().ToString()
+    LOG(INFO) << "submit block light: " << blkHeader.GetHash().ToString()
               << " with job_id: " << gbtlightJobId.c_str();
 #ifdef CHAIN_TYPE_BSV
     string coinbaseTxStr;
@@ -744,16 +755,16 @@ void BlockMakerBitcoin::processSolvedShare(rd_kafka_message_t *rkmessage) {
 #endif // CHAIN_TYPE_BCH
   {
 #ifdef CHAIN_TYPE_LTC
-    LOG(INFO) << "submit block pow: " << newblk.GetPoWHash().ToString();
+    LOG(INFO) << "submit block pow: " << blkHeader.GetPoWHash().ToString();
 #endif
-    LOG(INFO) << "submit block: " << newblk.GetHash().ToString();
+    LOG(INFO) << "submit block: " << blkHeader.GetHash().ToString();
     submitBlockNonBlocking(blockHex); // using thread
   }
 
 #ifdef CHAIN_TYPE_ZEC
-  uint64_t coinbaseValue = AMOUNT_SATOSHIS(newblk.vtx[0].GetValueOut());
+  uint64_t coinbaseValue = AMOUNT_SATOSHIS(coinbaseTx.GetValueOut());
 #else
-  uint64_t coinbaseValue = AMOUNT_SATOSHIS(newblk.vtx[0]->GetValueOut());
+  uint64_t coinbaseValue = AMOUNT_SATOSHIS(coinbaseTx->GetValueOut());
 #endif
 
   // save to DB, using thread
@@ -837,60 +848,49 @@ bool BlockMakerBitcoin::checkBitcoinds() {
 }
 
 void BlockMakerBitcoin::submitBlockNonBlocking(const string &blockHex) {
-  for (const auto &itr : def()->nodes) {
-    // use thread to submit
-    std::thread t(std::bind(
-        &BlockMakerBitcoin::_submitBlockThread,
-        this,
-        itr.rpcAddr_,
-        itr.rpcUserPwd_,
-        blockHex));
-    t.detach();
-  }
-}
-
-void BlockMakerBitcoin::_submitBlockThread(
-    const string &rpcAddress,
-    const string &rpcUserpass,
-    const string &blockHex) {
-  string request =
+  auto request = std::make_shared<string>(
       "{\"jsonrpc\":\"1.0\",\"id\":\"1\",\"method\":\"submitblock\",\"params\":"
-      "[\"";
-  request += blockHex + "\"]}";
-
-  LOG(INFO) << "submit block to: " << rpcAddress;
-  DLOG(INFO) << "submitblock request: " << request;
-  // try N times
-  for (size_t i = 0; i < 3; i++) {
-    string response;
-    bool res = blockchainNodeRpcCall(
-        rpcAddress.c_str(), rpcUserpass.c_str(), request.c_str(), response);
-
-    // success
-    if (res == true) {
-      LOG(INFO) << "rpc call success, submit block response: " << response;
-      break;
-    }
-
-    // failure
-    LOG(ERROR) << "rpc call fail: " << response
-               << "\nrpc request : " << request;
-  }
+      "[\"");
+  *request += blockHex + "\"]}";
+
+  static auto rpcDuration = prometheus::Registry::Default()->histogram(
+      "blkmaker_submit_block_rpc_duration_seconds",
+      "Time of a submitblock call to a node");
+  static auto firstSuccessDuration = prometheus::Registry::Default()->histogram(
+      "blkmaker_submit_block_first_success_duration_seconds",
+      "Time until the first node accepted a submitblock call");
+
+  DLOG(INFO) << "submitblock request: " << *request;
+  // submit to all the nodes at once, try N times
+  submitRpcClient_.fanOut(
+      rpcNodes_,
+      request,
+      3,
+      rpcDuration.get(),
+      firstSuccessDuration.get(),
+      [this, request](size_t node, bool success, const string &response) {
+        if (success) {
+          LOG(INFO) << "rpc call success, submit block to: "
+                    << rpcNodes_[node].url_ << ", response: " << response;
+        } else {
+          LOG(ERROR) << "rpc call fail, submit block to: "
+                     << rpcNodes_[node].url_ << ", response: " << response
+                     << "\nrpc request : " << *request;
+        }
+      });
 }
 
 #if defined(CHAIN_TYPE_BCH)
 void BlockMakerBitcoin::submitBlockLightNonBlocking(
     const string &blockHex, const string &job_id) {
   for (const auto &itr : def()->nodes) {
-    // use thread to submit
-    std::thread t(std::bind(
+    submitRpcClient_.dispatch(std::bind(
         &BlockMakerBitcoin::_submitBlockLightThread,
         this,
         itr.rpcAddr_,
         itr.rpcUserPwd_,
         job_id,
         blockHex));
-    t.detach();
   }
 }
 void BlockMakerBitcoin::_submitBlockLightThread(
@@ -910,8 +910,8 @@ void BlockMakerBitcoin::_submitBlockLightThread(
   // try N times
   for (size_t i = 0; i < 3; i++) {
     string response;
-    bool res = blockchainNodeRpcCall(
-        rpcAddress.c_str(), rpcUserpass.c_str(), request.c_str(), response);
+    bool res = submitRpcClient_.call(
+        RpcNode{rpcAddress, rpcUserpass}, request, response);
     // success
     if (res == true) {
       LOG(INFO) << "rpc call success, submit block light response: "
@@ -931,8 +931,7 @@ void BlockMakerBitcoin::submitBlockLightNonBlocking(
     uint32_t ntime,
     uint32_t nonce) {
   for (const auto &itr : def()->nodes) {
-    // use thread to submit
-    boost::thread t(boost::bind(
+    submitRpcClient_.dispatch(boost::bind(
         &BlockMakerBitcoin::_submitBlockLightThread,
         this,
         itr.rpcAddr_,
@@ -942,7 +941,6 @@ void BlockMakerBitcoin::submitBlockLightNonBlocking(
         version,
         ntime,
         nonce));
-    t.detach();
   }
 }
 void BlockMakerBitcoin::_submitBlockLightThread(
@@ -970,8 +968,8 @@ void BlockMakerBitcoin::_submitBlockLightThread(
   // try N times
   for (size_t i = 0; i < 3; i++) {
     string response;
-    bool res = blockchainNodeRpcCall(
-        rpcAddress.c_str(), rpcUserpass.c_str(), request.c_str(), response);
+    bool res = submitRpcClient_.call(
+        RpcNode{rpcAddress, rpcUserpass}, request, response);
     // success
     if (res == true) {
       LOG(INFO) << "rpc call success, submit block light response: "
@@ -1075,11 +1073,8 @@ void BlockMakerBitcoin::consumeStratumJob(rd_kafka_message_t *rkmessage) {
     string response;
     string request =
         "{\"jsonrpc\":\"1.0\",\"id\":\"1\",\"method\":\"help\",\"params\":[]}";
-    bool res = blockchainNodeRpcCall(
-        sjob->nmcRpcAddr_.c_str(),
-        sjob->nmcRpcUserpass_.c_str(),
-        request.c_str(),
-        response);
+    bool res = rpcClient_.call(
+        RpcNode{sjob->nmcRpcAddr_, sjob->nmcRpcUserpass_}, request, response);
     if (!res) {
       LOG(INFO) << "auxcoind rpc call failure";
     } else {
@@ -1163,7 +1158,7 @@ void BlockMakerBitcoin::submitRskBlockPartialMerkleNonBlocking(
     const string &merkleHashesHex,
     const string &totalTxCount,
     const string &rskHashForMergeMiningHex) {
-  std::thread t(std::bind(
+  rpcClient_.dispatch(std::bind(
       &BlockMakerBitcoin::_submitRskBlockPartialMerkleThread,
       this,
       rpcAddress,
@@ -1174,7 +1169,6 @@ void BlockMakerBitcoin::submitRskBlockPartialMerkleNonBlocking(
       merkleHashesHex,
       totalTxCount,
       rskHashForMergeMiningHex));
-  t.detach();
 }
 
 void BlockMakerBitcoin::_submitRskBlockPartialMerkleThread(
@@ -1199,8 +1193,8 @@ void BlockMakerBitcoin::_submitRskBlockPartialMerkleThread(
   // try N times
   string response;
   for (size_t i = 0; i < 3; i++) {
-    bool res = blockchainNodeRpcCall(
-        rpcAddress.c_str(), rpcUserPwd.c_str(), request.c_str(), response);
+    bool res =
+        rpcClient_.call(RpcNode{rpcAddress, rpcUserPwd}, request, response);
 
     // success
     if (res) {
@@ -1427,7 +1421,7 @@ void BlockMakerBitcoin::submitVcashBlockNonBlocking(
     const string &merkleHashesHex,
     const string &totalTxCount,
     const string &bitcoinblockhash) {
-  std::thread t(std::bind(
+  rpcClient_.dispatch(std::bind(
       &BlockMakerBitcoin::_submitVcashBlockThread,
       this,
       rpcAddress,
@@ -1438,7 +1432,6 @@ void BlockMakerBitcoin::submitVcashBlockNonBlocking(
       merkleHashesHex,
       totalTxCount,
       bitcoinblockhash));
-  t.detach();
 }
 
 void BlockMakerBitcoin::_submitVcashBlockThread(
@@ -1467,8 +1460,8 @@ void BlockMakerBitcoin::_submitVcashBlockThread(
   // try N times
   string response;
   for (size_t i = 0; i < 3; i++) {
-    bool res = blockchainNodeRpcCall(
-        rpcAddress.c_str(), rpcUserPwd.c_str(), request.c_str(), response);
+    bool res =
+        rpcClient_.call(RpcNode{rpcAddress, rpcUserPwd}, request, response);
 
     // success
     if (res) {
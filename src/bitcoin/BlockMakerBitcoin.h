@@ -25,6 +25,7 @@
 #define BLOCK_MAKER_BITCOIN_H_
 
 #include "BlockMaker.h"
+#include "RpcClient.h"
 #include "StratumBitcoin.h"
 
 #include <uint256.h>
@@ -55,6 +56,9 @@ protected:
   std::deque<uint256> rawGbtQ_;
   // key: gbthash, value: block template json
   std::map<uint256, shared_ptr<vector<CTransactionRef>>> rawGbtMap_;
+  // key: gbthash, value: the txs serialized by EncodeHexBlockTxs(), a found
+  // block is submitted without serializing them again
+  std::map<uint256, shared_ptr<const string>> rawGbtTxsHexMap_;
 
   mutex jobIdMapLock_;
   size_t kMaxStratumJobNum_;
@@ -86,7 +90,9 @@ protected:
   std::map<uint64_t, uint256> jobId2RskHashForMergeMining_;
 
   void insertRawGbt(
-      const uint256 &gbtHash, shared_ptr<vector<CTransactionRef>> vtxs);
+      const uint256 &gbtHash,
+      shared_ptr<vector<CTransactionRef>> vtxs,
+      shared_ptr<const string> txsHex);
 
   thread threadConsumeRawGbt_;
   thread threadConsumeStratumJob_;
@@ -151,10 +157,6 @@ protected:
 #endif // CHAIN_TYPE_BCH
 
   void submitBlockNonBlocking(const string &blockHex);
-  void _submitBlockThread(
-      const string &rpcAddress,
-      const string &rpcUserpass,
-      const string &blockHex);
   bool checkBitcoinds();
 
 #ifndef CHAIN_TYPE_ZEC
@@ -222,6 +224,20 @@ protected:
     return std::dynamic_pointer_cast<const BlockMakerDefinitionBitcoin>(def_);
   }
 
+  // the calls to the nodes run on the executors of two clients: the blocks of
+  // the main chain are submitted to def()->nodes by submitRpcClient_, a thread
+  // per kept open connection and an unbounded queue, so the solved share
+  // consumer never waits. The merged mining chains share rpcClient_.
+  static const size_t kRpcThreads = 16;
+  static const size_t kRpcQueueCapacity = 64;
+  static const size_t kRpcConnectionsPerNode = 2;
+  // bitcoind closes the connections idle for 30 seconds
+  static const uint32_t kRpcKeepConnectedInterval = 20;
+  vector<RpcNode> rpcNodes_;
+  // the last members, their executors stop before the other members are gone
+  RpcClient rpcClient_;
+  RpcClient submitRpcClient_;
+
 public:
   BlockMakerBitcoin(
       shared_ptr<BlockMakerDefinition> def,
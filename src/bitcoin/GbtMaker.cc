@@ -147,6 +147,7 @@ GbtMaker::GbtMaker(
   , zmqTimeout_(zmqTimeout)
   , bitcoindRpcAddr_(bitcoindRpcAddr)
   , bitcoindRpcUserpass_(bitcoindRpcUserpass)
+  , bitcoindRpcClient_(0 /* no executor, blocking calls only */, 1)
   , lastGbtMakeTime_(0)
   , kRpcCallInterval_(kRpcCallInterval)
   , kafkaBrokers_(kafkaBrokers)
@@ -207,11 +208,8 @@ bool GbtMaker::bitcoindRpcGBT(string &response) {
   string request =
       "{\"jsonrpc\":\"1.0\",\"id\":\"1\",\"method\":\"getblocktemplate\","
       "\"params\":[{\"rules\" : [\"segwit\"]}]}";
-  bool res = blockchainNodeRpcCall(
-      bitcoindRpcAddr_.c_str(),
-      bitcoindRpcUserpass_.c_str(),
-      request.c_str(),
-      response);
+  bool res = bitcoindRpcClient_.call(
+      RpcNode{bitcoindRpcAddr_, bitcoindRpcUserpass_}, request, response);
   if (!res) {
     LOG(ERROR) << "bitcoind rpc failure";
     return false;
@@ -307,11 +305,8 @@ bool GbtMaker::bitcoindRpcGBTLight(string &response) {
       "{\"jsonrpc\":\"1.0\",\"id\":\"1\",\"method\":\"getblocktemplatelight\","
       "\"params\":[{\"rules\" : [\"segwit\"]}]}";
 #endif
-  bool res = blockchainNodeRpcCall(
-      bitcoindRpcAddr_.c_str(),
-      bitcoindRpcUserpass_.c_str(),
-      request.c_str(),
-      response);
+  bool res = bitcoindRpcClient_.call(
+      RpcNode{bitcoindRpcAddr_, bitcoindRpcUserpass_}, request, response);
   if (!res) {
     LOG(ERROR) << "bitcoind rpc gbtlight failure";
     return false;
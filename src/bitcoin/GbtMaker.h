@@ -26,6 +26,7 @@
 
 #include "Common.h"
 #include "Kafka.h"
+#include "RpcClient.h"
 
 #include "zmq.hpp"
 
@@ -40,6 +41,8 @@ class GbtMaker {
 
   string bitcoindRpcAddr_;
   string bitcoindRpcUserpass_;
+  // polls bitcoind on a kept alive connection
+  RpcClient bitcoindRpcClient_;
   atomic<uint32_t> lastGbtMakeTime_;
 #if defined(CHAIN_TYPE_BCH) || defined(CHAIN_TYPE_BSV)
   atomic<uint32_t> lastGbtLightMakeTime_;
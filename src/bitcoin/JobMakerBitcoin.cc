@@ -44,6 +44,10 @@
 #include "utilities_js.hpp"
 #include "Utils.h"
 
+#include "prometheus/Registry.h"
+
+#include <chrono>
+
 ////////////////////////////////JobMakerHandlerBitcoin//////////////////////////////////
 JobMakerHandlerBitcoin::JobMakerHandlerBitcoin()
   : currBestHeight_(0)
@@ -79,6 +83,18 @@ bool JobMakerHandlerBitcoin::init(shared_ptr<JobMakerDefinition> defPtr) {
   }
   poolPayoutAddr_ = BitcoinUtils::DecodeDestination(def()->payoutAddr_);
 
+  if (def()->gbtDecodeThreads_ > 0) {
+    LOG(INFO) << "GBT decode threads: " << def()->gbtDecodeThreads_;
+    decodePool_ = std::make_unique<WorkerPool>(def()->gbtDecodeThreads_);
+    decodePool_->start(def()->gbtDecodeThreads_);
+    gbtContext_.decodePool_ = decodePool_.get();
+    gbtContext_.decodeThreads_ = def()->gbtDecodeThreads_;
+  }
+  buildJobDuration_ = prometheus::Registry::Default()->histogram(
+      "jobmaker_gbt_job_build_duration_seconds",
+      "Time to build a stratum job from a block template",
+      {{"topic", def()->jobTopic_}});
+
   return true;
 }
 
@@ -555,6 +571,7 @@ string JobMakerHandlerBitcoin::makeStratumJob(const string &gbt) {
   }
 
   StratumJobBitcoin sjob;
+  auto begin = std::chrono::steady_clock::now();
   if (!sjob.initFromGbt(
           gbt.c_str(),
           def()->coinbaseInfo_,
@@ -563,10 +580,19 @@ string JobMakerHandlerBitcoin::makeStratumJob(const string &gbt) {
           latestNmcAuxBlockJson,
           currentRskBlockJson,
           currentVcashBlockJson,
-          isMergedMiningUpdate_)) {
+          isMergedMiningUpdate_,
+          &gbtContext_)) {
     LOG(ERROR) << "init stratum job message from gbt str fail";
     return "";
   }
+  std::chrono::duration<double> buildTime =
+      std::chrono::steady_clock::now() - begin;
+  buildJobDuration_->observe(buildTime.count());
+  LOG(INFO) << "build job from gbt in " << buildTime.count() * 1000
+            << "ms, txs: " << gbtContext_.txs_
+            << ", decoded txs: " << gbtContext_.decodedTxs_
+            << ", reused merkle nodes: "
+            << gbtContext_.merkleCache_.reusedNodes();
   sjob.jobId_ = gen_->next();
   const string jobMsg = sjob.serializeToJson();
 
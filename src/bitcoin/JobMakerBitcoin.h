@@ -25,6 +25,8 @@
 #define JOB_MAKER_BITCOIN_H_
 
 #include "JobMaker.h"
+#include "StratumBitcoin.h"
+#include "WorkerPool.h"
 
 #include "rsk/RskWork.h"
 
@@ -68,6 +70,13 @@ class JobMakerHandlerBitcoin : public JobMakerHandler {
   VcashWork *currentVcashWork_;
   // bool isVcashMergedMiningUpdate_; // a flag to mark Vcash has an update
 
+  // the merkle tree of the last template and the transaction decoders
+  GbtJobContext gbtContext_;
+  unique_ptr<WorkerPool> decodePool_;
+  // time to build a job from a template, exported by the default prometheus
+  // registry
+  shared_ptr<prometheus::Histogram> buildJobDuration_;
+
   bool addRawGbt(const string &msg);
   void clearTimeoutGbt();
   bool isReachTimeout();
@@ -0,0 +1,448 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2016] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "Sha256dBatch.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256D_BATCH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// The lane kernels are written once for scalars and GCC vector extensions,
+// they must be inlined into the functions compiled for the target ISA, so
+// the notes about the ABI of AVX vectors passed by value never apply.
+#define SHA256_INLINE inline __attribute__((always_inline))
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace Sha256dBatch {
+
+namespace {
+
+const uint32_t kInit[8] = {0x6a09e667,
+                           0xbb67ae85,
+                           0x3c6ef372,
+                           0xa54ff53a,
+                           0x510e527f,
+                           0x9b05688c,
+                           0x1f83d9ab,
+                           0x5be0cd19};
+
+alignas(16) const uint32_t kK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+// padding of the second block of a header and of the 32 bytes hash
+const uint32_t kHeaderPadding = 0x80000000;
+const uint32_t kHeaderBits = kHeaderSize * 8;
+const uint32_t kHashPadding = 0x80000000;
+const uint32_t kHashBits = kHashSize * 8;
+
+SHA256_INLINE uint32_t ReadBE32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+      (uint32_t)p[3];
+}
+
+SHA256_INLINE void WriteBE32(uint8_t *p, uint32_t x) {
+  p[0] = x >> 24;
+  p[1] = x >> 16;
+  p[2] = x >> 8;
+  p[3] = x;
+}
+
+///////////////////////////////// Lane kernels /////////////////////////////////
+// V is uint32_t or a vector of N uint32_t, lane l of every V belongs to the
+// header l of the group.
+typedef uint32_t V4 __attribute__((vector_size(16)));
+typedef uint32_t V8 __attribute__((vector_size(32)));
+
+template <typename V>
+SHA256_INLINE V Splat(uint32_t x) {
+  V v = V{};
+  return v + x;
+}
+
+template <typename V>
+SHA256_INLINE V Rotr(const V &x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+template <typename V>
+SHA256_INLINE void Round(
+    const V &a,
+    const V &b,
+    const V &c,
+    V &d,
+    const V &e,
+    const V &f,
+    const V &g,
+    V &h,
+    uint32_t k,
+    const V &w) {
+  V t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) +
+      k + w;
+  V t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) +
+      ((a & b) ^ (a & c) ^ (b & c));
+  d += t1;
+  h = t1 + t2;
+}
+
+// message schedule of round i >= 16, w is a ring of the last 16 words
+template <typename V>
+SHA256_INLINE V Expand(V w[16], int i) {
+  V w15 = w[(i - 15) & 15];
+  V w2 = w[(i - 2) & 15];
+  return w[i & 15] += (Rotr(w15, 7) ^ Rotr(w15, 18) ^ (w15 >> 3)) +
+      (Rotr(w2, 17) ^ Rotr(w2, 19) ^ (w2 >> 10)) + w[(i - 7) & 15];
+}
+
+template <typename V>
+SHA256_INLINE void Compress(V s[8], V w[16]) {
+  V a = s[0], b = s[1], c = s[2], d = s[3];
+  V e = s[4], f = s[5], g = s[6], h = s[7];
+  // 8 rounds per iteration so the working variables rotate in place
+  for (int i = 0; i < 64; i += 8) {
+    if (i >= 16) {
+      for (int j = 0; j < 8; ++j) {
+        Expand(w, i + j);
+      }
+    }
+    Round(a, b, c, d, e, f, g, h, kK[i + 0], w[(i + 0) & 15]);
+    Round(h, a, b, c, d, e, f, g, kK[i + 1], w[(i + 1) & 15]);
+    Round(g, h, a, b, c, d, e, f, kK[i + 2], w[(i + 2) & 15]);
+    Round(f, g, h, a, b, c, d, e, kK[i + 3], w[(i + 3) & 15]);
+    Round(e, f, g, h, a, b, c, d, kK[i + 4], w[(i + 4) & 15]);
+    Round(d, e, f, g, h, a, b, c, kK[i + 5], w[(i + 5) & 15]);
+    Round(c, d, e, f, g, h, a, b, kK[i + 6], w[(i + 6) & 15]);
+    Round(b, c, d, e, f, g, h, a, kK[i + 7], w[(i + 7) & 15]);
+  }
+  s[0] += a;
+  s[1] += b;
+  s[2] += c;
+  s[3] += d;
+  s[4] += e;
+  s[5] += f;
+  s[6] += g;
+  s[7] += h;
+}
+
+// Loads word i of the N headers into the lanes of v
+template <typename V, size_t N>
+SHA256_INLINE void LoadWord(V &v, const uint8_t *headers, size_t offset) {
+  uint32_t lanes[N];
+  for (size_t l = 0; l < N; ++l) {
+    lanes[l] = ReadBE32(headers + l * kHeaderSize + offset);
+  }
+  memcpy(&v, lanes, sizeof(v));
+}
+
+template <typename V, size_t N>
+SHA256_INLINE void HashLanes(const uint8_t *headers, uint8_t *out) {
+  V s[8], w[16];
+
+  // first block: bytes 0 - 63 of the header
+  for (size_t i = 0; i < 8; ++i) {
+    s[i] = Splat<V>(kInit[i]);
+  }
+  for (size_t i = 0; i < 16; ++i) {
+    LoadWord<V, N>(w[i], headers, i * 4);
+  }
+  Compress(s, w);
+
+  // second block: bytes 64 - 79 of the header and the padding
+  for (size_t i = 0; i < 4; ++i) {
+    LoadWord<V, N>(w[i], headers, 64 + i * 4);
+  }
+  w[4] = Splat<V>(kHeaderPadding);
+  for (size_t i = 5; i < 15; ++i) {
+    w[i] = V{};
+  }
+  w[15] = Splat<V>(kHeaderBits);
+  Compress(s, w);
+
+  // the second SHA256 over the 32 bytes hash
+  for (size_t i = 0; i < 8; ++i) {
+    w[i] = s[i];
+    s[i] = Splat<V>(kInit[i]);
+  }
+  w[8] = Splat<V>(kHashPadding);
+  for (size_t i = 9; i < 15; ++i) {
+    w[i] = V{};
+  }
+  w[15] = Splat<V>(kHashBits);
+  Compress(s, w);
+
+  for (size_t i = 0; i < 8; ++i) {
+    uint32_t lanes[N];
+    memcpy(lanes, &s[i], sizeof(lanes));
+    for (size_t l = 0; l < N; ++l) {
+      WriteBE32(out + l * kHashSize + i * 4, lanes[l]);
+    }
+  }
+}
+
+void Hash1Scalar(const uint8_t *header, uint8_t *out) {
+  HashLanes<uint32_t, 1>(header, out);
+}
+
+#ifdef SHA256D_BATCH_X86
+// SSE2 is part of x86_64, but the vector code is kept out of line so i386
+// builds only run it after the detection
+__attribute__((target("sse2"))) void
+Hash4Sse2(const uint8_t *headers, uint8_t *out) {
+  HashLanes<V4, 4>(headers, out);
+}
+
+__attribute__((target("avx2"))) void
+Hash8Avx2(const uint8_t *headers, uint8_t *out) {
+  HashLanes<V8, 8>(headers, out);
+}
+
+////////////////////////////////// SHA-NI kernel ///////////////////////////////
+// Rounds 4 * I to 4 * I + 3, msgs is a ring of the last 4 message vectors
+template <int I>
+__attribute__((target("sha,sse4.1,ssse3"))) SHA256_INLINE void ShaniRounds(
+    __m128i &state0, __m128i &state1, __m128i msgs[4], const uint8_t *block) {
+  __m128i &cur = msgs[I & 3];
+  __m128i &next = msgs[(I + 1) & 3];
+  __m128i &prev = msgs[(I + 3) & 3];
+  if (I < 4) {
+    const __m128i kShuffle =
+        _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+    cur = _mm_shuffle_epi8(
+        _mm_loadu_si128((const __m128i *)(block + I * 16)), kShuffle);
+  }
+  __m128i msg = _mm_add_epi32(cur, _mm_load_si128((const __m128i *)&kK[I * 4]));
+  state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+  if (I >= 3 && I <= 14) {
+    next = _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4));
+    next = _mm_sha256msg2_epu32(next, cur);
+  }
+  msg = _mm_shuffle_epi32(msg, 0x0E);
+  state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+  if (I >= 1 && I <= 12) {
+    prev = _mm_sha256msg1_epu32(prev, cur);
+  }
+}
+
+// One 64 bytes block with the SHA extensions, state is in the order of kInit
+__attribute__((target("sha,sse4.1,ssse3"))) SHA256_INLINE void
+TransformShani(uint32_t state[8], const uint8_t block[64]) {
+  __m128i tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+  __m128i state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+  tmp = _mm_shuffle_epi32(tmp, 0xB1); // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1B); // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+  const __m128i abefSave = state0;
+  const __m128i cdghSave = state1;
+
+  __m128i msgs[4];
+  ShaniRounds<0>(state0, state1, msgs, block);
+  ShaniRounds<1>(state0, state1, msgs, block);
+  ShaniRounds<2>(state0, state1, msgs, block);
+  ShaniRounds<3>(state0, state1, msgs, block);
+  ShaniRounds<4>(state0, state1, msgs, block);
+  ShaniRounds<5>(state0, state1, msgs, block);
+  ShaniRounds<6>(state0, state1, msgs, block);
+  ShaniRounds<7>(state0, state1, msgs, block);
+  ShaniRounds<8>(state0, state1, msgs, block);
+  ShaniRounds<9>(state0, state1, msgs, block);
+  ShaniRounds<10>(state0, state1, msgs, block);
+  ShaniRounds<11>(state0, state1, msgs, block);
+  ShaniRounds<12>(state0, state1, msgs, block);
+  ShaniRounds<13>(state0, state1, msgs, block);
+  ShaniRounds<14>(state0, state1, msgs, block);
+  ShaniRounds<15>(state0, state1, msgs, block);
+
+  state0 = _mm_add_epi32(state0, abefSave);
+  state1 = _mm_add_epi32(state1, cdghSave);
+  tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8); // ABEF
+  _mm_storeu_si128((__m128i *)&state[0], state0);
+  _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+__attribute__((target("sha,sse4.1,ssse3"))) void
+Hash1Shani(const uint8_t *header, uint8_t *out) {
+  uint32_t state[8];
+  memcpy(state, kInit, sizeof(state));
+  TransformShani(state, header);
+
+  uint8_t block[64] = {0};
+  memcpy(block, header + 64, kHeaderSize - 64);
+  WriteBE32(block + 16, kHeaderPadding);
+  WriteBE32(block + 60, kHeaderBits);
+  TransformShani(state, block);
+
+  for (size_t i = 0; i < 8; ++i) {
+    WriteBE32(block + i * 4, state[i]);
+  }
+  WriteBE32(block + 32, kHashPadding);
+  memset(block + 36, 0, 24);
+  WriteBE32(block + 60, kHashBits);
+  memcpy(state, kInit, sizeof(state));
+  TransformShani(state, block);
+
+  for (size_t i = 0; i < 8; ++i) {
+    WriteBE32(out + i * 4, state[i]);
+  }
+}
+
+struct CpuFeatures {
+  bool sse2_ = false;
+  bool avx2_ = false;
+  bool shani_ = false;
+
+  CpuFeatures() {
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+      return;
+    }
+    sse2_ = (edx >> 26) & 1;
+    bool ssse3 = (ecx >> 9) & 1;
+    bool sse41 = (ecx >> 19) & 1;
+    bool osxsave = (ecx >> 27) & 1;
+    bool avx = (ecx >> 28) & 1;
+
+    // the OS must save the YMM registers on context switches
+    bool ymm = false;
+    if (osxsave && avx) {
+      uint32_t xcr0Low, xcr0High;
+      __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+      ymm = (xcr0Low & 6) == 6;
+    }
+
+    if (__get_cpuid_max(0, nullptr) >= 7) {
+      __cpuid_count(7, 0, eax, ebx, ecx, edx);
+      avx2_ = ymm && ((ebx >> 5) & 1);
+      shani_ = ssse3 && sse41 && ((ebx >> 29) & 1);
+    }
+  }
+};
+
+const CpuFeatures &GetCpuFeatures() {
+  static const CpuFeatures features;
+  return features;
+}
+#endif // SHA256D_BATCH_X86
+
+} // namespace
+
+const char *KernelName(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::SCALAR:
+    return "scalar";
+  case Kernel::SSE2:
+    return "sse2";
+  case Kernel::AVX2:
+    return "avx2";
+  case Kernel::SHANI:
+    return "shani";
+  }
+  return "unknown";
+}
+
+bool IsSupported(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::SCALAR:
+    return true;
+#ifdef SHA256D_BATCH_X86
+  case Kernel::SSE2:
+    return GetCpuFeatures().sse2_;
+  case Kernel::AVX2:
+    return GetCpuFeatures().avx2_;
+  case Kernel::SHANI:
+    return GetCpuFeatures().shani_;
+#endif
+  default:
+    return false;
+  }
+}
+
+Kernel BestKernel() {
+  // A SHA-NI round is cheaper than a round of 8 AVX2 lanes divided by 8
+  static const Kernel best = IsSupported(Kernel::SHANI)
+      ? Kernel::SHANI
+      : IsSupported(Kernel::AVX2)
+          ? Kernel::AVX2
+          : IsSupported(Kernel::SSE2) ? Kernel::SSE2 : Kernel::SCALAR;
+  return best;
+}
+
+void Hash80(const uint8_t *headers, size_t count, uint8_t *out) {
+  Hash80(BestKernel(), headers, count, out);
+}
+
+void Hash80(Kernel kernel, const uint8_t *headers, size_t count, uint8_t *out) {
+  if (!IsSupported(kernel)) {
+    kernel = Kernel::SCALAR;
+  }
+
+  size_t i = 0;
+#ifdef SHA256D_BATCH_X86
+  switch (kernel) {
+  case Kernel::SHANI:
+    for (; i < count; ++i) {
+      Hash1Shani(headers + i * kHeaderSize, out + i * kHashSize);
+    }
+    break;
+  case Kernel::AVX2:
+    for (; i + 8 <= count; i += 8) {
+      Hash8Avx2(headers + i * kHeaderSize, out + i * kHashSize);
+    }
+    // the rest of the headers go to the narrower kernels
+    // fall through
+  case Kernel::SSE2:
+    if (GetCpuFeatures().sse2_) {
+      for (; i + 4 <= count; i += 4) {
+        Hash4Sse2(headers + i * kHeaderSize, out + i * kHashSize);
+      }
+    }
+    break;
+  default:
+    break;
+  }
+#endif
+
+  for (; i < count; ++i) {
+    Hash1Scalar(headers + i * kHeaderSize, out + i * kHashSize);
+  }
+}
+
+} // namespace Sha256dBatch
@@ -0,0 +1,56 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2016] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// Double SHA256 of many independent 80 bytes block headers at once. The
+// headers are hashed in lanes of a SIMD kernel selected by CPU feature
+// detection, with a portable scalar kernel as the fallback.
+//
+namespace Sha256dBatch {
+
+static const size_t kHeaderSize = 80;
+static const size_t kHashSize = 32;
+
+enum class Kernel {
+  SCALAR, // one header at a time, portable
+  SSE2, // 4 lanes
+  AVX2, // 8 lanes
+  SHANI, // one header at a time with the SHA extensions
+};
+
+const char *KernelName(Kernel kernel);
+bool IsSupported(Kernel kernel);
+// The fastest kernel supported by the CPU
+Kernel BestKernel();
+
+// Hashes count headers stored back to back, out receives count hashes in the
+// byte order of CBlockHeader::GetHash()
+void Hash80(const uint8_t *headers, size_t count, uint8_t *out);
+void Hash80(Kernel kernel, const uint8_t *headers, size_t count, uint8_t *out);
+
+} // namespace Sha256dBatch
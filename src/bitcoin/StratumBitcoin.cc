@@ -34,8 +34,12 @@
 #include <streams.h>
 
 #include "Utils.h"
+#include "WorkerPool.h"
 #include <glog/logging.h>
 
+#include <condition_variable>
+#include <mutex>
+
 #include <boost/endian/buffers.hpp>
 
 void BitcoinHeaderData::set(const CBlockHeader &header) {
@@ -92,6 +96,147 @@ makeMerkleBranch(const vector<uint256> &vtxhashs, vector<uint256> &steps) {
   steps.push_back(*hashs.begin()); // put the last one
 }
 
+void MerkleBranchCache::makeMerkleBranch(
+    const vector<uint256> &txHashes, vector<uint256> &merkleBranch) {
+  reusedNodes_ = 0;
+  if (txHashes.empty()) {
+    levels_.clear();
+    return;
+  }
+
+  vector<vector<uint256>> levels(1);
+  levels[0].reserve(txHashes.size() + 1);
+  levels[0].emplace_back(); // coinbase
+  levels[0].insert(levels[0].end(), txHashes.begin(), txHashes.end());
+
+  // the leaves shared with the previous tree, the coinbase is always shared
+  size_t sharedLeaves = 1;
+  if (!levels_.empty()) {
+    const auto &oldLeaves = levels_[0];
+    size_t size = std::min(oldLeaves.size(), levels[0].size());
+    while (sharedLeaves < size &&
+           oldLeaves[sharedLeaves] == levels[0][sharedLeaves]) {
+      sharedLeaves++;
+    }
+  }
+
+  // Node j of a level is the hash of the nodes 2j and 2j + 1 of the level
+  // below, the last one is paired with itself. The branch is node 1 of every
+  // level. A node covering only shared leaves is the same as in the previous
+  // tree.
+  for (size_t depth = 0; levels[depth].size() > 1; depth++) {
+    levels.emplace_back((levels[depth].size() + 1) / 2);
+    const auto &nodes = levels[depth];
+    auto &parents = levels[depth + 1];
+    merkleBranch.push_back(nodes[1]);
+
+    size_t reused = 0;
+    if (depth + 1 < levels_.size()) {
+      reused = std::min(sharedLeaves >> (depth + 1), levels_[depth + 1].size());
+    }
+    for (size_t j = 1; j < parents.size(); j++) {
+      if (j < reused) {
+        parents[j] = levels_[depth + 1][j];
+        reusedNodes_++;
+        continue;
+      }
+      const uint256 &left = nodes[2 * j];
+      const uint256 &right = 2 * j + 1 < nodes.size() ? nodes[2 * j + 1] : left;
+      parents[j] = Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+    }
+  }
+  levels_.swap(levels);
+}
+
+static uint256 decodeTxHash(const JsonNode &data) {
+#ifdef CHAIN_TYPE_ZEC
+  CTransaction tx;
+  DecodeHexTx(tx, data.str());
+  return tx.GetHash();
+#else
+  CMutableTransaction tx;
+  DecodeHexTx(tx, data.str());
+  return MakeTransactionRef(std::move(tx))->GetHash();
+#endif
+}
+
+//
+// The txids of the transactions of a template. They are taken from the
+// "txid" of the transactions, nodes without segwit only give the "hash"
+// which is the txid there. The other transactions are decoded, in parallel
+// in the decode pool of the context if there are many of them.
+//
+static void getGbtTxHashes(
+    JsonNode &jgbt, vector<uint256> &txHashes, GbtJobContext *context) {
+  static const size_t kMinTxsPerThread = 256;
+
+  // with segwit "hash" is the wtxid
+  bool hashIsTxid = jgbt["default_witness_commitment"].type() !=
+      Utilities::JS::type::Str;
+
+  auto &transactions = jgbt["transactions"].array();
+  txHashes.resize(transactions.size());
+  // JsonNode::operator[] sorts the children on its first call, the nodes are
+  // looked up by this thread only
+  vector<size_t> missing;
+  vector<JsonNode> missingData;
+  for (size_t i = 0; i < transactions.size(); i++) {
+    JsonNode &node = transactions[i];
+    JsonNode id = node["txid"];
+    if (id.type() != Utilities::JS::type::Str && hashIsTxid) {
+      id = node["hash"];
+    }
+    if (id.type() == Utilities::JS::type::Str && id.size() == 64) {
+      txHashes[i] = uint256S(id.str());
+    } else {
+      missing.push_back(i);
+      missingData.push_back(node["data"]);
+    }
+  }
+
+  if (context != nullptr) {
+    context->txs_ = transactions.size();
+    context->decodedTxs_ = missing.size();
+  }
+  if (missing.empty()) {
+    return;
+  }
+
+  auto decode = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      txHashes[missing[i]] = decodeTxHash(missingData[i]);
+    }
+  };
+
+  size_t threads = 1;
+  if (context != nullptr && context->decodePool_ != nullptr) {
+    threads = std::min(
+        context->decodeThreads_ + 1, missing.size() / kMinTxsPerThread);
+    threads = std::max<size_t>(threads, 1);
+  }
+  size_t chunk = (missing.size() + threads - 1) / threads;
+
+  // the calling thread decodes the first chunk
+  std::mutex lock;
+  std::condition_variable finished;
+  size_t pending = threads - 1;
+  for (size_t t = 1; t < threads; t++) {
+    size_t begin = t * chunk;
+    size_t end = std::min(begin + chunk, missing.size());
+    context->decodePool_->dispatch([&, begin, end]() {
+      decode(begin, end);
+      std::lock_guard<std::mutex> l{lock};
+      if (--pending == 0) {
+        finished.notify_one();
+      }
+    });
+  }
+  decode(0, std::min(chunk, missing.size()));
+
+  std::unique_lock<std::mutex> l{lock};
+  finished.wait(l, [&pending]() { return pending == 0; });
+}
+
 static int64_t findExtraNonceStart(
     const vector<char> &coinbaseOriTpl, const vector<char> &placeHolder) {
   // find for the end
@@ -348,7 +493,8 @@ bool StratumJobBitcoin::initFromGbt(
     const string &nmcAuxBlockJson,
     const RskWork &latestRskBlockJson,
     const VcashWork &latestVcashBlockJson,
-    const bool isMergedMiningUpdate) {
+    const bool isMergedMiningUpdate,
+    GbtJobContext *context) {
   uint256 gbtHash = Hash(gbt, gbt + strlen(gbt));
   JsonNode r;
   if (!JsonNode::parse(gbt, gbt + strlen(gbt), r)) {
@@ -383,19 +529,13 @@ bool StratumJobBitcoin::initFromGbt(
     coinbaseValue_ = jgbt["coinbasevalue"].int64();
     // read txs hash/data
     vector<uint256> vtxhashs; // txs without coinbase
-    for (JsonNode &node : jgbt["transactions"].array()) {
-#ifdef CHAIN_TYPE_ZEC
-      CTransaction tx;
-      DecodeHexTx(tx, node["data"].str());
-      vtxhashs.push_back(tx.GetHash());
-#else
-      CMutableTransaction tx;
-      DecodeHexTx(tx, node["data"].str());
-      vtxhashs.push_back(MakeTransactionRef(std::move(tx))->GetHash());
-#endif
-    }
+    getGbtTxHashes(jgbt, vtxhashs, context);
     // make merkleSteps and merkle branch
-    makeMerkleBranch(vtxhashs, merkleBranch_);
+    if (context != nullptr) {
+      context->merkleCache_.makeMerkleBranch(vtxhashs, merkleBranch_);
+    } else {
+      makeMerkleBranch(vtxhashs, merkleBranch_);
+    }
   }
 
   // height etc.
@@ -49,6 +49,44 @@
 //       so 500 bytes may enough.
 #define COINBASE_TX_MAX_SIZE 500
 
+class WorkerPool;
+
+//
+// Builds the merkle branch of the coinbase transaction and keeps the merkle
+// tree, the subtrees covering the same leading transactions as the previous
+// template are reused instead of being hashed again.
+//
+class MerkleBranchCache {
+public:
+  // txHashes are the txids without the coinbase
+  void makeMerkleBranch(
+      const vector<uint256> &txHashes, vector<uint256> &merkleBranch);
+
+  // the number of nodes of the last tree copied from the previous one
+  size_t reusedNodes() const { return reusedNodes_; }
+
+private:
+  // levels_[0] are the leaves, the coinbase first. The nodes covering the
+  // coinbase are unknown and left null.
+  vector<vector<uint256>> levels_;
+  size_t reusedNodes_ = 0;
+};
+
+//
+// State of jobmaker kept between the templates by
+// StratumJobBitcoin::initFromGbt().
+//
+struct GbtJobContext {
+  // decodes the transactions the node gave no txid for, may be nullptr
+  WorkerPool *decodePool_ = nullptr;
+  size_t decodeThreads_ = 0;
+  MerkleBranchCache merkleCache_;
+
+  // transactions of the last template and how many had to be decoded
+  size_t txs_ = 0;
+  size_t decodedTxs_ = 0;
+};
+
 // ZCash's nonce is 256bits, others are 32bits.
 #ifdef CHAIN_TYPE_ZEC
 struct BitcoinNonceType {
@@ -448,7 +486,8 @@ public:
       const string &nmcAuxBlockJson,
       const RskWork &latestRskBlockJson,
       const VcashWork &latestVcashBlockJson,
-      const bool isMergedMiningUpdate);
+      const bool isMergedMiningUpdate,
+      GbtJobContext *context = nullptr);
   bool initFromStratumJob(
       vector<JsonNode> &jparamsArr,
       uint64_t currentDifficulty,
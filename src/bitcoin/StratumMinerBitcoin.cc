@@ -52,6 +52,17 @@ void StratumMinerBitcoin::handleRequest(
   }
 }
 
+bool StratumMinerBitcoin::handleSubmit(
+    const string &idStr, const StratumRequest &request) {
+  handleRequest_Submit(
+      idStr,
+      request.paramsSize(),
+      [&request](size_t i) -> const StratumRequest::Value & {
+        return request.param(i);
+      });
+  return true;
+}
+
 void StratumMinerBitcoin::handleExMessage(const std::string &exMessage) {
   //
   // SUBMIT_SHARE | SUBMIT_SHARE_WITH_TIME | SUBMIT_SHARE_WITH_VER |
@@ -73,6 +84,16 @@ void StratumMinerBitcoin::handleExMessage(const std::string &exMessage) {
 
 void StratumMinerBitcoin::handleRequest_Submit(
     const string &idStr, const JsonNode &jparams) {
+  const auto &params = *jparams.children();
+  handleRequest_Submit(
+      idStr, params.size(), [&params](size_t i) -> const JsonNode & {
+        return params[i];
+      });
+}
+
+template <typename GetParam>
+void StratumMinerBitcoin::handleRequest_Submit(
+    const string &idStr, size_t paramsSize, GetParam param) {
   auto &session = getSession();
   if (session.getState() != StratumSession::AUTHENTICATED) {
     session.responseError(idStr, StratumStatus::UNAUTHORIZED);
@@ -84,17 +105,16 @@ void StratumMinerBitcoin::handleRequest_Submit(
     return;
   }
 
-  if (jparams.children()->size() < 5) {
+  if (paramsSize < 5) {
     session.responseError(idStr, StratumStatus::ILLEGAL_PARARMS);
     return;
   }
 
   uint8_t shortJobId;
   if (isNiceHashClient_) {
-    shortJobId = (uint8_t)(
-        jparams.children()->at(1).uint64() % session.maxNumLocalJobs());
+    shortJobId = (uint8_t)(param(1).uint64() % session.maxNumLocalJobs());
   } else {
-    shortJobId = (uint8_t)jparams.children()->at(1).uint32();
+    shortJobId = (uint8_t)param(1).uint32();
   }
 
 #ifdef CHAIN_TYPE_ZEC
@@ -106,17 +126,15 @@ void StratumMinerBitcoin::handleRequest_Submit(
   //  params[2] = TIME
   //  params[3] = NONCE_2
   //  params[4] = EQUIHASH_SOLUTION
-  uint32_t nTime = SwapUint(jparams.children()->at(2).uint32_hex());
-  string nonce2Str = jparams.children()->at(3).str();
+  uint32_t nTime = SwapUint(param(2).uint32_hex());
+  string nonce2Str = param(3).str();
   if (nonce2Str.size() != 56) {
     session.responseError(idStr, StratumStatus::ILLEGAL_PARARMS);
   }
 
   nonce.nonce = SwapUint(uint256S(Strings::Format(
-      "%08x%s",
-      session.getSessionId(),
-      jparams.children()->at(3).str().c_str())));
-  nonce.solution = jparams.children()->at(4).str();
+      "%08x%s", session.getSessionId(), param(3).str().c_str())));
+  nonce.solution = param(4).str();
 
   // ZCash's share doesn't have them
   const uint64_t extraNonce2 = 0;
@@ -131,12 +149,12 @@ void StratumMinerBitcoin::handleRequest_Submit(
   //  params[3] = nTime
   //  params[4] = nonce
   //  params[5] = version mask (optional)
-  const uint64_t extraNonce2 = jparams.children()->at(2).uint64_hex();
-  uint32_t nTime = jparams.children()->at(3).uint32_hex();
-  BitcoinNonceType nonce = jparams.children()->at(4).uint32_hex();
+  const uint64_t extraNonce2 = param(2).uint64_hex();
+  uint32_t nTime = param(3).uint32_hex();
+  BitcoinNonceType nonce = param(4).uint32_hex();
   uint32_t versionMask = 0u;
-  if (jparams.children()->size() >= 6) {
-    versionMask = jparams.children()->at(5).uint32_hex();
+  if (paramsSize >= 6) {
+    versionMask = param(5).uint32_hex();
   }
 #endif
 
@@ -45,12 +45,19 @@ public:
       const std::string &method,
       const JsonNode &jparams,
       const JsonNode &jroot) override;
+  bool handleSubmit(
+      const std::string &idStr, const StratumRequest &request) override;
   void handleExMessage(const std::string &exMessage) override;
   bool handleCheckedShare(
       const std::string &idStr, size_t chainId, const ShareBitcoin &share);
 
 private:
   void handleRequest_Submit(const std::string &idStr, const JsonNode &jparams);
+  // param(i) returns the i-th of the paramsSize params, a JsonNode or a
+  // StratumRequest::Value
+  template <typename GetParam>
+  void handleRequest_Submit(
+      const std::string &idStr, size_t paramsSize, GetParam param);
   void handleExMessage_SubmitShare(
       const std::string &exMessage,
       const bool isWithTime,
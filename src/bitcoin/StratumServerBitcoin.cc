@@ -27,6 +27,7 @@
 #include "StratumMiner.h"
 #include "StratumMinerBitcoin.h"
 #include "BitcoinUtils.h"
+#include "Sha256dBatch.h"
 
 #include "rsk/RskSolvedShareData.h"
 
@@ -105,7 +106,7 @@ void JobRepositoryBitcoin::broadcastStratumJob(
   }
 
   // insert new job
-  exJobs_[sjob->jobId_] = exJob;
+  addStratumJobEx(exJob);
 
   // if job has clean flag, call server to send job
   if (isClean || isMergedMiningClean) {
@@ -224,6 +225,11 @@ void StratumJobExBitcoin::init(uint32_t extraNonce2Size) {
                << ") + StratumExtraNonce2Size(" << extraNonce2Size << ")";
   }
 
+  Hex2Bin(coinbase1_.c_str(), coinbase1_.size(), coinbase1Bin_);
+  Hex2Bin(sjob->coinbase2_.c_str(), sjob->coinbase2_.size(), coinbase2Bin_);
+  coinbase1Hasher_.Write(
+      (const unsigned char *)coinbase1Bin_.data(), coinbase1Bin_.size());
+
   miningNotify3_ = Strings::Format(
       "\",\"%s\""
       ",[%s]"
@@ -247,40 +253,57 @@ void StratumJobExBitcoin::init(uint32_t extraNonce2Size) {
       sjob->nBits_,
       sjob->nTime_);
 #endif
+
+  miningNotifyTail_ = std::make_shared<const string>(
+      miningNotify2_ + coinbase1_ + miningNotify3_);
+  miningNotifyTailClean_ = std::make_shared<const string>(
+      miningNotify2_ + coinbase1_ + miningNotify3Clean_);
 }
 
 void StratumJobExBitcoin::generateCoinbaseTx(
     std::vector<char> *coinbaseBin,
+    uint256 *coinbaseHash,
     const uint32_t extraNonce1,
     const string &extraNonce2Hex,
     string *userCoinbaseInfo) {
-  string coinbaseHex;
-  const string extraNonceStr =
-      Strings::Format("%08x%s", extraNonce1, extraNonce2Hex);
-  auto sjob = std::static_pointer_cast<StratumJobBitcoin>(sjob_);
-  string coinbase1 = sjob->coinbase1_;
+  const size_t coinbase1Size = coinbase1Bin_.size();
+  const size_t extraNonce2Size = extraNonce2Hex.size() / 2;
+  coinbaseBin->resize(
+      coinbase1Size + sizeof(extraNonce1) + extraNonce2Size +
+      coinbase2Bin_.size());
+
+  // coinbase1 + extraNonce1 (big endian) + extraNonce2 + coinbase2
+  char *p = coinbaseBin->data();
+  memcpy(p, coinbase1Bin_.data(), coinbase1Size);
+  p += coinbase1Size;
+  WriteBE32((unsigned char *)p, extraNonce1);
+  p += sizeof(extraNonce1);
+  Hex2Bin(extraNonce2Hex.data(), extraNonce2Hex.size(), p);
+  p += extraNonce2Size;
+  memcpy(p, coinbase2Bin_.data(), coinbase2Bin_.size());
 
 #ifdef USER_DEFINED_COINBASE
   if (userCoinbaseInfo != nullptr) {
-    string userCoinbaseHex;
-    Bin2Hex(
-        (uint8 *)(*userCoinbaseInfo).c_str(),
-        (*userCoinbaseInfo).size(),
-        userCoinbaseHex);
-    // replace the last `userCoinbaseHex.size()` bytes to `userCoinbaseHex`
-    coinbase1.replace(
-        coinbase1.size() - userCoinbaseHex.size(),
-        userCoinbaseHex.size(),
-        userCoinbaseHex);
+    // replace the last `userCoinbaseInfo->size()` bytes of coinbase1, the
+    // midstate of coinbase1 cannot be used then
+    memcpy(
+        coinbaseBin->data() + coinbase1Size - userCoinbaseInfo->size(),
+        userCoinbaseInfo->data(),
+        userCoinbaseInfo->size());
+    *coinbaseHash = Hash(coinbaseBin->begin(), coinbaseBin->end());
+    return;
   }
 #endif
 
-  coinbaseHex.append(coinbase1);
-  coinbaseHex.append(extraNonceStr);
-  coinbaseHex.append(sjob->coinbase2_);
-
-  // DLOG(INFO) << "coinbase tx: " << coinbaseHex;
-  Hex2Bin((const char *)coinbaseHex.c_str(), *coinbaseBin);
+  // double SHA256, resuming the first one from the midstate of coinbase1
+  unsigned char digest[CSHA256::OUTPUT_SIZE];
+  CSHA256 hasher = coinbase1Hasher_;
+  hasher
+      .Write(
+          (const unsigned char *)coinbaseBin->data() + coinbase1Size,
+          coinbaseBin->size() - coinbase1Size)
+      .Finalize(digest);
+  CSHA256().Write(digest, sizeof(digest)).Finalize(coinbaseHash->begin());
 }
 
 void StratumJobExBitcoin::generateBlockHeader(
@@ -318,15 +341,25 @@ void StratumJobExBitcoin::generateBlockHeader(
   header->nNonce = nonce;
 
   // compute merkle root
+  uint256 coinbaseHash;
   generateCoinbaseTx(
-      coinbaseBin, extraNonce1, extraNonce2Hex, userCoinbaseInfo);
+      coinbaseBin,
+      &coinbaseHash,
+      extraNonce1,
+      extraNonce2Hex,
+      userCoinbaseInfo);
   header->hashMerkleRoot =
-      ComputeCoinbaseMerkleRoot(*coinbaseBin, merkleBranch);
+      ComputeCoinbaseMerkleRoot(coinbaseHash, merkleBranch);
 #endif
 }
 
 ////////////////////////////////// ServerBitcoin ///////////////////////////////
 ServerBitcoin::~ServerBitcoin() {
+  for (auto &batch : shareHashBatches_) {
+    if (batch->timer_ != nullptr) {
+      event_free(batch->timer_);
+    }
+  }
   for (ChainVarsBitcoin &chain : chainsBitcoin_) {
     if (chain.kafkaProducerAuxSolvedShare_ != nullptr) {
       delete chain.kafkaProducerAuxSolvedShare_;
@@ -348,6 +381,28 @@ bool ServerBitcoin::setupInternal(const libconfig::Config &config) {
     return false;
   }
 
+  // Scrypt and Equihash headers are not hashed by the batch kernels
+#if !defined(CHAIN_TYPE_LTC) && !defined(CHAIN_TYPE_ZEC)
+  static_assert(
+      sizeof(CBlockHeader) == Sha256dBatch::kHeaderSize,
+      "CBlockHeader must be laid out as its serialization");
+  config.lookupValue("sserver.share_hash_batch_size", shareHashBatchSize_);
+  config.lookupValue(
+      "sserver.share_hash_batch_wait_us", shareHashBatchWaitUs_);
+  if (shareHashBatchSize_ > 1) {
+    LOG(INFO) << "[Option] share hash batch size: " << shareHashBatchSize_
+              << ", wait: " << shareHashBatchWaitUs_ << "us, kernel: "
+              << Sha256dBatch::KernelName(Sha256dBatch::BestKernel());
+    for (auto &reactor : reactors()) {
+      auto batch = std::make_unique<ShareHashBatch>();
+      batch->server_ = this;
+      batch->timer_ = evtimer_new(
+          reactor->base_, &ServerBitcoin::shareHashTimerCallback, batch.get());
+      shareHashBatches_.push_back(std::move(batch));
+    }
+  }
+#endif
+
   auto addChainVars = [&](const string &kafkaBrokers,
                           const string &auxSolvedShareTopic,
                           const string &rskSolvedShareTopic) {
@@ -523,233 +578,307 @@ void ServerBitcoin::checkShare(
       versionMask,
       userCoinbaseInfo);
 
-  dispatchToShareWorker([this,
-                         chainId,
-                         share,
-                         jobTarget,
-                         shareStatus,
-                         workFullName,
-                         returnFn = std::move(returnFn),
-                         sjob,
-                         header,
-                         coinbaseBin]() {
-    int32_t shareStatusReturn = shareStatus;
-#ifdef CHAIN_TYPE_LTC
-    uint256 blkHash = header.GetPoWHash();
-#else
-    uint256 blkHash = header.GetHash();
-#endif
-    arith_uint256 bnBlockHash = UintToArith256(blkHash);
-    arith_uint256 bnNetworkTarget = UintToArith256(sjob->networkTarget_);
-    uint32_t bitsReached = bnBlockHash.GetCompact();
+  hashShare({chainId,
+             share,
+             jobTarget,
+             shareStatus,
+             workFullName,
+             std::move(returnFn),
+             sjob,
+             header,
+             std::move(coinbaseBin)});
+}
+
+void ServerBitcoin::checkShareHash(
+    ShareHashCheck &check, const uint256 &blkHash) {
+  size_t chainId = check.chainId_;
+  const ShareBitcoin &share = check.share_;
+  const uint256 &jobTarget = check.jobTarget_;
+  int32_t shareStatus = check.shareStatus_;
+  const string &workFullName = check.workFullName_;
+  auto &returnFn = check.returnFn_;
+  auto &sjob = check.sjob_;
+  const CBlockHeader &header = check.header_;
+  const std::vector<char> &coinbaseBin = check.coinbaseBin_;
+
+  int32_t shareStatusReturn = shareStatus;
+  arith_uint256 bnBlockHash = UintToArith256(blkHash);
+  arith_uint256 bnNetworkTarget = UintToArith256(sjob->networkTarget_);
+  uint32_t bitsReached = bnBlockHash.GetCompact();
 
 #ifdef CHAIN_TYPE_ZEC
-    DLOG(INFO) << Strings::Format(
-        "CBlockHeader nVersion: %08x, hashPrevBlock: %s, hashMerkleRoot: %s, "
-        "hashFinalSaplingRoot: %s, nTime: %08x, nBits: %08x, nNonce: %s",
-        header.nVersion,
-        header.hashPrevBlock.ToString().c_str(),
-        header.hashMerkleRoot.ToString().c_str(),
-        header.hashFinalSaplingRoot.ToString().c_str(),
-        header.nTime,
-        header.nBits,
-        header.nNonce.ToString().c_str());
-
-    // check equihash solution
-    if (isEnableSimulator_ == false &&
-        CheckEquihashSolution(&header, Params()) == false) {
-      if (StratumStatus::UNKNOWN == shareStatusReturn) {
-        shareStatusReturn = StratumStatus::INVALID_SOLUTION;
-      }
-      dispatch(
-          [shareStatusReturn, bitsReached, returnFn = std::move(returnFn)]() {
-            returnFn(shareStatusReturn, bitsReached);
-          });
-      return;
+  DLOG(INFO) << Strings::Format(
+      "CBlockHeader nVersion: %08x, hashPrevBlock: %s, hashMerkleRoot: %s, "
+      "hashFinalSaplingRoot: %s, nTime: %08x, nBits: %08x, nNonce: %s",
+      header.nVersion,
+      header.hashPrevBlock.ToString().c_str(),
+      header.hashMerkleRoot.ToString().c_str(),
+      header.hashFinalSaplingRoot.ToString().c_str(),
+      header.nTime,
+      header.nBits,
+      header.nNonce.ToString().c_str());
+
+  // check equihash solution
+  if (isEnableSimulator_ == false &&
+      CheckEquihashSolution(&header, Params()) == false) {
+    if (StratumStatus::UNKNOWN == shareStatusReturn) {
+      shareStatusReturn = StratumStatus::INVALID_SOLUTION;
     }
+    dispatch(
+        [shareStatusReturn, bitsReached, returnFn = std::move(returnFn)]() {
+          returnFn(shareStatusReturn, bitsReached);
+        });
+    return;
+  }
 #endif
 
+  //
+  // found new block
+  //
+  if (StratumStatus::UNKNOWN == shareStatusReturn &&
+      (isSubmitInvalidBlock_ == true || bnBlockHash <= bnNetworkTarget)) {
     //
     // found new block
     //
-    if (StratumStatus::UNKNOWN == shareStatusReturn &&
-        (isSubmitInvalidBlock_ == true || bnBlockHash <= bnNetworkTarget)) {
-      //
-      // found new block
-      //
-      FoundBlock foundBlock;
-      foundBlock.jobId_ = share.jobid();
-      foundBlock.workerId_ = share.workerhashid();
-      foundBlock.userId_ =
-          singleUserMode() ? singleUserId(chainId) : share.userid();
-      foundBlock.height_ = sjob->height_;
-      foundBlock.headerData_.set(header);
-      snprintf(
-          foundBlock.workerFullName_,
-          sizeof(foundBlock.workerFullName_),
-          "%s",
-          workFullName.c_str());
-
-      // send
-      sendSolvedShare2Kafka(chainId, &foundBlock, coinbaseBin);
-
-      if (sjob->proxyJobDifficulty_ > 0) {
-        LOG(INFO) << ">>>> solution found: " << blkHash.ToString()
-                  << ", jobId: " << share.jobid()
-                  << ", userId: " << share.userid() << ", by: " << workFullName
-                  << " <<<<";
-      } else {
-        dispatch([this, chainId, height = sjob->height_]() {
-          // mark jobs as stale
-          GetJobRepository(chainId)->markAllJobsAsStale(height);
-        });
+    FoundBlock foundBlock;
+    foundBlock.jobId_ = share.jobid();
+    foundBlock.workerId_ = share.workerhashid();
+    foundBlock.userId_ =
+        singleUserMode() ? singleUserId(chainId) : share.userid();
+    foundBlock.height_ = sjob->height_;
+    foundBlock.headerData_.set(header);
+    snprintf(
+        foundBlock.workerFullName_,
+        sizeof(foundBlock.workerFullName_),
+        "%s",
+        workFullName.c_str());
+
+    // send
+    sendSolvedShare2Kafka(chainId, &foundBlock, coinbaseBin);
+
+    if (sjob->proxyJobDifficulty_ > 0) {
+      LOG(INFO) << ">>>> solution found: " << blkHash.ToString()
+                << ", jobId: " << share.jobid()
+                << ", userId: " << share.userid() << ", by: " << workFullName
+                << " <<<<";
+    } else {
+      dispatch([this, chainId, height = sjob->height_]() {
+        // mark jobs as stale
+        GetJobRepository(chainId)->markAllJobsAsStale(height);
+      });
 
-        LOG(INFO) << ">>>> found a new block: " << blkHash.ToString()
-                  << ", jobId: " << share.jobid()
-                  << ", userId: " << share.userid() << ", by: " << workFullName
-                  << " <<<<";
-      }
+      LOG(INFO) << ">>>> found a new block: " << blkHash.ToString()
+                << ", jobId: " << share.jobid()
+                << ", userId: " << share.userid() << ", by: " << workFullName
+                << " <<<<";
     }
+  }
 
-    // print out high diff share, 2^10 = 1024
-    if (sjob->proxyJobDifficulty_ == 0 &&
-        (bnBlockHash >> 10) <= bnNetworkTarget) {
-      LOG(INFO) << "high diff share, blkhash: " << blkHash.ToString()
-                << ", diff: " << BitcoinDifficulty::TargetToDiff(blkHash)
-                << ", networkDiff: "
-                << BitcoinDifficulty::TargetToDiff(sjob->networkTarget_)
-                << ", by: " << workFullName;
-    }
+  // print out high diff share, 2^10 = 1024
+  if (sjob->proxyJobDifficulty_ == 0 &&
+      (bnBlockHash >> 10) <= bnNetworkTarget) {
+    LOG(INFO) << "high diff share, blkhash: " << blkHash.ToString()
+              << ", diff: " << BitcoinDifficulty::TargetToDiff(blkHash)
+              << ", networkDiff: "
+              << BitcoinDifficulty::TargetToDiff(sjob->networkTarget_)
+              << ", by: " << workFullName;
+  }
 
+  //
+  // found new RSK block
+  //
+  if (!sjob->blockHashForMergedMining_.empty() &&
+      (isSubmitInvalidBlock_ == true ||
+       bnBlockHash <= UintToArith256(sjob->rskNetworkTarget_))) {
     //
-    // found new RSK block
+    // build data needed to submit block to RSK
     //
-    if (!sjob->blockHashForMergedMining_.empty() &&
-        (isSubmitInvalidBlock_ == true ||
-         bnBlockHash <= UintToArith256(sjob->rskNetworkTarget_))) {
-      //
-      // build data needed to submit block to RSK
-      //
-      RskSolvedShareData shareData;
-      shareData.jobId_ = share.jobid();
-      shareData.workerId_ = share.workerhashid();
-      shareData.userId_ = share.userid();
-      // height = matching bitcoin block height
-      shareData.height_ = sjob->height_;
-      snprintf(
-          shareData.feesForMiner_,
-          sizeof(shareData.feesForMiner_),
-          "%s",
-          sjob->feesForMiner_.c_str());
-      snprintf(
-          shareData.rpcAddress_,
-          sizeof(shareData.rpcAddress_),
-          "%s",
-          sjob->rskdRpcAddress_.c_str());
-      snprintf(
-          shareData.rpcUserPwd_,
-          sizeof(shareData.rpcUserPwd_),
-          "%s",
-          sjob->rskdRpcUserPwd_.c_str());
-      shareData.headerData_.set(header);
-      snprintf(
-          shareData.workerFullName_,
-          sizeof(shareData.workerFullName_),
-          "%s",
-          workFullName.c_str());
+    RskSolvedShareData shareData;
+    shareData.jobId_ = share.jobid();
+    shareData.workerId_ = share.workerhashid();
+    shareData.userId_ = share.userid();
+    // height = matching bitcoin block height
+    shareData.height_ = sjob->height_;
+    snprintf(
+        shareData.feesForMiner_,
+        sizeof(shareData.feesForMiner_),
+        "%s",
+        sjob->feesForMiner_.c_str());
+    snprintf(
+        shareData.rpcAddress_,
+        sizeof(shareData.rpcAddress_),
+        "%s",
+        sjob->rskdRpcAddress_.c_str());
+    snprintf(
+        shareData.rpcUserPwd_,
+        sizeof(shareData.rpcUserPwd_),
+        "%s",
+        sjob->rskdRpcUserPwd_.c_str());
+    shareData.headerData_.set(header);
+    snprintf(
+        shareData.workerFullName_,
+        sizeof(shareData.workerFullName_),
+        "%s",
+        workFullName.c_str());
 
-      //
-      // send to kafka topic
-      //
-      string buf;
-      buf.resize(sizeof(RskSolvedShareData) + coinbaseBin.size());
-      uint8_t *p = (uint8_t *)buf.data();
+    //
+    // send to kafka topic
+    //
+    string buf;
+    buf.resize(sizeof(RskSolvedShareData) + coinbaseBin.size());
+    uint8_t *p = (uint8_t *)buf.data();
 
-      // RskSolvedShareData
-      memcpy(p, (const uint8_t *)&shareData, sizeof(RskSolvedShareData));
-      p += sizeof(RskSolvedShareData);
+    // RskSolvedShareData
+    memcpy(p, (const uint8_t *)&shareData, sizeof(RskSolvedShareData));
+    p += sizeof(RskSolvedShareData);
 
-      // coinbase TX
-      memcpy(p, coinbaseBin.data(), coinbaseBin.size());
+    // coinbase TX
+    memcpy(p, coinbaseBin.data(), coinbaseBin.size());
 
-      sendRskSolvedShare2Kafka(chainId, buf.data(), buf.size());
+    sendRskSolvedShare2Kafka(chainId, buf.data(), buf.size());
 
-      //
-      // log the finding
-      //
-      LOG(INFO) << ">>>> found a new RSK block: " << blkHash.ToString()
-                << ", jobId: " << share.jobid()
-                << ", userId: " << share.userid() << ", by: " << workFullName
-                << " <<<<";
-    }
+    //
+    // log the finding
+    //
+    LOG(INFO) << ">>>> found a new RSK block: " << blkHash.ToString()
+              << ", jobId: " << share.jobid()
+              << ", userId: " << share.userid() << ", by: " << workFullName
+              << " <<<<";
+  }
 
+  //
+  // found namecoin block
+  //
+  if (sjob->nmcAuxBits_ != 0 &&
+      (isSubmitInvalidBlock_ == true ||
+       bnBlockHash <= UintToArith256(sjob->nmcNetworkTarget_))) {
     //
-    // found namecoin block
+    // build namecoin solved share message
     //
-    if (sjob->nmcAuxBits_ != 0 &&
-        (isSubmitInvalidBlock_ == true ||
-         bnBlockHash <= UintToArith256(sjob->nmcNetworkTarget_))) {
-      //
-      // build namecoin solved share message
-      //
-      string blockHeaderHex;
-      Bin2Hex((const uint8_t *)&header, sizeof(CBlockHeader), blockHeaderHex);
-      DLOG(INFO) << "blockHeaderHex: " << blockHeaderHex;
-
-      string coinbaseTxHex;
-      Bin2Hex(
-          (const uint8_t *)coinbaseBin.data(),
-          coinbaseBin.size(),
-          coinbaseTxHex);
-      DLOG(INFO) << "coinbaseTxHex: " << coinbaseTxHex;
-
-      const string auxSolvedShare = Strings::Format(
-          "{"
-          "\"job_id\":%u,"
-          "\"aux_block_hash\":\"%s\","
-          "\"block_header\":\"%s\","
-          "\"coinbase_tx\":\"%s\","
-          "\"rpc_addr\":\"%s\","
-          "\"rpc_userpass\":\"%s\""
-          "}",
-          share.jobid(),
-          sjob->nmcAuxBlockHash_.ToString(),
-          blockHeaderHex,
-          coinbaseTxHex,
-          sjob->nmcRpcAddr_,
-          sjob->nmcRpcUserpass_);
-      // send found merged mining aux block to kafka
-      sendAuxSolvedShare2Kafka(
-          chainId, auxSolvedShare.data(), auxSolvedShare.size());
-
-      LOG(INFO) << ">>>> found namecoin block: " << sjob->nmcHeight_ << ", "
-                << sjob->nmcAuxBlockHash_.ToString()
-                << ", jobId: " << share.jobid()
-                << ", userId: " << share.userid() << ", by: " << workFullName
-                << " <<<<";
-    }
+    string blockHeaderHex;
+    Bin2Hex((const uint8_t *)&header, sizeof(CBlockHeader), blockHeaderHex);
+    DLOG(INFO) << "blockHeaderHex: " << blockHeaderHex;
 
-    DLOG(INFO) << "blkHash: " << blkHash.ToString()
-               << ", jobTarget: " << jobTarget.ToString()
-               << ", networkTarget: " << sjob->networkTarget_.ToString();
+    string coinbaseTxHex;
+    Bin2Hex(
+        (const uint8_t *)coinbaseBin.data(),
+        coinbaseBin.size(),
+        coinbaseTxHex);
+    DLOG(INFO) << "coinbaseTxHex: " << coinbaseTxHex;
+
+    const string auxSolvedShare = Strings::Format(
+        "{"
+        "\"job_id\":%u,"
+        "\"aux_block_hash\":\"%s\","
+        "\"block_header\":\"%s\","
+        "\"coinbase_tx\":\"%s\","
+        "\"rpc_addr\":\"%s\","
+        "\"rpc_userpass\":\"%s\""
+        "}",
+        share.jobid(),
+        sjob->nmcAuxBlockHash_.ToString(),
+        blockHeaderHex,
+        coinbaseTxHex,
+        sjob->nmcRpcAddr_,
+        sjob->nmcRpcUserpass_);
+    // send found merged mining aux block to kafka
+    sendAuxSolvedShare2Kafka(
+        chainId, auxSolvedShare.data(), auxSolvedShare.size());
+
+    LOG(INFO) << ">>>> found namecoin block: " << sjob->nmcHeight_ << ", "
+              << sjob->nmcAuxBlockHash_.ToString()
+              << ", jobId: " << share.jobid()
+              << ", userId: " << share.userid() << ", by: " << workFullName
+              << " <<<<";
+  }
 
-    // check share diff
-    if (StratumStatus::UNKNOWN == shareStatusReturn &&
-        isEnableSimulator_ == false &&
-        bnBlockHash > UintToArith256(jobTarget)) {
-      shareStatusReturn = StratumStatus::LOW_DIFFICULTY;
-    }
+  DLOG(INFO) << "blkHash: " << blkHash.ToString()
+             << ", jobTarget: " << jobTarget.ToString()
+             << ", networkTarget: " << sjob->networkTarget_.ToString();
 
-    // reach here and shareStatusReturn is initvalue means an valid share
-    if (StratumStatus::UNKNOWN == shareStatusReturn)
-      shareStatusReturn = StratumStatus::ACCEPT;
+  // check share diff
+  if (StratumStatus::UNKNOWN == shareStatusReturn &&
+      isEnableSimulator_ == false &&
+      bnBlockHash > UintToArith256(jobTarget)) {
+    shareStatusReturn = StratumStatus::LOW_DIFFICULTY;
+  }
 
-    dispatch(
-        [shareStatusReturn, bitsReached, returnFn = std::move(returnFn)]() {
-          returnFn(shareStatusReturn, bitsReached);
-        });
+  // reach here and shareStatusReturn is initvalue means an valid share
+  if (StratumStatus::UNKNOWN == shareStatusReturn)
+    shareStatusReturn = StratumStatus::ACCEPT;
+
+  dispatch(
+      [shareStatusReturn, bitsReached, returnFn = std::move(returnFn)]() {
+        returnFn(shareStatusReturn, bitsReached);
+      });
+}
+
+void ServerBitcoin::hashShare(ShareHashCheck &&check) {
+  if (shareHashBatches_.empty()) {
+    dispatchToShareWorker([this, check = std::move(check)]() mutable {
+      ShareVerifyTimer timer{*this, check.chainId_};
+#ifdef CHAIN_TYPE_LTC
+      checkShareHash(check, check.header_.GetPoWHash());
+#else
+      checkShareHash(check, check.header_.GetHash());
+#endif
+    });
     return;
+  }
+
+  // Only reached by the chains using the double SHA256 of 80 bytes headers
+  // (see setupInternal), a CBlockHeader is laid out as its serialization.
+  ShareHashBatch &batch = *shareHashBatches_[currentReactor().id_];
+  const uint8_t *headerBin = (const uint8_t *)&check.header_;
+  batch.headers_.insert(
+      batch.headers_.end(), headerBin, headerBin + Sha256dBatch::kHeaderSize);
+  batch.checks_.push_back(std::move(check));
+
+  if (batch.checks_.size() >= shareHashBatchSize_) {
+    flushShareHashBatch(batch);
+  } else if (batch.checks_.size() == 1) {
+    struct timeval tv = {(time_t)(shareHashBatchWaitUs_ / 1000000),
+                         (suseconds_t)(shareHashBatchWaitUs_ % 1000000)};
+    evtimer_add(batch.timer_, &tv);
+  }
+}
+
+void ServerBitcoin::flushShareHashBatch(ShareHashBatch &batch) {
+  evtimer_del(batch.timer_);
+  if (batch.checks_.empty()) {
+    return;
+  }
+
+  dispatchToShareWorker([this,
+                         headers = std::move(batch.headers_),
+                         checks = std::move(batch.checks_)]() mutable {
+    static_assert(
+        sizeof(uint256) == Sha256dBatch::kHashSize,
+        "uint256 must be laid out as a hash");
+    const size_t count = checks.size();
+    std::vector<uint256> hashes(count);
+    auto begin = std::chrono::steady_clock::now();
+    Sha256dBatch::Hash80(headers.data(), count, (uint8_t *)hashes.data());
+    // every share is accounted for its part of the batch hashing
+    auto hashDuration = (std::chrono::steady_clock::now() - begin) / count;
+
+    for (size_t i = 0; i < count; ++i) {
+      ShareVerifyTimer timer{*this, checks[i].chainId_};
+      timer.start_ -= hashDuration;
+      checkShareHash(checks[i], hashes[i]);
+    }
   });
+
+  // moved from, the batch is filled again from empty vectors
+  batch.headers_.clear();
+  batch.checks_.clear();
+  batch.headers_.reserve(shareHashBatchSize_ * Sha256dBatch::kHeaderSize);
+  batch.checks_.reserve(shareHashBatchSize_);
+}
+
+void ServerBitcoin::shareHashTimerCallback(int, short, void *context) {
+  auto batch = static_cast<ShareHashBatch *>(context);
+  batch->server_->flushShareHashBatch(*batch);
 }
 
 void ServerBitcoin::sendAuxSolvedShare2Kafka(
@@ -28,6 +28,7 @@
 #include "StratumBitcoin.h"
 #include "StratumMiner.h"
 #include <uint256.h>
+#include <crypto/sha256.h>
 
 class CBlockHeader;
 class FoundBlock;
@@ -48,6 +49,32 @@ protected:
   uint32_t extraNonce2Size_ = StratumMiner::kExtraNonce2Size_;
   bool useShareV1_ = false;
 
+  // A share waiting for the hash of its header, checked by the share worker
+  struct ShareHashCheck {
+    size_t chainId_;
+    ShareBitcoin share_;
+    uint256 jobTarget_;
+    int32_t shareStatus_;
+    string workFullName_;
+    std::function<void(int32_t status, uint32_t bitsReached)> returnFn_;
+    shared_ptr<StratumJobBitcoin> sjob_;
+    CBlockHeader header_;
+    std::vector<char> coinbaseBin_;
+  };
+  // Shares of a network thread waiting to be hashed together, the batch is
+  // dispatched to the share worker when it is full or when the timer fires
+  struct ShareHashBatch {
+    ServerBitcoin *server_ = nullptr;
+    struct event *timer_ = nullptr;
+    std::vector<uint8_t> headers_; // serialized headers, back to back
+    std::vector<ShareHashCheck> checks_;
+  };
+  // indexed by the reactor id, empty if batching is disabled
+  vector<unique_ptr<ShareHashBatch>> shareHashBatches_;
+  // batching is disabled by default, see sserver.share_hash_batch_size
+  uint32_t shareHashBatchSize_ = 1;
+  uint32_t shareHashBatchWaitUs_ = 200;
+
 public:
   ServerBitcoin() = default;
   virtual ~ServerBitcoin();
@@ -92,6 +119,13 @@ protected:
 
   void sendAuxSolvedShare2Kafka(size_t chainId, const char *data, size_t len);
   void sendRskSolvedShare2Kafka(size_t chainId, const char *data, size_t len);
+
+  // Hash the header on the share worker, batched with the other shares of
+  // the network thread if enabled, and check the share with the hash
+  void hashShare(ShareHashCheck &&check);
+  void checkShareHash(ShareHashCheck &check, const uint256 &blkHash);
+  void flushShareHashBatch(ShareHashBatch &batch);
+  static void shareHashTimerCallback(int, short, void *context);
 };
 
 class JobRepositoryBitcoin : public JobRepositoryBase<ServerBitcoin> {
@@ -109,16 +143,28 @@ public:
 class StratumJobExBitcoin : public StratumJobEx {
   void generateCoinbaseTx(
       std::vector<char> *coinbaseBin,
+      uint256 *coinbaseHash,
       const uint32_t extraNonce1,
       const string &extraNonce2Hex,
       string *userCoinbaseInfo = nullptr);
 
+  // Binary coinbase1 (with padding) and coinbase2, and the SHA256 state after
+  // hashing coinbase1. They are built once per job so checking a share only
+  // hashes the extra nonces and coinbase2.
+  std::vector<char> coinbase1Bin_;
+  std::vector<char> coinbase2Bin_;
+  CSHA256 coinbase1Hasher_;
+
 public:
   string miningNotify1_;
   string miningNotify2_;
   string coinbase1_;
   string miningNotify3_;
   string miningNotify3Clean_;
+  // Everything after the job id in the mining.notify, it is the same for all
+  // sessions so they send it without copying (unless USER_DEFINED_COINBASE)
+  shared_ptr<const string> miningNotifyTail_;
+  shared_ptr<const string> miningNotifyTailClean_;
 
 public:
   StratumJobExBitcoin(
@@ -107,7 +107,7 @@ void StratumSessionBitcoin::sendMiningNotify(
 #endif
 
   string notifyStr;
-  notifyStr.reserve(2048);
+  notifyStr.reserve(64);
 
   // notify1
   notifyStr.append(exJob->miningNotify1_);
@@ -125,12 +125,14 @@ void StratumSessionBitcoin::sendMiningNotify(
     notifyStr.append(Strings::Format("%u", ljob.shortJobId_)); // short jobId
   }
 
+#ifdef USER_DEFINED_COINBASE
+  notifyStr.reserve(2048);
+
   // notify2
   notifyStr.append(exJob->miningNotify2_);
 
   string coinbase1 = exJob->coinbase1_;
 
-#ifdef USER_DEFINED_COINBASE
   string userCoinbaseHex;
   Bin2Hex(
       (const uint8_t *)ljob.userCoinbaseInfo_.c_str(),
@@ -141,7 +143,6 @@ void StratumSessionBitcoin::sendMiningNotify(
       coinbase1.size() - userCoinbaseHex.size(),
       userCoinbaseHex.size(),
       userCoinbaseHex);
-#endif
 
   // coinbase1
   notifyStr.append(coinbase1);
@@ -153,6 +154,12 @@ void StratumSessionBitcoin::sendMiningNotify(
     notifyStr.append(exJob->miningNotify3_);
 
   sendData(notifyStr); // send notify string
+#else
+  // notify2 + coinbase1 + notify3 are shared by all sessions
+  sendData(notifyStr);
+  sendSharedData(
+      isFirstJob ? exJob->miningNotifyTailClean_ : exJob->miningNotifyTail_);
+#endif
 
   // clear localJobs_
   clearLocalJobs(exJob->isClean_);
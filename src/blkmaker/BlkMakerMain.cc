@@ -36,6 +36,7 @@
 
 #include "config/bpool-version.h"
 #include "Utils.h"
+#include "prometheus/ExporterThread.h"
 
 #include "bitcoin/BlockMakerBitcoin.h"
 #include "eth/EthConsensus.h"
@@ -283,6 +284,12 @@ int main(int argc, char **argv) {
 
   createBlockMakers(cfg, poolDBInfo);
 
+  // setup prometheus exporter, the latencies are in the default registry
+  prometheus::ExporterThread statsExporter;
+  if (statsExporter.setup(cfg, "blkmaker")) {
+    statsExporter.run();
+  }
+
   try {
     vector<shared_ptr<thread>> workers;
     for (auto maker : makers) {
@@ -307,6 +314,7 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  statsExporter.stop();
   google::ShutdownGoogleLogging();
   return 0;
 }
@@ -28,12 +28,6 @@
 #include "StratumMessageDispatcher.h"
 #include "DiffController.h"
 
-#include "bytom/bh_shared.h"
-
-#ifndef NO_CUDA
-#include "cutil/src/GpuTs.h"
-#endif // NO_CUDA
-
 /////////////////////////////StratumMinerBytom////////////////////////////
 StratumMinerBytom::StratumMinerBytom(
     StratumSessionBytom &session,
@@ -67,52 +61,6 @@ void StratumMinerBytom::handleRequest_GetWork(
       false);
 }
 
-namespace BytomUtils {
-
-int checkProofOfWork(
-    EncodeBlockHeader_return encoded,
-    shared_ptr<StratumJobBytom> sJob,
-    uint64_t difficulty) {
-  DLOG(INFO) << "verify blockheader hash=" << encoded.r1
-             << ", seed=" << sJob->seed_;
-  vector<char> vHeader, vSeed;
-  Hex2Bin(encoded.r1, vHeader);
-  Hex2Bin(sJob->seed_.c_str(), sJob->seed_.length(), vSeed);
-
-#ifndef NO_CUDA
-  uint8_t *pTarget = GpuTs((uint8_t *)vHeader.data(), (uint8_t *)vSeed.data());
-#else
-  GoSlice hSlice = {
-      (void *)vHeader.data(), (int)vHeader.size(), (int)vHeader.size()};
-  GoSlice sSlice = {(void *)vSeed.data(), (int)vSeed.size(), (int)vSeed.size()};
-  uint8_t pTarget[32];
-  GoSlice hOut = {(void *)pTarget, 32, 32};
-  ProofOfWorkHashCPU(hSlice, sSlice, hOut);
-#endif
-
-  //  first job target first before checking solved share
-  string targetStr;
-  Bin2Hex(pTarget, 32, targetStr);
-  GoSlice text = {(void *)pTarget, 32, 32};
-  uint64_t localJobBits = Bytom_JobDifficultyToTargetCompact(difficulty);
-
-  bool powResultLocalJob = CheckProofOfWork(text, localJobBits);
-  if (powResultLocalJob) {
-    //  passed job target, now check the blockheader target
-    bool powResultBlock = CheckProofOfWork(text, sJob->blockHeader_.bits);
-    if (powResultBlock) {
-      return StratumStatus::SOLVED;
-    }
-    return StratumStatus::ACCEPT;
-  } else {
-    return StratumStatus::LOW_DIFFICULTY;
-  }
-
-  return StratumStatus::REJECT_NO_REASON;
-}
-
-} // namespace BytomUtils
-
 void StratumMinerBytom::handleRequest_Submit(
     const string &idStr, const JsonNode &jparams) {
   auto &session = getSession();
@@ -227,47 +175,51 @@ void StratumMinerBytom::handleRequest_Submit(
 
   share.set_combinedheader(&combinedHeader, sizeof(combinedHeader));
 
-  if (exjob->isStale()) {
-    share.set_status(StratumStatus::STALE_SHARE);
-    session.rpc2ResponseBoolean(idStr, false, "Block expired");
+  server.checkAndUpdateShare(
+      localJob->chainId_,
+      std::move(share),
+      exjob,
+      nonce,
+      worker.fullName_,
+      [this,
+       alive = std::weak_ptr<bool>{alive_},
+       idStr,
+       chainId = localJob->chainId_,
+       height = sJob->height(),
+       &server](const ShareBytom &share) {
+        if (StratumStatus::isSolved(share.status())) {
+          server.GetJobRepository(chainId)->markAllJobsAsStale(height);
+        }
+        if (alive.expired() || handleCheckedShare(idStr, chainId, share)) {
+          std::string message;
+          uint32_t size = 0;
+          if (!share.SerializeToArrayWithVersion(message, size)) {
+            LOG(ERROR) << "share SerializeToBuffer failed!" << share.toString();
+            return;
+          }
+          server.sendShare2Kafka(chainId, message.data(), size);
+        }
+      });
+}
+
+bool StratumMinerBytom::handleCheckedShare(
+    const std::string &idStr, size_t chainId, const ShareBytom &share) {
+  auto &session = getSession();
+  auto &worker = session.getWorker();
+
+  if (StratumStatus::isAccepted(share.status())) {
+    handleShare(idStr, share.status(), share.sharediff(), chainId);
   } else {
-    EncodeBlockHeader_return encoded = EncodeBlockHeader(
-        sJob->blockHeader_.version,
-        sJob->blockHeader_.height,
-        (char *)sJob->blockHeader_.previousBlockHash.c_str(),
-        sJob->blockHeader_.timestamp,
-        nonce,
-        sJob->blockHeader_.bits,
-        (char *)sJob->blockHeader_.transactionStatusHash.c_str(),
-        (char *)sJob->blockHeader_.transactionsMerkleRoot.c_str());
-    int powResult = BytomUtils::checkProofOfWork(encoded, sJob, difficulty);
-    share.set_status(powResult);
-    if (powResult == StratumStatus::SOLVED) {
-      std::cout << "share solved\n";
-      LOG(INFO) << "share solved";
-      server.sendSolvedShare2Kafka(
-          localJob->chainId_,
-          nonce,
-          encoded.r0,
-          share.height(),
-          Bytom_TargetCompactToDifficulty(sJob->blockHeader_.bits),
-          worker);
-      server.GetJobRepository(localJob->chainId_)
-          ->markAllJobsAsStale(sJob->height());
-      handleShare(idStr, share.status(), share.sharediff(), localJob->chainId_);
-    } else if (powResult == StratumStatus::ACCEPT) {
-      handleShare(idStr, share.status(), share.sharediff(), localJob->chainId_);
-    } else {
-      std::string failMessage = "Unknown reason";
-      switch (share.status()) {
-      case StratumStatus::LOW_DIFFICULTY:
-        failMessage = "Low difficulty share";
-        break;
-      }
-      session.rpc2ResponseBoolean(idStr, false, failMessage);
+    std::string failMessage = "Unknown reason";
+    switch (share.status()) {
+    case StratumStatus::STALE_SHARE:
+      failMessage = "Block expired";
+      break;
+    case StratumStatus::LOW_DIFFICULTY:
+      failMessage = "Low difficulty share";
+      break;
     }
-    free(encoded.r0);
-    free(encoded.r1);
+    session.rpc2ResponseBoolean(idStr, false, failMessage);
   }
 
   bool isSendShareToKafka = true;
@@ -284,20 +236,5 @@ void StratumMinerBytom::handleRequest_Submit(
     }
   }
 
-  if (isSendShareToKafka) {
-
-    std::string message;
-    uint32_t size = 0;
-    if (!share.SerializeToArrayWithVersion(message, size)) {
-      LOG(ERROR) << "share SerializeToBuffer failed!" << share.toString();
-      return;
-    }
-    server.sendShare2Kafka(localJob->chainId_, message.data(), size);
-
-    // string shareInHex;
-    // Bin2Hex((uint8_t *) &share, sizeof(ShareBytom), shareInHex);
-    // LOG(INFO) << "\nsendShare2Kafka ShareBytom:\n"
-    //           << "- size: " << sizeof(ShareBytom) << " bytes\n"
-    //           << "- hexvalue: " << shareInHex.c_str() << "\n";
-  }
+  return isSendShareToKafka;
 }
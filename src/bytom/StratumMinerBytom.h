@@ -41,6 +41,8 @@ public:
       const std::string &method,
       const JsonNode &jparams,
       const JsonNode &jroot) override;
+  bool handleCheckedShare(
+      const std::string &idStr, size_t chainId, const ShareBytom &share);
 
 private:
   void handleRequest_GetWork(const string &idStr, const JsonNode &jparams);
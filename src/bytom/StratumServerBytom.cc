@@ -26,6 +26,12 @@
 #include "StratumSessionBytom.h"
 #include "DiffController.h"
 
+#include "bytom/bh_shared.h"
+
+#ifndef NO_CUDA
+#include "cutil/src/GpuTs.h"
+#endif // NO_CUDA
+
 using namespace std;
 
 ///////////////////////////////////JobRepositoryBytom///////////////////////////////////
@@ -56,7 +62,7 @@ void JobRepositoryBytom::broadcastStratumJob(shared_ptr<StratumJob> sjobBase) {
   }
 
   // insert new job
-  exJobs_[sjob->jobId_] = exJob;
+  addStratumJobEx(exJob);
 
   if (isClean) {
     sendMiningNotify(exJob);
@@ -88,13 +94,113 @@ unique_ptr<StratumSession> ServerBytom::createConnection(
   return std::make_unique<StratumSessionBytom>(*this, bev, saddr, sessionID);
 }
 
+static int CheckProofOfWorkBytom(
+    EncodeBlockHeader_return encoded,
+    const StratumJobBytom &sJob,
+    uint64_t difficulty) {
+  DLOG(INFO) << "verify blockheader hash=" << encoded.r1
+             << ", seed=" << sJob.seed_;
+  vector<char> vHeader, vSeed;
+  Hex2Bin(encoded.r1, vHeader);
+  Hex2Bin(sJob.seed_.c_str(), sJob.seed_.length(), vSeed);
+
+  uint8_t pTarget[32];
+#ifndef NO_CUDA
+  {
+    // GpuTs() returns a global buffer, the share worker may call it from
+    // several threads
+    static std::mutex gpuLock;
+    ScopeLock sl(gpuLock);
+    memcpy(
+        pTarget, GpuTs((uint8_t *)vHeader.data(), (uint8_t *)vSeed.data()), 32);
+  }
+#else
+  GoSlice hSlice = {
+      (void *)vHeader.data(), (int)vHeader.size(), (int)vHeader.size()};
+  GoSlice sSlice = {(void *)vSeed.data(), (int)vSeed.size(), (int)vSeed.size()};
+  GoSlice hOut = {(void *)pTarget, 32, 32};
+  ProofOfWorkHashCPU(hSlice, sSlice, hOut);
+#endif
+
+  //  first job target first before checking solved share
+  GoSlice text = {(void *)pTarget, 32, 32};
+  uint64_t localJobBits = Bytom_JobDifficultyToTargetCompact(difficulty);
+
+  bool powResultLocalJob = CheckProofOfWork(text, localJobBits);
+  if (powResultLocalJob) {
+    //  passed job target, now check the blockheader target
+    bool powResultBlock = CheckProofOfWork(text, sJob.blockHeader_.bits);
+    if (powResultBlock) {
+      return StratumStatus::SOLVED;
+    }
+    return StratumStatus::ACCEPT;
+  } else {
+    return StratumStatus::LOW_DIFFICULTY;
+  }
+
+  return StratumStatus::REJECT_NO_REASON;
+}
+
+void ServerBytom::checkAndUpdateShare(
+    size_t chainId,
+    ShareBytom share,
+    shared_ptr<StratumJobEx> exjob,
+    uint64_t nonce,
+    const string &workerFullName,
+    std::function<void(const ShareBytom &share)> returnFn) {
+  if (exjob->isStale()) {
+    share.set_status(StratumStatus::STALE_SHARE);
+    returnFn(share);
+    return;
+  }
+
+  auto sJob = std::static_pointer_cast<StratumJobBytom>(exjob->sjob_);
+  dispatchToShareWorker([this,
+                         chainId,
+                         share = std::move(share),
+                         sJob,
+                         nonce,
+                         workerFullName,
+                         returnFn = std::move(returnFn)]() mutable {
+    ShareVerifyTimer timer{*this, chainId};
+    EncodeBlockHeader_return encoded = EncodeBlockHeader(
+        sJob->blockHeader_.version,
+        sJob->blockHeader_.height,
+        (char *)sJob->blockHeader_.previousBlockHash.c_str(),
+        sJob->blockHeader_.timestamp,
+        nonce,
+        sJob->blockHeader_.bits,
+        (char *)sJob->blockHeader_.transactionStatusHash.c_str(),
+        (char *)sJob->blockHeader_.transactionsMerkleRoot.c_str());
+    share.set_status(CheckProofOfWorkBytom(encoded, *sJob, share.sharediff()));
+    if (share.status() == StratumStatus::SOLVED) {
+      LOG(INFO) << "share solved";
+      sendSolvedShare2Kafka(
+          chainId,
+          nonce,
+          encoded.r0,
+          share.height(),
+          Bytom_TargetCompactToDifficulty(sJob->blockHeader_.bits),
+          share,
+          workerFullName);
+    }
+    free(encoded.r0);
+    free(encoded.r1);
+
+    dispatch([share = std::move(share), returnFn = std::move(returnFn)]() {
+      returnFn(share);
+    });
+  });
+}
+
 void ServerBytom::sendSolvedShare2Kafka(
     size_t chainId,
     uint64_t nonce,
     const string &strHeader,
     uint64_t height,
     uint64_t networkDiff,
-    const StratumWorker &worker) {
+    const ShareBytom &share,
+    const string &workerFullName) {
   string msg = Strings::Format(
       "{\"nonce\":%u,\"header\":\"%s\","
       "\"height\":%u,\"networkDiff\":%u,\"userId\":%d,"
@@ -103,8 +209,8 @@ void ServerBytom::sendSolvedShare2Kafka(
       strHeader,
       height,
       networkDiff,
-      worker.userId(chainId),
-      worker.workerHashId_,
-      filterWorkerName(worker.fullName_));
+      share.userid(),
+      share.workerhashid(),
+      filterWorkerName(workerFullName));
   ServerBase::sendSolvedShare2Kafka(chainId, msg.data(), msg.size());
 }
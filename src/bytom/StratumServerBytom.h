@@ -44,13 +44,23 @@ public:
       struct bufferevent *bev,
       struct sockaddr *saddr,
       const uint32_t sessionID) override;
+  // The tensority hash is computed by the share worker, returnFn is called
+  // with the checked share in the reactor of the caller
+  void checkAndUpdateShare(
+      size_t chainId,
+      ShareBytom share,
+      shared_ptr<StratumJobEx> exjob,
+      uint64_t nonce,
+      const string &workerFullName,
+      std::function<void(const ShareBytom &share)> returnFn);
   void sendSolvedShare2Kafka(
       size_t chainId,
       uint64_t nonce,
       const string &strHeader,
       uint64_t height,
       uint64_t networkDiff,
-      const StratumWorker &worker);
+      const ShareBytom &share,
+      const string &workerFullName);
 };
 
 class JobRepositoryBytom : public JobRepositoryBase<ServerBytom> {
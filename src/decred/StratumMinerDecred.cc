@@ -154,26 +154,55 @@ void StratumMinerDecred::handleRequest_Submit(
       nonce,
       session.getSessionId());
 
-  // we send share to kafka by default, but if there are lots of invalid
-  // shares in a short time, we just drop them.
-  bool isSendShareToKafka = true;
-
   LocalShare localShare(
       reinterpret_cast<boost::endian::little_uint64_buf_t *>(extraNonce2.data())
           ->value(),
       nonce,
       ntime);
 
+  auto sendShare = [this,
+                    alive = std::weak_ptr<bool>{alive_},
+                    idStr,
+                    chainId = localJob->chainId_,
+                    &server](const ShareDecred &share) {
+    if (alive.expired() || handleCheckedShare(idStr, chainId, share)) {
+      std::string message;
+      uint32_t size = 0;
+      if (!share.SerializeToArrayWithVersion(message, size)) {
+        LOG(ERROR) << "share SerializeToArrayWithVersion failed!"
+                   << share.toString();
+        return;
+      }
+
+      server.sendShare2Kafka(chainId, message.data(), size);
+    }
+  };
+
   // can't find local share
   if (!localJob->addLocalShare(localShare)) {
     share.set_status(StratumStatus::DUPLICATE_SHARE);
+    sendShare(share);
   } else {
     server.checkAndUpdateShare(
-        share, exjob, extraNonce2, ntime, nonce, worker.fullName_);
+        share,
+        exjob,
+        extraNonce2,
+        ntime,
+        nonce,
+        worker.fullName_,
+        std::move(sendShare));
   }
+}
+
+bool StratumMinerDecred::handleCheckedShare(
+    const std::string &idStr, size_t chainId, const ShareDecred &share) {
+  auto &worker = getSession().getWorker();
 
-  if (!handleShare(
-          idStr, share.status(), share.sharediff(), localJob->chainId_)) {
+  // we send share to kafka by default, but if there are lots of invalid
+  // shares in a short time, we just drop them.
+  bool isSendShareToKafka = true;
+
+  if (!handleShare(idStr, share.status(), share.sharediff(), chainId)) {
     // add invalid share to counter
     invalidSharesCounter_.insert(static_cast<int64_t>(time(nullptr)), 1);
   }
@@ -197,17 +226,5 @@ void StratumMinerDecred::handleRequest_Submit(
     }
   }
 
-  if (isSendShareToKafka) {
-
-    std::string message;
-    uint32_t size = 0;
-    if (!share.SerializeToArrayWithVersion(message, size)) {
-      LOG(ERROR) << "share SerializeToArrayWithVersion failed!"
-                 << share.toString();
-      return;
-    }
-
-    server.sendShare2Kafka(localJob->chainId_, message.data(), size);
-  }
-  return;
+  return isSendShareToKafka;
 }
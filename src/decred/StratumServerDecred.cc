@@ -102,7 +102,7 @@ void JobRepositoryDecred::broadcastStratumJob(shared_ptr<StratumJob> sjob) {
   }
 
   // insert new job
-  exJobs_[jobDecred->jobId_] = jobEx;
+  addStratumJobEx(jobEx);
 
   // We want to update jobs immediately if there are more voters for the same
   // height block
@@ -202,18 +202,21 @@ JobRepository *ServerDecred::createJobRepository(
 }
 
 void ServerDecred::checkAndUpdateShare(
-    ShareDecred &share,
+    ShareDecred share,
     shared_ptr<StratumJobEx> exJobPtr,
     const vector<uint8_t> &extraNonce2,
     uint32_t ntime,
     uint32_t nonce,
-    const string &workerFullName) {
+    const string &workerFullName,
+    std::function<void(const ShareDecred &share)> returnFn) {
   if (!exJobPtr) {
     share.set_status(StratumStatus::JOB_NOT_FOUND);
+    returnFn(share);
     return;
   }
   if (exJobPtr->isStale()) {
     share.set_status(StratumStatus::STALE_SHARE);
+    returnFn(share);
     return;
   }
 
@@ -222,6 +225,7 @@ void ServerDecred::checkAndUpdateShare(
   share.set_voters(sjob->header_.voters.value());
   if (ntime > sjob->header_.timestamp.value() + 600) {
     share.set_status(StratumStatus::TIME_TOO_NEW);
+    returnFn(share);
     return;
   }
 
@@ -237,9 +241,31 @@ void ServerDecred::checkAndUpdateShare(
   header.nonce = nonce;
   protocol_->setExtraNonces(header, share.sessionid(), extraNonce2);
 
+  dispatchToShareWorker([this,
+                         chainId = exJobPtr->chainId_,
+                         share = std::move(share),
+                         sjob,
+                         foundBlock,
+                         workerFullName,
+                         returnFn = std::move(returnFn)]() mutable {
+    ShareVerifyTimer timer{*this, chainId};
+    verifyShare(chainId, share, *sjob, foundBlock, workerFullName);
+    dispatch([share = std::move(share), returnFn = std::move(returnFn)]() {
+      returnFn(share);
+    });
+  });
+}
+
+void ServerDecred::verifyShare(
+    size_t chainId,
+    ShareDecred &share,
+    const StratumJobDecred &sjob,
+    const FoundBlockDecred &foundBlock,
+    const string &workerFullName) {
+  auto &header = foundBlock.header_;
   uint256 blkHash = header.getHash();
   auto bnBlockHash = UintToArith256(blkHash);
-  auto bnNetworkTarget = UintToArith256(sjob->target_);
+  auto bnNetworkTarget = UintToArith256(sjob.target_);
 
   share.set_bitsreached(bnBlockHash.GetCompact());
 
@@ -249,10 +275,10 @@ void ServerDecred::checkAndUpdateShare(
   if (isSubmitInvalidBlock_ == true || bnBlockHash <= bnNetworkTarget) {
     // send
     sendSolvedShare2Kafka(
-        exJobPtr->chainId_, (const char *)&foundBlock, sizeof(foundBlock));
+        chainId, (const char *)&foundBlock, sizeof(foundBlock));
 
     // mark jobs as stale
-    GetJobRepository(exJobPtr->chainId_)->markAllJobsAsStale(sjob->height());
+    GetJobRepository(chainId)->markAllJobsAsStale(sjob.height());
 
     LOG(INFO) << ">>>> found a new block: " << blkHash.ToString()
               << ", jobId: " << share.jobid() << ", userId: " << share.userid()
@@ -262,17 +288,17 @@ void ServerDecred::checkAndUpdateShare(
   // print out high diff share, 2^10 = 1024
   if ((bnBlockHash >> 10) <= bnNetworkTarget) {
     LOG(INFO) << "high diff share, blkhash: " << blkHash.ToString()
-              << ", networkTarget: " << sjob->target_.ToString()
+              << ", networkTarget: " << sjob.target_.ToString()
               << ", by: " << workerFullName;
   }
 
   // check share diff
   auto jobTarget =
-      NetworkParamsDecred::get(sjob->network_).powLimit / share.sharediff();
+      NetworkParamsDecred::get(sjob.network_).powLimit / share.sharediff();
 
   DLOG(INFO) << "blkHash: " << blkHash.ToString()
              << ", jobTarget: " << jobTarget.ToString()
-             << ", networkTarget: " << sjob->target_.ToString();
+             << ", networkTarget: " << sjob.target_.ToString();
 
   if (isEnableSimulator_ == false && bnBlockHash > jobTarget) {
     share.set_status(StratumStatus::LOW_DIFFICULTY);
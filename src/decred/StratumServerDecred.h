@@ -56,15 +56,24 @@ public:
   unique_ptr<StratumSession> createConnection(
       bufferevent *bev, sockaddr *saddr, uint32_t sessionID) override;
 
+  // The block header is hashed by the share worker, returnFn is called with
+  // the checked share in the reactor of the caller
   void checkAndUpdateShare(
-      ShareDecred &share,
+      ShareDecred share,
       shared_ptr<StratumJobEx> exJobPtr,
       const vector<uint8_t> &extraNonce2,
       uint32_t ntime,
       uint32_t nonce,
-      const string &workerFullName);
+      const string &workerFullName,
+      std::function<void(const ShareDecred &share)> returnFn);
 
 protected:
+  void verifyShare(
+      size_t chainId,
+      ShareDecred &share,
+      const StratumJobDecred &sjob,
+      const FoundBlockDecred &foundBlock,
+      const string &workerFullName);
   JobRepository *createJobRepository(
       size_t chainId,
       const char *kafkaBrokers,
@@ -28,6 +28,14 @@
 
 #include "StratumEth.h"
 
+template <>
+struct ShareLogRawVersion<ShareEth> {
+  static bool match(uint32_t version) {
+    return version == ShareEth::CURRENT_VERSION_FOUNDATION ||
+        version == ShareEth::CURRENT_VERSION_CLASSIC;
+  }
+};
+
 //////////////////////////////  Alias  ///////////////////////////////
 using ShareLogWriterEth = ShareLogWriterT<ShareEth>;
 
@@ -28,8 +28,16 @@
 
 #include <boost/thread.hpp>
 
+#include <atomic>
 #include <fstream>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
 #include "CommonEth.h"
 #include "libethash/ethash.h"
 #include "libethash/internal.h"
@@ -40,275 +48,353 @@ using namespace std;
 
 ///////////////////////////// EthashCalculator ////////////////////////////////
 
-EthashCalculator::EthashCalculator(const string &cacheFile)
-  : cacheFile_(cacheFile) {
-  if (!cacheFile_.empty()) {
-    loadCacheFromFile(cacheFile_);
-  }
-}
+static const uint32_t kLightCacheMagic = 0x47414445; // "EDAG"
+static const uint32_t kLightCacheVersion = 1;
 
-EthashCalculator::~EthashCalculator() {
-  if (!cacheFile_.empty()) {
-    saveCacheToFile(cacheFile_);
-  }
-
-  ScopeLock sl(lock_);
-  for (auto itr : lightCaches_) {
-    ethash_light_delete(itr.second);
+EthashCalculator::EthashCalculator(const string &cacheDir)
+  : cacheDir_(cacheDir) {
+  if (!cacheDir_.empty() && mkdir(cacheDir_.c_str(), 0755) != 0 &&
+      errno != EEXIST) {
+    LOG(WARNING) << "cannot create DAG cache directory " << cacheDir_ << ": "
+                 << strerror(errno);
+    cacheDir_.clear();
   }
 }
 
-size_t EthashCalculator::saveCacheToFile(const string &cacheFile) {
-  ScopeLock sl(lock_);
-  size_t loadedNum = 0;
-
-  if (lightCaches_.empty()) {
-    LOG(INFO) << "DAG cache was empty";
-    return 0;
-  }
-
-  std::ofstream f(cacheFile, std::ios::binary | std::ios::trunc);
-  if (!f) {
-    LOG(ERROR) << "create DAG cache file " << cacheFile << " failed";
-    return 0;
-  }
+string EthashCalculator::getCacheFilePath(uint64_t epoch) const {
+  return Strings::Format(
+      "%s/epoch-%u.v%u.dat", cacheDir_, (uint32_t)epoch, kLightCacheVersion);
+}
 
-  for (auto itr : lightCaches_) {
-    saveCacheToFile(itr.second, f);
-    loadedNum++;
+std::shared_ptr<ethash_light>
+EthashCalculator::storeCacheToFile(const ethash_light &light) {
+  if (cacheDir_.empty()) {
+    return nullptr;
   }
 
-  f.close();
-  LOG(INFO) << "saved " << loadedNum << " DAG caches to file " << cacheFile;
-  return loadedNum;
-}
+  uint64_t epoch = light.block_number / ETHASH_EPOCH_LENGTH;
+  string filePath = getCacheFilePath(epoch);
+  // unique for every writer, sserver processes sharing the directory may
+  // store the same epoch at the same time
+  static std::atomic<uint32_t> tmpFileCounter{0};
+  string tmpPath = Strings::Format(
+      "%s.%d.%u.tmp", filePath, (int)getpid(), tmpFileCounter++);
 
-void EthashCalculator::saveCacheToFile(
-    const ethash_light_t &light, std::ofstream &f) {
   LightCacheHeader header;
-  header.blockNumber_ = light->block_number;
-  header.cacheSize_ = light->cache_size;
+  memset(&header, 0, sizeof(header));
+  header.magic_ = kLightCacheMagic;
+  header.version_ = kLightCacheVersion;
+  header.blockNumber_ = light.block_number;
+  header.cacheSize_ = light.cache_size;
   header.checksum_ =
-      computeCacheChecksum(header, (const uint8_t *)light->cache);
+      crc32(0, (const Bytef *)light.cache, (uInt)header.cacheSize_);
 
+  std::ofstream f(tmpPath, std::ios::binary | std::ios::trunc);
   f.write((const char *)&header, sizeof(header));
-  f.write((const char *)light->cache, header.cacheSize_);
-  f.flush();
-}
-
-size_t EthashCalculator::loadCacheFromFile(const string &cacheFile) {
-  ScopeLock sl(lock_);
-  size_t loadedNum = 0;
-
-  std::ifstream f(cacheFile, std::ios::binary);
-  if (!f) {
-    LOG(WARNING) << "cannot read DAG cache file " << cacheFile;
-    return 0;
-  }
-
-  ethash_light_t light;
-  while (nullptr != (light = loadCacheFromFile(f))) {
-    uint64_t epoch = light->block_number / ETHASH_EPOCH_LENGTH;
-    lightCaches_[epoch] = light;
-    loadedNum++;
+  f.write((const char *)light.cache, header.cacheSize_);
+  f.close();
+  if (!f || rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+    LOG(ERROR) << "save DAG cache to file " << filePath << " failed";
+    unlink(tmpPath.c_str());
+    return nullptr;
   }
+  LOG(INFO) << "saved DAG cache of epoch " << epoch << " to file "
+            << filePath;
 
-  f.close();
-  LOG(INFO) << "loaded " << loadedNum << " DAG caches from file " << cacheFile;
-  return loadedNum;
+  removeOldCacheFiles(epoch);
+  return loadCacheFromFile(light.block_number);
 }
 
-ethash_light_t EthashCalculator::loadCacheFromFile(std::ifstream &f) {
-  LightCacheHeader header;
-  uint64_t checksum;
-  struct ethash_light *ret;
-
-  f.read((char *)&header, sizeof(header));
-  if (f.gcount() == 0) {
-    // file EOF reached
+std::shared_ptr<ethash_light>
+EthashCalculator::loadCacheFromFile(uint64_t height) {
+  if (cacheDir_.empty()) {
     return nullptr;
   }
-  if (f.gcount() != sizeof(header)) {
-    LOG(WARNING) << "cannot load DAG cache: header should be " << sizeof(header)
-                 << " bytes but read only " << f.gcount() << " bytes";
+
+  uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
+  string filePath = getCacheFilePath(epoch);
+  int fd = open(filePath.c_str(), O_RDONLY);
+  if (fd < 0) {
     return nullptr;
   }
 
-  // ethash_light_delete() will use free() to release the memory.
-  // So malloc() and calloc() should used for memory allocation.
-  // The basic logic and codes copied from ethash_light_new_internal().
-  ret = (ethash_light *)calloc(sizeof(*ret), 1);
-  if (!ret) {
-    LOG(WARNING) << "cannot load DAG cache: calloc " << sizeof(*ret)
-                 << " bytes failed";
-    return nullptr;
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(LightCacheHeader)) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
   }
-#if defined(__MIC__)
-  ret->cache = _mm_malloc((size_t)header.cacheSize_, 64);
-#else
-  ret->cache = malloc((size_t)header.cacheSize_);
-#endif
-  if (!ret->cache) {
-    LOG(WARNING) << "cannot load DAG cache: malloc " << header.cacheSize_
-                 << " bytes failed";
-    goto fail_free_light;
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(WARNING) << "cannot map DAG cache file " << filePath;
+    return nullptr;
   }
-
-  f.read((char *)ret->cache, header.cacheSize_);
-  if (f.gcount() != (std::streamsize)header.cacheSize_) {
-    LOG(WARNING) << "cannot load DAG cache: cache should be "
-                 << header.cacheSize_ << " bytes but read only " << f.gcount()
-                 << " bytes";
-    goto fail_free_cache_mem;
+  const size_t mapSize = st.st_size;
+  const LightCacheHeader &header = *(const LightCacheHeader *)data;
+  const uint8_t *cache = (const uint8_t *)data + sizeof(LightCacheHeader);
+
+  if (header.magic_ != kLightCacheMagic ||
+      header.version_ != kLightCacheVersion ||
+      header.blockNumber_ / ETHASH_EPOCH_LENGTH != epoch ||
+      header.cacheSize_ != ethash_get_cachesize(height) ||
+      mapSize != sizeof(LightCacheHeader) + header.cacheSize_) {
+    LOG(WARNING) << "cannot load DAG cache: invalid file " << filePath;
+    munmap(data, mapSize);
+    return nullptr;
   }
 
-  checksum = computeCacheChecksum(header, (const uint8_t *)ret->cache);
+  uint32_t checksum = crc32(0, cache, (uInt)header.cacheSize_);
   if (checksum != header.checksum_) {
-    LOG(WARNING) << "cannot load DAG light: checksum mis-matched, it should be "
+    LOG(WARNING) << "cannot load DAG cache: checksum mis-matched, it should be "
                  << header.checksum_ << " but is " << checksum;
-    goto fail_free_cache_mem;
+    munmap(data, mapSize);
+    return nullptr;
   }
 
-  ret->block_number = header.blockNumber_;
-  ret->cache_size = header.cacheSize_;
-  return ret;
-
-fail_free_cache_mem:
-#if defined(__MIC__)
-  _mm_free(ret->cache);
-#else
-  free(ret->cache);
-#endif
-fail_free_light:
-  free(ret);
-  return nullptr;
+  auto light = new ethash_light;
+  light->cache = (void *)cache;
+  light->cache_size = header.cacheSize_;
+  light->block_number = header.blockNumber_;
+
+  LOG(INFO) << "loaded DAG cache of epoch " << epoch << " from file "
+            << filePath;
+  return std::shared_ptr<ethash_light>(
+      light, [data, mapSize](ethash_light *l) {
+        munmap(data, mapSize);
+        delete l;
+      });
 }
 
-uint64_t EthashCalculator::computeCacheChecksum(
-    const LightCacheHeader &header, const uint8_t *data) {
-  union {
-    uint64_t u64;
-    uint8_t u8[8];
-  } checksum;
-
-  checksum.u64 = 0;
-  checksum.u64 += header.blockNumber_;
-  checksum.u64 += header.cacheSize_;
-
-  for (size_t i = 0; i < header.cacheSize_; i++) {
-    checksum.u8[i % 8] += data[i];
+void EthashCalculator::removeOldCacheFiles(uint64_t epoch) {
+  DIR *dir = opendir(cacheDir_.c_str());
+  if (dir == nullptr) {
+    return;
   }
-
-  return checksum.u64;
+  while (struct dirent *entry = readdir(dir)) {
+    uint32_t fileEpoch = 0;
+    if (sscanf(entry->d_name, "epoch-%u.", &fileEpoch) != 1 ||
+        fileEpoch + kMaxCacheSize_ > epoch) {
+      continue;
+    }
+    string filePath = cacheDir_ + "/" + entry->d_name;
+    if (filePath == getCacheFilePath(fileEpoch)) {
+      LOG(INFO) << "remove old DAG cache file " << filePath;
+      unlink(filePath.c_str());
+    }
+  }
+  closedir(dir);
 }
 
-void EthashCalculator::buildDagCacheWithoutLock(uint64_t height) {
+std::shared_ptr<ethash_light> EthashCalculator::newLightCache(uint64_t height) {
   uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
-  if (lightCaches_[epoch] != nullptr) {
-    return;
-  }
 
   LOG(INFO) << "building DAG cache for block height " << height << " (epoch "
             << epoch << ")";
   time_t beginTime = time(nullptr);
 
-  lightCaches_[epoch] = ethash_light_new(height);
+  ethash_light_t cache = ethash_light_new(height);
+  if (cache == nullptr) {
+    LOG(ERROR) << "building DAG cache for block height " << height
+               << " (epoch " << epoch << ") failed";
+    return nullptr;
+  }
+  std::shared_ptr<ethash_light> light(cache, ethash_light_delete);
 
   // Note: The performance of ethash_light_new() difference between Debug and
-  // Release builds is very large. The Release build may complete in 5 seconds,
-  // while the Debug build takes more than 60 seconds.
+  // Release builds is very large. The Release build may complete in 5
+  // seconds, while the Debug build takes more than 60 seconds.
   LOG(INFO) << "DAG cache for block height " << height << " (epoch " << epoch
             << ") built within " << (time(nullptr) - beginTime) << " seconds";
-}
 
-ethash_light_t EthashCalculator::getDagCacheWithoutLock(uint64_t height) {
-  uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
-  if (lightCaches_[epoch] == nullptr) {
-    buildDagCacheWithoutLock(height);
-  }
-  return lightCaches_[epoch];
+  // the mapped file replaces the private copy, so sserver processes on the
+  // same host share its memory
+  auto stored = storeCacheToFile(*light);
+  return stored ? stored : light;
 }
 
-void EthashCalculator::buildDagCache(uint64_t height) {
-  uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
+void EthashCalculator::publishWithoutLock(
+    uint64_t epoch, const EpochCache &cache) {
+  auto caches = std::atomic_load(&caches_);
+  auto newCaches = caches ? std::make_shared<EpochCaches>(*caches)
+                          : std::make_shared<EpochCaches>();
+  (*newCaches)[epoch] = cache;
 
-  bool currentEpochExists = false;
-  bool nextEpochExists = false;
-  {
-    ScopeLock sl(lock_);
-    currentEpochExists = lightCaches_[epoch] != nullptr;
-    nextEpochExists = lightCaches_[epoch + 1] != nullptr;
+  // remove redundant caches, epochs only grow
+  while (newCaches->size() > kMaxCacheSize_) {
+    newCaches->erase(newCaches->begin());
+  }
+  size_t fullDags = 0;
+  for (auto itr = newCaches->rbegin(); itr != newCaches->rend(); ++itr) {
+    if (itr->second.full_ && ++fullDags > kMaxFullDagSize_) {
+      itr->second.full_ = nullptr;
+    }
   }
 
-  if (currentEpochExists && nextEpochExists) {
-    return;
+  // the old ones are freed after the last verifying thread releases them
+  std::atomic_store(&caches_, std::shared_ptr<const EpochCaches>(newCaches));
+}
+
+EthashCalculator::EpochCache EthashCalculator::getEpochCache(uint64_t epoch) {
+  auto caches = std::atomic_load(&caches_);
+  if (caches) {
+    auto itr = caches->find(epoch);
+    if (itr != caches->end()) {
+      return itr->second;
+    }
   }
+  return {};
+}
 
-  auto buildLightWithLock = [this](uint64_t height, uint64_t epoch) {
-    {
-      ScopeLock sl(lock_);
-      if (buildingLightCaches_.find(epoch) != buildingLightCaches_.end()) {
-        return;
+void EthashCalculator::buildLightCache(uint64_t height, bool wait) {
+  uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
+  {
+    std::unique_lock<std::mutex> ul(lock_);
+    if (getEpochCache(epoch).light_) {
+      return;
+    }
+    if (buildingLightCaches_.find(epoch) != buildingLightCaches_.end()) {
+      // Other threads are building the same light.
+      if (wait) {
+        built_.wait(ul, [this, epoch]() {
+          return buildingLightCaches_.find(epoch) ==
+              buildingLightCaches_.end();
+        });
       }
-      buildingLightCaches_.insert(epoch);
+      return;
     }
+    buildingLightCaches_.insert(epoch);
+  }
 
-    LOG(INFO) << "building DAG cache for block height " << height << " (epoch "
-              << epoch << ")";
-    time_t beginTime = time(nullptr);
-
-    ethash_light_t light = ethash_light_new(height);
-
-    // Note: The performance of ethash_light_new() difference between Debug and
-    // Release builds is very large. The Release build may complete in 5
-    // seconds, while the Debug build takes more than 60 seconds.
-    LOG(INFO) << "DAG cache for block height " << height << " (epoch " << epoch
-              << ") built within " << (time(nullptr) - beginTime) << " seconds";
+  // stored by an earlier run or another sserver process
+  auto light = loadCacheFromFile(height);
+  if (!light) {
+    light = newLightCache(height);
+  }
 
+  {
     ScopeLock sl(lock_);
     buildingLightCaches_.erase(epoch);
+    publishWithoutLock(epoch, {light, nullptr});
+  }
+  built_.notify_all();
+}
 
-    if (lightCaches_[epoch] != nullptr) {
-      // Other threads have added the same light.
-      ethash_light_delete(light);
+void EthashCalculator::buildFullDag(uint64_t height) {
+  uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
+  EpochCache cache;
+  string dagDir;
+  {
+    ScopeLock sl(lock_);
+    cache = getEpochCache(epoch);
+    dagDir = fullDagDir_;
+    if (dagDir.empty() || !cache.light_ || cache.full_ ||
+        buildingFullDags_.find(epoch) != buildingFullDags_.end()) {
       return;
     }
+    buildingFullDags_.insert(epoch);
+  }
 
-    lightCaches_[epoch] = light;
-  };
+  LOG(INFO) << "building full DAG for block height " << height << " (epoch "
+            << epoch << ") in " << dagDir;
+  time_t beginTime = time(nullptr);
 
-  if (!currentEpochExists) {
-    buildLightWithLock(height, epoch);
+  // an existing DAG file of the epoch is mapped directly, otherwise it is
+  // generated first, which takes minutes
+  ethash_full_t full = ethash_full_new_internal(
+      dagDir.c_str(),
+      ethash_get_seedhash(height),
+      ethash_get_datasize(height),
+      cache.light_.get(),
+      nullptr);
+
+  if (full == nullptr) {
+    LOG(ERROR) << "building full DAG for block height " << height
+               << " failed, keep verifying with the DAG cache";
+  } else {
+    LOG(INFO) << "full DAG for block height " << height << " (epoch "
+              << epoch << ") built within " << (time(nullptr) - beginTime)
+              << " seconds";
   }
 
-  if (!nextEpochExists) {
-    buildLightWithLock(height + ETHASH_EPOCH_LENGTH, epoch + 1);
+  ScopeLock sl(lock_);
+  buildingFullDags_.erase(epoch);
+  if (full == nullptr) {
+    return;
+  }
+  // the light may have been rebuilt meanwhile, keep the current one
+  cache = getEpochCache(epoch);
+  if (!cache.light_) {
+    // removed as an outdated epoch
+    ethash_full_delete(full);
+    return;
   }
+  cache.full_.reset(full, ethash_full_delete);
+  publishWithoutLock(epoch, cache);
+}
 
-  // remove redundant caches
+void EthashCalculator::enableFullDag(const string &dagDir) {
   ScopeLock sl(lock_);
-  lightCaches_.clear(kMaxCacheSize_);
+  fullDagDir_ = dagDir;
 }
 
-void EthashCalculator::rebuildDagCache(uint64_t height) {
+void EthashCalculator::buildDagCache(uint64_t height) {
   uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
 
-  LOG(INFO) << "rebuilding DAG cache for block height " << height;
-  time_t beginTime = time(nullptr);
+  if (!getEpochCache(epoch).light_) {
+    buildLightCache(height, false);
+  }
 
-  ethash_light_t light = ethash_light_new(height);
+  if (!getEpochCache(epoch + 1).light_) {
+    buildLightCache(height + ETHASH_EPOCH_LENGTH, false);
+  }
 
-  LOG(INFO) << "DAG cache for block height " << height << " rebuilt within "
-            << (time(nullptr) - beginTime) << " seconds";
+  // no-op if the full DAG mode is disabled or the DAG exists
+  buildFullDag(height);
+  buildFullDag(height + ETHASH_EPOCH_LENGTH);
+}
 
+bool EthashCalculator::markLightCacheBuilding(uint64_t epoch) {
   ScopeLock sl(lock_);
-  if (lightCaches_[epoch] != nullptr) {
-    ethash_light_delete(lightCaches_[epoch]);
-  } else {
-    LOG(ERROR) << "EthashCalculator::rebuildDagCache(" << height
-               << "): the old DAG cache should not be empty";
+  if (buildingLightCaches_.find(epoch) != buildingLightCaches_.end()) {
+    return false;
+  }
+  buildingLightCaches_.insert(epoch);
+  return true;
+}
+
+void EthashCalculator::rebuildDagCache(uint64_t height) {
+  // being built or rebuilt by another thread
+  if (!markLightCacheBuilding(height / ETHASH_EPOCH_LENGTH)) {
+    return;
+  }
+  rebuildMarkedDagCache(height);
+}
+
+void EthashCalculator::rebuildDagCacheNonBlocking(uint64_t height) {
+  // every failed share asks for a rebuild, only the first one starts it
+  if (!markLightCacheBuilding(height / ETHASH_EPOCH_LENGTH)) {
+    return;
+  }
+  std::thread t([height, this]() { this->rebuildMarkedDagCache(height); });
+  t.detach();
+}
+
+void EthashCalculator::rebuildMarkedDagCache(uint64_t height) {
+  uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
+
+  LOG(INFO) << "rebuilding DAG cache for block height " << height;
+  auto light = newLightCache(height);
+
+  // the full DAG is dropped as well, it is mapped again by buildDagCache()
+  {
+    ScopeLock sl(lock_);
+    if (!getEpochCache(epoch).light_) {
+      LOG(ERROR) << "EthashCalculator::rebuildDagCache(" << height
+                 << "): the old DAG cache should not be empty";
+    }
+    buildingLightCaches_.erase(epoch);
+    publishWithoutLock(epoch, {light, nullptr});
   }
-  lightCaches_[epoch] = light;
+  built_.notify_all();
 }
 
 bool EthashCalculator::compute(
@@ -316,8 +402,22 @@ bool EthashCalculator::compute(
     const ethash_h256_t &header,
     uint64_t nonce,
     ethash_return_value_t &r) {
-  ScopeLock sl(lock_);
-  r = ethash_light_compute(getDagCacheWithoutLock(height), header, nonce);
+  uint64_t epoch = height / ETHASH_EPOCH_LENGTH;
+  EpochCache cache = getEpochCache(epoch);
+  if (!cache.light_) {
+    buildLightCache(height, true);
+    cache = getEpochCache(epoch);
+    if (!cache.light_) {
+      r.success = false;
+      return false;
+    }
+  }
+
+  if (cache.full_) {
+    r = ethash_full_compute(cache.full_.get(), header, nonce);
+  } else {
+    r = ethash_light_compute(cache.light_.get(), header, nonce);
+  }
   return r.success;
 }
 
@@ -341,7 +441,7 @@ JobRepositoryEth::JobRepositoryEth(
         niceHashForced,
         niceHashMinDiff,
         niceHashMinDiffZookeeperPath)
-  , ethashCalc_(Strings::Format(kLightCacheFilePathFormat, (uint32_t)chainId)) {
+  , ethashCalc_(Strings::Format(kLightCacheDirFormat, (uint32_t)chainId)) {
 }
 
 shared_ptr<StratumJobEx> JobRepositoryEth::createStratumJobEx(
@@ -386,7 +486,7 @@ void JobRepositoryEth::broadcastStratumJob(shared_ptr<StratumJob> sjob) {
   }
 
   // insert new job
-  exJobs_[sjobEth->jobId_] = exJob;
+  addStratumJobEx(exJob);
 
   if (isClean) {
     // Send the job immediately.
@@ -419,9 +519,7 @@ void JobRepositoryEth::buildDagCacheNonBlocking(uint64_t height) {
 }
 
 void JobRepositoryEth::rebuildDagCacheNonBlocking(uint64_t height) {
-  std::thread t(
-      [height, this]() { this->ethashCalc_.rebuildDagCache(height); });
-  t.detach();
+  ethashCalc_.rebuildDagCacheNonBlocking(height);
 }
 
 bool JobRepositoryEth::compute(
@@ -451,6 +549,23 @@ bool ServerEth::setupInternal(const libconfig::Config &config) {
   sessionIDManager_->setAllocInterval(256);
 #endif
 
+  bool ethashFull = false;
+  config.lookupValue("sserver.ethash_full", ethashFull);
+  if (ethashFull) {
+    string dagDir = "./ethash";
+    config.lookupValue("sserver.ethash_full_dag_dir", dagDir);
+    if (mkdir(dagDir.c_str(), 0755) != 0 && errno != EEXIST) {
+      LOG(ERROR) << "cannot create ethash_full_dag_dir " << dagDir << ": "
+                 << strerror(errno);
+      return false;
+    }
+    for (size_t chainId = 0; chainId < chains_.size(); chainId++) {
+      // one directory per chain, ETH and ETC DAGs have the same file names
+      GetJobRepository(chainId)->enableFullDag(
+          Strings::Format("%s/%s", dagDir, chainName(chainId)));
+    }
+  }
+
   return true;
 }
 
@@ -537,6 +652,7 @@ void ServerEth::checkShareAndUpdateDiff(
                          preliminarySolution,
                          chainId,
                          returnFn = std::move(returnFn)]() {
+    ShareVerifyTimer timer{*this, chainId};
     DLOG(INFO) << "checking share nonce: " << hex << nonce
                << ", header: " << header.GetHex();
 
@@ -77,47 +77,84 @@ public:
       const uint32_t sessionID) override;
 };
 
+// Verifying threads read the caches of an epoch without locking: they are
+// immutable once published, and replaced as a whole by the threads building
+// them. lock_ only guards the building and publishing.
 class EthashCalculator {
 protected:
   const size_t kMaxCacheSize_ = 3;
+  // full DAGs are huge, only keep the current and the next epoch
+  const size_t kMaxFullDagSize_ = 2;
+
+  struct EpochCache {
+    std::shared_ptr<ethash_light> light_;
+    std::shared_ptr<ethash_full> full_; // nullptr if not (yet) built
+  };
+  using EpochCaches = std::map<uint64_t /*epoch*/, EpochCache>;
 
   std::mutex lock_;
-  SeqMap<uint64_t /*epoch*/, ethash_light_t> lightCaches_;
+  std::condition_variable built_;
+  // load and store with std::atomic_load() / std::atomic_store()
+  std::shared_ptr<const EpochCaches> caches_;
   std::set<uint64_t /*epoch*/> buildingLightCaches_;
-  string cacheFile_;
-
-  // save ethash_light_t to file
-  struct LightCacheHeader {
-    uint64_t checksum_;
-    uint64_t blockNumber_;
-    uint64_t cacheSize_;
-  };
+  std::set<uint64_t /*epoch*/> buildingFullDags_;
+  // where DAG caches are stored, empty to keep them in memory only
+  string cacheDir_;
+  // where full DAGs are memory-mapped from, empty to verify with light
+  // caches only
+  string fullDagDir_;
 
   // Creating a new ethash_light_t (DAG cache) is so slow (in Debug build),
   // it may need more than 120 seconds for current Ethereum mainnet.
-  // So save it to a file before exiting and load it back at next time
-  // to reduce the computation time required after a restart.
+  // So every DAG cache is stored in a file of its epoch as soon as it is
+  // built, and memory-mapped from there after a restart. The mapping is
+  // read-only and shared by all sserver processes using the same directory.
   //
   // Note: The performance of ethash_light_new() difference between Debug and
   // Release builds is very large. The Release build may complete in 5 seconds,
   // while the Debug build takes more than 60 seconds.
-  size_t /*saved num*/ saveCacheToFile(const string &cacheFile);
-  void saveCacheToFile(const ethash_light_t &light, std::ofstream &f);
-  size_t /*loaded num*/ loadCacheFromFile(const string &cacheFile);
-  ethash_light_t loadCacheFromFile(std::ifstream &f);
-  uint64_t
-  computeCacheChecksum(const LightCacheHeader &header, const uint8_t *data);
-
-  void buildDagCacheWithoutLock(uint64_t height);
-  ethash_light_t getDagCacheWithoutLock(uint64_t height);
+  struct LightCacheHeader {
+    uint32_t magic_;
+    uint32_t version_;
+    uint64_t blockNumber_;
+    uint64_t cacheSize_;
+    uint32_t checksum_; // crc32 of the cache
+    uint8_t reserved_[36]; // keep the cache 64 bytes aligned
+  };
+  static_assert(sizeof(LightCacheHeader) == 64, "unexpected header size");
+
+  string getCacheFilePath(uint64_t epoch) const;
+  // written to a temporary file and renamed, so readers never see a partial
+  // file. Returns the stored cache mapped from the file, or nullptr.
+  std::shared_ptr<ethash_light> storeCacheToFile(const ethash_light &light);
+  // nullptr if the file is missing or invalid
+  std::shared_ptr<ethash_light> loadCacheFromFile(uint64_t height);
+  void removeOldCacheFiles(uint64_t epoch);
+  std::shared_ptr<ethash_light> newLightCache(uint64_t height);
+
+  // the caller should hold lock_
+  void publishWithoutLock(uint64_t epoch, const EpochCache &cache);
+  EpochCache getEpochCache(uint64_t epoch);
+  // wait: wait for other threads building the same light cache
+  void buildLightCache(uint64_t height, bool wait);
+  void buildFullDag(uint64_t height);
+  // adds the epoch to buildingLightCaches_, false if it is there already
+  bool markLightCacheBuilding(uint64_t epoch);
+  // rebuilds the cache marked by markLightCacheBuilding() and clears the mark
+  void rebuildMarkedDagCache(uint64_t height);
 
 public:
   EthashCalculator() {}
-  EthashCalculator(const string &cacheFile);
-  ~EthashCalculator();
+  EthashCalculator(const string &cacheDir);
+
+  void enableFullDag(const string &dagDir);
 
   void buildDagCache(uint64_t height);
+  // Rebuilds the DAG cache of the height, unless it is being built or rebuilt
+  // by another thread already. The non-blocking one rebuilds it in a new
+  // thread, no thread is created if it is skipped.
   void rebuildDagCache(uint64_t height);
+  void rebuildDagCacheNonBlocking(uint64_t height);
   bool compute(
       uint64_t height,
       const ethash_h256_t &header,
@@ -152,12 +189,15 @@ public:
   void broadcastStratumJob(shared_ptr<StratumJob> sjob) override;
 
   void rebuildDagCacheNonBlocking(uint64_t height);
+  void enableFullDag(const string &dagDir) {
+    ethashCalc_.enableFullDag(dagDir);
+  }
 
 protected:
   void buildDagCacheNonBlocking(uint64_t height);
 
   // TODO: move to configuration file
-  const char *kLightCacheFilePathFormat = "./sserver-eth%u-dagcache.dat";
+  const char *kLightCacheDirFormat = "./sserver-eth%u-dagcache";
 
   EthashCalculator ethashCalc_;
   uint32_t lastHeight_ = 0;
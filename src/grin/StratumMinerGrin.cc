@@ -144,28 +144,47 @@ void StratumMinerGrin::handleRequest_Submit(
     return;
   }
 
-  uint256 blockHash;
   server.checkAndUpdateShare(
-      localJob->chainId_, share, exjob, proofs, worker.fullName_, blockHash);
+      localJob->chainId_,
+      std::move(share),
+      exjob,
+      std::move(proofs),
+      worker.fullName_,
+      [this,
+       alive = std::weak_ptr<bool>{alive_},
+       idStr,
+       chainId = localJob->chainId_,
+       height = sjob->height(),
+       &server](const ShareGrin &share) {
+        if (StratumStatus::isSolved(share.status())) {
+          // mark jobs as stale
+          server.GetJobRepository(chainId)->markAllJobsAsStale(height);
+        }
+        if (alive.expired() || handleCheckedShare(idStr, chainId, share)) {
+          std::string message;
+          uint32_t size = 0;
+          if (!share.SerializeToArrayWithVersion(message, size)) {
+            LOG(ERROR) << "share SerializeToBuffer failed!" << share.toString();
+            return;
+          }
+          server.sendShare2Kafka(chainId, message.data(), size);
+        }
+      });
+}
 
+bool StratumMinerGrin::handleCheckedShare(
+    const std::string &idStr, size_t chainId, const ShareGrin &share) {
   if (StratumStatus::isAccepted(share.status())) {
     DLOG(INFO) << "share reached the diff: " << share.scaledShareDiff();
   } else {
     DLOG(INFO) << "share not reached the diff: " << share.scaledShareDiff();
   }
 
+  auto &worker = getSession().getWorker();
+
   // we send share to kafka by default, but if there are lots of invalid
   // shares in a short time, we just drop them.
-  if (handleShare(
-          idStr, share.status(), share.sharediff(), localJob->chainId_)) {
-    if (StratumStatus::isSolved(share.status())) {
-      server.sendSolvedShare2Kafka(
-          localJob->chainId_, share, exjob, proofs, worker, blockHash);
-      // mark jobs as stale
-      server.GetJobRepository(localJob->chainId_)
-          ->markAllJobsAsStale(sjob->height());
-    }
-  } else {
+  if (!handleShare(idStr, share.status(), share.sharediff(), chainId)) {
     // check if there is invalid share spamming
     int64_t invalidSharesNum = invalidSharesCounter_.sum(
         time(nullptr), INVALID_SHARE_SLIDING_WINDOWS_SIZE);
@@ -173,17 +192,10 @@ void StratumMinerGrin::handleRequest_Submit(
     if (invalidSharesNum >= INVALID_SHARE_SLIDING_WINDOWS_MAX_LIMIT) {
       LOG(WARNING) << "invalid share spamming, worker: " << worker.fullName_
                    << ", " << share.toString();
-      return;
+      return false;
     }
   }
 
   DLOG(INFO) << share.toString();
-
-  std::string message;
-  uint32_t size = 0;
-  if (!share.SerializeToArrayWithVersion(message, size)) {
-    LOG(ERROR) << "share SerializeToBuffer failed!" << share.toString();
-    return;
-  }
-  server.sendShare2Kafka(localJob->chainId_, message.data(), size);
+  return true;
 }
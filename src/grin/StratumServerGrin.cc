@@ -37,11 +37,11 @@ unique_ptr<StratumSession> StratumServerGrin::createConnection(
 
 void StratumServerGrin::checkAndUpdateShare(
     size_t chainId,
-    ShareGrin &share,
+    ShareGrin share,
     shared_ptr<StratumJobEx> exjob,
-    const vector<uint64_t> &proofs,
+    vector<uint64_t> proofs,
     const string &workFullName,
-    uint256 &blockHash) {
+    std::function<void(const ShareGrin &share)> returnFn) {
   auto sjob = std::static_pointer_cast<StratumJobGrin>(exjob->sjob_);
 
   DLOG(INFO) << "checking share nonce: " << std::hex << share.nonce()
@@ -50,11 +50,39 @@ void StratumServerGrin::checkAndUpdateShare(
 
   if (exjob->isStale()) {
     share.set_status(StratumStatus::STALE_SHARE);
+    returnFn(share);
     return;
   }
 
+  dispatchToShareWorker([this,
+                         chainId,
+                         share = std::move(share),
+                         exjob = std::move(exjob),
+                         sjob,
+                         proofs = std::move(proofs),
+                         workFullName,
+                         returnFn = std::move(returnFn)]() mutable {
+    ShareVerifyTimer timer{*this, chainId};
+    uint256 blockHash;
+    verifyShare(share, *sjob, proofs, workFullName, blockHash);
+    if (StratumStatus::isSolved(share.status())) {
+      sendSolvedShare2Kafka(
+          chainId, share, exjob, proofs, workFullName, blockHash);
+    }
+    dispatch([share = std::move(share), returnFn = std::move(returnFn)]() {
+      returnFn(share);
+    });
+  });
+}
+
+void StratumServerGrin::verifyShare(
+    ShareGrin &share,
+    const StratumJobGrin &sjob,
+    const vector<uint64_t> &proofs,
+    const string &workFullName,
+    uint256 &blockHash) {
   PreProofGrin preProof;
-  preProof.prePow = sjob->prePow_;
+  preProof.prePow = sjob.prePow_;
   preProof.prePow.timestamp =
       preProof.prePow.timestamp.value() + DiffToShift(share.sharediff());
   preProof.nonce = share.nonce();
@@ -73,19 +101,19 @@ void StratumServerGrin::checkAndUpdateShare(
       preProof.prePow.secondaryScaling.value(),
       proofs);
   DLOG(INFO) << "compare share difficulty: " << scaledShareDiff
-             << ", network difficulty: " << sjob->difficulty_;
+             << ", network difficulty: " << sjob.difficulty_;
 
   // print out high diff share
-  if (isValidSolution && scaledShareDiff / sjob->difficulty_ >= 1024) {
+  if (isValidSolution && scaledShareDiff / sjob.difficulty_ >= 1024) {
     LOG(INFO) << "high diff share, share difficulty: " << scaledShareDiff
-              << ", network difficulty: " << sjob->difficulty_
+              << ", network difficulty: " << sjob.difficulty_
               << ", worker: " << workFullName;
   }
 
   if (isSubmitInvalidBlock_ ||
-      (isValidSolution && scaledShareDiff >= sjob->difficulty_)) {
+      (isValidSolution && scaledShareDiff >= sjob.difficulty_)) {
     LOG(INFO) << "solution found, share difficulty: " << scaledShareDiff
-              << ", network difficulty: " << sjob->difficulty_
+              << ", network difficulty: " << sjob.difficulty_
               << ", worker: " << workFullName;
 
     share.set_status(StratumStatus::SOLVED);
@@ -110,7 +138,7 @@ void StratumServerGrin::sendSolvedShare2Kafka(
     const ShareGrin &share,
     shared_ptr<StratumJobEx> exjob,
     const vector<uint64_t> &proofs,
-    const StratumWorker &worker,
+    const string &workFullName,
     const uint256 &blockHash) {
   string proofArray;
   if (!proofs.empty()) {
@@ -143,9 +171,9 @@ void StratumServerGrin::sendSolvedShare2Kafka(
       share.edgebits(),
       share.nonce(),
       proofArray,
-      worker.userId(chainId),
-      worker.workerHashId_,
-      filterWorkerName(worker.fullName_).c_str(),
+      share.userid(),
+      share.workerhashid(),
+      filterWorkerName(workFullName).c_str(),
       blockHashStr.c_str(),
       timestampStr.c_str());
   ServerBase::sendSolvedShare2Kafka(chainId, msg.c_str(), msg.length());
@@ -219,7 +247,7 @@ void JobRepositoryGrin::broadcastStratumJob(shared_ptr<StratumJob> sjob) {
   }
 
   // insert new job
-  exJobs_[sjobGrin->jobId_] = exJob;
+  addStratumJobEx(exJob);
 
   // sending data in lock scope may cause implicit race condition in libevent
   if (isClean) {
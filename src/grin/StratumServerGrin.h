@@ -30,6 +30,7 @@
 
 class JobRepositoryGrin;
 class ShareGrin;
+class StratumJobGrin;
 
 class StratumServerGrin : public ServerBase<JobRepositoryGrin> {
 public:
@@ -38,22 +39,31 @@ public:
       struct sockaddr *saddr,
       uint32_t sessionID) override;
 
+  // The proof of work is verified by the share worker, returnFn is called with
+  // the checked share in the reactor of the caller
   void checkAndUpdateShare(
       size_t chainId,
-      ShareGrin &share,
+      ShareGrin share,
       shared_ptr<StratumJobEx> exjob,
-      const vector<uint64_t> &proofs,
+      vector<uint64_t> proofs,
       const string &workFullName,
-      uint256 &blockHash);
+      std::function<void(const ShareGrin &share)> returnFn);
   void sendSolvedShare2Kafka(
       size_t chainId,
       const ShareGrin &share,
       shared_ptr<StratumJobEx> exjob,
       const vector<uint64_t> &proofs,
-      const StratumWorker &worker,
+      const string &workFullName,
       const uint256 &blockHash);
 
 protected:
+  void verifyShare(
+      ShareGrin &share,
+      const StratumJobGrin &sjob,
+      const vector<uint64_t> &proofs,
+      const string &workFullName,
+      uint256 &blockHash);
+
   JobRepository *createJobRepository(
       size_t chainId,
       const char *kafkaBrokers,
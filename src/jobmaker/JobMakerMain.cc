@@ -40,6 +40,7 @@
 #include "Utils.h"
 #include "JobMaker.h"
 #include "Zookeeper.h"
+#include "prometheus/ExporterThread.h"
 
 #include "bitcoin/JobMakerBitcoin.h"
 #include "eth/JobMakerEth.h"
@@ -171,6 +172,8 @@ createGbtJobMakerDefinition(const Setting &setting) {
   readFromSetting(setting, "max_job_delay", def->maxJobDelay_);
   readFromSetting(setting, "gbt_life_time", def->gbtLifeTime_);
   readFromSetting(setting, "empty_gbt_life_time", def->emptyGbtLifeTime_);
+  def->gbtDecodeThreads_ = 0;
+  readFromSetting(setting, "gbt_decode_threads", def->gbtDecodeThreads_, true);
 
   def->auxmergedMiningNotifyPolicy_ = 1;
   readFromSetting(
@@ -321,6 +324,12 @@ int main(int argc, char **argv) {
   signal(SIGTERM, handler);
   signal(SIGINT, handler);
 
+  // setup prometheus exporter, the latencies are in the default registry
+  prometheus::ExporterThread statsExporter;
+  if (statsExporter.setup(cfg, "jobmaker")) {
+    statsExporter.run();
+  }
+
   try {
     vector<shared_ptr<thread>> workers;
 
@@ -351,6 +360,7 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  statsExporter.stop();
   google::ShutdownGoogleLogging();
   return 0;
 }
@@ -34,6 +34,7 @@
 #include <glog/logging.h>
 
 #include <iterator>
+#include <map>
 #include <set>
 
 namespace prometheus {
@@ -46,11 +47,61 @@ static std::string FormatMetricType(Metric::Type t) {
     return "counter";
   case Metric::Type::Gauge:
     return "gauge";
+  case Metric::Type::Histogram:
+    return "histogram";
   default:
     return "untyped";
   }
 }
 
+template <typename Out>
+static void FormatSample(
+    Out out,
+    const std::string &name,
+    const char *suffix,
+    const std::map<std::string, std::string> &labels,
+    const std::string &le,
+    const std::string &value) {
+  fmt::format_to(out, "{}{}", name, suffix);
+  if (!labels.empty() || !le.empty()) {
+    fmt::format_to(out, "{{");
+    for (auto &label : labels) {
+      fmt::format_to(out, "{}=\"{}\",", label.first, label.second);
+    }
+    if (!le.empty()) {
+      fmt::format_to(out, "le=\"{}\",", le);
+    }
+    fmt::format_to(out, "}}");
+  }
+  fmt::format_to(out, " {}\n", value);
+}
+
+// A histogram is exposed as cumulative _bucket series with the le label plus
+// the _sum and _count series
+template <typename Out>
+static void FormatHistogram(
+    Out out,
+    const std::string &name,
+    const std::map<std::string, std::string> &labels,
+    const HistogramSnapshot &histogram) {
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < histogram.buckets_.size(); ++i) {
+    cumulative += histogram.buckets_[i];
+    FormatSample(
+        out,
+        name,
+        "_bucket",
+        labels,
+        i < histogram.bounds_.size() ? fmt::format("{}", histogram.bounds_[i])
+                                     : "+Inf",
+        fmt::format("{}", cumulative));
+  }
+  FormatSample(
+      out, name, "_sum", labels, "", fmt::format("{}", histogram.sum_));
+  FormatSample(
+      out, name, "_count", labels, "", fmt::format("{}", histogram.count_));
+}
+
 } // namespace
 
 class Exporter : public IExporter {
@@ -76,7 +127,8 @@ private:
   std::set<std::shared_ptr<Collector>> collectors_;
 };
 
-Exporter::Exporter() {
+Exporter::Exporter()
+  : httpd_{nullptr} {
 }
 
 Exporter::~Exporter() {
@@ -135,28 +187,32 @@ std::string Exporter::exportMetrics() {
   auto out = std::back_inserter(text);
   for (auto &collector : collectors_) {
     auto metrics = collector->collectMetrics();
+    std::string lastName;
     for (auto &metric : metrics) {
       auto &name = metric->getName();
       if (name.empty()) {
         continue;
       }
 
-      auto &help = metric->getHelp();
-      if (!help.empty()) {
-        fmt::format_to(out, "# HELP {} {}\n", name, help);
-      }
-      fmt::format_to(
-          out, "# TYPE {} {}\n", name, FormatMetricType(metric->getType()));
-      fmt::format_to(out, "{}", name);
-      auto &labels = metric->getLabels();
-      if (!labels.empty()) {
-        fmt::format_to(out, "{{");
-        for (auto &label : labels) {
-          fmt::format_to(out, "{}=\"{}\",", label.first, label.second);
+      // Series of the same metric are collected together and share the HELP
+      // and TYPE lines
+      if (name != lastName) {
+        auto &help = metric->getHelp();
+        if (!help.empty()) {
+          fmt::format_to(out, "# HELP {} {}\n", name, help);
         }
-        fmt::format_to(out, "}}");
+        fmt::format_to(
+            out, "# TYPE {} {}\n", name, FormatMetricType(metric->getType()));
+        lastName = name;
+      }
+
+      auto histogram = metric->getHistogram();
+      if (histogram != nullptr) {
+        FormatHistogram(out, name, metric->getLabels(), *histogram);
+      } else {
+        FormatSample(
+            out, name, "", metric->getLabels(), "", metric->getValue());
       }
-      fmt::format_to(out, " {}\n", metric->getValue());
     }
   }
   return text;
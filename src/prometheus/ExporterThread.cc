@@ -0,0 +1,97 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*/
+
+#include "ExporterThread.h"
+
+#include "Registry.h"
+
+#include <event2/thread.h>
+#include <glog/logging.h>
+
+namespace prometheus {
+
+ExporterThread::~ExporterThread() {
+  stop();
+}
+
+bool ExporterThread::setup(
+    const libconfig::Config &cfg, const std::string &component) {
+  bool enabled = false;
+  cfg.lookupValue("prometheus.enabled", enabled);
+  if (!enabled) {
+    return false;
+  }
+
+  std::string address = "0.0.0.0";
+  unsigned int port = 8080;
+  std::string path = "/metrics";
+  cfg.lookupValue("prometheus.address", address);
+  cfg.lookupValue("prometheus.port", port);
+  cfg.lookupValue("prometheus.path", path);
+
+  component_ = component;
+  exporter_ = CreateExporter();
+  if (!exporter_->setup(address, port, path)) {
+    LOG(WARNING) << "Failed to setup " << component_ << " statistics exporter";
+  }
+  registerCollector(Registry::Default());
+  return true;
+}
+
+bool ExporterThread::registerCollector(std::shared_ptr<Collector> collector) {
+  if (!exporter_->registerCollector(std::move(collector))) {
+    LOG(WARNING) << "Failed to register " << component_
+                 << " statistics collector";
+    return false;
+  }
+  return true;
+}
+
+bool ExporterThread::run() {
+  evthread_use_pthreads();
+  base_ = event_base_new();
+  if (!exporter_->run(base_)) {
+    LOG(WARNING) << "Failed to run " << component_ << " statistics exporter";
+    return false;
+  }
+  thread_ = std::thread([base = base_]() {
+    event_base_loop(base, EVLOOP_NO_EXIT_ON_EMPTY);
+  });
+  return true;
+}
+
+void ExporterThread::stop() {
+  if (base_ == nullptr) {
+    return;
+  }
+  event_base_loopexit(base_, nullptr);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  exporter_.reset();
+  event_base_free(base_);
+  base_ = nullptr;
+}
+
+} // namespace prometheus
@@ -0,0 +1,60 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "Exporter.h"
+
+#include <libconfig.h++>
+
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace prometheus {
+
+//
+// An exporter serving from an event loop thread of its own, for the
+// components without an event loop to host it. The default registry is
+// always exported.
+//
+class ExporterThread {
+public:
+  ~ExporterThread();
+
+  // Reads the prometheus section of the configuration, returns false if the
+  // exporter is not enabled
+  bool setup(const libconfig::Config &cfg, const std::string &component);
+  bool registerCollector(std::shared_ptr<Collector> collector);
+  bool run();
+  void stop();
+
+private:
+  std::string component_;
+  struct event_base *base_ = nullptr;
+  std::unique_ptr<IExporter> exporter_;
+  std::thread thread_;
+};
+
+} // namespace prometheus
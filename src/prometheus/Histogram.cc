@@ -0,0 +1,121 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*/
+
+#include "Histogram.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace prometheus {
+
+namespace {
+
+// Threads are spread over the shards in the order they first observe
+size_t ShardOfThread(size_t shards) {
+  static std::atomic<size_t> nextShard{0};
+  thread_local size_t shard = nextShard++;
+  return shard % shards;
+}
+
+uint64_t ToBits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double FromBits(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+} // namespace
+
+const std::vector<double> &Histogram::DurationBounds() {
+  static const std::vector<double> bounds = {0.00001,
+                                             0.00005,
+                                             0.0001,
+                                             0.00025,
+                                             0.0005,
+                                             0.001,
+                                             0.0025,
+                                             0.005,
+                                             0.01,
+                                             0.025,
+                                             0.05,
+                                             0.1,
+                                             0.25,
+                                             0.5,
+                                             1,
+                                             2.5,
+                                             5,
+                                             10};
+  return bounds;
+}
+
+Histogram::Histogram(const std::vector<double> &bounds)
+  : bounds_{bounds} {
+  // the sum plus the +Inf bucket, rounded up to whole cache lines
+  size_t cells = bounds_.size() + 2;
+  stride_ = (cells + kCacheLineCells - 1) / kCacheLineCells * kCacheLineCells;
+  cells_.reset(new std::atomic<uint64_t>[stride_ * kShards + kCacheLineCells]);
+  for (size_t i = 0; i < stride_ * kShards + kCacheLineCells; ++i) {
+    cells_[i].store(0, std::memory_order_relaxed);
+  }
+  auto offset = reinterpret_cast<uintptr_t>(cells_.get()) % kCacheLine;
+  shards_ = cells_.get() +
+      (offset ? (kCacheLine - offset) / sizeof(std::atomic<uint64_t>) : 0);
+}
+
+void Histogram::observe(double value) {
+  std::atomic<uint64_t> *shard = shards_ + ShardOfThread(kShards) * stride_;
+  auto bound = std::lower_bound(bounds_.begin(), bounds_.end(), value);
+  shard[1 + (bound - bounds_.begin())].fetch_add(1, std::memory_order_relaxed);
+
+  // There is no atomic add of doubles, the loop only retries if another
+  // thread of the same shard races with us
+  uint64_t sum = shard[0].load(std::memory_order_relaxed);
+  while (!shard[0].compare_exchange_weak(
+      sum, ToBits(FromBits(sum) + value), std::memory_order_relaxed)) {
+  }
+}
+
+HistogramSnapshot Histogram::collect() const {
+  HistogramSnapshot snapshot;
+  snapshot.bounds_ = bounds_;
+  snapshot.buckets_.resize(bounds_.size() + 1);
+  for (size_t s = 0; s < kShards; ++s) {
+    const std::atomic<uint64_t> *shard = shards_ + s * stride_;
+    snapshot.sum_ += FromBits(shard[0].load(std::memory_order_relaxed));
+    for (size_t i = 0; i < snapshot.buckets_.size(); ++i) {
+      uint64_t n = shard[1 + i].load(std::memory_order_relaxed);
+      snapshot.buckets_[i] += n;
+      // the count is the +Inf bucket, it must not disagree with the buckets
+      snapshot.count_ += n;
+    }
+  }
+  return snapshot;
+}
+
+} // namespace prometheus
@@ -0,0 +1,85 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "Metric.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace prometheus {
+
+//
+// A histogram observed by many threads without a lock. Every thread counts
+// into one of kShards shards, each on its own cache lines, and the shards are
+// only merged when the histogram is collected.
+//
+class Histogram {
+public:
+  // Upper bounds in seconds from 10us to 10s, for latencies
+  static const std::vector<double> &DurationBounds();
+
+  explicit Histogram(const std::vector<double> &bounds = DurationBounds());
+  Histogram(const Histogram &) = delete;
+  Histogram &operator=(const Histogram &) = delete;
+
+  void observe(double value);
+  HistogramSnapshot collect() const;
+
+private:
+  static const size_t kShards = 16;
+  static const size_t kCacheLine = 64;
+  static const size_t kCacheLineCells =
+      kCacheLine / sizeof(std::atomic<uint64_t>);
+
+  std::vector<double> bounds_;
+  // cells of a shard: the bits of the double sum, then the buckets
+  size_t stride_;
+  std::unique_ptr<std::atomic<uint64_t>[]> cells_;
+  std::atomic<uint64_t> *shards_; // cells_ aligned to a cache line
+};
+
+// Observes its lifetime into a histogram in seconds
+class HistogramTimer {
+public:
+  explicit HistogramTimer(Histogram &histogram)
+    : histogram_{histogram}
+    , start_{std::chrono::steady_clock::now()} {}
+  ~HistogramTimer() {
+    histogram_.observe(std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start_)
+                           .count());
+  }
+
+private:
+  Histogram &histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace prometheus
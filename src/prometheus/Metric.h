@@ -24,18 +24,30 @@
 
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace prometheus {
 
+// Counts of observations in buckets, buckets_[i] counts the values not greater
+// than bounds_[i] and above bounds_[i - 1], the last bucket is +Inf
+struct HistogramSnapshot {
+  std::vector<double> bounds_;
+  std::vector<uint64_t> buckets_;
+  uint64_t count_ = 0;
+  double sum_ = 0;
+};
+
 class Metric {
 public:
   enum class Type {
     Counter,
     Gauge,
+    Histogram,
   };
   virtual ~Metric() = default;
   virtual const std::string &getName() const = 0;
@@ -43,6 +55,8 @@ public:
   virtual std::string getValue() const = 0;
   virtual const std::string &getHelp() const = 0;
   virtual const std::map<std::string, std::string> &getLabels() const = 0;
+  // Only histograms have a snapshot, getValue() returns their count
+  virtual const HistogramSnapshot *getHistogram() const { return nullptr; }
 };
 
 } // namespace prometheus
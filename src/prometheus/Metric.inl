@@ -97,6 +97,23 @@ private:
   std::function<T()> valueFn_;
 };
 
+class MetricHistogram : public MetricBase {
+public:
+  MetricHistogram(
+      const std::string &name,
+      const std::string &help,
+      const std::map<std::string, std::string> &labels,
+      HistogramSnapshot snapshot)
+    : MetricBase{name, Metric::Type::Histogram, help, labels}
+    , snapshot_{std::move(snapshot)} {}
+
+  std::string getValue() const { return fmt::format("{}", snapshot_.count_); }
+  const HistogramSnapshot *getHistogram() const override { return &snapshot_; }
+
+private:
+  HistogramSnapshot snapshot_;
+};
+
 template <typename T>
 std::shared_ptr<Metric> CreateMetricValue(
     const std::string &name,
@@ -118,4 +135,13 @@ std::shared_ptr<Metric> CreateMetricFn(
       name, type, help, labels, std::move(valueFn));
 }
 
+inline std::shared_ptr<Metric> CreateMetricHistogram(
+    const std::string &name,
+    const std::string &help,
+    const std::map<std::string, std::string> &labels,
+    HistogramSnapshot snapshot) {
+  return std::make_shared<MetricHistogram>(
+      name, help, labels, std::move(snapshot));
+}
+
 } // namespace prometheus
@@ -0,0 +1,72 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*/
+
+#include "Registry.h"
+
+#include <algorithm>
+
+namespace prometheus {
+
+std::shared_ptr<Registry> Registry::Default() {
+  static auto registry = std::make_shared<Registry>();
+  return registry;
+}
+
+std::shared_ptr<Histogram> Registry::histogram(
+    const std::string &name,
+    const std::string &help,
+    const std::map<std::string, std::string> &labels,
+    const std::vector<double> &bounds) {
+  std::lock_guard<std::mutex> l{lock_};
+  for (auto &entry : histograms_) {
+    if (entry.name_ == name && entry.labels_ == labels) {
+      return entry.histogram_;
+    }
+  }
+  auto histogram = std::make_shared<Histogram>(bounds);
+  histograms_.push_back({name, help, labels, histogram});
+  return histogram;
+}
+
+std::vector<std::shared_ptr<Metric>> Registry::collectMetrics() {
+  std::vector<Entry> histograms;
+  {
+    std::lock_guard<std::mutex> l{lock_};
+    histograms = histograms_;
+  }
+  // the series of a metric are exported together
+  std::stable_sort(
+      histograms.begin(),
+      histograms.end(),
+      [](const Entry &a, const Entry &b) { return a.name_ < b.name_; });
+
+  std::vector<std::shared_ptr<Metric>> metrics;
+  for (auto &entry : histograms) {
+    metrics.push_back(CreateMetricHistogram(
+        entry.name_, entry.help_, entry.labels_, entry.histogram_->collect()));
+  }
+  return metrics;
+}
+
+} // namespace prometheus
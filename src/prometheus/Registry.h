@@ -0,0 +1,69 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "Collector.h"
+#include "Histogram.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace prometheus {
+
+//
+// Metrics of a process instrumented outside of any collector, like the
+// latencies of its main loops. The default registry is exported by every
+// component with the prometheus exporter enabled.
+//
+class Registry : public Collector {
+public:
+  static std::shared_ptr<Registry> Default();
+
+  // Returns the histogram already registered with the same name and labels if
+  // there is one
+  std::shared_ptr<Histogram> histogram(
+      const std::string &name,
+      const std::string &help,
+      const std::map<std::string, std::string> &labels = {},
+      const std::vector<double> &bounds = Histogram::DurationBounds());
+
+  std::vector<std::shared_ptr<Metric>> collectMetrics() override;
+
+private:
+  struct Entry {
+    std::string name_;
+    std::string help_;
+    std::map<std::string, std::string> labels_;
+    std::shared_ptr<Histogram> histogram_;
+  };
+
+  std::mutex lock_;
+  std::vector<Entry> histograms_;
+};
+
+} // namespace prometheus
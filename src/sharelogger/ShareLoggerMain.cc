@@ -40,6 +40,7 @@
 
 #include "config/bpool-version.h"
 #include "Utils.h"
+#include "prometheus/ExporterThread.h"
 #include "bitcoin/ShareLoggerBitcoin.h"
 #include "eth/ShareLoggerEth.h"
 #include "bytom/ShareLoggerBytom.h"
@@ -78,6 +79,18 @@ newShareLogWriter(const string &kafkaBrokers, const Setting &def) {
   int compressionLevel = Z_DEFAULT_COMPRESSION;
   def.lookupValue("compression_level", compressionLevel);
 
+  int formatVersion = 1;
+  int blockInterval = 10;
+  ShareLogBlockOptions blockOptions;
+  def.lookupValue("format_version", formatVersion);
+  def.lookupValue("block_size", blockOptions.blockSize_);
+  def.lookupValue("block_interval", blockInterval);
+  blockOptions.enabled_ = (formatVersion >= 2);
+  blockOptions.blockInterval_ = blockInterval;
+
+  bool zeroCopy = true;
+  def.lookupValue("zero_copy", zeroCopy);
+
 #if defined(CHAIN_TYPE_STR)
   if (CHAIN_TYPE_STR == chainType)
 #else
@@ -90,7 +103,9 @@ newShareLogWriter(const string &kafkaBrokers, const Setting &def) {
         def.lookup("data_dir").c_str(),
         def.lookup("kafka_group_id").c_str(),
         def.lookup("share_topic"),
-        compressionLevel);
+        compressionLevel,
+        blockOptions,
+        zeroCopy);
   } else if (chainType == "ETH") {
     return make_shared<ShareLogWriterEth>(
         def.lookup("chain_type").c_str(),
@@ -98,7 +113,9 @@ newShareLogWriter(const string &kafkaBrokers, const Setting &def) {
         def.lookup("data_dir").c_str(),
         def.lookup("kafka_group_id").c_str(),
         def.lookup("share_topic"),
-        compressionLevel);
+        compressionLevel,
+        blockOptions,
+        zeroCopy);
   } else if (chainType == "BTM") {
     return make_shared<ShareLogWriterBytom>(
         def.lookup("chain_type").c_str(),
@@ -106,7 +123,9 @@ newShareLogWriter(const string &kafkaBrokers, const Setting &def) {
         def.lookup("data_dir").c_str(),
         def.lookup("kafka_group_id").c_str(),
         def.lookup("share_topic"),
-        compressionLevel);
+        compressionLevel,
+        blockOptions,
+        zeroCopy);
   } else if (chainType == "DCR") {
     return make_shared<ShareLogWriterDecred>(
         chainType.c_str(),
@@ -114,7 +133,9 @@ newShareLogWriter(const string &kafkaBrokers, const Setting &def) {
         def.lookup("data_dir").c_str(),
         def.lookup("kafka_group_id").c_str(),
         def.lookup("share_topic"),
-        compressionLevel);
+        compressionLevel,
+        blockOptions,
+        zeroCopy);
   } else if (chainType == "BEAM") {
     return make_shared<ShareLogWriterBeam>(
         chainType.c_str(),
@@ -122,7 +143,9 @@ newShareLogWriter(const string &kafkaBrokers, const Setting &def) {
         def.lookup("data_dir").c_str(),
         def.lookup("kafka_group_id").c_str(),
         def.lookup("share_topic"),
-        compressionLevel);
+        compressionLevel,
+        blockOptions,
+        zeroCopy);
   }
 
   else if (chainType == "GRIN") {
@@ -132,7 +155,9 @@ newShareLogWriter(const string &kafkaBrokers, const Setting &def) {
         def.lookup("data_dir").c_str(),
         def.lookup("kafka_group_id").c_str(),
         def.lookup("share_topic"),
-        compressionLevel);
+        compressionLevel,
+        blockOptions,
+        zeroCopy);
   } else {
     LOG(FATAL) << "Unknown chain type " << chainType;
     return nullptr;
@@ -219,24 +244,36 @@ int main(int argc, char **argv) {
       }
 
       writers.push_back(newShareLogWriter(brokers, def));
-      vector<shared_ptr<thread>> workers;
-      for (auto writer : writers)
-        workers.push_back(std::make_shared<thread>(workerThread, writer));
-
-      // run
-      for (auto pWorker : workers) {
-        if (pWorker->joinable()) {
-          LOG(INFO) << "wait for worker " << pWorker->get_id();
-          pWorker->join();
-          LOG(INFO) << "worker exit";
-        }
-      }
     }
   } catch (const SettingException &e) {
     LOG(FATAL) << "config missing: " << e.getPath();
     return 1;
   }
 
+  // setup promethues exporter, every writer reports its own metrics
+  prometheus::ExporterThread statsExporter;
+  if (statsExporter.setup(cfg, "sharelogger")) {
+    for (auto writer : writers) {
+      statsExporter.registerCollector(writer);
+    }
+    statsExporter.run();
+  }
+
+  vector<shared_ptr<thread>> workers;
+  for (auto writer : writers)
+    workers.push_back(std::make_shared<thread>(workerThread, writer));
+
+  // run
+  for (auto pWorker : workers) {
+    if (pWorker->joinable()) {
+      LOG(INFO) << "wait for worker " << pWorker->get_id();
+      pWorker->join();
+      LOG(INFO) << "worker exit";
+    }
+  }
+
+  statsExporter.stop();
+
   google::ShutdownGoogleLogging();
   return 0;
 }
@@ -68,7 +68,7 @@ void JobRepositorySia::broadcastStratumJob(shared_ptr<StratumJob> sjob) {
     it.second->markStale();
 
   // insert new job
-  exJobs_[sjob->jobId_] = exJob;
+  addStratumJobEx(exJob);
 
   sendMiningNotify(exJob);
 }
@@ -39,6 +39,7 @@
 #include "config/bpool-version.h"
 #include "Utils.h"
 #include "ShareLogParser.h"
+#include "prometheus/ExporterThread.h"
 
 #include "bitcoin/StatisticsBitcoin.h"
 #include "bitcoin/ShareLogParserBitcoin.h"
@@ -81,31 +82,32 @@ void usage() {
   fprintf(
       stderr,
       "\tslparser -c \"slparser.cfg\" -l \"log_dir3\" -d \"20160830\" -u "
-      "\"puid(0: dump all, >0: someone's)\"\n");
+      "\"puid(0: dump all, >0: someone's)\" [-H \"hour(0-23)\"]\n");
 }
 
 std::shared_ptr<ShareLogDumper> newShareLogDumper(
     const string &chainType,
     const libconfig::Config &cfg,
     time_t timestamp,
-    const std::set<int32_t> &uids) {
+    const std::set<int32_t> &uids,
+    int32_t hour) {
 #if defined(CHAIN_TYPE_STR)
   if (CHAIN_TYPE_STR == chainType)
 #else
   if (false)
 #endif
   {
-    return std::make_shared<ShareLogDumperBitcoin>(cfg, timestamp, uids);
+    return std::make_shared<ShareLogDumperBitcoin>(cfg, timestamp, uids, hour);
   } else if (chainType == "ETH") {
-    return std::make_shared<ShareLogDumperEth>(cfg, timestamp, uids);
+    return std::make_shared<ShareLogDumperEth>(cfg, timestamp, uids, hour);
   } else if (chainType == "BTM") {
-    return std::make_shared<ShareLogDumperBytom>(cfg, timestamp, uids);
+    return std::make_shared<ShareLogDumperBytom>(cfg, timestamp, uids, hour);
   } else if (chainType == "DCR") {
-    return std::make_shared<ShareLogDumperDecred>(cfg, timestamp, uids);
+    return std::make_shared<ShareLogDumperDecred>(cfg, timestamp, uids, hour);
   } else if (chainType == "BEAM") {
-    return std::make_shared<ShareLogDumperBeam>(cfg, timestamp, uids);
+    return std::make_shared<ShareLogDumperBeam>(cfg, timestamp, uids, hour);
   } else if (chainType == "GRIN") {
-    return std::make_shared<ShareLogDumperGrin>(cfg, timestamp, uids);
+    return std::make_shared<ShareLogDumperGrin>(cfg, timestamp, uids, hour);
     LOG(FATAL) << "newShareLogDumper: unknown chain type " << chainType;
     return nullptr;
   }
@@ -191,13 +193,14 @@ int main(int argc, char **argv) {
   char *optConf = NULL;
   int32_t optDate = 0;
   int32_t optPUID = -1; // pool user id
+  int32_t optHour = -1; // only dump this hour
   int c;
 
   if (argc <= 1) {
     usage();
     return 1;
   }
-  while ((c = getopt(argc, argv, "c:l:d:u:h")) != -1) {
+  while ((c = getopt(argc, argv, "c:l:d:u:H:h")) != -1) {
     switch (c) {
     case 'c':
       optConf = optarg;
@@ -211,6 +214,9 @@ int main(int argc, char **argv) {
     case 'u':
       optPUID = atoi(optarg);
       break;
+    case 'H':
+      optHour = atoi(optarg);
+      break;
     case 'h':
     default:
       usage();
@@ -288,7 +294,7 @@ int main(int argc, char **argv) {
         uids.insert(optPUID);
 
       std::shared_ptr<ShareLogDumper> sldumper =
-          newShareLogDumper(chainType, cfg, ts, uids);
+          newShareLogDumper(chainType, cfg, ts, uids, optHour);
       sldumper->dump2stdout();
 
       google::ShutdownGoogleLogging();
@@ -340,6 +346,12 @@ int main(int argc, char **argv) {
     signal(SIGTERM, handler);
     signal(SIGINT, handler);
 
+    // setup prometheus exporter, the latencies are in the default registry
+    prometheus::ExporterThread statsExporter;
+    if (statsExporter.setup(cfg, "slparser")) {
+      statsExporter.run();
+    }
+
     gShareLogParserServer =
         newShareLogParserServer(chainType, dupShareTrackingHeight, cfg);
     gShareLogParserServer->run();
@@ -39,6 +39,7 @@
 #include "config/bpool-version.h"
 #include "Utils.h"
 #include "StatsHttpd.h"
+#include "prometheus/ExporterThread.h"
 #include "RedisConnection.h"
 
 #include "bitcoin/StatisticsBitcoin.h"
@@ -178,8 +179,17 @@ int main(int argc, char **argv) {
   signal(SIGTERM, handler);
   signal(SIGINT, handler);
 
+  prometheus::ExporterThread statsExporter;
   try {
     gStatsServer = newStatsServer(cfg);
+
+    // setup prometheus exporter, the latencies are in the default registry
+    // and the server reports its consuming lag
+    if (statsExporter.setup(cfg, "statshttpd")) {
+      statsExporter.registerCollector(gStatsServer);
+      statsExporter.run();
+    }
+
     if (gStatsServer->init()) {
       gStatsServer->run();
     }
@@ -188,6 +198,7 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  statsExporter.stop();
   google::ShutdownGoogleLogging();
   return 0;
 }
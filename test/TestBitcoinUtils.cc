@@ -27,6 +27,8 @@
 
 #include "bitcoin/BitcoinUtils.h"
 
+#include <streams.h>
+
 /////////////////////////  Block Rewards /////////////////////////
 void TestBitcoinBlockReward(int height, int64_t expectedReward) {
   // using mainnet
@@ -123,3 +125,59 @@ TEST(BitcoinUtils, GetBlockRewardBitcoin) {
   TestBitcoinBlockReward(70000000, 0); // 0 satoshi
 }
 #endif
+
+#ifndef CHAIN_TYPE_ZEC
+/////////////////////////  Block Hex /////////////////////////
+// A transaction of the testnet, without witness
+static const string kTxHex =
+    "01000000010291939c5ae8191c2e7d4ce8eba7d6616a66482e3200037cb8b8c2d0af45"
+    "b445000000006a47304402204df709d9e149804e358de4b082e41d8bb21b3c9d347241"
+    "b728b1362aafcb153602200d06d9b6f2eca899f43dcd62ec2efb2d9ce2e10adf02738b"
+    "b908420d7db93ede012103cae98ab925e20dd6ae1f76e767e9e99bc47b3844095c6860"
+    "0af9c775104fb36cffffffff0290f1770b000000001976a91400dc5fd62f6ee48eb8ec"
+    "da749eaec6824a780fdd88aca08601000000000017a914eb65573e5dd52d3d950396cc"
+    "be1a47daf8f400338700000000";
+
+static CBlock MakeBlock(
+    const vector<char> &coinbaseTxBin, const BlockTxs &vtxs) {
+  CBlock block;
+  block.nVersion = 0x20000000;
+  block.hashPrevBlock = uint256S(
+      "000000004f2ea239532b2e77bb46c03b86643caac3fe92959a31fd2d03979c34");
+  block.nTime = 1469006933;
+  block.nBits = 0x1a018ae2;
+  block.nNonce = 0x12345678;
+
+  CDataStream ssCoinbase(coinbaseTxBin, SER_NETWORK, PROTOCOL_VERSION);
+  CMutableTransaction coinbaseTx;
+  ssCoinbase >> coinbaseTx;
+  block.vtx.push_back(MakeTransactionRef(std::move(coinbaseTx)));
+  block.vtx.insert(block.vtx.end(), vtxs.begin(), vtxs.end());
+  return block;
+}
+
+static void GetTestTx(CTransactionRef &tx, vector<char> &txBin) {
+  CMutableTransaction mtx;
+  ASSERT_TRUE(DecodeHexTx(mtx, kTxHex));
+  tx = MakeTransactionRef(std::move(mtx));
+  CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+  ssTx << *tx;
+  txBin.assign(ssTx.begin(), ssTx.end());
+}
+
+TEST(BitcoinUtils, EncodeHexBlockTxs) {
+  CTransactionRef tx;
+  vector<char> coinbaseTxBin;
+  GetTestTx(tx, coinbaseTxBin);
+
+  // the transaction count takes 1, 3 and 5 bytes
+  for (size_t txs : {0, 1, 251, 252, 65534, 65535}) {
+    BlockTxs vtxs(txs, tx);
+    const CBlock block = MakeBlock(coinbaseTxBin, vtxs);
+    ASSERT_EQ(
+        EncodeHexBlock(block, coinbaseTxBin, EncodeHexBlockTxs(vtxs)),
+        EncodeHexBlock(block))
+        << txs << " txs";
+  }
+}
+#endif
@@ -0,0 +1,101 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "HierarchicalBitmap.h"
+
+#include <random>
+#include <vector>
+
+using namespace std;
+
+// The first clear bit of the reference at or after pos, wrapping around
+static size_t FindClear(const vector<bool> &bits, size_t pos) {
+  for (size_t i = 0; i < bits.size(); i++) {
+    size_t j = (pos + i) % bits.size();
+    if (!bits[j]) {
+      return j;
+    }
+  }
+  return HierarchicalBitmap::npos;
+}
+
+TEST(HierarchicalBitmap, FillAndFree) {
+  for (size_t size : {1, 63, 64, 65, 4096, 4097, 262145}) {
+    HierarchicalBitmap bitmap(size);
+    ASSERT_EQ(bitmap.size(), size);
+    ASSERT_FALSE(bitmap.full());
+
+    for (size_t i = 0; i < size; i++) {
+      ASSERT_EQ(bitmap.findClear(0), i) << size;
+      ASSERT_TRUE(bitmap.set(i));
+      ASSERT_FALSE(bitmap.set(i));
+    }
+    ASSERT_TRUE(bitmap.full());
+    ASSERT_EQ(bitmap.count(), size);
+    ASSERT_EQ(bitmap.findClear(0), HierarchicalBitmap::npos);
+
+    // free the last one, then the first one
+    ASSERT_TRUE(bitmap.reset(size - 1));
+    ASSERT_FALSE(bitmap.reset(size - 1));
+    ASSERT_EQ(bitmap.findClear(0), size - 1);
+    ASSERT_EQ(bitmap.findClearFrom(size - 1), size - 1);
+    if (size > 1) {
+      ASSERT_TRUE(bitmap.reset(0));
+      ASSERT_EQ(bitmap.findClear(0), 0u);
+      ASSERT_EQ(bitmap.findClear(1), size - 1);
+      ASSERT_EQ(bitmap.findClear(size - 1), size - 1);
+      ASSERT_EQ(bitmap.count(), size - 2);
+    }
+
+    bitmap.reset();
+    ASSERT_EQ(bitmap.count(), 0u);
+    ASSERT_EQ(bitmap.findClear(size - 1), size - 1);
+  }
+}
+
+TEST(HierarchicalBitmap, Random) {
+  std::mt19937 rng(42);
+  for (size_t size : {100, 4100, 300000}) {
+    HierarchicalBitmap bitmap(size);
+    vector<bool> reference(size);
+    std::uniform_int_distribution<size_t> position(0, size - 1);
+
+    // fill most of the bits then churn them
+    for (size_t round = 0; round < 3 * size; round++) {
+      size_t pos = position(rng);
+      if (round < 2 * size) {
+        ASSERT_EQ(bitmap.set(pos), !reference[pos]);
+        reference[pos] = true;
+      } else {
+        ASSERT_EQ(bitmap.reset(pos), reference[pos]);
+        reference[pos] = false;
+      }
+      size_t from = position(rng);
+      ASSERT_EQ(bitmap.findClear(from), FindClear(reference, from));
+    }
+    for (size_t i = 0; i < size; i++) {
+      ASSERT_EQ(bitmap.test(i), reference[i]);
+    }
+  }
+}
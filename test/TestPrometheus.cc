@@ -0,0 +1,113 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2016] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "prometheus/Histogram.h"
+#include "prometheus/Registry.h"
+
+#include <thread>
+#include <vector>
+
+TEST(Prometheus, Histogram) {
+  prometheus::Histogram histogram{{0.1, 1, 10}};
+  histogram.observe(0.05);
+  histogram.observe(0.1); // the bounds are inclusive
+  histogram.observe(0.5);
+  histogram.observe(10);
+  histogram.observe(100);
+
+  auto snapshot = histogram.collect();
+  ASSERT_EQ(snapshot.bounds_, std::vector<double>({0.1, 1, 10}));
+  ASSERT_EQ(snapshot.buckets_, std::vector<uint64_t>({2, 1, 1, 1}));
+  ASSERT_EQ(snapshot.count_, 5u);
+  ASSERT_DOUBLE_EQ(snapshot.sum_, 110.65);
+
+  // the default bounds fit the latencies of the share path
+  prometheus::Histogram durations;
+  durations.observe(0.00002);
+  snapshot = durations.collect();
+  ASSERT_EQ(
+      snapshot.buckets_.size(),
+      prometheus::Histogram::DurationBounds().size() + 1);
+  ASSERT_EQ(snapshot.buckets_[1], 1u);
+}
+
+TEST(Prometheus, HistogramConcurrent) {
+  const size_t kThreads = 8;
+  const size_t kObservations = 100000;
+
+  prometheus::Histogram histogram{{1, 2}};
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&histogram, i]() {
+      for (size_t j = 0; j < kObservations; ++j) {
+        histogram.observe(i % 3 + 0.5);
+      }
+    });
+  }
+  // collecting while observing must not disturb the observations
+  for (size_t i = 0; i < 100; ++i) {
+    histogram.collect();
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  auto snapshot = histogram.collect();
+  ASSERT_EQ(snapshot.count_, kThreads * kObservations);
+  ASSERT_EQ(snapshot.buckets_[0], 3 * kObservations);
+  ASSERT_EQ(snapshot.buckets_[1], 3 * kObservations);
+  ASSERT_EQ(snapshot.buckets_[2], 2 * kObservations);
+  ASSERT_DOUBLE_EQ(
+      snapshot.sum_, (3 * 0.5 + 3 * 1.5 + 2 * 2.5) * kObservations);
+}
+
+TEST(Prometheus, Registry) {
+  prometheus::Registry registry;
+  auto b = registry.histogram("test_b_seconds", "B", {{"x", "1"}});
+  auto a = registry.histogram("test_a_seconds", "A");
+  auto b2 = registry.histogram("test_b_seconds", "B", {{"x", "2"}});
+  ASSERT_EQ(registry.histogram("test_b_seconds", "B", {{"x", "1"}}), b);
+  ASSERT_NE(b2, b);
+
+  a->observe(1);
+  b2->observe(1);
+  b2->observe(2);
+
+  auto metrics = registry.collectMetrics();
+  ASSERT_EQ(metrics.size(), 3u);
+  // the series of a metric are collected together
+  ASSERT_EQ(metrics[0]->getName(), "test_a_seconds");
+  ASSERT_EQ(metrics[1]->getName(), "test_b_seconds");
+  ASSERT_EQ(metrics[2]->getName(), "test_b_seconds");
+  ASSERT_EQ(metrics[2]->getLabels().at("x"), "2");
+
+  for (auto &metric : metrics) {
+    ASSERT_EQ(metric->getType(), prometheus::Metric::Type::Histogram);
+    ASSERT_NE(metric->getHistogram(), nullptr);
+  }
+  ASSERT_EQ(metrics[0]->getValue(), "1");
+  ASSERT_EQ(metrics[1]->getHistogram()->count_, 0u);
+  ASSERT_EQ(metrics[2]->getHistogram()->count_, 2u);
+  ASSERT_DOUBLE_EQ(metrics[2]->getHistogram()->sum_, 3);
+}
@@ -0,0 +1,67 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "RedisConnection.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TEST(RedisCommandBuffer, Encode) {
+  RedisCommandBuffer buffer(16);
+  ASSERT_TRUE(buffer.empty());
+
+  buffer.command(3);
+  buffer.arg("SET");
+  buffer.arg(string("key"));
+  buffer.arg("", 0);
+  ASSERT_EQ(buffer.data(), "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$0\r\n\r\n");
+  ASSERT_EQ(buffer.commands(), 1u);
+
+  buffer.clear();
+  ASSERT_TRUE(buffer.empty());
+  ASSERT_EQ(buffer.size(), 0u);
+
+  buffer.command(6);
+  buffer.arg(0);
+  buffer.arg(-1);
+  buffer.arg((uint32_t)1234567890);
+  buffer.arg(INT64_MIN);
+  buffer.arg(UINT64_MAX);
+  buffer.arg((time_t)1546300800);
+  ASSERT_EQ(
+      buffer.data(),
+      "*6\r\n$1\r\n0\r\n$2\r\n-1\r\n$10\r\n1234567890\r\n"
+      "$20\r\n-9223372036854775808\r\n$20\r\n18446744073709551615\r\n"
+      "$10\r\n1546300800\r\n");
+
+  // a long argument
+  buffer.clear();
+  string value(1000, 'x');
+  buffer.command(1);
+  buffer.arg(value);
+  ASSERT_EQ(buffer.data(), "*1\r\n$1000\r\n" + value + "\r\n");
+}
@@ -0,0 +1,293 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "RpcClient.h"
+#include "Utils.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//
+// A local HTTP/1.1 node giving the same response to every request, the
+// connections are kept alive. It counts the connections and the requests.
+//
+class MockHttpNode {
+public:
+  explicit MockHttpNode(int status = 200, int delayMs = 0)
+    : status_(status)
+    , delayMs_(delayMs)
+    , stop_(false)
+    , connections_(0)
+    , requests_(0) {
+    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (bind(listenFd_, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listenFd_, 64) != 0 ||
+        getsockname(listenFd_, (sockaddr *)&addr, &len) != 0) {
+      LOG(FATAL) << "mock node cannot listen";
+    }
+    port_ = ntohs(addr.sin_port);
+    acceptThread_ = thread([this]() { runAccept(); });
+  }
+
+  ~MockHttpNode() {
+    stop_ = true;
+    acceptThread_.join();
+    for (auto &t : connectionThreads_) {
+      t.join();
+    }
+    close(listenFd_);
+  }
+
+  string url() const { return "http://127.0.0.1:" + to_string(port_); }
+  RpcNode node() const { return RpcNode{url(), "user:pass"}; }
+  size_t connections() const { return connections_; }
+  size_t requests() const { return requests_; }
+
+private:
+  // waits until fd is readable or the node stops
+  bool waitReadable(int fd) {
+    pollfd pfd = {fd, POLLIN, 0};
+    while (!stop_) {
+      if (poll(&pfd, 1, 20) > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void runAccept() {
+    while (waitReadable(listenFd_)) {
+      int fd = accept(listenFd_, nullptr, nullptr);
+      if (fd >= 0) {
+        connections_++;
+        connectionThreads_.emplace_back([this, fd]() { serve(fd); });
+      }
+    }
+  }
+
+  void serve(int fd) {
+    string buffer;
+    char data[4096];
+    while (waitReadable(fd)) {
+      ssize_t size = read(fd, data, sizeof(data));
+      if (size <= 0) {
+        break;
+      }
+      buffer.append(data, size);
+
+      // answer the complete requests
+      for (;;) {
+        size_t headerEnd = buffer.find("\r\n\r\n");
+        if (headerEnd == string::npos) {
+          break;
+        }
+        size_t bodySize = 0;
+        size_t pos = buffer.find("Content-Length: ");
+        if (pos != string::npos && pos < headerEnd) {
+          bodySize = strtoul(buffer.c_str() + pos + 16, nullptr, 10);
+        }
+        if (buffer.size() < headerEnd + 4 + bodySize) {
+          break;
+        }
+        buffer.erase(0, headerEnd + 4 + bodySize);
+        requests_++;
+
+        if (delayMs_ > 0) {
+          this_thread::sleep_for(chrono::milliseconds(delayMs_));
+        }
+        const string body = "{\"result\":null,\"error\":null,\"id\":\"1\"}";
+        const string response = "HTTP/1.1 " + to_string(status_) +
+            " Status\r\nContent-Type: application/json\r\n"
+            "Content-Length: " +
+            to_string(body.size()) + "\r\n\r\n" + body;
+        if (write(fd, response.data(), response.size()) !=
+            (ssize_t)response.size()) {
+          break;
+        }
+      }
+    }
+    close(fd);
+  }
+
+  const int status_;
+  const int delayMs_;
+  int listenFd_;
+  uint16_t port_;
+  atomic<bool> stop_;
+  atomic<size_t> connections_;
+  atomic<size_t> requests_;
+  thread acceptThread_;
+  vector<thread> connectionThreads_; // only changed by acceptThread_
+};
+
+static const string kRequest =
+    "{\"jsonrpc\":\"1.0\",\"id\":\"1\",\"method\":\"getblockcount\","
+    "\"params\":[]}";
+
+TEST(RpcClient, KeepAlive) {
+  MockHttpNode node;
+  RpcClient client(0, 1);
+
+  for (size_t i = 0; i < 20; i++) {
+    string response;
+    ASSERT_TRUE(client.call(node.node(), kRequest, response));
+    ASSERT_EQ(response, "{\"result\":null,\"error\":null,\"id\":\"1\"}");
+  }
+  ASSERT_EQ(node.requests(), 20u);
+  ASSERT_EQ(node.connections(), 1u);
+  ASSERT_EQ(client.idleConnections(node.url()), 1u);
+}
+
+TEST(RpcClient, Failure) {
+  MockHttpNode node(500);
+  RpcClient client(0, 1);
+
+  string response;
+  ASSERT_FALSE(client.call(node.node(), kRequest, response));
+  // the connection of a failed call is not reused
+  ASSERT_EQ(client.idleConnections(node.url()), 0u);
+  ASSERT_FALSE(client.call(node.node(), kRequest, response));
+  ASSERT_EQ(node.connections(), 2u);
+
+  // nothing listens on the port of a stopped node
+  string url;
+  {
+    MockHttpNode stopped;
+    url = stopped.url();
+  }
+  ASSERT_FALSE(client.call(RpcNode{url, ""}, kRequest, response, 1000));
+}
+
+TEST(RpcClient, FanOut) {
+  MockHttpNode fastNode;
+  MockHttpNode slowNode(200, 300);
+  MockHttpNode failingNode(500);
+  const vector<RpcNode> nodes = {
+      slowNode.node(), failingNode.node(), fastNode.node()};
+
+  prometheus::Histogram callDuration;
+  prometheus::Histogram firstSuccessDuration;
+  RpcClient client(4, 16);
+
+  mutex lock;
+  condition_variable finished;
+  vector<int> results(nodes.size(), -1);
+  size_t pending = nodes.size();
+  auto begin = chrono::steady_clock::now();
+  client.fanOut(
+      nodes,
+      make_shared<const string>(kRequest),
+      3,
+      &callDuration,
+      &firstSuccessDuration,
+      [&](size_t node, bool success, const string &) {
+        lock_guard<mutex> l{lock};
+        results[node] = success;
+        if (--pending == 0) {
+          finished.notify_one();
+        }
+      });
+  {
+    unique_lock<mutex> l{lock};
+    finished.wait(l, [&pending]() { return pending == 0; });
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+
+  ASSERT_EQ(results, vector<int>({1, 0, 1}));
+  ASSERT_EQ(failingNode.requests(), 3u);
+  // the nodes are called in parallel
+  ASSERT_LT(elapsed.count(), 0.6);
+  ASSERT_EQ(callDuration.collect().count_, 5u);
+  // the fast node answered first
+  auto firstSuccess = firstSuccessDuration.collect();
+  ASSERT_EQ(firstSuccess.count_, 1u);
+  ASSERT_LT(firstSuccess.sum_, 0.3);
+}
+
+TEST(RpcClient, UnboundedQueue) {
+  RpcClient client(1, 0);
+  mutex lock;
+  condition_variable released;
+  bool blocked = true;
+  atomic<size_t> done{0};
+
+  // the executor is busy, dispatching does not wait for it
+  client.dispatch([&]() {
+    unique_lock<mutex> l{lock};
+    released.wait(l, [&blocked]() { return !blocked; });
+    done++;
+  });
+  for (size_t i = 0; i < 100; i++) {
+    client.dispatch([&done]() { done++; });
+  }
+  ASSERT_EQ(done.load(), 0u);
+
+  {
+    lock_guard<mutex> l{lock};
+    blocked = false;
+  }
+  released.notify_one();
+  while (done < 101) {
+    this_thread::sleep_for(chrono::milliseconds(1));
+  }
+}
+
+TEST(RpcClient, Preconnect) {
+  MockHttpNode node;
+  RpcClient client(0, 1);
+
+  ASSERT_TRUE(client.preconnect(node.node(), kRequest, 3));
+  ASSERT_EQ(node.connections(), 3u);
+  ASSERT_EQ(client.idleConnections(node.url()), 3u);
+
+  string response;
+  ASSERT_TRUE(client.call(node.node(), kRequest, response));
+  ASSERT_EQ(node.connections(), 3u);
+
+  // the idle connections are used again
+  client.keepConnected({node.node()}, kRequest, 3, 1);
+  this_thread::sleep_for(chrono::milliseconds(1500));
+  ASSERT_EQ(node.requests(), 7u);
+  ASSERT_EQ(node.connections(), 3u);
+}
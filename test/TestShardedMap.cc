@@ -0,0 +1,153 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "ShardedMap.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST(ShardedMap, FindInsertUpdate) {
+  ShardedMap<int32_t, int32_t> map(8);
+  ASSERT_EQ(map.shards(), 8u);
+
+  int32_t value = 0;
+  ASSERT_FALSE(map.find(1, value));
+  ASSERT_TRUE(map.insert(1, 10, value));
+  ASSERT_EQ(value, 10);
+  // an existing value is kept
+  ASSERT_FALSE(map.insert(1, 11, value));
+  ASSERT_EQ(value, 10);
+  ASSERT_TRUE(map.find(1, value));
+  ASSERT_EQ(value, 10);
+  ASSERT_EQ(map.size(), 1u);
+
+  auto increase = [](int32_t &count) { return ++count > 0; };
+  auto decrease = [](int32_t &count) { return --count > 0; };
+  map.update(2, increase);
+  map.update(2, increase);
+  ASSERT_TRUE(map.find(2, value));
+  ASSERT_EQ(value, 2);
+  ASSERT_EQ(map.size(), 2u);
+  map.update(2, decrease);
+  map.update(2, decrease);
+  ASSERT_FALSE(map.find(2, value));
+  ASSERT_EQ(map.size(), 1u);
+}
+
+TEST(ShardedMap, ShardIndex) {
+  ShardedMap<int32_t, int32_t> map(8);
+  std::vector<size_t> keys(map.shards(), 0);
+  for (int32_t i = 0; i < 1000; i++) {
+    int32_t value;
+    map.insert(i, i, value);
+    ASSERT_LT(map.shardIndex(i), map.shards());
+    keys[map.shardIndex(i)]++;
+  }
+  // a shard walk visits the keys with its index
+  for (size_t shard = 0; shard < map.shards(); shard++) {
+    ASSERT_GT(keys[shard], 0u);
+    size_t visited = 0;
+    map.forEach(shard, [&map, shard, &visited](int32_t key, int32_t) {
+      ASSERT_EQ(map.shardIndex(key), shard);
+      visited++;
+    });
+    ASSERT_EQ(visited, keys[shard]);
+  }
+}
+
+TEST(ShardedMap, ForEachEraseIf) {
+  ShardedMap<int32_t, int32_t> map(4);
+  for (int32_t i = 0; i < 1000; i++) {
+    int32_t value;
+    map.insert(i, i * 2, value);
+  }
+
+  std::vector<int32_t> seen(1000, 0);
+  for (size_t shard = 0; shard < map.shards(); shard++) {
+    map.forEach(shard, [&seen](int32_t key, int32_t value) {
+      ASSERT_EQ(value, key * 2);
+      seen[key]++;
+    });
+  }
+  for (auto count : seen) {
+    ASSERT_EQ(count, 1);
+  }
+
+  size_t erased = 0;
+  for (size_t shard = 0; shard < map.shards(); shard++) {
+    erased +=
+        map.eraseIf(shard, [](int32_t key, int32_t) { return key % 2 == 0; });
+  }
+  ASSERT_EQ(erased, 500u);
+  ASSERT_EQ(map.size(), 500u);
+
+  size_t left = 0;
+  map.forEach([&left](int32_t key, int32_t) {
+    ASSERT_EQ(key % 2, 1);
+    left++;
+  });
+  ASSERT_EQ(left, 500u);
+}
+
+TEST(ShardedMap, Concurrent) {
+  const int32_t kKeys = 100000;
+  ShardedMap<int32_t, int32_t> map;
+  std::atomic<bool> done{false};
+
+  // a sweeper walks and erases the shards while the writers insert
+  std::thread sweeper([&map, &done]() {
+    while (!done) {
+      for (size_t shard = 0; shard < map.shards(); shard++) {
+        map.eraseIf(shard, [](int32_t key, int32_t) { return key < 0; });
+      }
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (int32_t t = 0; t < 4; t++) {
+    writers.emplace_back([&map, t]() {
+      for (int32_t i = t; i < kKeys; i += 4) {
+        int32_t value;
+        map.insert(i, i, value);
+        map.insert(-1 - i, i, value);
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  done = true;
+  sweeper.join();
+
+  for (size_t shard = 0; shard < map.shards(); shard++) {
+    map.eraseIf(shard, [](int32_t key, int32_t) { return key < 0; });
+  }
+  ASSERT_EQ(map.size(), (size_t)kKeys);
+  for (int32_t i = 0; i < kKeys; i++) {
+    int32_t value;
+    ASSERT_TRUE(map.find(i, value));
+    ASSERT_EQ(value, i);
+  }
+}
@@ -0,0 +1,204 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2016] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "Common.h"
+#include "ShareLogFile.h"
+
+#include "bitcoin/StratumBitcoin.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <unistd.h>
+
+// a fake record: the share index padded to a varying size
+static string MakeRecord(uint32_t i) {
+  string record((const char *)&i, sizeof(i));
+  record.append(i % 50, 'x');
+  return record;
+}
+
+static void AppendRecords(
+    ShareLogBlockWriter &writer, uint32_t begin, uint32_t end) {
+  for (uint32_t i = begin; i < end; i++) {
+    string record = MakeRecord(i);
+    ASSERT_TRUE(writer.addRecord(
+        record.data(), record.size(), 1000000 + i, (int32_t)(i / 1000)));
+  }
+}
+
+static vector<uint32_t> ReadRecords(
+    const ShareLogBlockReader &reader,
+    const vector<ShareLogBlockInfo> &blocks,
+    size_t threads) {
+  vector<uint32_t> ids;
+  bool success =
+      reader.readBlocks(blocks, threads, [&ids](const string &records) {
+        size_t consumed = ForEachShareRecord(
+            records.data(),
+            records.size(),
+            [&ids](const uint8_t *buf, size_t len) {
+              uint32_t id = *(const uint32_t *)buf;
+              EXPECT_EQ(MakeRecord(id), string((const char *)buf, len));
+              ids.push_back(id);
+            });
+        EXPECT_EQ(consumed, records.size());
+      });
+  EXPECT_TRUE(success);
+  return ids;
+}
+
+TEST(ShareLogFile, WriteAndSeek) {
+  const string path = "/tmp/sharelog-v2-test.bin";
+  unlink(path.c_str());
+
+  ShareLogBlockOptions options;
+  options.enabled_ = true;
+  options.blockSize_ = 16 * 1024;
+
+  {
+    ShareLogBlockWriter writer(path, 1, options);
+    ASSERT_TRUE(writer.open());
+    AppendRecords(writer, 0, 30000);
+    ASSERT_TRUE(writer.close());
+  }
+  ASSERT_EQ(ShareLogBlockReader::detectFormat(path), ShareLogFormat::BLOCK);
+
+  // reopen: the index is dropped, new blocks appended and indexed again
+  {
+    ShareLogBlockWriter writer(path, 1, options);
+    ASSERT_TRUE(writer.open());
+    AppendRecords(writer, 30000, 50000);
+    ASSERT_TRUE(writer.close());
+  }
+
+  ShareLogBlockReader reader(path);
+  ASSERT_TRUE(reader.open());
+  ASSERT_TRUE(reader.hasIndex());
+  ASSERT_GT(reader.blocks().size(), 10u);
+
+  for (size_t threads : {0, 1, 4}) {
+    vector<uint32_t> ids = ReadRecords(reader, reader.blocks(), threads);
+    ASSERT_EQ(ids.size(), 50000u);
+    for (uint32_t i = 0; i < ids.size(); i++) {
+      ASSERT_EQ(ids[i], i);
+    }
+  }
+
+  // seek by user: user 20 owns shares [20000, 21000)
+  auto blocks = reader.findBlocks(0, UINT32_MAX, 20, 20);
+  ASSERT_LT(blocks.size(), reader.blocks().size() / 10);
+  vector<uint32_t> ids = ReadRecords(reader, blocks, 2);
+  ASSERT_LE(ids.front(), 20000u);
+  ASSERT_GE(ids.back(), 20999u);
+
+  // seek by time
+  blocks = reader.findBlocks(1000000 + 45000, 1000000 + 45001);
+  ids = ReadRecords(reader, blocks, 1);
+  ASSERT_EQ(blocks.size(), 1u);
+  ASSERT_NE(std::find(ids.begin(), ids.end(), 45000u), ids.end());
+
+  unlink(path.c_str());
+}
+
+TEST(ShareLogFile, GrowingAndTruncated) {
+  const string path = "/tmp/sharelog-v2-growing.bin";
+  unlink(path.c_str());
+
+  ShareLogBlockOptions options;
+  options.enabled_ = true;
+  options.blockSize_ = 4 * 1024;
+
+  ShareLogBlockWriter writer(path, 1, options);
+  ASSERT_TRUE(writer.open());
+  AppendRecords(writer, 0, 1000);
+  ASSERT_TRUE(writer.flush(true));
+
+  ShareLogBlockReader reader(path);
+  ASSERT_TRUE(reader.open());
+  ASSERT_FALSE(reader.hasIndex());
+  const size_t firstBlocks = reader.blocks().size();
+  ASSERT_GT(firstBlocks, 0u);
+  ASSERT_EQ(reader.refresh(), 0u);
+
+  AppendRecords(writer, 1000, 2000);
+  ASSERT_TRUE(writer.flush(true));
+  ASSERT_GT(reader.refresh(), 0u);
+  ASSERT_EQ(ReadRecords(reader, reader.blocks(), 1).size(), 2000u);
+
+  // a half written block is ignored by readers and dropped by writers
+  {
+    std::ofstream f(path, std::ios::binary | std::ios::app);
+    ShareLogBlockHeader header = reader.blocks().back().header_;
+    f.write((const char *)&header, sizeof(header));
+    f.write("abc", 3);
+  }
+  ASSERT_EQ(reader.refresh(), 0u);
+
+  ShareLogBlockWriter writer2(path, 1, options);
+  ASSERT_TRUE(writer2.open());
+  AppendRecords(writer2, 2000, 3000);
+  ASSERT_TRUE(writer2.close());
+
+  ASSERT_GT(reader.refresh(), 0u);
+  ASSERT_TRUE(reader.hasIndex());
+  ASSERT_EQ(ReadRecords(reader, reader.blocks(), 1).size(), 3000u);
+
+  unlink(path.c_str());
+}
+
+TEST(ShareLogFile, PeekShareLogFields) {
+  for (int32_t userId : {1, -2, 0x7fffffff, -0x7fffffff - 1, 0}) {
+    ShareBitcoin share;
+    share.set_version(ShareBitcoin::CURRENT_VERSION);
+    share.set_workerhashid(-1);
+    share.set_userid(userId);
+    share.set_timestamp(1564617600 + userId % 86400);
+    share.set_ip("2001:db8::1");
+    share.set_jobid(0xffffffffffffffffULL);
+    share.set_sharediff(1024);
+
+    string message;
+    uint32_t size = 0;
+    ASSERT_TRUE(share.SerializeToBuffer(message, size));
+
+    int64_t timestamp = 0;
+    int32_t peekedUserId = 0;
+    ASSERT_TRUE(PeekShareLogFields<ShareBitcoin>(
+        (const uint8_t *)message.data(), size, timestamp, peekedUserId));
+    ASSERT_EQ(timestamp, share.timestamp());
+    ASSERT_EQ(peekedUserId, userId);
+
+    // a truncated message is rejected
+    for (uint32_t i = 0; i < size; i++) {
+      ShareBitcoin parsed;
+      if (parsed.ParseFromArray(message.data(), i) && parsed.has_timestamp()) {
+        continue;
+      }
+      ASSERT_FALSE(PeekShareLogFields<ShareBitcoin>(
+          (const uint8_t *)message.data(), i, timestamp, peekedUserId));
+    }
+  }
+}
@@ -0,0 +1,174 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2016] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "Common.h"
+#include "Utils.h"
+
+#include "bitcoin/ShareLogParserBitcoin.h"
+#include "bitcoin/BitcoinUtils.h"
+
+#include <libconfig.h++>
+
+#include <fstream>
+
+#include <dirent.h>
+#include <unistd.h>
+
+// a unique directory under /tmp, removed with its files at the end of a test
+class TempDir {
+public:
+  TempDir() {
+    char path[] = "/tmp/slparser-test.XXXXXX";
+    if (mkdtemp(path) != nullptr) {
+      path_ = path;
+    }
+  }
+  ~TempDir() {
+    if (path_.empty()) {
+      return;
+    }
+    DIR *dir = opendir(path_.c_str());
+    if (dir != nullptr) {
+      while (struct dirent *entry = readdir(dir)) {
+        const string name = entry->d_name;
+        if (name != "." && name != "..") {
+          unlink((path_ + "/" + name).c_str());
+        }
+      }
+      closedir(dir);
+    }
+    rmdir(path_.c_str());
+  }
+
+  const string &path() const { return path_; }
+
+private:
+  string path_;
+};
+
+static void
+WriteShareLog(const string &path, const vector<ShareBitcoin> &shares) {
+  std::ofstream f(path, std::ios::binary | std::ios::trunc);
+  for (const auto &share : shares) {
+    string message;
+    uint32_t size = 0;
+    ASSERT_TRUE(share.SerializeToBuffer(message, size));
+    f.write((char *)&size, sizeof(uint32_t));
+    f.write((char *)message.data(), size);
+  }
+}
+
+static shared_ptr<ShareLogParserBitcoin>
+CreateShareLogParser(const string &dataDir, time_t date, int parseThreads) {
+  libconfig::Config cfg;
+  cfg.readString(Strings::Format(
+      "sharelog = { chain_type = \"BTC\"; data_dir = \"%s\"; "
+      "parse_threads = %d; };"
+      "pooldb = { host = \"127.0.0.1\"; username = \"\"; password = \"\"; "
+      "dbname = \"\"; };",
+      dataDir,
+      parseThreads));
+  return std::make_shared<ShareLogParserBitcoin>(cfg, date, nullptr);
+}
+
+static void ExpectSameStats(const ShareStats &a, const ShareStats &b) {
+  ASSERT_EQ(a.shareAccept_, b.shareAccept_);
+  ASSERT_EQ(a.shareStale_, b.shareStale_);
+  ASSERT_EQ(a.shareReject_, b.shareReject_);
+  ASSERT_EQ(a.rejectDetail_, b.rejectDetail_);
+  // must be bit-identical, not just close
+  ASSERT_EQ(0, memcmp(&a.rejectRate_, &b.rejectRate_, sizeof(double)));
+  ASSERT_EQ(0, memcmp(&a.earn_, &b.earn_, sizeof(double)));
+}
+
+TEST(ShareLogParser, ParallelMatchesSingleThread) {
+  SelectParams(CBaseChainParams::MAIN);
+
+  const time_t date = 1562889600; // 2019-07-12 00:00:00 UTC
+  TempDir tempDir;
+  ASSERT_FALSE(tempDir.path().empty());
+  const string dataDir = tempDir.path();
+  const string path = getStatsFilePath("BTC", dataDir, date);
+
+  // enough shares for a few pipeline chunks
+  const int32_t kUsers = 50;
+  const int64_t kWorkers = 20;
+  vector<ShareBitcoin> shares(300000);
+  std::mt19937 rng(12345);
+  for (size_t i = 0; i < shares.size(); i++) {
+    ShareBitcoin &share = shares[i];
+    share.set_jobid(i + 1);
+    share.set_userid(rng() % kUsers + 1);
+    share.set_workerhashid(rng() % kWorkers + 1);
+    share.set_timestamp(date + i * 86400 / shares.size());
+    share.set_height(527259);
+    share.set_blkbits(0x18050edcu);
+    share.set_sharediff(rng() % 100000 + 1);
+    switch (rng() % 10) {
+    case 0:
+      share.set_status(StratumStatus::REJECT_NO_REASON);
+      break;
+    case 1:
+      share.set_status(StratumStatus::JOB_NOT_FOUND);
+      break;
+    case 2:
+      share.set_status(StratumStatus::ACCEPT_STALE);
+      break;
+    default:
+      share.set_status(StratumStatus::ACCEPT);
+    }
+  }
+  WriteShareLog(path, shares);
+
+  auto single = CreateShareLogParser(dataDir, date, 0);
+  auto parallel = CreateShareLogParser(dataDir, date, 4);
+  ASSERT_TRUE(single->processUnchangedShareLog());
+  ASSERT_TRUE(parallel->processUnchangedShareLog());
+
+  vector<WorkerKey> keys = {WorkerKey(0, 0)};
+  for (int32_t userId = 1; userId <= kUsers; userId++) {
+    keys.emplace_back(userId, 0);
+    for (int64_t workerId = 1; workerId <= kWorkers; workerId++) {
+      keys.emplace_back(userId, workerId);
+    }
+  }
+
+  for (const auto &key : keys) {
+    auto a = single->getShareStatsDayHandler(key);
+    auto b = parallel->getShareStatsDayHandler(key);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+
+    ShareStats sa, sb;
+    a->getShareStatsDay(&sa);
+    b->getShareStatsDay(&sb);
+    ExpectSameStats(sa, sb);
+    for (uint32_t hour = 0; hour < 24; hour++) {
+      a->getShareStatsHour(hour, &sa);
+      b->getShareStatsHour(hour, &sb);
+      ExpectSameStats(sa, sb);
+    }
+  }
+}
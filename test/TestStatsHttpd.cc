@@ -0,0 +1,141 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+#include "StatsHttpd.h"
+
+#include "bitcoin/StratumBitcoin.h"
+
+static ShareBitcoin MakeShare(int32_t status, uint64_t diff) {
+  ShareBitcoin share;
+  share.set_version(ShareBitcoin::CURRENT_VERSION);
+  share.set_status(status);
+  share.set_sharediff(diff);
+  share.set_timestamp(time(nullptr));
+  share.set_ip("127.0.0.1");
+  return share;
+}
+
+TEST(WorkerStatus, Fingerprint) {
+  WorkerStatus status;
+  const uint64_t empty = status.fingerprint();
+  ASSERT_EQ(WorkerStatus().fingerprint(), empty);
+
+  status.accept15m_ = 1;
+  ASSERT_NE(status.fingerprint(), empty);
+  status.accept15m_ = 0;
+  ASSERT_EQ(status.fingerprint(), empty);
+
+  // the values do not cancel each other out
+  status.accept5m_ = 1;
+  status.accept15m_ = 1;
+  ASSERT_NE(status.fingerprint(), empty);
+
+  WorkerStatus rejected;
+  rejected.rejectDetail1h_ = "{\"1\":2}";
+  ASSERT_NE(rejected.fingerprint(), empty);
+}
+
+TEST(WorkerShares, SkipUnchangedWithinRewriteInterval) {
+  const time_t kRewriteInterval = 300;
+  WorkerShares<ShareBitcoin> worker(1, 1);
+  ShareBitcoin share = MakeShare(StratumStatus::ACCEPT, 1024);
+  worker.processShare(share, false);
+
+  const time_t now = time(nullptr);
+  uint64_t fingerprint = worker.getWorkerStatus().fingerprint();
+  ASSERT_TRUE(
+      worker.needFlush(STATS_FLUSH_DB, fingerprint, now, kRewriteInterval));
+  worker.setFlushed(STATS_FLUSH_DB, fingerprint, now);
+
+  // unchanged status
+  ASSERT_FALSE(
+      worker.needFlush(STATS_FLUSH_DB, fingerprint, now, kRewriteInterval));
+  ASSERT_FALSE(worker.needFlush(
+      STATS_FLUSH_DB,
+      fingerprint,
+      now + kRewriteInterval - 1,
+      kRewriteInterval));
+
+  // every target has its own state
+  ASSERT_TRUE(worker.needFlush(
+      STATS_FLUSH_REDIS, fingerprint, now, kRewriteInterval));
+
+  // a new share changes the status
+  worker.processShare(share, false);
+  fingerprint = worker.getWorkerStatus().fingerprint();
+  ASSERT_TRUE(
+      worker.needFlush(STATS_FLUSH_DB, fingerprint, now, kRewriteInterval));
+}
+
+TEST(WorkerShares, RewriteAfterInterval) {
+  const time_t kRewriteInterval = 300;
+  WorkerShares<ShareBitcoin> worker(1, 1);
+  ShareBitcoin share = MakeShare(StratumStatus::REJECT_NO_REASON, 1024);
+  worker.processShare(share, false);
+
+  const time_t now = time(nullptr);
+  const uint64_t fingerprint = worker.getWorkerStatus().fingerprint();
+  worker.setFlushed(STATS_FLUSH_DB, fingerprint, now);
+  ASSERT_TRUE(worker.needFlush(
+      STATS_FLUSH_DB, fingerprint, now + kRewriteInterval, kRewriteInterval));
+
+  worker.setFlushed(STATS_FLUSH_DB, fingerprint, now + kRewriteInterval);
+  ASSERT_FALSE(worker.needFlush(
+      STATS_FLUSH_DB, fingerprint, now + kRewriteInterval, kRewriteInterval));
+}
+
+TEST(WorkerShares, RewriteIntervalZeroWritesEverything) {
+  WorkerShares<ShareBitcoin> worker(1, 1);
+  const time_t now = time(nullptr);
+  const uint64_t fingerprint = worker.getWorkerStatus().fingerprint();
+  for (int i = 0; i < 3; i++) {
+    ASSERT_TRUE(worker.needFlush(STATS_FLUSH_DB, fingerprint, now, 0));
+    worker.setFlushed(STATS_FLUSH_DB, fingerprint, now);
+  }
+}
+
+TEST(WorkerShares, FailedFlushIsWrittenAgain) {
+  const time_t kRewriteInterval = 300;
+  WorkerShares<ShareBitcoin> worker(1, 1);
+  ShareBitcoin share = MakeShare(StratumStatus::ACCEPT, 1024);
+  worker.processShare(share, false);
+
+  const time_t now = time(nullptr);
+  const uint64_t written = worker.getWorkerStatus().fingerprint();
+  worker.setFlushed(STATS_FLUSH_DB, written, now);
+
+  // the flush of the changed status fails, so it is not marked as flushed
+  worker.processShare(share, false);
+  const uint64_t changed = worker.getWorkerStatus().fingerprint();
+  ASSERT_TRUE(
+      worker.needFlush(STATS_FLUSH_DB, changed, now + 1, kRewriteInterval));
+
+  // the next flush writes it again
+  ASSERT_TRUE(
+      worker.needFlush(STATS_FLUSH_DB, changed, now + 2, kRewriteInterval));
+  worker.setFlushed(STATS_FLUSH_DB, changed, now + 2);
+  ASSERT_FALSE(
+      worker.needFlush(STATS_FLUSH_DB, changed, now + 3, kRewriteInterval));
+}
@@ -32,6 +32,7 @@
 #include "rsk/RskWork.h"
 #include "vcash/VcashWork.h"
 #include "beam/StratumBeam.h"
+#include "WorkerPool.h"
 
 #include <chainparams.h>
 #include <hash.h>
@@ -45,6 +46,8 @@
 
 #include <stdint.h>
 
+#include <random>
+
 TEST(Stratum, jobId2Time) {
   uint64_t jobId;
 
@@ -824,6 +827,182 @@ TEST(Stratum, StratumJobWithRskWork) {
 }
 #endif
 
+// the merkle branch as it is computed without MerkleBranchCache
+static vector<uint256> MakeMerkleBranch(vector<uint256> hashes) {
+  vector<uint256> branch;
+  if (hashes.empty()) {
+    return branch;
+  }
+  hashes.insert(hashes.begin(), uint256()); // coinbase
+  while (hashes.size() > 1) {
+    branch.push_back(hashes[1]);
+    if (hashes.size() % 2 != 0) {
+      hashes.push_back(hashes.back());
+    }
+    vector<uint256> parents(hashes.size() / 2);
+    for (size_t i = 1; i < parents.size(); i++) {
+      parents[i] = Hash(
+          BEGIN(hashes[2 * i]),
+          END(hashes[2 * i]),
+          BEGIN(hashes[2 * i + 1]),
+          END(hashes[2 * i + 1]));
+    }
+    hashes.swap(parents);
+  }
+  return branch;
+}
+
+static uint256 RandomHash(std::mt19937_64 &rng) {
+  uint256 hash;
+  for (auto p = hash.begin(); p != hash.end(); p++) {
+    *p = (unsigned char)rng();
+  }
+  return hash;
+}
+
+TEST(Stratum, MerkleBranchCache) {
+  std::mt19937_64 rng(42);
+  MerkleBranchCache cache;
+  vector<uint256> hashes;
+  for (size_t round = 0; round < 300; round++) {
+    switch (rng() % 4) {
+    case 0: // a new template
+      hashes.resize(rng() % 100);
+      for (auto &hash : hashes) {
+        hash = RandomHash(rng);
+      }
+      break;
+    case 1: // transactions appended
+      for (size_t n = rng() % 10; n > 0; n--) {
+        hashes.push_back(RandomHash(rng));
+      }
+      break;
+    case 2: // transactions removed from the tail
+      hashes.resize(
+          hashes.size() - std::min<size_t>(rng() % 10, hashes.size()));
+      break;
+    default: // a transaction replaced
+      if (!hashes.empty()) {
+        hashes[rng() % hashes.size()] = RandomHash(rng);
+      }
+      break;
+    }
+
+    vector<uint256> branch;
+    cache.makeMerkleBranch(hashes, branch);
+    ASSERT_EQ(branch, MakeMerkleBranch(hashes)) << "round " << round;
+  }
+
+  // all the nodes not covering the new transaction are reused
+  hashes.resize(1000);
+  for (auto &hash : hashes) {
+    hash = RandomHash(rng);
+  }
+  vector<uint256> branch;
+  cache.makeMerkleBranch(hashes, branch);
+  hashes.push_back(RandomHash(rng));
+  branch.clear();
+  cache.makeMerkleBranch(hashes, branch);
+  ASSERT_EQ(branch, MakeMerkleBranch(hashes));
+  // 1001 leaves with the coinbase: 500 + 250 + 125 + 62 + 31 + 15 + 7 + 3 + 1
+  // nodes not covering the coinbase, one per level covers the new transaction
+  ASSERT_EQ(cache.reusedNodes(), 994u - 9u);
+}
+
+#ifdef CHAIN_TYPE_BTC
+// A transaction and its txid of the testnet, without witness
+static const string kGbtTxData =
+      "01000000010291939c5ae8191c2e7d4ce8eba7d6616a66482e3200037cb8b8c2d0"
+      "af45b445000000006a47304402204df709d9e149804e358de4b082e41d8bb21b3c"
+      "9d347241b728b1362aafcb153602200d06d9b6f2eca899f43dcd62ec2efb2d9ce2"
+      "e10adf02738bb908420d7db93ede012103cae98ab925e20dd6ae1f76e767e9e99b"
+      "c47b3844095c68600af9c775104fb36cffffffff0290f1770b000000001976a914"
+      "00dc5fd62f6ee48eb8ecda749eaec6824a780fdd88aca08601000000000017a914"
+      "eb65573e5dd52d3d950396ccbe1a47daf8f400338700000000";
+static const string kGbtTxId =
+    "bd36bd4fff574b573152e7d4f64adf2bb1c9ab0080a12f8544c351f65aca79ff";
+
+static string MakeGbt(size_t txs, bool withTxid, bool withWitnessCommitment) {
+  string gbt =
+      "{\"result\":{\"version\":536870912,\"previousblockhash\":"
+      "\"0000000000000047e5bda122407654b25d52e0f3eeb00c152f631f70e9803772\","
+      "\"transactions\":[";
+  for (size_t i = 0; i < txs; i++) {
+    gbt += i == 0 ? "{" : ",{";
+    gbt += "\"data\":\"" + kGbtTxData + "\",";
+    if (withTxid) {
+      gbt += "\"txid\":\"" + kGbtTxId + "\",";
+    }
+    // the wtxid if the template has a witness commitment
+    gbt += "\"hash\":\"" + string(64, 'f') + "\",\"fee\":10000}";
+  }
+  gbt +=
+      "],\"coinbasevalue\":312659655,\"mintime\":1480831053,"
+      "\"curtime\":1480834892,\"bits\":\"1a171448\",\"height\":1038222";
+  if (withWitnessCommitment) {
+    gbt +=
+        ",\"default_witness_commitment\":\"6a24aa21a9ed842a6d6672504c2b7abb7"
+        "96fdd7cfbd7262977b71b945452e17fbac69ed22bf8\"";
+  }
+  return gbt + "}}";
+}
+
+TEST(Stratum, StratumJobGbtContext) {
+  SelectParams(CBaseChainParams::TESTNET);
+  CTxDestination poolPayoutAddrTestnet =
+      BitcoinUtils::DecodeDestination("myxopLJB19oFtNBdrAxD5Z34Aw6P8o9P8U");
+
+  WorkerPool pool(16);
+  pool.start(3);
+  GbtJobContext context;
+  context.decodePool_ = &pool;
+  context.decodeThreads_ = 3;
+
+  const size_t kTxs = 2000;
+  const vector<uint256> expected =
+      MakeMerkleBranch(vector<uint256>(kTxs, uint256S(kGbtTxId)));
+
+  struct Case {
+    bool withTxid;
+    bool withWitnessCommitment;
+    size_t decodedTxs;
+  };
+  // the hash is the txid only without the witness commitment
+  for (const Case &c : {Case{true, true, 0},
+                        Case{false, false, 0},
+                        Case{false, true, kTxs}}) {
+    const string gbt = MakeGbt(kTxs, c.withTxid, c.withWitnessCommitment);
+    StratumJobBitcoin sjob;
+    ASSERT_TRUE(sjob.initFromGbt(
+        gbt.c_str(),
+        "/BTC.COM/",
+        poolPayoutAddrTestnet,
+        0,
+        "",
+        RskWork(),
+        VcashWork(),
+        false,
+        &context));
+    ASSERT_EQ(context.txs_, kTxs);
+    ASSERT_EQ(context.decodedTxs_, c.decodedTxs);
+    ASSERT_EQ(sjob.merkleBranch_, expected);
+
+    // the same template without a context
+    StratumJobBitcoin sjob2;
+    ASSERT_TRUE(sjob2.initFromGbt(
+        gbt.c_str(),
+        "/BTC.COM/",
+        poolPayoutAddrTestnet,
+        0,
+        "",
+        RskWork(),
+        VcashWork(),
+        false));
+    ASSERT_EQ(sjob2.merkleBranch_, expected);
+  }
+}
+#endif
+
 TEST(Stratum, StratumJobBeam) {
   string sjobStr = R"EOF(
     {
@@ -0,0 +1,146 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2016] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "StratumRequest.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using JsonType = Utilities::JS::type;
+
+static bool Scan(StratumRequest &request, const string &line) {
+  return request.scan(line.data(), line.data() + line.size());
+}
+
+TEST(StratumRequest, Submit) {
+  StratumRequest request;
+  const string line =
+      "{\"params\": [\"slush.miner1\", \"bf\", \"00000001\", \"504e86ed\", "
+      "\"b2957c02\"], \"id\": 4, \"method\": \"mining.submit\"}\n";
+  ASSERT_TRUE(Scan(request, line));
+  ASSERT_TRUE(request.isMethod("mining.submit"));
+  ASSERT_FALSE(request.isMethod("mining.subscribe"));
+  ASSERT_TRUE(request.hasScalarParams());
+  ASSERT_EQ(request.paramsSize(), 5u);
+  ASSERT_EQ(request.param(0).type_, JsonType::Str);
+  ASSERT_EQ(request.param(0).str(), "slush.miner1");
+  ASSERT_EQ(request.param(1).uint32_hex(), 0xbfu);
+  ASSERT_EQ(request.param(2).uint64_hex(), 1u);
+  ASSERT_EQ(request.param(3).uint32_hex(), 0x504e86edu);
+  ASSERT_EQ(request.param(4).uint32_hex(), 0xb2957c02u);
+
+  string idStr;
+  request.getIdStr(idStr);
+  ASSERT_EQ(idStr, "4");
+}
+
+TEST(StratumRequest, Id) {
+  // the values point into the lines, they must be alive
+  const vector<pair<string, string>> lines = {
+      {"{\"id\":\"a\\\"b\",\"method\":\"x\"}", "\"a\\\"b\""},
+      {"{\"id\":null,\"method\":\"x\"}", "null"},
+      // like the JsonNode path, a real number is not a valid id
+      {"{\"id\":1.5,\"method\":\"x\"}", "null"},
+      {"{\"method\":\"x\",\"id\":-12}", "-12"},
+      {"{\"method\":\"x\"}", "null"},
+  };
+
+  StratumRequest request;
+  string idStr;
+  for (const auto &line : lines) {
+    ASSERT_TRUE(Scan(request, line.first)) << line.first;
+    request.getIdStr(idStr);
+    ASSERT_EQ(idStr, line.second);
+  }
+}
+
+TEST(StratumRequest, Params) {
+  StratumRequest request;
+
+  const string line =
+      "{\"id\":1,\"method\":\"m\",\"params\":[1, -2.5e3, true, false, null, "
+      "\"s\"]}";
+  ASSERT_TRUE(Scan(request, line));
+  ASSERT_TRUE(request.hasScalarParams());
+  ASSERT_EQ(request.paramsSize(), 6u);
+  ASSERT_EQ(request.param(0).type_, JsonType::Int);
+  ASSERT_EQ(request.param(0).uint32(), 1u);
+  ASSERT_EQ(request.param(1).type_, JsonType::Real);
+  ASSERT_EQ(request.param(1).str(), "-2.5e3");
+  ASSERT_EQ(request.param(2).type_, JsonType::Bool);
+  ASSERT_EQ(request.param(3).type_, JsonType::Bool);
+  ASSERT_EQ(request.param(4).type_, JsonType::Null);
+  ASSERT_EQ(request.param(5).str(), "s");
+
+  ASSERT_TRUE(Scan(request, "{\"id\":1,\"method\":\"m\",\"params\":[]}"));
+  ASSERT_TRUE(request.hasScalarParams());
+  ASSERT_EQ(request.paramsSize(), 0u);
+
+  // nested values are left to JsonNode
+  ASSERT_TRUE(Scan(
+      request,
+      "{\"id\":1,\"method\":\"m\",\"params\":[\"a\",{\"b\":[1,\"]\"]}]}"));
+  ASSERT_FALSE(request.hasScalarParams());
+  ASSERT_TRUE(Scan(request, "{\"id\":1,\"method\":\"m\",\"params\":{}}"));
+  ASSERT_FALSE(request.hasScalarParams());
+  ASSERT_TRUE(Scan(request, "{\"id\":1,\"method\":\"m\"}"));
+  ASSERT_FALSE(request.hasScalarParams());
+
+  string manyParams = "{\"id\":1,\"method\":\"m\",\"params\":[0";
+  for (size_t i = 1; i <= StratumRequest::kMaxParams; i++) {
+    manyParams += "," + std::to_string(i);
+  }
+  manyParams += "]}";
+  ASSERT_TRUE(Scan(request, manyParams));
+  ASSERT_FALSE(request.hasScalarParams());
+}
+
+TEST(StratumRequest, Malformed) {
+  StratumRequest request;
+  const vector<string> lines = {
+      "",
+      "\n",
+      "[1,2]",
+      "{",
+      "{\"id\":1",
+      "{\"id\":1,}",
+      "{\"id\" 1}",
+      "{\"id\":1 \"method\":\"m\"}",
+      "{\"method\":\"m}",
+      "{\"params\":[1,2}",
+      "{\"params\":[1,,2]}",
+      "{\"params\":[{\"a\":1]]}",
+      "{\"params\":[x]}",
+      "{\"id\":-}",
+      "{\"id\":1} x",
+  };
+  for (const auto &line : lines) {
+    ASSERT_FALSE(Scan(request, line)) << line;
+  }
+
+  ASSERT_TRUE(Scan(request, " { } \r\n"));
+  ASSERT_FALSE(request.isMethod("mining.submit"));
+  ASSERT_FALSE(request.hasScalarParams());
+}
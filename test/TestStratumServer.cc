@@ -29,12 +29,18 @@
 #include "StratumServer.h"
 #include "StratumMiner.h"
 #include "bitcoin/BitcoinUtils.h"
+#include "bitcoin/Sha256dBatch.h"
 #include "bitcoin/StratumBitcoin.h"
 #include "bitcoin/StratumServerBitcoin.h"
 #include "eth/StratumServerEth.h"
 
 // #include "Kafka.h"
 
+#include <chrono>
+#include <fstream>
+
+#include <streams.h>
+
 #ifndef WORK_WITH_STRATUM_SWITCHER
 
 TEST(StratumServer, SessionIDManager24Bits) {
@@ -183,11 +189,34 @@ TEST(StratumServer, SessionIDManager8Bits) {
   ASSERT_EQ(m.ifFull(), true);
 }
 
+TEST(StratumServer, SessionIDManagerSlab) {
+  SessionIDManagerT<8> m(0x68u);
+  m.setAllocInterval(16);
+
+  // a slab follows the same order as single allocations
+  uint32_t ids[300];
+  ASSERT_EQ(m.allocSessionIds(ids, 3), 3u);
+  ASSERT_EQ(ids[0], 0x6800u);
+  ASSERT_EQ(ids[1], 0x6810u);
+  ASSERT_EQ(ids[2], 0x6820u);
+  uint32_t sessionID;
+  ASSERT_EQ(m.allocSessionId(&sessionID), true);
+  ASSERT_EQ(sessionID, 0x6830u);
+
+  // only the free ids are returned
+  ASSERT_EQ(m.allocSessionIds(ids, 300), 252u);
+  ASSERT_EQ(m.ifFull(), true);
+  ASSERT_EQ(m.allocSessionIds(ids, 1), 0u);
+
+  m.freeSessionId(0x6842u);
+  ASSERT_EQ(m.allocSessionIds(ids, 2), 1u);
+  ASSERT_EQ(ids[0], 0x6842u);
+}
+
 #endif // #ifndef WORK_WITH_STRATUM_SWITCHER
 
 #ifndef CHAIN_TYPE_ZEC
-TEST(StratumServerBitcoin, CheckShare) {
-  string sjobJson = R"EOF(
+static const string kCheckShareJobJson = R"EOF(
     {
       "jobId": 6645522065066147329,
       "gbtHash": "d349be274f007c2e1ee773b33bd21ef43d2615c089b7c5460b66584881a10683",
@@ -217,8 +246,10 @@ TEST(StratumServerBitcoin, CheckShare) {
     }
   )EOF";
 
+TEST(StratumServerBitcoin, CheckShare) {
   auto sjob = std::make_shared<StratumJobBitcoin>();
-  sjob->unserializeFromJson(sjobJson.c_str(), sjobJson.size());
+  sjob->unserializeFromJson(
+      kCheckShareJobJson.c_str(), kCheckShareJobJson.size());
 
   StratumJobExBitcoin exjob(0, sjob, true, StratumMiner::kExtraNonce2Size_);
 
@@ -242,6 +273,77 @@ TEST(StratumServerBitcoin, CheckShare) {
       "1028e53e8145994a9ebe4f39eb6a7e3fd4036f2f21a05a5a696e8ac6d0829ef4");
   ASSERT_EQ(blkHash, header.GetHash());
 }
+
+// Headers of shares with different extra nonces
+static vector<CBlockHeader> MakeShareHeaders(size_t count) {
+  auto sjob = std::make_shared<StratumJobBitcoin>();
+  sjob->unserializeFromJson(
+      kCheckShareJobJson.c_str(), kCheckShareJobJson.size());
+  StratumJobExBitcoin exjob(0, sjob, true, StratumMiner::kExtraNonce2Size_);
+
+  vector<CBlockHeader> headers(count);
+  for (size_t i = 0; i < count; i++) {
+    CBlockHeader &header = headers[i];
+    std::vector<char> coinbaseBin;
+    exjob.generateBlockHeader(
+        &header,
+        &coinbaseBin,
+        0xfe0000c3u,
+        Strings::Format("%016x", i * 0x9E3779B97F4A7C15),
+        sjob->merkleBranch_,
+        sjob->prevHash_,
+        sjob->nBits_,
+        sjob->nVersion_,
+        0x5c39a313u + i,
+        0x07ba7929u,
+        0x00013f00u);
+  }
+  return headers;
+}
+
+static vector<uint8_t> SerializeHeaders(const vector<CBlockHeader> &headers) {
+  CDataStream ssHeaders(SER_NETWORK, PROTOCOL_VERSION);
+  for (const auto &header : headers) {
+    ssHeaders << header;
+  }
+  return vector<uint8_t>(ssHeaders.begin(), ssHeaders.end());
+}
+
+static const Sha256dBatch::Kernel kSha256dKernels[] = {
+    Sha256dBatch::Kernel::SCALAR,
+    Sha256dBatch::Kernel::SSE2,
+    Sha256dBatch::Kernel::AVX2,
+    Sha256dBatch::Kernel::SHANI};
+
+TEST(StratumServerBitcoin, Sha256dBatch) {
+  auto blockHeaders = MakeShareHeaders(35);
+  vector<uint256> expected;
+  for (const auto &header : blockHeaders) {
+    expected.push_back(header.GetHash());
+  }
+  auto headers = SerializeHeaders(blockHeaders);
+  ASSERT_EQ(headers.size(), expected.size() * Sha256dBatch::kHeaderSize);
+
+  ASSERT_TRUE(Sha256dBatch::IsSupported(Sha256dBatch::BestKernel()));
+  for (auto kernel : kSha256dKernels) {
+    if (!Sha256dBatch::IsSupported(kernel)) {
+      LOG(INFO) << "sha256d kernel not supported: "
+                << Sha256dBatch::KernelName(kernel);
+      continue;
+    }
+    // every count up to the full set to cover the lanes left over
+    for (size_t count = 0; count <= expected.size(); count++) {
+      vector<uint256> hashes(count);
+      Sha256dBatch::Hash80(
+          kernel, headers.data(), count, (uint8_t *)hashes.data());
+      for (size_t i = 0; i < count; i++) {
+        ASSERT_EQ(hashes[i], expected[i])
+            << Sha256dBatch::KernelName(kernel) << ", count: " << count
+            << ", index: " << i;
+      }
+    }
+  }
+}
 #endif
 
 TEST(StratumServerEth, EthashCalculator) {
@@ -367,3 +469,97 @@ TEST(StratumServerEth, EthashCalculator) {
   LOG(INFO) << "ethash_light_new() in debug build was too slow, skip the test.";
 #endif
 }
+
+TEST(StratumServerEth, EthashCalculatorCacheFile) {
+#ifdef NDEBUG
+  const string cacheDir = "./TestEthashCalculatorCacheFile";
+  const string cacheFile = cacheDir + "/epoch-0.v1.dat";
+  const uint64_t height = 100;
+  ethash_h256_t etheader = {0};
+
+  ethash_return_value_t expected;
+  {
+    EthashCalculator ethashCalc(cacheDir);
+    ASSERT_TRUE(ethashCalc.compute(height, etheader, 1, expected));
+  }
+  ASSERT_EQ(access(cacheFile.c_str(), R_OK), 0);
+
+  // loaded from the file, or rebuilt if the file is corrupted
+  for (int corrupted = 0; corrupted < 2; corrupted++) {
+    if (corrupted) {
+      std::fstream f(
+          cacheFile, std::ios::in | std::ios::out | std::ios::binary);
+      f.seekp(1000);
+      f.write("xx", 2);
+    }
+
+    EthashCalculator ethashCalc(cacheDir);
+    ethash_return_value_t r;
+    ASSERT_TRUE(ethashCalc.compute(height, etheader, 1, r));
+    ASSERT_EQ(
+        Ethash256ToUint256(r.result).ToString(),
+        Ethash256ToUint256(expected.result).ToString());
+  }
+
+  unlink(cacheFile.c_str());
+  rmdir(cacheDir.c_str());
+#else
+  LOG(INFO) << "ethash_light_new() in debug build was too slow, skip the test.";
+#endif
+}
+
+TEST(StratumServerEth, EthashCalculatorConcurrent) {
+#ifdef NDEBUG
+  const uint64_t height = 0x6eab2a;
+  const uint64_t nonce = 0x41ba179e96428b55;
+  ethash_h256_t etheader;
+  Uint256ToEthash256(
+      uint256S("0x729a3740005234239728098a2d75855f5cb0fd7c536ad1337013bbc5"
+               "159aefce"),
+      etheader);
+
+  EthashCalculator ethashCalc;
+  const size_t kThreads = std::max(2u, std::thread::hardware_concurrency());
+  const size_t kSharesPerThread = 100;
+
+  // verifying threads build the missing cache once and share it, while
+  // another thread keeps rebuilding it
+  std::atomic<size_t> failed{0};
+  std::atomic<bool> running{true};
+  std::thread rebuilder([&]() {
+    while (running) {
+      ethashCalc.rebuildDagCache(height);
+    }
+  });
+
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < kThreads; i++) {
+    threads.emplace_back([&]() {
+      for (size_t j = 0; j < kSharesPerThread; j++) {
+        ethash_return_value_t r;
+        if (!ethashCalc.compute(height, etheader, nonce, r) ||
+            Ethash256ToUint256(r.result).ToString() !=
+                "0000000042901566d9a95493277579e6bca96c8c6bc5998c73f4fd96c8f6"
+                "3627") {
+          failed++;
+        }
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - begin)
+                      .count();
+  running = false;
+  rebuilder.join();
+
+  ASSERT_EQ(failed.load(), 0u);
+  LOG(INFO) << kThreads * kSharesPerThread << " shares verified by "
+            << kThreads << " threads within " << duration << " ms";
+#else
+  LOG(INFO) << "ethash_light_new() in debug build was too slow, skip the test.";
+#endif
+}
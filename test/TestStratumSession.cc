@@ -28,6 +28,9 @@
 
 #include <boost/algorithm/string.hpp>
 
+#include <deque>
+#include <functional>
+
 #include "StratumSession.h"
 #include "StratumMessageDispatcher.h"
 #include "StratumMiner.h"
@@ -96,6 +99,20 @@ TEST(StratumSession, LocalJob) {
   }
 }
 
+TEST(StratumSession, LocalJobManyShares) {
+  LocalJob lj(0, 0);
+  std::set<LocalShare> shares;
+
+  std::mt19937_64 rng(1);
+  for (size_t i = 0; i < 10000; i++) {
+    // Narrow value ranges so there are plenty of duplicates
+    LocalShare ls(
+        rng() % 64, rng() % 64, 0x5d000000 + rng() % 4, 0x20000000);
+    ASSERT_EQ(lj.addLocalShare(ls), shares.insert(ls).second);
+  }
+  ASSERT_EQ(lj.submitShares_.size(), shares.size());
+}
+
 class StratumSessionMock : public IStratumSession {
 public:
   MOCK_METHOD3(addWorker, void(const string &, const string &, int64_t));
@@ -599,6 +616,192 @@ TEST(StratumSession, StratumClientAgentHandler) {
   }
 }
 
+// A session without mocks for the sub-workers of the agent tests
+class StratumSessionAgentStub : public IStratumSession {
+public:
+  explicit StratumSessionAgentStub(const DiffController &diffController)
+    : diffController_(diffController) {}
+
+  void addWorker(const string &, const string &, int64_t) override {}
+  void removeWorker(const string &, const string &, int64_t) override {}
+  unique_ptr<StratumMiner> createMiner(
+      const string &clientAgent,
+      const string &workerName,
+      int64_t workerId) override;
+  uint16_t decodeSessionId(const string &) const override { return 0; }
+  StratumMessageDispatcher &getDispatcher() override {
+    return nullDispatcher_;
+  }
+  void responseTrue(const string &) override {}
+  void responseTrueWithCode(const string &, int) override {}
+  void responseError(const string &, int) override {}
+  void sendData(const char *data, size_t len) override {
+    sent_.append(data, len);
+  }
+  void sendData(const string &str) override { sent_.append(str); }
+  void sendSetDifficulty(LocalJob &, uint64_t) override {}
+  bool switchChain(size_t) override { return false; }
+  void reportShare(size_t, int32_t, uint64_t) override {}
+  bool acceptStale() const override { return false; }
+  bool niceHashForced() const override { return false; }
+  uint64_t niceHashMinDiff() const override { return 0; }
+
+  std::deque<LocalJob> &getLocalJobs() { return localJobs_; }
+
+  const DiffController &diffController_;
+  StratumMessageNullDispatcher nullDispatcher_;
+  std::deque<LocalJob> localJobs_;
+  string sent_;
+};
+
+struct StratumTraitsAgentStub {
+  using SessionType = StratumSessionAgentStub;
+  using JobDiffType = uint64_t;
+};
+
+class StratumMinerAgentStub : public StratumMinerBase<StratumTraitsAgentStub> {
+public:
+  StratumMinerAgentStub(
+      StratumSessionAgentStub &session,
+      const DiffController &diffController,
+      const string &clientAgent,
+      const string &workerName,
+      int64_t workerId)
+    : StratumMinerBase(
+          session, diffController, clientAgent, workerName, workerId) {}
+
+  void handleRequest(
+      const string &, const string &, const JsonNode &, const JsonNode &)
+      override {}
+};
+
+unique_ptr<StratumMiner> StratumSessionAgentStub::createMiner(
+    const string &clientAgent, const string &workerName, int64_t workerId) {
+  return std::make_unique<StratumMinerAgentStub>(
+      *this, diffController_, clientAgent, workerName, workerId);
+}
+
+TEST(StratumSession, StratumClientAgentHandler_SetDiff) {
+  DiffController dc(0x4000, 0x4000000000000000, 0x2, 10, 3000);
+  StratumSessionAgentStub session(dc);
+  StratumMessageAgentDispatcher agent(session, dc);
+
+  for (uint16_t sessionId : {9, 1, 5, 7}) {
+    agent.registerWorker(sessionId, "", "w", sessionId);
+  }
+  agent.unregisterWorker(1);
+  agent.unregisterWorker(1);
+  ASSERT_EQ(agent.getTotalDiff(), 0u);
+
+  // the sub-workers have no difficulty before their first job, the last one
+  // took the place of the unregistered one
+  map<uint8_t, vector<uint16_t>> diffSessionIds;
+  string data;
+  diffSessionIds[14] = {9, 7, 5};
+  agent.getSetDiffCommand(diffSessionIds, data);
+  session.localJobs_.emplace_back(0, 1);
+  agent.addLocalJob(session.localJobs_.back());
+  ASSERT_EQ(session.sent_, data);
+  ASSERT_EQ(agent.getTotalDiff(), 3 * 0x4000u);
+
+  session.sent_.clear();
+  session.localJobs_.emplace_back(0, 2);
+  agent.addLocalJob(session.localJobs_.back());
+  ASSERT_TRUE(session.sent_.empty());
+
+  // only the changed sub-workers are sent, a new one gets the difficulty of
+  // the existing jobs when registered
+  agent.resetCurDiff(0x10000);
+  agent.registerWorker(3, "", "w", 3);
+  session.localJobs_.emplace_back(0, 3);
+  agent.addLocalJob(session.localJobs_.back());
+  diffSessionIds.clear();
+  diffSessionIds[16] = {9, 7, 5};
+  agent.getSetDiffCommand(diffSessionIds, data);
+  ASSERT_EQ(session.sent_, data);
+  ASSERT_EQ(agent.getTotalDiff(), 3 * 0x10000u + 0x4000u);
+}
+
+// Broadcasts jobs to the sub-workers of an agent with the dense table and
+// with a map of miners, both have to send the same messages
+TEST(StratumSession, StratumClientAgentHandler_Broadcast) {
+  const uint16_t kWorkers = 300;
+  const size_t kJobs = 40;
+  const size_t kKeptJobs = 10;
+  // the difficulty of every sub-worker changes every kResetInterval jobs
+  const size_t kResetInterval = 10;
+
+  DiffController dc(0x4000, 0x4000000000000000, 0x2, 10, 3000);
+  StratumSessionAgentStub session(dc);
+  StratumMessageAgentDispatcher agent(session, dc);
+
+  // The map of sub-workers as it was used before the dense table
+  map<uint16_t, unique_ptr<StratumMiner>> miners;
+  for (uint16_t sessionId = 0; sessionId < kWorkers; sessionId++) {
+    miners.emplace(sessionId, session.createMiner("", "w", sessionId));
+    agent.registerWorker(sessionId, "", "w", sessionId);
+  }
+
+  auto broadcast = [&](std::function<void(LocalJob &)> add,
+                       std::function<void(LocalJob &)> remove,
+                       std::function<void(uint64_t)> reset) {
+    session.localJobs_.clear();
+    for (size_t jobId = 0; jobId < kJobs; jobId++) {
+      if (jobId % kResetInterval == 0) {
+        reset(jobId % (2 * kResetInterval) ? 0x8000 : 0x10000);
+      }
+      session.localJobs_.emplace_back(0, jobId);
+      add(session.localJobs_.back());
+      if (session.localJobs_.size() > kKeptJobs) {
+        remove(session.localJobs_.front());
+        session.localJobs_.pop_front();
+      }
+    }
+  };
+
+  string mapSent;
+  broadcast(
+      [&](LocalJob &localJob) {
+        map<uint8_t, vector<uint16_t>> newDiffs;
+        for (auto &p : miners) {
+          uint64_t curDiff = p.second->getCurDiff();
+          uint8_t oldDiff = curDiff ? log2(curDiff) : 0;
+          uint8_t newDiff = log2(p.second->addLocalJob(localJob));
+          if (newDiff != oldDiff) {
+            newDiffs[newDiff].push_back(p.first);
+          }
+        }
+        if (!newDiffs.empty()) {
+          string data;
+          agent.getSetDiffCommand(newDiffs, data);
+          mapSent.append(data);
+        }
+      },
+      [&](LocalJob &localJob) {
+        for (auto &p : miners) {
+          p.second->removeLocalJob(localJob);
+        }
+      },
+      [&](uint64_t diff) {
+        for (auto &p : miners) {
+          p.second->resetCurDiff(diff);
+        }
+      });
+
+  broadcast(
+      [&](LocalJob &localJob) { agent.addLocalJob(localJob); },
+      [&](LocalJob &localJob) { agent.removeLocalJob(localJob); },
+      [&](uint64_t diff) { agent.resetCurDiff(diff); });
+
+  ASSERT_FALSE(session.sent_.empty());
+  ASSERT_EQ(session.sent_, mapSent);
+  uint64_t totalDiff = 0;
+  for (auto &p : miners) {
+    totalDiff += p.second->getCurDiff();
+  }
+  ASSERT_EQ(agent.getTotalDiff(), totalDiff);
+}
+
 TEST(StratumSession, SetDiff) {
   using namespace boost::algorithm;
 
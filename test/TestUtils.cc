@@ -458,3 +458,14 @@ TEST(Utils, EquihashCompute) {
       "006f5dca69b024e5bf0647275f6223551090ddb7dda5e89afe2c8f548c6ad580");
 }
 #endif
+
+TEST(Utils, HourOfDay) {
+  // every 7 minutes over a year, plus both sides of the hour boundaries
+  for (time_t ts = 1262304000; ts < 1262304000 + 86400 * 366; ts += 420) {
+    time_t hourStart = ts - ts % 3600;
+    ASSERT_EQ(hourOfDay(ts), atoi(date("%H", ts).c_str()));
+    ASSERT_EQ(hourOfDay(hourStart), atoi(date("%H", hourStart).c_str()));
+    ASSERT_EQ(
+        hourOfDay(hourStart - 1), atoi(date("%H", hourStart - 1).c_str()));
+  }
+}
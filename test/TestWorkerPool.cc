@@ -0,0 +1,187 @@
+/*
+ The MIT License (MIT)
+
+ Copyright (c) [2019] [BTC.COM]
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+#include "gtest/gtest.h"
+#include "WorkerPool.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+TEST(WorkerPool, DispatchFromMultipleProducers) {
+  const size_t kProducers = 4;
+  const size_t kWorksPerProducer = 10000;
+
+  std::atomic<size_t> executed{0};
+  std::atomic<size_t> sum{0};
+  {
+    WorkerPool pool{64};
+    pool.start(4);
+
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < kProducers; ++p) {
+      producers.emplace_back([&pool, &executed, &sum, p]() {
+        for (size_t i = 0; i < kWorksPerProducer; ++i) {
+          size_t value = p * kWorksPerProducer + i;
+          pool.dispatch([&executed, &sum, value]() {
+            sum += value;
+            ++executed;
+          });
+        }
+      });
+    }
+    for (auto &producer : producers) {
+      producer.join();
+    }
+
+    while (executed < kProducers * kWorksPerProducer) {
+      std::this_thread::yield();
+    }
+
+    auto stats = pool.getStats();
+    ASSERT_EQ(stats.dispatched, kProducers * kWorksPerProducer);
+    ASSERT_EQ(stats.queueDepth, 0u);
+    pool.stop();
+    ASSERT_EQ(pool.getStats().completed, kProducers * kWorksPerProducer);
+  }
+
+  size_t n = kProducers * kWorksPerProducer;
+  ASSERT_EQ(sum, n * (n - 1) / 2);
+}
+
+TEST(WorkerPool, QueueDepthNeverWraps) {
+  const size_t kWorks = 50000;
+
+  std::atomic<size_t> executed{0};
+  std::atomic<bool> running{true};
+  std::atomic<size_t> maxDepth{0};
+  WorkerPool pool{64};
+  pool.start(4);
+
+  // the workers pop the works as soon as they are published
+  std::thread sampler([&]() {
+    while (running) {
+      size_t depth = pool.getStats().queueDepth;
+      if (depth > maxDepth) {
+        maxDepth = depth;
+      }
+    }
+  });
+  for (size_t i = 0; i < kWorks; ++i) {
+    pool.dispatch([&executed]() { ++executed; });
+  }
+  while (executed < kWorks) {
+    std::this_thread::yield();
+  }
+  running = false;
+  sampler.join();
+  pool.stop();
+
+  ASSERT_LE(maxDepth.load(), pool.capacity());
+  ASSERT_EQ(pool.getStats().queueDepth, 0u);
+}
+
+TEST(WorkerPool, DispatchWaitsForFreeSlot) {
+  const size_t kProducers = 4;
+  const size_t kWorksPerProducer = 500;
+
+  std::atomic<size_t> executed{0};
+  WorkerPool pool{2};
+  pool.start(1);
+
+  // the works are slower than the producers, so they wait on the full ring
+  std::vector<std::thread> producers;
+  for (size_t p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&pool, &executed]() {
+      for (size_t i = 0; i < kWorksPerProducer; ++i) {
+        pool.dispatch([&executed]() {
+          std::this_thread::sleep_for(std::chrono::microseconds(20));
+          ++executed;
+        });
+      }
+    });
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  while (executed < kProducers * kWorksPerProducer) {
+    std::this_thread::yield();
+  }
+
+  auto stats = pool.getStats();
+  ASSERT_EQ(stats.dispatched, kProducers * kWorksPerProducer);
+  ASSERT_GT(stats.queueFull, 0u);
+  pool.stop();
+}
+
+TEST(WorkerPool, StopWakesWaitingProducer) {
+  std::atomic<bool> release{false};
+  WorkerPool pool{2};
+  pool.start(1);
+
+  // the worker is blocked, so the ring fills up and the producer waits
+  std::thread producer([&pool, &release]() {
+    for (size_t i = 0; i < 10; ++i) {
+      pool.dispatch([&release]() {
+        while (!release) {
+          std::this_thread::yield();
+        }
+      });
+    }
+  });
+  while (pool.getStats().queueFull == 0) {
+    std::this_thread::yield();
+  }
+
+  // the producer returns while the worker is still blocked
+  std::thread stopper([&pool]() { pool.stop(); });
+  producer.join();
+  release = true;
+  stopper.join();
+  ASSERT_LT(pool.getStats().dispatched, 10u);
+}
+
+TEST(WorkerPool, CapacityIsPowerOfTwo) {
+  ASSERT_EQ(WorkerPool{256}.capacity(), 256u);
+  ASSERT_EQ(WorkerPool{1000}.capacity(), 1024u);
+}
+
+TEST(WorkerPool, TaskWithLargeCapture) {
+  std::array<char, WorkerTask::kInlineSize * 2> large;
+  large.fill('x');
+  auto shared = std::make_shared<int>(0);
+
+  WorkerTask task{[large, shared]() { *shared = large.back(); }};
+  ASSERT_EQ(shared.use_count(), 2);
+
+  WorkerTask moved{std::move(task)};
+  ASSERT_FALSE(task);
+  ASSERT_TRUE(moved);
+  moved();
+  ASSERT_EQ(*shared, 'x');
+
+  moved.reset();
+  ASSERT_EQ(shared.use_count(), 1);
+}
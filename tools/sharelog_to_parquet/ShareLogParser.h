@@ -28,6 +28,7 @@
 #include <zlibstream/zstr.hpp>
 
 #include "ParquetWritter.hpp"
+#include "ShareLogFile.h"
 #include "StratumBitcoin.hpp"
 #include "StratumBeam.hpp"
 
@@ -61,6 +62,8 @@ class ShareLogParserT : public ShareLogParser {
   // for processGrowingShareLog()
   //
   zstr::ifstream *f_; // file handler
+  std::unique_ptr<ShareLogBlockReader> blockReader_; // for sharelog v2
+  size_t nextBlock_ = 0;
   uint8_t *buf_; // fread buffer
   // 48 * 1000000 = 48,000,000 ~ 48 MB
   static const size_t kMaxElementsNum_ = 1000000; // num of shares
@@ -71,6 +74,9 @@ class ShareLogParserT : public ShareLogParser {
   bool singleUserMode_ = false;
   int32_t singleUserId_ = 0;
 
+  // threads decompressing sharelog v2 blocks
+  uint32_t parseThreads_ = 0;
+
   inline int32_t getHourIdx(uint32_t ts) {
     // %H	Hour in 24h format (00-23)
     return atoi(date("%H", ts).c_str());
@@ -80,6 +86,8 @@ class ShareLogParserT : public ShareLogParser {
   void parseShare(SHARE &share);
   void generateEmptyParquets();
   bool openParquet();
+  bool processUnchangedBlockShareLog();
+  int64_t processGrowingBlockShareLog();
 
 public:
   ShareLogParserT(const libconfig::Config &cfg, time_t timestamp);
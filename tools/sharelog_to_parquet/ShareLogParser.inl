@@ -44,6 +44,7 @@ ShareLogParserT<SHARE>::ShareLogParserT(
   if (singleUserMode_) {
     LOG(INFO) << "[Option] Single User Mode Enabled, puid: " << singleUserId_;
   }
+  cfg.lookupValue("sharelog.parse_threads", parseThreads_);
 
   filePath_ = getStatsFilePath(
       chainType_.c_str(), cfg.lookup("sharelog.data_dir"), timestamp);
@@ -130,8 +131,44 @@ void ShareLogParserT<SHARE>::generateEmptyParquets() {
   parquetWriter_.close();
 }
 
+template <class SHARE>
+bool ShareLogParserT<SHARE>::processUnchangedBlockShareLog() {
+  openFileFailed_ = true;
+
+  LOG(INFO) << "open file: " << filePath_;
+  ShareLogBlockReader reader(filePath_);
+  if (!reader.open()) {
+    return false;
+  }
+  LOG(INFO) << "sharelog v2, blocks: " << reader.blocks().size();
+
+  openFileFailed_ = false;
+  if (!openParquet()) {
+    return false;
+  }
+
+  // blocks are decompressed in parallel but handed over in file order,
+  // the parquet files are still written hour by hour
+  bool success = reader.readBlocks(
+      reader.blocks(), parseThreads_, [this](const string &records) {
+        ForEachShareRecord(
+            records.data(),
+            records.size(),
+            [this](const uint8_t *buf, size_t len) {
+              parseShareLog(buf, len);
+            });
+      });
+
+  generateEmptyParquets();
+  return success;
+}
+
 template <class SHARE>
 bool ShareLogParserT<SHARE>::processUnchangedShareLog() {
+  if (ShareLogBlockReader::detectFormat(filePath_) == ShareLogFormat::BLOCK) {
+    return processUnchangedBlockShareLog();
+  }
+
   try {
     openFileFailed_ = true;
 
@@ -202,10 +239,60 @@ bool ShareLogParserT<SHARE>::processUnchangedShareLog() {
   }
 }
 
+template <class SHARE>
+int64_t ShareLogParserT<SHARE>::processGrowingBlockShareLog() {
+  blockReader_->refresh();
+  const auto &blocks = blockReader_->blocks();
+
+  int64_t parsedsharenum = 0;
+  string records;
+  for (; nextBlock_ < blocks.size(); nextBlock_++) {
+    if (!blockReader_->readBlock(blocks[nextBlock_], records)) {
+      continue;
+    }
+    ForEachShareRecord(
+        records.data(),
+        records.size(),
+        [this, &parsedsharenum](const uint8_t *buf, size_t len) {
+          parseShareLog(buf, len);
+          parsedsharenum++;
+        });
+  }
+
+  DLOG(INFO) << "processGrowingShareLog share count: " << parsedsharenum;
+  return parsedsharenum;
+}
+
 template <class SHARE>
 int64_t ShareLogParserT<SHARE>::processGrowingShareLog() {
   openFileFailed_ = true;
 
+  if (f_ == nullptr && blockReader_ == nullptr) {
+    switch (ShareLogBlockReader::detectFormat(filePath_)) {
+    case ShareLogFormat::BLOCK:
+      blockReader_.reset(new ShareLogBlockReader(filePath_));
+      if (!blockReader_->open()) {
+        blockReader_.reset();
+        return -1;
+      }
+      openFileFailed_ = false;
+      if (!openParquet()) {
+        return false;
+      }
+      break;
+    case ShareLogFormat::UNKNOWN:
+      // not created yet, or the v2 file header is not written yet
+      LOG(WARNING) << "open file fail. Filename: " << filePath_;
+      return -1;
+    case ShareLogFormat::LEGACY:
+      break;
+    }
+  }
+  if (blockReader_) {
+    openFileFailed_ = false;
+    return processGrowingBlockShareLog();
+  }
+
   if (f_ == nullptr) {
     bool fileOpened = true;
     try {
@@ -300,6 +387,9 @@ int64_t ShareLogParserT<SHARE>::processGrowingShareLog() {
 
 template <class SHARE>
 bool ShareLogParserT<SHARE>::isReachEOF() {
+  if (blockReader_) {
+    return nextBlock_ >= blockReader_->blocks().size();
+  }
   if (f_ == nullptr || !*f_) {
     // if error we consider as EOF
     return true;